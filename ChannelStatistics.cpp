@@ -0,0 +1,180 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ChannelStatistics.h"
+
+// STL
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  const unsigned int NumberOfBins = 1 << 16;
+
+  /** A key whose unsigned order is the order of the float values.*/
+  unsigned int ToKey(const float value)
+  {
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  }
+
+  float FromKey(const unsigned int key)
+  {
+    const unsigned int bits = (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /** The value of the middle of the bin in which the cumulative count reaches 'fraction' of 'total'.*/
+  float FindPercentile(const std::vector<size_t>& histogram, const size_t total, const double fraction,
+                       const float minValue, const float maxValue)
+  {
+    const size_t rank = std::min(total - 1, static_cast<size_t>(fraction * total));
+    size_t cumulative = 0;
+    for(unsigned int bin = 0; bin < NumberOfBins; ++bin)
+    {
+      cumulative += histogram[bin];
+      if(cumulative > rank)
+      {
+        const float value = FromKey((bin << 16) | 0x8000u);
+        return std::max(minValue, std::min(maxValue, value));
+      }
+    }
+    return maxValue;
+  }
+}
+
+namespace ChannelStatistics
+{
+
+std::vector<Statistics> Compute(const NNFieldTypes::NNFieldImageType* const nnField, const std::atomic<bool>& cancel)
+{
+  const unsigned int numberOfChannels = nnField->GetNumberOfComponentsPerPixel();
+  const size_t numberOfPixels = nnField->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* buffer = nnField->GetBufferPointer();
+
+  // Every thread has its own histograms and ranges, so the pass needs no synchronization.
+  const unsigned int numberOfThreads = Parallel::GetNumberOfThreads();
+  std::vector<std::vector<unsigned int> > histograms(numberOfThreads * numberOfChannels);
+  std::vector<float> minValues(numberOfThreads * numberOfChannels, std::numeric_limits<float>::max());
+  std::vector<float> maxValues(numberOfThreads * numberOfChannels, -std::numeric_limits<float>::max());
+
+  Parallel::ForChunks(0, numberOfPixels, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    std::vector<unsigned int>* threadHistograms = &histograms[threadId * numberOfChannels];
+    float* threadMin = &minValues[threadId * numberOfChannels];
+    float* threadMax = &maxValues[threadId * numberOfChannels];
+    for(unsigned int channel = 0; channel < numberOfChannels; ++channel)
+    {
+      threadHistograms[channel].assign(NumberOfBins, 0);
+    }
+
+    const size_t pixelsBetweenCancelChecks = 1 << 16;
+    for(size_t pixelId = chunkBegin; pixelId < chunkEnd; ++pixelId)
+    {
+      if(pixelId % pixelsBetweenCancelChecks == 0 && cancel)
+      {
+        return;
+      }
+
+      const float* pixel = buffer + pixelId * numberOfChannels;
+      for(unsigned int channel = 0; channel < numberOfChannels; ++channel)
+      {
+        const float value = pixel[channel];
+        if(value != value) // NaN
+        {
+          continue;
+        }
+        threadHistograms[channel][ToKey(value) >> 16]++;
+        threadMin[channel] = std::min(threadMin[channel], value);
+        threadMax[channel] = std::max(threadMax[channel], value);
+      }
+    }
+    });
+
+  std::vector<Statistics> statistics;
+  if(cancel)
+  {
+    return statistics;
+  }
+
+  statistics.resize(numberOfChannels);
+  Parallel::For(0, numberOfChannels, [&](const size_t channel)
+    {
+    std::vector<size_t> histogram(NumberOfBins, 0);
+    float minValue = std::numeric_limits<float>::max();
+    float maxValue = -std::numeric_limits<float>::max();
+    for(unsigned int threadId = 0; threadId < numberOfThreads; ++threadId)
+    {
+      const std::vector<unsigned int>& threadHistogram = histograms[threadId * numberOfChannels + channel];
+      if(threadHistogram.empty()) // This thread had no chunk.
+      {
+        continue;
+      }
+      for(unsigned int bin = 0; bin < NumberOfBins; ++bin)
+      {
+        histogram[bin] += threadHistogram[bin];
+      }
+      minValue = std::min(minValue, minValues[threadId * numberOfChannels + channel]);
+      maxValue = std::max(maxValue, maxValues[threadId * numberOfChannels + channel]);
+    }
+
+    Statistics& channelStatistics = statistics[channel];
+    for(unsigned int bin = 0; bin < NumberOfBins; ++bin)
+    {
+      channelStatistics.NumberOfValues += histogram[bin];
+    }
+    if(channelStatistics.NumberOfValues == 0)
+    {
+      return;
+    }
+
+    channelStatistics.Min = minValue;
+    channelStatistics.Max = maxValue;
+    channelStatistics.Median = FindPercentile(histogram, channelStatistics.NumberOfValues, 0.5, minValue, maxValue);
+    channelStatistics.Percentile90 = FindPercentile(histogram, channelStatistics.NumberOfValues, 0.9, minValue, maxValue);
+    channelStatistics.Percentile99 = FindPercentile(histogram, channelStatistics.NumberOfValues, 0.99, minValue, maxValue);
+    });
+
+  return statistics;
+}
+
+std::string DescribeRank(const Statistics& statistics, const float value)
+{
+  if(value >= statistics.Percentile99)
+  {
+    return "above the 99th percentile";
+  }
+  else if(value >= statistics.Percentile90)
+  {
+    return "above the 90th percentile";
+  }
+  else if(value >= statistics.Median)
+  {
+    return "above the median";
+  }
+  return "below the median";
+}
+
+} // end namespace
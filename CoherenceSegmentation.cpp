@@ -0,0 +1,318 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CoherenceSegmentation.h"
+
+// STL
+#include <limits>
+#include <stdexcept>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  /** The root of the tree of 'pixelId'. The path is halved on the way, so later searches are shorter.*/
+  unsigned int FindRoot(std::vector<unsigned int>& parents, unsigned int pixelId)
+  {
+    while(parents[pixelId] != pixelId)
+    {
+      parents[pixelId] = parents[parents[pixelId]];
+      pixelId = parents[pixelId];
+    }
+    return pixelId;
+  }
+
+  /** Join the trees of two pixels. The smaller root becomes the root of both, so a tree never gets a root
+    * that is above (in row major order) all of its pixels.*/
+  void Join(std::vector<unsigned int>& parents, const unsigned int pixelId, const unsigned int otherPixelId)
+  {
+    const unsigned int root = FindRoot(parents, pixelId);
+    const unsigned int otherRoot = FindRoot(parents, otherPixelId);
+    if(root < otherRoot)
+    {
+      parents[otherRoot] = root;
+    }
+    else
+    {
+      parents[root] = otherRoot;
+    }
+  }
+}
+
+CoherenceSegmentation::CoherenceSegmentation() : NumberOfDiscontinuousPixels(0)
+{
+  this->Size.Fill(0);
+}
+
+itk::Size<2> CoherenceSegmentation::GetSize() const
+{
+  return this->Size;
+}
+
+bool CoherenceSegmentation::Build(const NNFieldTypes::NNFieldImageType* const nnField,
+                                  const NNFieldTypes::INTERPRETATION_ENUM interpretation, const float threshold,
+                                  const bool eightConnected, const std::atomic<bool>& cancel)
+{
+  this->Segments.clear();
+  this->Discontinuous.clear();
+  this->SegmentAreas.clear();
+  this->NumberOfDiscontinuousPixels = 0;
+  this->Size = nnField->GetLargestPossibleRegion().GetSize();
+
+  const int width = static_cast<int>(this->Size[0]);
+  const int height = static_cast<int>(this->Size[1]);
+  const size_t numberOfPixels = static_cast<size_t>(width) * height;
+  if(numberOfPixels >= std::numeric_limits<unsigned int>::max())
+  {
+    throw std::runtime_error("CoherenceSegmentation: the field has too many pixels!");
+  }
+
+  if(nnField->GetNumberOfComponentsPerPixel() < 2)
+  {
+    throw std::runtime_error("CoherenceSegmentation: the NNField must have at least 2 channels!");
+  }
+
+  const float* buffer = nnField->GetBufferPointer();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  // The offsets of absolute fields differ by the distance between the pixels less than their matches do.
+  const float positionStep = (interpretation == NNFieldTypes::ABSOLUTE) ? 1.0f : 0.0f;
+  const float squaredThreshold = threshold * threshold;
+
+  std::vector<unsigned int> parents(numberOfPixels);
+  this->Discontinuous.assign(numberOfPixels, 0);
+
+  // Join 'pixelId' with its neighbor at (-offsetX, -offsetY) if they are coherent, or mark both discontinuous.
+  // Comparisons with NaN are false, so offsets that are not finite are never coherent.
+  auto visitNeighbor = [&](const unsigned int pixelId, const int offsetX, const int offsetY)
+  {
+    const unsigned int neighborId = pixelId - offsetY * width - offsetX;
+    const float* pixel = buffer + static_cast<size_t>(pixelId) * numberOfComponents;
+    const float* neighbor = buffer + static_cast<size_t>(neighborId) * numberOfComponents;
+    const float differenceX = pixel[0] - neighbor[0] - positionStep * offsetX;
+    const float differenceY = pixel[1] - neighbor[1] - positionStep * offsetY;
+    if(differenceX * differenceX + differenceY * differenceY <= squaredThreshold)
+    {
+      Join(parents, pixelId, neighborId);
+    }
+    else
+    {
+      this->Discontinuous[pixelId] = 1;
+      this->Discontinuous[neighborId] = 1;
+    }
+  };
+
+  // The neighbors of a pixel that come before it. Every pair of neighbors is visited once, from its second pixel.
+  auto visitRow = [&](const int y, const bool withRowAbove)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      const unsigned int pixelId = static_cast<unsigned int>(y * width + x);
+      if(x > 0)
+      {
+        visitNeighbor(pixelId, 1, 0);
+      }
+      if(withRowAbove)
+      {
+        visitNeighbor(pixelId, 0, 1);
+        if(eightConnected && x > 0)
+        {
+          visitNeighbor(pixelId, 1, 1);
+        }
+        if(eightConnected && x + 1 < width)
+        {
+          visitNeighbor(pixelId, -1, 1);
+        }
+      }
+    }
+  };
+
+  // 1) Every thread joins the pixels of its band of rows. As roots are the smallest pixel id of their tree,
+  // all trees (and their paths) stay inside the band, so the threads never write the same pixel.
+  std::vector<int> bandBegins(Parallel::GetNumberOfThreads(), -1);
+  Parallel::ForChunks(0, height, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    bandBegins[threadId] = static_cast<int>(chunkBegin);
+    for(size_t pixelId = chunkBegin * width; pixelId < chunkEnd * width; ++pixelId)
+    {
+      parents[pixelId] = static_cast<unsigned int>(pixelId);
+    }
+
+    for(size_t y = chunkBegin; y < chunkEnd; ++y)
+    {
+      if(cancel)
+      {
+        return;
+      }
+      visitRow(static_cast<int>(y), y > chunkBegin);
+    }
+    });
+
+  if(cancel)
+  {
+    this->Discontinuous.clear();
+    return false;
+  }
+
+  // 2) Join the bands along their borders. This is one row per band.
+  for(size_t bandId = 0; bandId < bandBegins.size(); ++bandId)
+  {
+    const int y = bandBegins[bandId];
+    if(y <= 0)
+    {
+      continue;
+    }
+    for(int x = 0; x < width; ++x)
+    {
+      const unsigned int pixelId = static_cast<unsigned int>(y * width + x);
+      visitNeighbor(pixelId, 0, 1);
+      if(eightConnected && x > 0)
+      {
+        visitNeighbor(pixelId, 1, 1);
+      }
+      if(eightConnected && x + 1 < width)
+      {
+        visitNeighbor(pixelId, -1, 1);
+      }
+    }
+  }
+
+  // 3) Number the roots in row major order: every thread counts the roots of its chunk, the counts are scanned,
+  // and every thread then numbers its roots starting from its chunk's total. The trees are not changed any more,
+  // so the other pixels can then follow their paths to their root in parallel.
+  this->Segments.resize(numberOfPixels);
+  std::vector<unsigned int> chunkTotals(Parallel::GetNumberOfThreads() + 1, 0);
+  Parallel::ForChunks(0, numberOfPixels, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    unsigned int total = 0;
+    for(size_t pixelId = chunkBegin; pixelId < chunkEnd; ++pixelId)
+    {
+      total += (parents[pixelId] == pixelId) ? 1 : 0;
+    }
+    chunkTotals[threadId + 1] = total;
+    });
+
+  for(size_t threadId = 1; threadId < chunkTotals.size(); ++threadId)
+  {
+    chunkTotals[threadId] += chunkTotals[threadId - 1];
+  }
+
+  Parallel::ForChunks(0, numberOfPixels, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    unsigned int segment = chunkTotals[threadId];
+    for(size_t pixelId = chunkBegin; pixelId < chunkEnd; ++pixelId)
+    {
+      if(parents[pixelId] == pixelId)
+      {
+        this->Segments[pixelId] = segment++;
+      }
+    }
+    });
+
+  Parallel::For(0, numberOfPixels, [&](const size_t pixelId)
+    {
+    unsigned int root = parents[pixelId];
+    while(parents[root] != root)
+    {
+      root = parents[root];
+    }
+    this->Segments[pixelId] = this->Segments[root];
+    });
+
+  // 4) The areas, and the number of discontinuous pixels.
+  this->SegmentAreas.assign(chunkTotals.back(), 0);
+  for(size_t pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+  {
+    ++this->SegmentAreas[this->Segments[pixelId]];
+    this->NumberOfDiscontinuousPixels += this->Discontinuous[pixelId];
+  }
+
+  return true;
+}
+
+unsigned int CoherenceSegmentation::GetSegment(const size_t pixelId) const
+{
+  return this->Segments[pixelId];
+}
+
+bool CoherenceSegmentation::IsDiscontinuous(const size_t pixelId) const
+{
+  return this->Discontinuous[pixelId] != 0;
+}
+
+unsigned int CoherenceSegmentation::GetNumberOfSegments() const
+{
+  return static_cast<unsigned int>(this->SegmentAreas.size());
+}
+
+size_t CoherenceSegmentation::GetNumberOfDiscontinuousPixels() const
+{
+  return this->NumberOfDiscontinuousPixels;
+}
+
+size_t CoherenceSegmentation::GetSegmentArea(const unsigned int segment) const
+{
+  return this->SegmentAreas[segment];
+}
+
+std::vector<size_t> CoherenceSegmentation::ComputeAreaHistogram() const
+{
+  std::vector<size_t> histogram;
+  for(size_t segment = 0; segment < this->SegmentAreas.size(); ++segment)
+  {
+    unsigned int bin = 0;
+    while((static_cast<size_t>(2) << bin) <= this->SegmentAreas[segment])
+    {
+      ++bin;
+    }
+    if(bin >= histogram.size())
+    {
+      histogram.resize(bin + 1, 0);
+    }
+    ++histogram[bin];
+  }
+  return histogram;
+}
+
+NNFieldTypes::ImageType::Pointer CoherenceSegmentation::CreateColorImage() const
+{
+  NNFieldTypes::ImageType::Pointer image = NNFieldTypes::ImageType::New();
+  image->SetRegions(itk::ImageRegion<2>(this->Size));
+  image->Allocate();
+
+  NNFieldTypes::ImageType::PixelType* buffer = image->GetBufferPointer();
+  Parallel::For(0, this->Segments.size(), [this, buffer](const size_t pixelId)
+    {
+    NNFieldTypes::ImageType::PixelType& color = buffer[pixelId];
+    if(this->Discontinuous[pixelId])
+    {
+      color.Fill(255);
+      return;
+    }
+
+    // Neighboring segments have consecutive numbers, which the hash spreads over the colors.
+    // The channels are at most 208, so no segment is mistaken for a discontinuity.
+    const unsigned int hash = this->Segments[pixelId] * 2654435761u;
+    for(unsigned int channel = 0; channel < 3; ++channel)
+    {
+      color[channel] = static_cast<unsigned char>(32 + ((hash >> (8 * channel + 8)) & 0xff) * 176 / 255);
+    }
+    });
+
+  return image;
+}
@@ -0,0 +1,83 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CoherenceSegmentation_H
+#define CoherenceSegmentation_H
+
+// STL
+#include <atomic>
+#include <vector>
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** The coherent segments of a nearest neighbor field: two neighboring pixels are coherent if their offsets
+  * differ by at most a threshold, and the segments are the connected components of coherent pixels.
+  * A pixel that is not coherent with all of its neighbors is discontinuous. Where PatchMatch propagation worked,
+  * the segments are large; where it broke down, the field is a mosaic of small segments and discontinuities.
+  *
+  * Build() is a parallel union-find: every thread joins the pixels of its band of rows, the bands are then joined
+  * along their borders, and the roots are numbered in parallel. Roots are always the smallest pixel id of their
+  * tree, so the bands never touch each other's pixels, and the segments are numbered in row major order.
+  */
+class CoherenceSegmentation
+{
+public:
+  CoherenceSegmentation();
+
+  /** Segment 'nnField', where the offsets of coherent neighbors differ by at most 'threshold' pixels.
+    * The neighbors are the 4 or, if 'eightConnected', the 8 pixels around a pixel. Offsets that are not finite
+    * are coherent with nothing. Returns false (and leaves the segmentation empty) if 'cancel' became true.*/
+  bool Build(const NNFieldTypes::NNFieldImageType* const nnField, const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+             const float threshold, const bool eightConnected, const std::atomic<bool>& cancel);
+
+  /** The segment of a pixel (row major id), in [0, GetNumberOfSegments()).*/
+  unsigned int GetSegment(const size_t pixelId) const;
+
+  /** Whether a pixel is not coherent with one of its neighbors.*/
+  bool IsDiscontinuous(const size_t pixelId) const;
+
+  unsigned int GetNumberOfSegments() const;
+  size_t GetNumberOfDiscontinuousPixels() const;
+
+  /** The number of pixels of a segment.*/
+  size_t GetSegmentArea(const unsigned int segment) const;
+
+  /** The number of segments of every area range: bin b counts the segments of [2^b, 2^(b+1)) pixels.*/
+  std::vector<size_t> ComputeAreaHistogram() const;
+
+  /** An image where every segment has its own color and the discontinuous pixels are white.*/
+  NNFieldTypes::ImageType::Pointer CreateColorImage() const;
+
+  /** The size of the field the segmentation was built from.*/
+  itk::Size<2> GetSize() const;
+
+private:
+  itk::Size<2> Size;
+
+  /** The segment of every pixel.*/
+  std::vector<unsigned int> Segments;
+
+  /** Whether every pixel is discontinuous (0 or 1).*/
+  std::vector<unsigned char> Discontinuous;
+
+  std::vector<size_t> SegmentAreas;
+  size_t NumberOfDiscontinuousPixels;
+};
+
+#endif
@@ -0,0 +1,605 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CompactNNField.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+// ITK
+#include "itk_zlib.h"
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  const char Magic[8] = {'N', 'N', 'C', 'O', 'M', 'P', 'A', '1'};
+
+  /** The x and y must be smaller than this in magnitude, so the differences of the residuals fit into the varints.*/
+  const float MaximumCoordinate = 1 << 30;
+
+  /** The largest quantized value of the channels after x and y.*/
+  const unsigned int MaximumQuantized = std::numeric_limits<unsigned short>::max();
+
+  // The values are written and read in the byte order of the machine, which must be little endian like the files.
+  static_assert(sizeof(unsigned int) == 4 && sizeof(unsigned long long) == 8 && sizeof(float) == 4 &&
+                sizeof(unsigned short) == 2,
+                "The .nnc format needs 16 bit unsigned short, 32 bit unsigned int and float and 64 bit unsigned long long.");
+
+  void PutVarint(std::vector<unsigned char>& bytes, unsigned long long value)
+  {
+    while(value >= 0x80)
+    {
+      bytes.push_back(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+    bytes.push_back(static_cast<unsigned char>(value));
+  }
+
+  /** Read the varint at 'position' (which is moved past it). Returns false if it does not end before 'end'.*/
+  bool GetVarint(const unsigned char*& position, const unsigned char* const end, unsigned long long& value)
+  {
+    value = 0;
+    for(unsigned int shift = 0; shift < 64 && position < end; shift += 7)
+    {
+      const unsigned char byte = *position++;
+      value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+      if(!(byte & 0x80))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Small differences of either sign become small unsigned values.*/
+  unsigned long long ZigZag(const long long value)
+  {
+    return (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+  }
+
+  long long UnZigZag(const unsigned long long value)
+  {
+    return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+  }
+
+  template <typename T>
+  void WriteValues(std::ostream& stream, const T* const values, const size_t numberOfValues)
+  {
+    stream.write(reinterpret_cast<const char*>(values), numberOfValues * sizeof(T));
+  }
+
+  /** Write the uncompressed and compressed number of bytes of 'values', then the compressed values.*/
+  template <typename T>
+  void WriteSection(std::ostream& stream, const std::vector<T>& values)
+  {
+    unsigned long long sizes[2] = {values.size() * sizeof(T), 0};
+    if(values.empty())
+    {
+      WriteValues(stream, sizes, 2);
+      return;
+    }
+
+    // The file is written once and read often, and decompressing is equally fast at any level.
+    uLongf compressedSize = compressBound(sizes[0]);
+    std::vector<unsigned char> compressed(compressedSize);
+    if(compress2(&compressed[0], &compressedSize, reinterpret_cast<const Bytef*>(&values[0]), sizes[0],
+                 Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+      throw std::runtime_error("CompactNNField: compressing the field failed!");
+    }
+    sizes[1] = compressedSize;
+    WriteValues(stream, sizes, 2);
+    WriteValues(stream, &compressed[0], compressedSize);
+  }
+
+  /** Read a section written by WriteSection into 'values'.*/
+  template <typename T>
+  void ReadSection(std::istream& stream, const unsigned long long fileSize, std::vector<T>& values)
+  {
+    unsigned long long sizes[2];
+    stream.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+    // zlib does not compress by more than about 1000:1, so larger sizes are not valid (and are not allocated).
+    if(!stream || sizes[1] > fileSize || sizes[0] % sizeof(T) != 0 || sizes[0] > 1100 * sizes[1])
+    {
+      throw std::runtime_error("CompactNNField: a section of the file is not valid!");
+    }
+
+    values.clear();
+    if(sizes[0] == 0)
+    {
+      return;
+    }
+
+    std::vector<unsigned char> compressed(sizes[1]);
+    stream.read(reinterpret_cast<char*>(&compressed[0]), compressed.size());
+    if(!stream)
+    {
+      throw std::runtime_error("CompactNNField: the file is truncated!");
+    }
+
+    values.resize(sizes[0] / sizeof(T));
+    uLongf uncompressedSize = sizes[0];
+    if(uncompress(reinterpret_cast<Bytef*>(&values[0]), &uncompressedSize, &compressed[0], compressed.size()) != Z_OK ||
+       uncompressedSize != sizes[0])
+    {
+      throw std::runtime_error("CompactNNField: a section of the file could not be decompressed!");
+    }
+  }
+}
+
+CompactNNField::CompactNNField() : Width(0), Height(0), NumberOfComponents(0), Step(0)
+{
+}
+
+bool CompactNNField::IsCompactFileName(const std::string& fileName)
+{
+  const std::string extension = ".nnc";
+  return fileName.size() >= extension.size() &&
+         fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool CompactNNField::Encode(const NNFieldImageType* const nnField, const std::atomic<bool>& cancel)
+{
+  const itk::Size<2> size = nnField->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  if(size[0] == 0 || size[1] == 0 || numberOfComponents < 2)
+  {
+    throw std::runtime_error("CompactNNField: the field must not be empty and must have at least two channels!");
+  }
+
+  const float* const buffer = nnField->GetBufferPointer();
+  const size_t rowStride = static_cast<size_t>(size[0]) * numberOfComponents;
+  const unsigned int numberOfThreads = Parallel::GetNumberOfThreads();
+
+  // One pass finds the ranges, checks that x and y can be encoded, and counts how many pixels equal their left
+  // neighbor as offsets (step 0) and as absolute positions (step 1).
+  std::vector<std::vector<float> > threadMin(numberOfThreads,
+                                             std::vector<float>(numberOfComponents, std::numeric_limits<float>::max()));
+  std::vector<std::vector<float> > threadMax(numberOfThreads,
+                                             std::vector<float>(numberOfComponents, -std::numeric_limits<float>::max()));
+  std::vector<size_t> threadCoherent[2] = {std::vector<size_t>(numberOfThreads, 0), std::vector<size_t>(numberOfThreads, 0)};
+  std::atomic<bool> notEncodable(false);
+  Parallel::ForChunks(0, size[1], [&](const size_t firstRow, const size_t lastRow, const unsigned int threadId)
+    {
+    std::vector<float>& channelMin = threadMin[threadId];
+    std::vector<float>& channelMax = threadMax[threadId];
+    for(size_t row = firstRow; row < lastRow; ++row)
+    {
+      const float* value = buffer + row * rowStride;
+      for(unsigned int x = 0; x < size[0]; ++x, value += numberOfComponents)
+      {
+        for(unsigned int channel = 0; channel < numberOfComponents; ++channel)
+        {
+          if(std::isfinite(value[channel]))
+          {
+            channelMin[channel] = std::min(channelMin[channel], value[channel]);
+            channelMax[channel] = std::max(channelMax[channel], value[channel]);
+          }
+        }
+
+        // NaN fails these tests too.
+        for(unsigned int channel = 0; channel < 2; ++channel)
+        {
+          if(!(std::floor(value[channel]) == value[channel] && std::fabs(value[channel]) < MaximumCoordinate))
+          {
+            notEncodable = true;
+          }
+        }
+
+        if(x > 0 && value[1] == value[1 - static_cast<int>(numberOfComponents)])
+        {
+          const float left = value[-static_cast<int>(numberOfComponents)];
+          threadCoherent[0][threadId] += (value[0] == left);
+          threadCoherent[1][threadId] += (value[0] == left + 1.0f);
+        }
+      }
+    }
+    });
+
+  if(notEncodable)
+  {
+    throw std::runtime_error("CompactNNField: only fields with integer x and y (of magnitude below 2^30) can be encoded!");
+  }
+  if(cancel)
+  {
+    return false;
+  }
+
+  size_t coherent[2] = {0, 0};
+  for(unsigned int threadId = 0; threadId < numberOfThreads; ++threadId)
+  {
+    coherent[0] += threadCoherent[0][threadId];
+    coherent[1] += threadCoherent[1][threadId];
+    for(unsigned int channel = 0; channel < numberOfComponents; ++channel)
+    {
+      threadMin[0][channel] = std::min(threadMin[0][channel], threadMin[threadId][channel]);
+      threadMax[0][channel] = std::max(threadMax[0][channel], threadMax[threadId][channel]);
+    }
+  }
+  for(unsigned int channel = 0; channel < numberOfComponents; ++channel)
+  {
+    // No finite value at all.
+    if(threadMin[0][channel] > threadMax[0][channel])
+    {
+      threadMin[0][channel] = 0.0f;
+      threadMax[0][channel] = 0.0f;
+    }
+  }
+
+  this->Width = size[0];
+  this->Height = size[1];
+  this->NumberOfComponents = numberOfComponents;
+  this->Step = (coherent[1] > coherent[0]) ? 1 : 0;
+  this->ChannelMin = threadMin[0];
+  this->ChannelMax = threadMax[0];
+
+  const unsigned int numberOfExtraChannels = numberOfComponents - 2;
+  std::vector<double> scales(numberOfExtraChannels, 0.0);
+  for(unsigned int extraChannel = 0; extraChannel < numberOfExtraChannels; ++extraChannel)
+  {
+    const double range = static_cast<double>(this->ChannelMax[extraChannel + 2]) - this->ChannelMin[extraChannel + 2];
+    scales[extraChannel] = (range > 0.0) ? MaximumQuantized / range : 0.0;
+  }
+
+  // Every row is encoded on its own, then the rows are concatenated.
+  const unsigned int numberOfBlocksPerRow = GetNumberOfBlocksPerRow();
+  std::vector<std::vector<unsigned char> > rowRuns(size[1]);
+  std::vector<unsigned long long> blockSizes(static_cast<size_t>(size[1]) * numberOfBlocksPerRow);
+  this->ExtraChannels.assign(static_cast<size_t>(size[0]) * size[1] * numberOfExtraChannels, 0);
+  const long long step = this->Step;
+
+  Parallel::ForChunks(0, size[1], [&](const size_t firstRow, const size_t lastRow, const unsigned int)
+    {
+    for(size_t row = firstRow; row < lastRow && !cancel; ++row)
+    {
+      const float* const rowValues = buffer + row * rowStride;
+      std::vector<unsigned char>& runs = rowRuns[row];
+
+      for(unsigned int block = 0; block < numberOfBlocksPerRow; ++block)
+      {
+        const size_t blockBegin = runs.size();
+        const unsigned int blockEnd = std::min((block + 1) * BlockSize, this->Width);
+        long long previousResidual[2] = {0, 0};
+
+        for(unsigned int x = block * BlockSize; x < blockEnd; )
+        {
+          const float* value = rowValues + static_cast<size_t>(x) * numberOfComponents;
+          const long long residual[2] = {static_cast<long long>(value[0]) - step * x,
+                                         static_cast<long long>(value[1]) - step * static_cast<long long>(row)};
+
+          unsigned int runEnd = x + 1;
+          for(value += numberOfComponents; runEnd < blockEnd; ++runEnd, value += numberOfComponents)
+          {
+            if(static_cast<long long>(value[0]) - step * runEnd != residual[0] ||
+               static_cast<long long>(value[1]) - step * static_cast<long long>(row) != residual[1])
+            {
+              break;
+            }
+          }
+
+          PutVarint(runs, runEnd - x - 1);
+          PutVarint(runs, ZigZag(residual[0] - previousResidual[0]));
+          PutVarint(runs, ZigZag(residual[1] - previousResidual[1]));
+          previousResidual[0] = residual[0];
+          previousResidual[1] = residual[1];
+          x = runEnd;
+        }
+
+        blockSizes[row * numberOfBlocksPerRow + block] = runs.size() - blockBegin;
+      }
+
+      unsigned short* quantized = numberOfExtraChannels ? &this->ExtraChannels[row * size[0] * numberOfExtraChannels] : NULL;
+      for(unsigned int x = 0; x < size[0] && numberOfExtraChannels; ++x)
+      {
+        const float* value = rowValues + static_cast<size_t>(x) * numberOfComponents + 2;
+        for(unsigned int extraChannel = 0; extraChannel < numberOfExtraChannels; ++extraChannel, ++quantized)
+        {
+          const double position = (static_cast<double>(value[extraChannel]) - this->ChannelMin[extraChannel + 2]) *
+                                  scales[extraChannel];
+          // Not finite values become the minimum.
+          *quantized = std::isfinite(position) ?
+                       static_cast<unsigned short>(std::min<double>(std::max(position, 0.0) + 0.5, MaximumQuantized)) : 0;
+        }
+      }
+    }
+    });
+
+  if(cancel)
+  {
+    this->Width = 0;
+    this->Height = 0;
+    this->BlockOffsets.clear();
+    this->Runs.clear();
+    this->ExtraChannels.clear();
+    return false;
+  }
+
+  this->BlockOffsets.resize(blockSizes.size() + 1);
+  this->BlockOffsets[0] = 0;
+  for(size_t blockId = 0; blockId < blockSizes.size(); ++blockId)
+  {
+    this->BlockOffsets[blockId + 1] = this->BlockOffsets[blockId] + blockSizes[blockId];
+  }
+
+  this->Runs.resize(this->BlockOffsets.back());
+  for(size_t row = 0; row < rowRuns.size(); ++row)
+  {
+    if(!rowRuns[row].empty())
+    {
+      std::copy(rowRuns[row].begin(), rowRuns[row].end(), &this->Runs[this->BlockOffsets[row * numberOfBlocksPerRow]]);
+    }
+    std::vector<unsigned char>().swap(rowRuns[row]);
+  }
+
+  return true;
+}
+
+void CompactNNField::Write(const std::string& fileName) const
+{
+  if(this->Width == 0 || this->Height == 0)
+  {
+    throw std::runtime_error("CompactNNField: there is no field to write!");
+  }
+
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  if(!file)
+  {
+    throw std::runtime_error("CompactNNField: could not open " + fileName + " for writing!");
+  }
+
+  const unsigned int header[4] = {this->Width, this->Height, this->NumberOfComponents, this->Step};
+  file.write(Magic, sizeof(Magic));
+  WriteValues(file, header, 4);
+  WriteValues(file, &this->ChannelMin[0], this->NumberOfComponents);
+  WriteValues(file, &this->ChannelMax[0], this->NumberOfComponents);
+
+  // A block of BlockSize pixels takes at most BlockSize runs of 21 bytes, so its size fits into 16 bits.
+  std::vector<unsigned short> blockSizes(this->BlockOffsets.size() - 1);
+  for(size_t blockId = 0; blockId < blockSizes.size(); ++blockId)
+  {
+    blockSizes[blockId] = static_cast<unsigned short>(this->BlockOffsets[blockId + 1] - this->BlockOffsets[blockId]);
+  }
+  WriteSection(file, blockSizes);
+  WriteSection(file, this->Runs);
+  WriteSection(file, this->ExtraChannels);
+
+  file.close();
+  if(!file)
+  {
+    throw std::runtime_error("CompactNNField: could not write " + fileName + "!");
+  }
+}
+
+void CompactNNField::Read(const std::string& fileName)
+{
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+  if(!file)
+  {
+    throw std::runtime_error("CompactNNField: could not open " + fileName + "!");
+  }
+  file.seekg(0, std::ios::end);
+  const unsigned long long fileSize = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  char magic[sizeof(Magic)];
+  unsigned int header[4];
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(header), sizeof(header));
+  if(!file || std::memcmp(magic, Magic, sizeof(Magic)) != 0)
+  {
+    throw std::runtime_error("CompactNNField: " + fileName + " is not a .nnc file!");
+  }
+  if(header[0] == 0 || header[1] == 0 || header[2] < 2 || header[3] > 1)
+  {
+    throw std::runtime_error("CompactNNField: the header of " + fileName + " is not valid!");
+  }
+
+  this->Width = header[0];
+  this->Height = header[1];
+  this->NumberOfComponents = header[2];
+  this->Step = header[3];
+
+  this->ChannelMin.resize(this->NumberOfComponents);
+  this->ChannelMax.resize(this->NumberOfComponents);
+  file.read(reinterpret_cast<char*>(&this->ChannelMin[0]), this->NumberOfComponents * sizeof(float));
+  file.read(reinterpret_cast<char*>(&this->ChannelMax[0]), this->NumberOfComponents * sizeof(float));
+  if(!file)
+  {
+    throw std::runtime_error("CompactNNField: the file is truncated!");
+  }
+
+  std::vector<unsigned short> blockSizes;
+  ReadSection(file, fileSize, blockSizes);
+  ReadSection(file, fileSize, this->Runs);
+  ReadSection(file, fileSize, this->ExtraChannels);
+
+  const size_t numberOfPixels = static_cast<size_t>(this->Width) * this->Height;
+  if(blockSizes.size() != static_cast<size_t>(this->Height) * GetNumberOfBlocksPerRow() ||
+     this->ExtraChannels.size() != numberOfPixels * (this->NumberOfComponents - 2))
+  {
+    throw std::runtime_error("CompactNNField: the sections of " + fileName + " do not match its size!");
+  }
+
+  this->BlockOffsets.resize(blockSizes.size() + 1);
+  this->BlockOffsets[0] = 0;
+  for(size_t blockId = 0; blockId < blockSizes.size(); ++blockId)
+  {
+    this->BlockOffsets[blockId + 1] = this->BlockOffsets[blockId] + blockSizes[blockId];
+  }
+
+  // Decoding trusts the runs, so they are checked once here.
+  if(this->BlockOffsets.back() != this->Runs.size() || !AreBlocksValid())
+  {
+    throw std::runtime_error("CompactNNField: the runs of " + fileName + " are not valid!");
+  }
+}
+
+itk::ImageRegion<2> CompactNNField::GetRegion() const
+{
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{this->Width, this->Height}};
+  return itk::ImageRegion<2>(corner, size);
+}
+
+unsigned int CompactNNField::GetNumberOfComponents() const
+{
+  return this->NumberOfComponents;
+}
+
+float CompactNNField::GetChannelMin(const unsigned int channel) const
+{
+  return this->ChannelMin[channel];
+}
+
+float CompactNNField::GetChannelMax(const unsigned int channel) const
+{
+  return this->ChannelMax[channel];
+}
+
+void CompactNNField::GetPixel(const itk::Index<2>& index, float* const pixel)
+{
+  itk::Size<2> size = {{1, 1}};
+  ReadRegion(itk::ImageRegion<2>(index, size), pixel, this->NumberOfComponents);
+}
+
+void CompactNNField::ReadRegion(const itk::ImageRegion<2>& region, float* const out, const size_t outRowStride)
+{
+  if(!GetRegion().IsInside(region))
+  {
+    throw std::runtime_error("CompactNNField: the region must be inside the field!");
+  }
+
+  const unsigned int firstX = region.GetIndex()[0];
+  const unsigned int firstY = region.GetIndex()[1];
+  for(unsigned int row = 0; row < region.GetSize()[1]; ++row)
+  {
+    DecodeRow(firstY + row, firstX, firstX + region.GetSize()[0], out + row * outRowStride);
+  }
+}
+
+size_t CompactNNField::GetNumberOfBytes() const
+{
+  return this->BlockOffsets.size() * sizeof(unsigned long long) + this->Runs.size() +
+         this->ExtraChannels.size() * sizeof(unsigned short);
+}
+
+void CompactNNField::DecodeRow(const unsigned int row, const unsigned int firstX, const unsigned int lastX,
+                               float* const out) const
+{
+  const unsigned int numberOfBlocksPerRow = GetNumberOfBlocksPerRow();
+  const long long step = this->Step;
+  const float stepY = static_cast<float>(step * row);
+
+  for(unsigned int block = firstX / BlockSize; block * BlockSize < lastX; ++block)
+  {
+    const size_t blockId = static_cast<size_t>(row) * numberOfBlocksPerRow + block;
+    const unsigned char* position = &this->Runs[0] + this->BlockOffsets[blockId];
+    const unsigned char* const end = &this->Runs[0] + this->BlockOffsets[blockId + 1];
+    long long residual[2] = {0, 0};
+
+    for(unsigned int x = block * BlockSize; x < lastX && position < end; )
+    {
+      unsigned long long length;
+      unsigned long long difference[2];
+      GetVarint(position, end, length);
+      GetVarint(position, end, difference[0]);
+      GetVarint(position, end, difference[1]);
+      residual[0] += UnZigZag(difference[0]);
+      residual[1] += UnZigZag(difference[1]);
+
+      const unsigned int runEnd = std::min<unsigned long long>(x + length + 1, lastX);
+      for(unsigned int pixel = std::max(x, firstX); pixel < runEnd; ++pixel)
+      {
+        float* const value = out + static_cast<size_t>(pixel - firstX) * this->NumberOfComponents;
+        value[0] = static_cast<float>(residual[0] + step * pixel);
+        value[1] = static_cast<float>(residual[1]) + stepY;
+      }
+      x = runEnd;
+    }
+  }
+
+  const unsigned int numberOfExtraChannels = this->NumberOfComponents - 2;
+  if(numberOfExtraChannels == 0)
+  {
+    return;
+  }
+
+  const unsigned short* quantized = &this->ExtraChannels[(static_cast<size_t>(row) * this->Width + firstX) * numberOfExtraChannels];
+  for(unsigned int pixel = firstX; pixel < lastX; ++pixel)
+  {
+    float* const value = out + static_cast<size_t>(pixel - firstX) * this->NumberOfComponents + 2;
+    for(unsigned int extraChannel = 0; extraChannel < numberOfExtraChannels; ++extraChannel, ++quantized)
+    {
+      const float minimum = this->ChannelMin[extraChannel + 2];
+      value[extraChannel] = minimum + *quantized * ((this->ChannelMax[extraChannel + 2] - minimum) / MaximumQuantized);
+    }
+  }
+}
+
+bool CompactNNField::AreBlocksValid() const
+{
+  const unsigned int numberOfBlocksPerRow = GetNumberOfBlocksPerRow();
+  std::atomic<bool> valid(true);
+
+  Parallel::ForChunks(0, this->Height, [&](const size_t firstRow, const size_t lastRow, const unsigned int)
+    {
+    for(size_t row = firstRow; row < lastRow && valid; ++row)
+    {
+      for(unsigned int block = 0; block < numberOfBlocksPerRow; ++block)
+      {
+        const size_t blockId = row * numberOfBlocksPerRow + block;
+        const unsigned char* position = this->Runs.empty() ? NULL : &this->Runs[0] + this->BlockOffsets[blockId];
+        const unsigned char* const end = this->Runs.empty() ? NULL : &this->Runs[0] + this->BlockOffsets[blockId + 1];
+        const unsigned long long numberOfPixels = std::min((block + 1) * BlockSize, this->Width) - block * BlockSize;
+
+        unsigned long long numberOfDecodedPixels = 0;
+        while(position < end && numberOfDecodedPixels < numberOfPixels)
+        {
+          unsigned long long values[3];
+          if(!GetVarint(position, end, values[0]) || !GetVarint(position, end, values[1]) ||
+             !GetVarint(position, end, values[2]) || values[0] >= numberOfPixels - numberOfDecodedPixels)
+          {
+            valid = false;
+            return;
+          }
+          numberOfDecodedPixels += values[0] + 1;
+        }
+
+        if(position != end || numberOfDecodedPixels != numberOfPixels)
+        {
+          valid = false;
+          return;
+        }
+      }
+    }
+    });
+
+  return valid;
+}
+
+unsigned int CompactNNField::GetNumberOfBlocksPerRow() const
+{
+  return (this->Width + BlockSize - 1) / BlockSize;
+}
@@ -0,0 +1,108 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CompactNNField_H
+#define CompactNNField_H
+
+// STL
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Custom
+#include "NNFieldStore.h"
+#include "NNFieldTypes.h"
+
+/** A nearest neighbor field kept in a compact encoding in memory, which is also its .nnc file format.
+  *
+  * PatchMatch fields are coherent: neighboring pixels mostly match neighboring patches. The x and y of a pixel
+  * are stored as its residual, the match minus Step times the pixel (Step is 1 for absolute fields and 0 for
+  * offset fields, whichever makes more neighbors equal), and the residuals are run length encoded along the rows.
+  * A run is the varint of its length minus one, then the zigzag varints of the difference of its residual to the
+  * residual of the previous run. The runs restart at every block of BlockSize pixels of a row, so any pixel is
+  * decoded from at most one block. The channels after x and y (e.g. the patch distance) are not coherent. They
+  * are quantized to 16 bits over their range.
+  *
+  * A .nnc file (all values little endian) is the 8 bytes "NNCOMPA1", the uint32 width, height, number of
+  * channels and Step, the float minimum and maximum of every channel, then three zlib compressed sections: the
+  * uint16 number of bytes of every block, the runs, and the uint16 channels after x and y. Each section is
+  * preceded by its uint64 uncompressed and compressed number of bytes.
+  */
+class CompactNNField : public NNFieldStore
+{
+public:
+  typedef NNFieldTypes::NNFieldImageType NNFieldImageType;
+
+  /** The number of pixels of a row that are encoded together.*/
+  static const unsigned int BlockSize = 64;
+
+  CompactNNField();
+
+  /** Encode 'nnField' on all cores. Throws if its x and y are not integers. Returns false if 'cancel' became
+    * true first.*/
+  bool Encode(const NNFieldImageType* const nnField, const std::atomic<bool>& cancel);
+
+  /** Write the field as a .nnc file. Throws if it cannot be written.*/
+  void Write(const std::string& fileName) const;
+
+  /** Read a .nnc file. Throws if the file is not valid.*/
+  void Read(const std::string& fileName);
+
+  /** Whether 'fileName' has the .nnc extension.*/
+  static bool IsCompactFileName(const std::string& fileName);
+
+  itk::ImageRegion<2> GetRegion() const;
+  unsigned int GetNumberOfComponents() const;
+  float GetChannelMin(const unsigned int channel) const;
+  float GetChannelMax(const unsigned int channel) const;
+
+  /** The pixels are decoded from their blocks, which only reads memory, so any number of threads can decode.*/
+  void GetPixel(const itk::Index<2>& index, float* const pixel);
+  void ReadRegion(const itk::ImageRegion<2>& region, float* const out, const size_t outRowStride);
+
+  /** The number of bytes of the encoded field.*/
+  size_t GetNumberOfBytes() const;
+
+private:
+  /** Decode the pixels [firstX, lastX) of 'row' to 'out'.*/
+  void DecodeRow(const unsigned int row, const unsigned int firstX, const unsigned int lastX, float* const out) const;
+
+  /** Whether the runs of every block are well formed and cover exactly the pixels of the block.*/
+  bool AreBlocksValid() const;
+
+  unsigned int GetNumberOfBlocksPerRow() const;
+
+  unsigned int Width;
+  unsigned int Height;
+  unsigned int NumberOfComponents;
+
+  /** 1 if the residuals are relative to the pixel, 0 if they are the x and y themselves.*/
+  unsigned int Step;
+
+  std::vector<float> ChannelMin;
+  std::vector<float> ChannelMax;
+
+  /** The offset of the runs of every block in Runs, and the end of the last one.*/
+  std::vector<unsigned long long> BlockOffsets;
+  std::vector<unsigned char> Runs;
+
+  /** The quantized channels after x and y, interleaved.*/
+  std::vector<unsigned short> ExtraChannels;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "FlowColor.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Custom
+#include "Parallel.h"
+
+namespace FlowColor
+{
+
+namespace
+{
+  /** The number of colors of the wheel.*/
+  const unsigned int NumberOfWheelColors = 55;
+
+  /** The colors of the wheel in [0, 1]: red to yellow, yellow to green, green to cyan, cyan to blue,
+    * blue to magenta and magenta to red, in steps chosen for a perceptually even wheel.*/
+  struct Wheel
+  {
+    Wheel()
+    {
+      const unsigned int steps[6] = {15, 6, 4, 11, 13, 6};
+      // The color at the start of each segment, and the channel that changes along it (up, or down if negative).
+      const float starts[6][3] = {{1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}, {1, 0, 1}};
+      const int changes[6] = {2, -1, 3, -2, 1, -3};
+
+      unsigned int colorId = 0;
+      for(unsigned int segment = 0; segment < 6; ++segment)
+      {
+        for(unsigned int step = 0; step < steps[segment]; ++step, ++colorId)
+        {
+          const float fraction = static_cast<float>(step) / steps[segment];
+          const unsigned int channel = std::abs(changes[segment]) - 1;
+          std::copy(starts[segment], starts[segment] + 3, this->Colors[colorId]);
+          this->Colors[colorId][channel] = (changes[segment] > 0) ? fraction : 1.0f - fraction;
+        }
+      }
+    }
+
+    float Colors[NumberOfWheelColors][3];
+  };
+
+  const Wheel& GetWheel()
+  {
+    static const Wheel wheel;
+    return wheel;
+  }
+
+  /** atan2 without branches (the conditions become selects), accurate to about 1e-5 radians.*/
+  inline float FastAtan2(const float y, const float x)
+  {
+    const float absoluteX = std::fabs(x);
+    const float absoluteY = std::fabs(y);
+    const float ratio = std::min(absoluteX, absoluteY) / (std::max(absoluteX, absoluteY) + 1e-30f);
+    const float squared = ratio * ratio;
+    float angle = ((((-0.0117212f * squared + 0.05265332f) * squared - 0.11643287f) * squared + 0.19354346f) * squared
+                   - 0.33262347f) * squared * ratio + 0.99997726f * ratio;
+    angle = (absoluteY > absoluteX) ? 1.57079637f - angle : angle;
+    angle = (x < 0.0f) ? 3.14159274f - angle : angle;
+    return (y < 0.0f) ? -angle : angle;
+  }
+}
+
+void Compute(const float* const field, const unsigned int numberOfComponents, const unsigned int width,
+             const unsigned int height, const double origin[2], const double spacing[2],
+             const NNFieldTypes::INTERPRETATION_ENUM interpretation, float maximumMagnitude,
+             unsigned char* const rgba)
+{
+  const Wheel& wheel = GetWheel();
+
+  // An absolute position minus the position of the pixel is the offset.
+  const float positionStep = (interpretation == NNFieldTypes::ABSOLUTE) ? 1.0f : 0.0f;
+  const size_t rowStride = static_cast<size_t>(width) * numberOfComponents;
+
+  if(maximumMagnitude <= 0.0f)
+  {
+    std::vector<float> threadMaximum(Parallel::GetNumberOfThreads(), 0.0f);
+    Parallel::ForChunks(0, height, [&](const size_t firstRow, const size_t lastRow, const unsigned int threadId)
+      {
+      float maximumSquared = 0.0f;
+      for(size_t y = firstRow; y < lastRow; ++y)
+      {
+        const float* const in = field + y * rowStride;
+        const float positionY = positionStep * static_cast<float>(origin[1] + y * spacing[1]);
+        for(unsigned int x = 0; x < width; ++x)
+        {
+          const float offsetX = in[x * numberOfComponents] - positionStep * static_cast<float>(origin[0] + x * spacing[0]);
+          const float offsetY = in[x * numberOfComponents + 1] - positionY;
+          const float squared = offsetX * offsetX + offsetY * offsetY;
+          // NaNs fail the comparison.
+          maximumSquared = (squared > maximumSquared) ? squared : maximumSquared;
+        }
+      }
+      threadMaximum[threadId] = std::sqrt(maximumSquared);
+      });
+    maximumMagnitude = std::max(*std::max_element(threadMaximum.begin(), threadMaximum.end()), 1e-6f);
+  }
+
+  Parallel::ForChunks(0, height, [&](const size_t firstRow, const size_t lastRow, const unsigned int)
+    {
+    std::vector<float> wheelPosition(width);
+    std::vector<float> radius(width);
+    for(size_t y = firstRow; y < lastRow; ++y)
+    {
+      const float* const in = field + y * rowStride;
+      const float positionY = positionStep * static_cast<float>(origin[1] + y * spacing[1]);
+
+      // The offsets, their direction and their relative length, without branches.
+      for(unsigned int x = 0; x < width; ++x)
+      {
+        const float offsetX = (in[x * numberOfComponents] - positionStep * static_cast<float>(origin[0] + x * spacing[0])) /
+                              maximumMagnitude;
+        const float offsetY = (in[x * numberOfComponents + 1] - positionY) / maximumMagnitude;
+        radius[x] = std::sqrt(offsetX * offsetX + offsetY * offsetY);
+        // The angle in [-pi, pi] becomes a position on the wheel in [0, NumberOfWheelColors - 1].
+        wheelPosition[x] = (FastAtan2(-offsetY, -offsetX) / 3.14159274f + 1.0f) * 0.5f * (NumberOfWheelColors - 1);
+      }
+
+      unsigned char* const out = rgba + y * width * 4;
+      for(unsigned int x = 0; x < width; ++x)
+      {
+        unsigned char* const color = out + x * 4;
+        color[3] = 255;
+        if(!std::isfinite(radius[x]))
+        {
+          color[0] = color[1] = color[2] = 0;
+          continue;
+        }
+
+        const unsigned int colorId = std::min(static_cast<unsigned int>(wheelPosition[x]), NumberOfWheelColors - 1);
+        const unsigned int nextColorId = (colorId + 1 == NumberOfWheelColors) ? 0 : colorId + 1;
+        const float fraction = wheelPosition[x] - colorId;
+        for(unsigned int channel = 0; channel < 3; ++channel)
+        {
+          float value = (1.0f - fraction) * wheel.Colors[colorId][channel] + fraction * wheel.Colors[nextColorId][channel];
+          // Short offsets are pale, offsets longer than the maximum are darker.
+          value = (radius[x] <= 1.0f) ? 1.0f - radius[x] * (1.0f - value) : 0.75f * value;
+          color[channel] = static_cast<unsigned char>(255.0f * value + 0.5f);
+        }
+      }
+    }
+    });
+}
+
+} // end namespace
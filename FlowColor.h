@@ -0,0 +1,45 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef FlowColor_H
+#define FlowColor_H
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** The color coding of optical flow benchmarks (the Middlebury color wheel): the hue of a pixel is the direction
+  * of its offset, and the saturation grows with the length of the offset up to 'maximumMagnitude'. Longer
+  * offsets are darkened. Offsets that are not finite are black.
+  *
+  * The colors are computed straight from the float field, converting absolute positions to offsets on the fly,
+  * in one pass over all cores. The angle comes from a polynomial approximation of atan2 (accurate to 1e-5 radians)
+  * written without branches, so the per row loops vectorize, and only the lookup into the wheel is per pixel.
+  */
+namespace FlowColor
+{
+  /** Write the RGBA color of every pixel of 'field' (a row major buffer of width x height pixels with
+    * 'numberOfComponents' interleaved channels) to 'rgba'. The pixel (x, y) is at the position
+    * 'origin' + (x, y) * 'spacing' of the image, which is what absolute positions are relative to.
+    * If 'maximumMagnitude' is not positive, the longest offset of the field is used.*/
+  void Compute(const float* const field, const unsigned int numberOfComponents, const unsigned int width,
+               const unsigned int height, const double origin[2], const double spacing[2],
+               const NNFieldTypes::INTERPRETATION_ENUM interpretation, float maximumMagnitude,
+               unsigned char* const rgba);
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef Hash64_H
+#define Hash64_H
+
+// POSIX
+#include <stdint.h>
+
+/** The 64-bit multiply-rotate mixer of the content hashes (LayerCache) and the tile checksums (TileChecksums).
+  * It is fast rather than cryptographic: the inputs are images and fields, not data chosen to collide.
+  */
+namespace Hash64
+{
+  /** Add 'value' to 'hash'.*/
+  inline uint64_t Mix(uint64_t hash, const uint64_t value)
+  {
+    hash ^= value * 0x9E3779B97F4A7C15ull;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xBF58476D1CE4E5B9ull;
+  }
+
+  /** Spread the bits of 'hash', so hashes that are mixed into keys or compared differ in all bits.*/
+  inline uint64_t Finalize(uint64_t hash)
+  {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+  }
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LRUCache_H
+#define LRUCache_H
+
+// STL
+#include <list>
+#include <map>
+#include <memory>
+
+/** A cache of values that takes at most a given number of bytes, evicting the least recently used values first.
+  * Values are handed out as shared pointers, so a value that is evicted while it is being used stays alive
+  * until its user is done with it. This class is not thread safe.
+  */
+template <typename TKey, typename TValue>
+class LRUCache
+{
+public:
+  typedef std::shared_ptr<const TValue> ValuePointer;
+
+  explicit LRUCache(const size_t maximumNumberOfBytes) : MaximumNumberOfBytes(maximumNumberOfBytes), NumberOfBytes(0) {}
+
+  /** The value of 'key', which becomes the most recently used one, or NULL if it is not cached.*/
+  ValuePointer Find(const TKey& key)
+  {
+    typename EntryMap::iterator entry = this->Entries.find(key);
+    if(entry == this->Entries.end())
+    {
+      return ValuePointer();
+    }
+
+    this->Usage.splice(this->Usage.begin(), this->Usage, entry->second.Usage);
+    return entry->second.Value;
+  }
+
+  /** Add (or replace) the value of 'key', which takes 'numberOfBytes'. The least recently used values are
+    * evicted until the cache fits into its budget again. The new value itself is never evicted by this call.*/
+  void Insert(const TKey& key, const ValuePointer& value, const size_t numberOfBytes)
+  {
+    Erase(key);
+
+    this->Usage.push_front(key);
+    Entry& entry = this->Entries[key];
+    entry.Value = value;
+    entry.NumberOfBytes = numberOfBytes;
+    entry.Usage = this->Usage.begin();
+    this->NumberOfBytes += numberOfBytes;
+
+    while(this->NumberOfBytes > this->MaximumNumberOfBytes && this->Usage.size() > 1)
+    {
+      Erase(this->Usage.back());
+    }
+  }
+
+  /** Remove the value of 'key', if it is cached.*/
+  void Erase(const TKey& key)
+  {
+    typename EntryMap::iterator entry = this->Entries.find(key);
+    if(entry == this->Entries.end())
+    {
+      return;
+    }
+
+    this->NumberOfBytes -= entry->second.NumberOfBytes;
+    this->Usage.erase(entry->second.Usage);
+    this->Entries.erase(entry);
+  }
+
+  void Clear()
+  {
+    this->Entries.clear();
+    this->Usage.clear();
+    this->NumberOfBytes = 0;
+  }
+
+  size_t GetNumberOfBytes() const
+  {
+    return this->NumberOfBytes;
+  }
+
+  size_t GetNumberOfEntries() const
+  {
+    return this->Entries.size();
+  }
+
+private:
+  /** The keys from the most to the least recently used.*/
+  typedef std::list<TKey> UsageList;
+
+  struct Entry
+  {
+    ValuePointer Value;
+    size_t NumberOfBytes;
+
+    /** The position of the key in Usage, so it can be moved to the front without a search.*/
+    typename UsageList::iterator Usage;
+  };
+  typedef std::map<TKey, Entry> EntryMap;
+
+  EntryMap Entries;
+  UsageList Usage;
+
+  size_t MaximumNumberOfBytes;
+  size_t NumberOfBytes;
+};
+
+#endif
@@ -0,0 +1,504 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "LayerCache.h"
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Custom
+#include "Hash64.h"
+#include "Parallel.h"
+#include "PrivateDirectory.h"
+
+namespace
+{
+  /** The name of the file listing the layers and values of an entry. It is written last.*/
+  const char* const IndexFileName = "entry.txt";
+
+  /** Part of every key, so entries of an older layout are never found.*/
+  const LayerCache::HashType FormatVersion = 1;
+
+  /** The bytes hashed by one task. The hashes of the blocks are combined in order, so the hash does not depend
+    * on the number of cores.*/
+  const size_t HashBlockSize = 1 << 20;
+
+  std::atomic<unsigned int> NextWriterId(0);
+
+  /** Four independent lanes of 8 bytes, so the multiplications of consecutive words overlap.*/
+  uint64_t HashBlock(const unsigned char* const data, const size_t numberOfBytes, const uint64_t seed)
+  {
+    uint64_t lanes[4] = {seed, seed + 1, seed + 2, seed + 3};
+    size_t offset = 0;
+    for(; offset + 32 <= numberOfBytes; offset += 32)
+    {
+      uint64_t words[4];
+      memcpy(words, data + offset, sizeof(words));
+      lanes[0] = Hash64::Mix(lanes[0], words[0]);
+      lanes[1] = Hash64::Mix(lanes[1], words[1]);
+      lanes[2] = Hash64::Mix(lanes[2], words[2]);
+      lanes[3] = Hash64::Mix(lanes[3], words[3]);
+    }
+
+    uint64_t tail[4] = {0, 0, 0, 0};
+    memcpy(tail, data + offset, numberOfBytes - offset);
+    uint64_t hash = numberOfBytes;
+    for(unsigned int lane = 0; lane < 4; ++lane)
+    {
+      hash = Hash64::Mix(hash, Hash64::Mix(lanes[lane], tail[lane]));
+    }
+    return hash;
+  }
+
+  /** Create the parents of 'directory'. Returns false if that failed.*/
+  bool CreateParentDirectories(const std::string& directory)
+  {
+    for(size_t slash = directory.find('/', 1); slash != std::string::npos; slash = directory.find('/', slash + 1))
+    {
+      const std::string parent = directory.substr(0, slash);
+      if(mkdir(parent.c_str(), 0700) != 0 && errno != EEXIST)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Remove 'directory' and the files in it (entries have no subdirectories).*/
+  void RemoveDirectory(const std::string& directory)
+  {
+    if(DIR* handle = opendir(directory.c_str()))
+    {
+      while(dirent* entry = readdir(handle))
+      {
+        const std::string name = entry->d_name;
+        if(name != "." && name != "..")
+        {
+          unlink((directory + "/" + name).c_str());
+        }
+      }
+      closedir(handle);
+    }
+    rmdir(directory.c_str());
+  }
+
+  bool WriteAll(const int fileDescriptor, const char* data, size_t numberOfBytes, off_t offset)
+  {
+    while(numberOfBytes > 0)
+    {
+      const ssize_t written = pwrite(fileDescriptor, data, numberOfBytes, offset);
+      if(written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if(written <= 0)
+      {
+        return false;
+      }
+      data += written;
+      numberOfBytes -= static_cast<size_t>(written);
+      offset += written;
+    }
+    return true;
+  }
+}
+
+std::string LayerCache::GetDefaultDirectory()
+{
+  const char* cacheHome = getenv("XDG_CACHE_HOME");
+  if(cacheHome && cacheHome[0] == '/')
+  {
+    return std::string(cacheHome) + "/NNFieldInspector";
+  }
+
+  const char* home = getenv("HOME");
+  if(home && home[0] == '/')
+  {
+    return std::string(home) + "/.cache/NNFieldInspector";
+  }
+
+  std::stringstream ss;
+  ss << "/tmp/NNFieldInspector-cache-" << getuid();
+  return ss.str();
+}
+
+LayerCache::LayerCache(const std::string& directory, const unsigned long long maximumBytes) :
+  Directory(directory), MaximumBytes(maximumBytes)
+{
+}
+
+LayerCache::HashType LayerCache::Hash(const void* const data, const size_t numberOfBytes,
+                                      const std::atomic<bool>& cancel)
+{
+  const unsigned char* const bytes = static_cast<const unsigned char*>(data);
+  const size_t numberOfBlocks = (numberOfBytes + HashBlockSize - 1) / HashBlockSize;
+  std::vector<uint64_t> blockHashes(numberOfBlocks);
+
+  Parallel::ForChunks(0, numberOfBlocks, [&](const size_t begin, const size_t end, const unsigned int)
+    {
+    for(size_t block = begin; block < end && !cancel; ++block)
+    {
+      const size_t offset = block * HashBlockSize;
+      blockHashes[block] = HashBlock(bytes + offset, std::min(HashBlockSize, numberOfBytes - offset), block);
+    }
+    });
+
+  uint64_t hash = Hash64::Mix(FormatVersion, numberOfBytes);
+  for(size_t block = 0; block < numberOfBlocks; ++block)
+  {
+    hash = Hash64::Mix(hash, blockHashes[block]);
+  }
+  return Hash64::Finalize(hash);
+}
+
+LayerCache::HashType LayerCache::Hash(const NNFieldTypes::NNFieldImageType* const nnField,
+                                      const std::atomic<bool>& cancel)
+{
+  const itk::Size<2> size = nnField->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  const size_t numberOfBytes = static_cast<size_t>(size[0]) * size[1] * numberOfComponents * sizeof(float);
+
+  uint64_t hash = Hash64::Mix(Hash64::Mix(Hash64::Mix(0, size[0]), size[1]), numberOfComponents);
+  return Hash64::Finalize(Hash64::Mix(hash, Hash(nnField->GetBufferPointer(), numberOfBytes, cancel)));
+}
+
+LayerCache::HashType LayerCache::Hash(const NNFieldTypes::ImageType* const image, const std::atomic<bool>& cancel)
+{
+  const itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const size_t numberOfBytes = static_cast<size_t>(size[0]) * size[1] * sizeof(NNFieldTypes::ImageType::PixelType);
+
+  uint64_t hash = Hash64::Mix(Hash64::Mix(0, size[0]), size[1]);
+  return Hash64::Finalize(Hash64::Mix(hash, Hash(image->GetBufferPointer(), numberOfBytes, cancel)));
+}
+
+std::string LayerCache::MakeKey(const std::string& kind, const std::vector<HashType>& parts)
+{
+  uint64_t hash = FormatVersion;
+  for(size_t partId = 0; partId < parts.size(); ++partId)
+  {
+    hash = Hash64::Mix(hash, parts[partId]);
+  }
+
+  std::stringstream ss;
+  ss << kind << "-" << std::hex << std::setw(16) << std::setfill('0') << Hash64::Finalize(hash);
+  return ss.str();
+}
+
+LayerCache::FloatImageType* LayerCache::Entry::GetLayer(const std::string& name) const
+{
+  std::map<std::string, FloatImageType::Pointer>::const_iterator iterator = this->Layers.find(name);
+  return (iterator == this->Layers.end()) ? NULL : iterator->second.GetPointer();
+}
+
+float LayerCache::Entry::GetValue(const std::string& name, const float defaultValue) const
+{
+  std::map<std::string, float>::const_iterator iterator = this->Values.find(name);
+  return (iterator == this->Values.end()) ? defaultValue : iterator->second;
+}
+
+std::shared_ptr<LayerCache::Entry> LayerCache::Find(const std::string& key) const
+{
+  const std::string entryDirectory = this->Directory + "/" + key;
+  std::ifstream index((entryDirectory + "/" + IndexFileName).c_str());
+  if(!index || !PrivateDirectory::IsPrivate(this->Directory))
+  {
+    return std::shared_ptr<Entry>();
+  }
+
+  std::shared_ptr<Entry> entry(new Entry);
+  try
+  {
+    std::string kind;
+    std::string name;
+    while(index >> kind >> name)
+    {
+      if(kind == "layer")
+      {
+        std::shared_ptr<MappedMetaImage> mapping(new MappedMetaImage);
+        if(!mapping->Open(entryDirectory + "/" + name + ".mha") || mapping->GetImage()->GetNumberOfComponentsPerPixel() != 1)
+        {
+          throw std::runtime_error("LayerCache: the layer " + name + " of " + key + " cannot be mapped!");
+        }
+
+        // An image that views the mapped pixels, like the layers that are computed.
+        MappedMetaImage::ImageType* const mappedImage = mapping->GetImage();
+        FloatImageType::Pointer layer = FloatImageType::New();
+        layer->SetRegions(mappedImage->GetLargestPossibleRegion());
+        layer->GetPixelContainer()->SetImportPointer(mappedImage->GetBufferPointer(),
+                                                     mappedImage->GetLargestPossibleRegion().GetNumberOfPixels(), false);
+        entry->Mappings[name] = mapping;
+        entry->Layers[name] = layer;
+      }
+      else if(kind == "value")
+      {
+        float value = 0.0f;
+        if(!(index >> value))
+        {
+          throw std::runtime_error("LayerCache: the value " + name + " of " + key + " is not a number!");
+        }
+        entry->Values[name] = value;
+      }
+    }
+  }
+  catch(std::runtime_error& exception)
+  {
+    // A damaged entry would never be replaced otherwise.
+    std::cerr << exception.what() << " It is removed from the cache." << std::endl;
+    RemoveDirectory(entryDirectory);
+    return std::shared_ptr<Entry>();
+  }
+
+  // The modification time of the directory is when the entry was used last, see Trim().
+  utimes(entryDirectory.c_str(), NULL);
+
+  return entry;
+}
+
+void LayerCache::Trim(const unsigned long long maximumBytes) const
+{
+  struct EntryUsage
+  {
+    std::string Directory;
+    /** In nanoseconds, entries are often used within the same second.*/
+    long long LastUsed;
+    unsigned long long NumberOfBytes;
+
+    bool operator<(const EntryUsage& other) const
+    {
+      return this->LastUsed < other.LastUsed;
+    }
+  };
+
+  if(!PrivateDirectory::IsPrivate(this->Directory))
+  {
+    return;
+  }
+
+  std::vector<EntryUsage> entries;
+  unsigned long long totalBytes = 0;
+
+  DIR* handle = opendir(this->Directory.c_str());
+  if(!handle)
+  {
+    return;
+  }
+  while(dirent* directoryEntry = readdir(handle))
+  {
+    const std::string name = directoryEntry->d_name;
+    // Entries that are being written are not touched.
+    if(name == "." || name == ".." || name.find(".tmp") != std::string::npos)
+    {
+      continue;
+    }
+
+    EntryUsage usage;
+    usage.Directory = this->Directory + "/" + name;
+    struct stat status;
+    if(stat(usage.Directory.c_str(), &status) != 0 || !S_ISDIR(status.st_mode))
+    {
+      continue;
+    }
+    usage.LastUsed = static_cast<long long>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+    usage.NumberOfBytes = 0;
+
+    if(DIR* entryHandle = opendir(usage.Directory.c_str()))
+    {
+      while(dirent* file = readdir(entryHandle))
+      {
+        struct stat fileStatus;
+        if(stat((usage.Directory + "/" + file->d_name).c_str(), &fileStatus) == 0 && S_ISREG(fileStatus.st_mode))
+        {
+          usage.NumberOfBytes += static_cast<unsigned long long>(fileStatus.st_size);
+        }
+      }
+      closedir(entryHandle);
+    }
+
+    totalBytes += usage.NumberOfBytes;
+    entries.push_back(usage);
+  }
+  closedir(handle);
+
+  std::sort(entries.begin(), entries.end());
+  for(size_t entryId = 0; entryId < entries.size() && totalBytes > maximumBytes; ++entryId)
+  {
+    // Entries that are mapped by an inspector stay readable until it unmaps them.
+    RemoveDirectory(entries[entryId].Directory);
+    totalBytes -= entries[entryId].NumberOfBytes;
+  }
+}
+
+LayerCache::Writer::Writer(const LayerCache& cache, const std::string& key, const std::vector<std::string>& layerNames,
+                           const itk::Size<2>& size) :
+  Cache(cache), Key(key), LayerNames(layerNames), Size(size), Failed(false)
+{
+  if(!CreateParentDirectories(cache.Directory))
+  {
+    throw std::runtime_error("LayerCache: could not create " + cache.Directory + ": " + strerror(errno));
+  }
+  // Another user could otherwise plant entries, or have Trim() remove the directories of a directory it links to.
+  try
+  {
+    PrivateDirectory::Create(cache.Directory);
+  }
+  catch(std::runtime_error& exception)
+  {
+    throw std::runtime_error(std::string("LayerCache: ") + exception.what());
+  }
+
+  std::stringstream ssTemporary;
+  ssTemporary << cache.Directory << "/" << key << ".tmp." << getpid() << "." << NextWriterId++;
+  this->TemporaryDirectory = ssTemporary.str();
+  if(mkdir(this->TemporaryDirectory.c_str(), 0700) != 0)
+  {
+    throw std::runtime_error("LayerCache: could not create " + this->TemporaryDirectory + ": " + strerror(errno));
+  }
+
+  const double spacing[2] = {1.0, 1.0};
+  const double origin[2] = {0.0, 0.0};
+  const std::string header = MappedMetaImage::CreateHeader(size, 1, spacing, origin, "NNFieldInspector layer cache");
+  const off_t dataLength = static_cast<off_t>(size[0]) * size[1] * sizeof(float);
+  for(size_t layerId = 0; layerId < layerNames.size(); ++layerId)
+  {
+    const std::string fileName = this->TemporaryDirectory + "/" + layerNames[layerId] + ".mha";
+    const int fileDescriptor = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fileDescriptor < 0)
+    {
+      const std::string error = strerror(errno);
+      Discard();
+      throw std::runtime_error("LayerCache: could not create " + fileName + ": " + error);
+    }
+    this->FileDescriptors.push_back(fileDescriptor);
+    this->HeaderLengths.push_back(header.size());
+
+    // The rows arrive in any order, so the file gets its final length first.
+    if(!WriteAll(fileDescriptor, header.c_str(), header.size(), 0) ||
+       ftruncate(fileDescriptor, static_cast<off_t>(header.size()) + dataLength) != 0)
+    {
+      const std::string error = strerror(errno);
+      Discard();
+      throw std::runtime_error("LayerCache: could not write " + fileName + ": " + error);
+    }
+  }
+}
+
+LayerCache::Writer::~Writer()
+{
+  Discard();
+}
+
+void LayerCache::Writer::WriteRows(const unsigned int layerId, const unsigned int firstRow, const float* const rows,
+                                   const unsigned int numberOfRows)
+{
+  if(this->Failed || layerId >= this->FileDescriptors.size() || firstRow + numberOfRows > this->Size[1])
+  {
+    this->Failed = true;
+    return;
+  }
+
+  const size_t rowBytes = this->Size[0] * sizeof(float);
+  const off_t offset = static_cast<off_t>(this->HeaderLengths[layerId] + firstRow * rowBytes);
+  if(!WriteAll(this->FileDescriptors[layerId], reinterpret_cast<const char*>(rows), numberOfRows * rowBytes, offset))
+  {
+    this->Failed = true;
+  }
+}
+
+void LayerCache::Writer::SetValue(const std::string& name, const float value)
+{
+  this->Values[name] = value;
+}
+
+bool LayerCache::Writer::Commit()
+{
+  if(this->Failed || this->TemporaryDirectory.empty())
+  {
+    Discard();
+    return false;
+  }
+
+  for(size_t layerId = 0; layerId < this->FileDescriptors.size(); ++layerId)
+  {
+    if(close(this->FileDescriptors[layerId]) != 0)
+    {
+      this->Failed = true;
+    }
+  }
+  this->FileDescriptors.clear();
+
+  // The index is written last, an entry without it is never found.
+  {
+    std::ofstream index((this->TemporaryDirectory + "/" + IndexFileName).c_str());
+    index << std::setprecision(9);
+    for(size_t layerId = 0; layerId < this->LayerNames.size(); ++layerId)
+    {
+      index << "layer " << this->LayerNames[layerId] << "\n";
+    }
+    for(std::map<std::string, float>::const_iterator iterator = this->Values.begin(); iterator != this->Values.end(); ++iterator)
+    {
+      index << "value " << iterator->first << " " << iterator->second << "\n";
+    }
+    if(!index)
+    {
+      this->Failed = true;
+    }
+  }
+
+  // Renaming a directory onto an existing entry fails, so an entry another writer added first is kept.
+  if(this->Failed || rename(this->TemporaryDirectory.c_str(), (this->Cache.Directory + "/" + this->Key).c_str()) != 0)
+  {
+    Discard();
+    return false;
+  }
+  this->TemporaryDirectory.clear();
+
+  this->Cache.Trim(this->Cache.MaximumBytes);
+  return true;
+}
+
+void LayerCache::Writer::Discard()
+{
+  for(size_t layerId = 0; layerId < this->FileDescriptors.size(); ++layerId)
+  {
+    close(this->FileDescriptors[layerId]);
+  }
+  this->FileDescriptors.clear();
+
+  if(!this->TemporaryDirectory.empty())
+  {
+    RemoveDirectory(this->TemporaryDirectory);
+    this->TemporaryDirectory.clear();
+  }
+}
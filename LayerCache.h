@@ -0,0 +1,140 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LayerCache_H
+#define LayerCache_H
+
+// STL
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Custom
+#include "MappedMetaImage.h"
+#include "NNFieldTypes.h"
+
+/** A cache on disk of the layers derived from images and fields (e.g. the magnitude of the offsets or the match
+  * error), so reopening a field that was inspected before shows them without computing them again.
+  *
+  * An entry is found by a key made from a content hash of its inputs and the parameters the layers depend on, so
+  * it does not matter where the inputs were read from. It is a directory holding one uncompressed float
+  * MetaImage per layer and a text file with the layer names and scalar values (such as the ranges of the layers).
+  * The layers of an entry that is found are memory mapped, so only the pages that are displayed are read.
+  *
+  * Entries are written to a temporary directory that is renamed when it is complete, so several inspectors can
+  * share a cache and an entry is never seen half written. When the cache grows beyond its limit, the entries
+  * that were used least recently are removed. This does not depend on Qt, so it can be used on worker threads.
+  */
+class LayerCache
+{
+public:
+  typedef unsigned long long HashType;
+  typedef NNFieldTypes::FloatImageType FloatImageType;
+
+  /** $XDG_CACHE_HOME/NNFieldInspector, or ~/.cache/NNFieldInspector if it is not set. The directory is only used
+    * if it is private to this user (see PrivateDirectory.h), which matters for the /tmp fallback without a home.*/
+  static std::string GetDefaultDirectory();
+
+  /** A cache in 'directory', which is created when the first entry is written. It is trimmed to
+    * 'maximumBytes' after every entry that is written.*/
+  LayerCache(const std::string& directory, const unsigned long long maximumBytes);
+
+  /** A hash of 'numberOfBytes' bytes, computed on all cores. 'cancel' is checked between blocks of 1 MB; the hash
+    * is meaningless if it was set.*/
+  static HashType Hash(const void* const data, const size_t numberOfBytes, const std::atomic<bool>& cancel);
+
+  /** A hash of the size, the number of channels and the pixels of 'nnField' or 'image'.*/
+  static HashType Hash(const NNFieldTypes::NNFieldImageType* const nnField, const std::atomic<bool>& cancel);
+  static HashType Hash(const NNFieldTypes::ImageType* const image, const std::atomic<bool>& cancel);
+
+  /** The key of the entry of the layers 'kind' (a name without '/') derived from inputs with the hashes and
+    * parameters 'parts'.*/
+  static std::string MakeKey(const std::string& kind, const std::vector<HashType>& parts);
+
+  /** The layers and values of an entry that was found. The layers view the mapped files, so they must not be used
+    * after the entry is destroyed.*/
+  class Entry
+  {
+  public:
+    /** The layer 'name', or NULL if the entry has none.*/
+    FloatImageType* GetLayer(const std::string& name) const;
+
+    /** The value 'name', or 'defaultValue' if the entry has none.*/
+    float GetValue(const std::string& name, const float defaultValue) const;
+
+  private:
+    friend class LayerCache;
+
+    std::map<std::string, std::shared_ptr<MappedMetaImage> > Mappings;
+    std::map<std::string, FloatImageType::Pointer> Layers;
+    std::map<std::string, float> Values;
+  };
+
+  /** The entry 'key', or NULL if it is not cached. An entry that cannot be read is removed.*/
+  std::shared_ptr<Entry> Find(const std::string& key) const;
+
+  /** Writes an entry while its layers are computed, a band of rows at a time. The entry is only added to the cache
+    * by Commit(), an entry that is destroyed before is discarded.*/
+  class Writer
+  {
+  public:
+    /** Start writing the entry 'key' of 'cache' with the layers 'layerNames' of 'size'. Throws if the files
+      * cannot be created.*/
+    Writer(const LayerCache& cache, const std::string& key, const std::vector<std::string>& layerNames,
+           const itk::Size<2>& size);
+    ~Writer();
+
+    /** Write 'numberOfRows' rows of layer 'layerId' starting at 'firstRow'. A failure is remembered, so the entry
+      * is discarded by Commit().*/
+    void WriteRows(const unsigned int layerId, const unsigned int firstRow, const float* const rows,
+                   const unsigned int numberOfRows);
+
+    void SetValue(const std::string& name, const float value);
+
+    /** Add the entry to the cache. Returns false if writing failed or another writer added the entry first.*/
+    bool Commit();
+
+  private:
+    Writer(const Writer&);
+    void operator=(const Writer&);
+
+    /** Close the files and remove the temporary directory, if it is still there.*/
+    void Discard();
+
+    const LayerCache& Cache;
+    std::string Key;
+    std::string TemporaryDirectory;
+    std::vector<std::string> LayerNames;
+    std::vector<int> FileDescriptors;
+    std::vector<size_t> HeaderLengths;
+    itk::Size<2> Size;
+    std::map<std::string, float> Values;
+    bool Failed;
+  };
+
+  /** Remove the entries that were used least recently until the cache takes at most 'maximumBytes'.*/
+  void Trim(const unsigned long long maximumBytes) const;
+
+private:
+  std::string Directory;
+  unsigned long long MaximumBytes;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "LayerImport.h"
+
+// STL
+#include <stdexcept>
+
+// VTK
+#include <vtkFloatArray.h>
+#include <vtkImageData.h>
+#include <vtkImageProperty.h>
+#include <vtkImageSlice.h>
+#include <vtkLookupTable.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+#include <vtkUnsignedCharArray.h>
+
+namespace LayerImport
+{
+
+// The RGB buffer is handed to VTK as a packed array of bytes, which requires the pixel type to have no padding.
+static_assert(sizeof(RGBImageType::PixelType) == 3, "RGB pixels must be tightly packed to be shared with VTK.");
+
+void WrapRGBImage(RGBImageType* const image, Layer& layer)
+{
+  itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(size[0]) * static_cast<vtkIdType>(size[1]);
+
+  vtkSmartPointer<vtkUnsignedCharArray> array = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  array->SetNumberOfComponents(3);
+  // The last argument (1) tells VTK that it does not own the memory, so it will never free it.
+  array->SetArray(reinterpret_cast<unsigned char*>(image->GetBufferPointer()), numberOfPixels * 3, 1);
+
+  layer.ImageData->SetDimensions(size[0], size[1], 1);
+  layer.ImageData->GetPointData()->SetScalars(array);
+  layer.ImageData->Modified();
+}
+
+void WrapVectorImageChannel(FloatVectorImageType* const image, const unsigned int channel, Layer& layer)
+{
+  const unsigned int numberOfComponents = image->GetNumberOfComponentsPerPixel();
+  if(channel >= numberOfComponents)
+  {
+    throw std::runtime_error("WrapVectorImageChannel: channel is out of range!");
+  }
+
+  itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(size[0]) * static_cast<vtkIdType>(size[1]);
+
+  vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+  array->SetNumberOfComponents(numberOfComponents);
+  // The last argument (1) tells VTK that it does not own the memory, so it will never free it.
+  array->SetArray(image->GetBufferPointer(), numberOfPixels * numberOfComponents, 1);
+
+  layer.ImageData->SetDimensions(size[0], size[1], 1);
+  layer.ImageData->GetPointData()->SetScalars(array);
+  layer.ImageData->Modified();
+
+  SetGrayscaleLookupTable(layer, 0.0f, 1.0f, channel);
+}
+
+void WrapFloatImage(FloatImageType* const image, Layer& layer)
+{
+  itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(size[0]) * static_cast<vtkIdType>(size[1]);
+
+  vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+  array->SetNumberOfComponents(1);
+  // The last argument (1) tells VTK that it does not own the memory, so it will never free it.
+  array->SetArray(image->GetBufferPointer(), numberOfPixels, 1);
+
+  layer.ImageData->SetDimensions(size[0], size[1], 1);
+  layer.ImageData->GetPointData()->SetScalars(array);
+  layer.ImageData->Modified();
+
+  SetGrayscaleLookupTable(layer, 0.0f, 1.0f);
+}
+
+void SetGrayscaleLookupTable(Layer& layer, const float minValue, const float maxValue,
+                             const unsigned int component)
+{
+  vtkSmartPointer<vtkLookupTable> lookupTable = vtkSmartPointer<vtkLookupTable>::New();
+  lookupTable->SetRange(minValue, maxValue);
+  lookupTable->SetHueRange(0, 0);
+  lookupTable->SetSaturationRange(0, 0);
+  lookupTable->SetValueRange(0, 1);
+  lookupTable->SetVectorModeToComponent();
+  lookupTable->SetVectorComponent(component);
+  lookupTable->Build();
+
+  layer.ImageSlice->GetProperty()->SetLookupTable(lookupTable);
+  layer.ImageSlice->GetProperty()->UseLookupTableScalarRangeOn();
+}
+
+void SetHeatMapLookupTable(Layer& layer, const float minValue, const float maxValue)
+{
+  vtkSmartPointer<vtkLookupTable> lookupTable = vtkSmartPointer<vtkLookupTable>::New();
+  lookupTable->SetRange(minValue, maxValue);
+  lookupTable->SetHueRange(0.667, 0.0);
+  lookupTable->SetSaturationRange(1, 1);
+  lookupTable->SetValueRange(1, 1);
+  lookupTable->Build();
+
+  layer.ImageSlice->GetProperty()->SetLookupTable(lookupTable);
+  layer.ImageSlice->GetProperty()->UseLookupTableScalarRangeOn();
+}
+
+} // end namespace
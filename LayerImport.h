@@ -0,0 +1,57 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LayerImport_H
+#define LayerImport_H
+
+// Custom
+#include "NNFieldTypes.h"
+
+// Submodules
+#include "Layer/Layer.h"
+
+/** Functions to display ITK images in a Layer without copying their pixel buffers.
+  * The vtkImageData of the layer references the ITK buffer directly, so the ITK image
+  * must be kept alive for as long as the layer displays it.
+  */
+namespace LayerImport
+{
+  typedef NNFieldTypes::ImageType RGBImageType;
+  typedef NNFieldTypes::NNFieldImageType FloatVectorImageType;
+  typedef NNFieldTypes::FloatImageType FloatImageType;
+
+  /** Make the layer display 'image' by referencing its RGB buffer.*/
+  void WrapRGBImage(RGBImageType* const image, Layer& layer);
+
+  /** Make the layer display one channel of 'image'. The layer references the whole interleaved
+    * buffer and a lookup table in component mode selects 'channel', so no copy is made.
+    * The lookup table initially spans [0, 1], use SetGrayscaleLookupTable once the range of the channel is known.*/
+  void WrapVectorImageChannel(FloatVectorImageType* const image, const unsigned int channel, Layer& layer);
+
+  /** Make the layer display 'image' by referencing its buffer. The lookup table initially spans [0, 1].*/
+  void WrapFloatImage(FloatImageType* const image, Layer& layer);
+
+  /** Display the scalars of the layer in grayscale from 'minValue' to 'maxValue', using 'component' of the scalars.*/
+  void SetGrayscaleLookupTable(Layer& layer, const float minValue, const float maxValue,
+                               const unsigned int component = 0);
+
+  /** Display the scalars of the layer from blue ('minValue') to red ('maxValue').*/
+  void SetHeatMapLookupTable(Layer& layer, const float minValue, const float maxValue);
+}
+
+#endif
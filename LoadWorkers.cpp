@@ -0,0 +1,424 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "LoadWorkers.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// ITK
+#include "itkCommand.h"
+#include "itkImageFileReader.h"
+
+// Custom
+#include "CompactNNField.h"
+#include "Parallel.h"
+#include "TiledNNField.h"
+
+namespace LoadWorkers
+{
+
+namespace
+{
+  /** The scratch rows of ComputeLayerRow.*/
+  struct LayerRowScratch
+  {
+    explicit LayerRowScratch(const unsigned int width) : MatchX(width), MatchY(width), OffsetX(width), OffsetY(width) {}
+
+    std::vector<float> MatchX;
+    std::vector<float> MatchY;
+    std::vector<float> OffsetX;
+    std::vector<float> OffsetY;
+  };
+
+  /** Compute the NNField layers of 'width' pixels of row 'y' starting at column 'firstX', whose channels are 'in'.
+    * 'matchX' and 'matchY' may be NULL if only the ranges of the match are needed. The ranges are extended by
+    * the values of these pixels.*/
+  void ComputeLayerRow(const float* const in, const unsigned int numberOfComponents, const unsigned int firstX,
+                       const unsigned int width, const unsigned int y, const bool absolute, float* matchX, float* matchY,
+                       float* const magnitude, LayerRowScratch& scratch, float channelMin[2], float channelMax[2],
+                       float& magnitudeMax)
+  {
+    // The match is the offset plus the pixel. One of them is stored in channels 0 and 1, depending on the
+    // interpretation. The rows are converted without branches, so the compiler can vectorize the loops.
+    const float matchStep = absolute ? 0.0f : 1.0f;
+    const float offsetStep = absolute ? 1.0f : 0.0f;
+    if(!matchX)
+    {
+      matchX = &scratch.MatchX[0];
+      matchY = &scratch.MatchY[0];
+    }
+    float* const offsetX = &scratch.OffsetX[0];
+    float* const offsetY = &scratch.OffsetY[0];
+
+    const float rowY = static_cast<float>(y);
+    for(unsigned int x = 0; x < width; ++x)
+    {
+      const float channelX = in[x * numberOfComponents];
+      const float channelY = in[x * numberOfComponents + 1];
+      const float pixelX = static_cast<float>(firstX + x);
+      matchX[x] = channelX + matchStep * pixelX;
+      matchY[x] = channelY + matchStep * rowY;
+      offsetX[x] = channelX - offsetStep * pixelX;
+      offsetY[x] = channelY - offsetStep * rowY;
+    }
+
+    for(unsigned int x = 0; x < width; ++x)
+    {
+      magnitude[x] = std::sqrt(offsetX[x] * offsetX[x] + offsetY[x] * offsetY[x]);
+      channelMin[0] = std::min(channelMin[0], matchX[x]);
+      channelMax[0] = std::max(channelMax[0], matchX[x]);
+      channelMin[1] = std::min(channelMin[1], matchY[x]);
+      channelMax[1] = std::max(channelMax[1], matchY[x]);
+      magnitudeMax = std::max(magnitudeMax, magnitude[x]);
+    }
+  }
+
+  /** The state shared with ObserveProgress.*/
+  struct ProgressObserverData
+  {
+    itk::ProcessObject* Process;
+    const std::atomic<bool>* Cancel;
+    const ProgressCallback* Progress;
+    int LastPercent;
+  };
+
+  /** Forward the progress of an ITK filter, and ask it to abort if loading was cancelled.*/
+  void ObserveProgress(itk::Object* caller, const itk::EventObject& event, void* clientData)
+  {
+    ProgressObserverData* data = static_cast<ProgressObserverData*>(clientData);
+
+    if(*data->Cancel)
+    {
+      data->Process->AbortGenerateDataOn();
+      return;
+    }
+
+    const int percent = static_cast<int>(100.0f * data->Process->GetProgress());
+    if(percent != data->LastPercent)
+    {
+      data->LastPercent = percent;
+      (*data->Progress)(percent);
+    }
+  }
+
+  /** Read a file with itk::ImageFileReader, reporting progress and honoring 'cancel'.*/
+  template <typename TImage>
+  typename TImage::Pointer Read(const std::string& fileName, const std::atomic<bool>& cancel,
+                                const ProgressCallback& progress)
+  {
+    typedef itk::ImageFileReader<TImage> ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fileName);
+
+    ProgressObserverData observerData;
+    observerData.Process = reader.GetPointer();
+    observerData.Cancel = &cancel;
+    observerData.Progress = &progress;
+    observerData.LastPercent = -1;
+
+    itk::CStyleCommand::Pointer progressCommand = itk::CStyleCommand::New();
+    progressCommand->SetCallback(ObserveProgress);
+    progressCommand->SetClientData(&observerData);
+    reader->AddObserver(itk::ProgressEvent(), progressCommand);
+
+    reader->Update();
+
+    // Keep the reader's buffer instead of copying it.
+    typename TImage::Pointer image = reader->GetOutput();
+    image->DisconnectPipeline();
+    return image;
+  }
+}
+
+ImageResult ReadImage(const std::string& fileName, const std::atomic<bool>& cancel,
+                      const ProgressCallback& progress, const bool map)
+{
+  ImageResult result;
+
+  try
+  {
+    std::shared_ptr<MappedMetaImage> mapping(new MappedMetaImage);
+    if(map && mapping->OpenRGB(fileName))
+    {
+      result.Image = mapping->GetRGBImage();
+      result.Mapping = mapping;
+    }
+    else
+    {
+      result.Image = Read<NNFieldTypes::ImageType>(fileName, cancel, progress);
+    }
+  }
+  catch(itk::ExceptionObject& exception)
+  {
+    // Aborting a filter is reported as an exception.
+    result.Error = exception.GetDescription();
+  }
+  catch(std::exception& exception)
+  {
+    // Also std::bad_alloc and std::length_error, e.g. from the sizes in a damaged header. Nothing may escape a worker.
+    result.Error = exception.what();
+  }
+
+  if(cancel)
+  {
+    result.Cancelled = true;
+    result.Error.clear();
+    result.Image = NULL;
+    result.Mapping.reset();
+  }
+
+  progress(100);
+
+  return result;
+}
+
+NNFieldResult ReadNNField(const std::string& fileName, const std::atomic<bool>& cancel,
+                          const ProgressCallback& progress, const bool map, const size_t tileCacheBytes)
+{
+  NNFieldResult result;
+
+  try
+  {
+    // Uncompressed MetaImages are mapped and tiled fields are opened, so nothing is read until it is used.
+    std::shared_ptr<MappedMetaImage> mapping(new MappedMetaImage);
+    if(TiledNNField::IsTiledFileName(fileName))
+    {
+      std::shared_ptr<TiledNNField> tiles(new TiledNNField(tileCacheBytes));
+      tiles->Open(fileName);
+      result.Store = tiles;
+    }
+    else if(CompactNNField::IsCompactFileName(fileName))
+    {
+      // Decoding is left to the users of the field, which only decode the pixels they need.
+      std::shared_ptr<CompactNNField> compact(new CompactNNField);
+      compact->Read(fileName);
+      result.Store = compact;
+    }
+    else if(map && mapping->Open(fileName))
+    {
+      result.NNField = mapping->GetImage();
+      result.Mapping = mapping;
+    }
+    else
+    {
+      result.NNField = Read<NNFieldTypes::NNFieldImageType>(fileName, cancel, progress);
+    }
+
+    if(result.NNField && result.NNField->GetNumberOfComponentsPerPixel() < 2)
+    {
+      result.Error = "The NNField must have at least two channels!";
+    }
+  }
+  catch(itk::ExceptionObject& exception)
+  {
+    // Aborting a filter is reported as an exception.
+    result.Error = exception.GetDescription();
+  }
+  catch(std::exception& exception)
+  {
+    // Also std::bad_alloc and std::length_error, e.g. from the sizes in a damaged header. Nothing may escape a worker.
+    result.Error = exception.what();
+  }
+
+  if(cancel)
+  {
+    result.Cancelled = true;
+    result.Error.clear();
+  }
+
+  if(result.Cancelled || !result.Error.empty())
+  {
+    // The image must be released before the mapping it views.
+    result.NNField = NULL;
+    result.Mapping.reset();
+    result.Store.reset();
+  }
+
+  progress(100);
+
+  return result;
+}
+
+NNFieldTypes::NNFieldImageType::Pointer ReadNNFieldStore(NNFieldStore* const store, const std::atomic<bool>& cancel)
+{
+  const itk::ImageRegion<2> region = store->GetRegion();
+  const unsigned int numberOfComponents = store->GetNumberOfComponents();
+
+  NNFieldTypes::NNFieldImageType::Pointer nnField = NNFieldTypes::NNFieldImageType::New();
+  nnField->SetRegions(region);
+  nnField->SetNumberOfComponentsPerPixel(numberOfComponents);
+  nnField->Allocate();
+
+  // Bands of rows are read on all cores. The threads must not throw, so they keep the first error.
+  const unsigned int rowsPerBand = 64;
+  const size_t rowStride = static_cast<size_t>(region.GetSize()[0]) * numberOfComponents;
+  const size_t numberOfBands = (region.GetSize()[1] + rowsPerBand - 1) / rowsPerBand;
+  std::vector<std::string> threadErrors(Parallel::GetNumberOfThreads());
+  Parallel::ForChunks(0, numberOfBands, [&](const size_t firstBand, const size_t lastBand, const unsigned int threadId)
+    {
+    for(size_t band = firstBand; band < lastBand && !cancel && threadErrors[threadId].empty(); ++band)
+    {
+      itk::Index<2> bandIndex = region.GetIndex();
+      bandIndex[1] += band * rowsPerBand;
+      itk::Size<2> bandSize = region.GetSize();
+      bandSize[1] = std::min<size_t>(rowsPerBand, bandSize[1] - band * rowsPerBand);
+      const itk::ImageRegion<2> bandRegion(bandIndex, bandSize);
+      try
+      {
+        store->ReadRegion(bandRegion, nnField->GetBufferPointer() + band * rowsPerBand * rowStride, rowStride);
+      }
+      catch(std::exception& exception)
+      {
+        // Nothing may escape a thread, which would terminate the program.
+        threadErrors[threadId] = exception.what();
+      }
+    }
+    });
+
+  for(unsigned int threadId = 0; threadId < threadErrors.size(); ++threadId)
+  {
+    if(!threadErrors[threadId].empty())
+    {
+      throw std::runtime_error(threadErrors[threadId]);
+    }
+  }
+
+  if(cancel)
+  {
+    return NULL;
+  }
+  return nnField;
+}
+
+void ComputeNNFieldLayerBands(const NNFieldTypes::NNFieldImageType* const nnField,
+                              const NNFieldTypes::INTERPRETATION_ENUM interpretation, const unsigned int generation,
+                              const unsigned int rowsPerBand, const std::atomic<bool>& cancel,
+                              const BandCallback& deliver)
+{
+  const itk::Size<2> size = nnField->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  const float* const buffer = nnField->GetBufferPointer();
+  const bool absolute = (interpretation == NNFieldTypes::ABSOLUTE);
+
+  // One band per core is computed at a time, and the bands are delivered in order once they are all done.
+  const unsigned int numberOfBands = (size[1] + rowsPerBand - 1) / rowsPerBand;
+  std::vector<NNFieldLayerBand> bands;
+  for(unsigned int firstBand = 0; firstBand < numberOfBands && !cancel; firstBand += Parallel::GetNumberOfThreads())
+  {
+    bands.assign(std::min(Parallel::GetNumberOfThreads(), numberOfBands - firstBand), NNFieldLayerBand());
+    Parallel::For(0, bands.size(), [&](const size_t bandId)
+      {
+      NNFieldLayerBand& band = bands[bandId];
+      band.Generation = generation;
+      band.FirstRow = (firstBand + bandId) * rowsPerBand;
+      band.NumberOfRows = std::min<unsigned int>(rowsPerBand, size[1] - band.FirstRow);
+      const size_t numberOfPixels = static_cast<size_t>(band.NumberOfRows) * size[0];
+      band.Magnitude.resize(numberOfPixels);
+      if(!absolute)
+      {
+        band.X.resize(numberOfPixels);
+        band.Y.resize(numberOfPixels);
+      }
+
+      for(unsigned int channel = 0; channel < 2; ++channel)
+      {
+        band.ChannelMin[channel] = std::numeric_limits<float>::max();
+        band.ChannelMax[channel] = -std::numeric_limits<float>::max();
+      }
+
+      band.MagnitudeMax = 0.0f;
+
+      LayerRowScratch scratch(size[0]);
+      for(unsigned int row = 0; row < band.NumberOfRows; ++row)
+      {
+        const size_t rowOffset = static_cast<size_t>(row) * size[0];
+        const float* const in = buffer + (static_cast<size_t>(band.FirstRow) * size[0] + rowOffset) * numberOfComponents;
+        ComputeLayerRow(in, numberOfComponents, 0, size[0], band.FirstRow + row, absolute,
+                        absolute ? NULL : &band.X[rowOffset], absolute ? NULL : &band.Y[rowOffset],
+                        &band.Magnitude[rowOffset], scratch, band.ChannelMin, band.ChannelMax, band.MagnitudeMax);
+      }
+      });
+
+    for(size_t bandId = 0; bandId < bands.size() && !cancel; ++bandId)
+    {
+      deliver(bands[bandId]);
+    }
+  }
+}
+
+void UpdateNNFieldLayerTiles(const NNFieldTypes::NNFieldImageType* const nnField,
+                             const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+                             const std::vector<itk::ImageRegion<2> >& tiles, float* const magnitude,
+                             float* const matchX, float* const matchY, float channelMin[2], float channelMax[2],
+                             float& magnitudeMax)
+{
+  const itk::ImageRegion<2> region = nnField->GetLargestPossibleRegion();
+  const unsigned int width = region.GetSize()[0];
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  const float* const buffer = nnField->GetBufferPointer();
+  const bool absolute = (interpretation == NNFieldTypes::ABSOLUTE);
+
+  for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+  {
+    if(!region.IsInside(tiles[tileId]))
+    {
+      throw std::runtime_error("UpdateNNFieldLayerTiles: a tile is outside of the NNField!");
+    }
+  }
+
+  // The tiles do not overlap, so they are computed in parallel with ranges of their own.
+  std::vector<float> tileRanges(5 * tiles.size());
+  Parallel::For(0, tiles.size(), [&](const size_t tileId)
+    {
+    const itk::ImageRegion<2>& tile = tiles[tileId];
+    float* const ranges = &tileRanges[5 * tileId];
+    float* const tileMin = ranges;
+    float* const tileMax = ranges + 2;
+    tileMin[0] = tileMin[1] = std::numeric_limits<float>::max();
+    tileMax[0] = tileMax[1] = -std::numeric_limits<float>::max();
+    ranges[4] = 0.0f;
+
+    const unsigned int firstX = tile.GetIndex()[0] - region.GetIndex()[0];
+    const unsigned int firstY = tile.GetIndex()[1] - region.GetIndex()[1];
+    LayerRowScratch scratch(tile.GetSize()[0]);
+    for(unsigned int y = firstY; y < firstY + tile.GetSize()[1]; ++y)
+    {
+      const size_t pixelOffset = static_cast<size_t>(y) * width + firstX;
+      ComputeLayerRow(buffer + pixelOffset * numberOfComponents, numberOfComponents, firstX, tile.GetSize()[0], y,
+                      absolute, absolute ? NULL : matchX + pixelOffset, absolute ? NULL : matchY + pixelOffset,
+                      magnitude + pixelOffset, scratch, tileMin, tileMax, ranges[4]);
+    }
+    });
+
+  for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+  {
+    const float* const ranges = &tileRanges[5 * tileId];
+    for(unsigned int channel = 0; channel < 2; ++channel)
+    {
+      channelMin[channel] = std::min(channelMin[channel], ranges[channel]);
+      channelMax[channel] = std::max(channelMax[channel], ranges[2 + channel]);
+    }
+    magnitudeMax = std::max(magnitudeMax, ranges[4]);
+  }
+}
+
+} // end namespace
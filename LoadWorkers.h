@@ -0,0 +1,138 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LoadWorkers_H
+#define LoadWorkers_H
+
+// STL
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Custom
+#include "MappedMetaImage.h"
+#include "NNFieldStore.h"
+#include "NNFieldTypes.h"
+
+/** The parts of loading that run on worker threads. None of these functions touch Qt or VTK,
+  * they report through callbacks (which are called on the worker thread) and stop early when
+  * 'cancel' becomes true.
+  */
+namespace LoadWorkers
+{
+  /** Called with a percentage in [0, 100].*/
+  typedef std::function<void(int)> ProgressCallback;
+
+  struct ImageResult
+  {
+    ImageResult() : Cancelled(false) {}
+
+    NNFieldTypes::ImageType::Pointer Image;
+
+    /** Keeps the mapping alive if Image views a memory mapped file.*/
+    std::shared_ptr<MappedMetaImage> Mapping;
+
+    /** Whether loading stopped because it was cancelled.*/
+    bool Cancelled;
+
+    /** Non-empty if loading failed.*/
+    std::string Error;
+  };
+
+  struct NNFieldResult
+  {
+    NNFieldResult() : Cancelled(false) {}
+
+    NNFieldTypes::NNFieldImageType::Pointer NNField;
+
+    /** Keeps the mapping alive if NNField views a memory mapped file.*/
+    std::shared_ptr<MappedMetaImage> Mapping;
+
+    /** Set instead of NNField if the file is a tiled .nnt field (which is read tile by tile when it is used)
+      * or a compact .nnc field (which stays encoded in memory).*/
+    std::shared_ptr<NNFieldStore> Store;
+
+    /** Whether loading stopped because it was cancelled.*/
+    bool Cancelled;
+
+    /** Non-empty if loading failed.*/
+    std::string Error;
+  };
+
+  /** A band of rows of the NNField layers, computed on a worker thread and handed to the GUI.*/
+  struct NNFieldLayerBand
+  {
+    /** Identifies the NNField the band was computed from, so bands of a replaced field can be dropped.*/
+    unsigned int Generation;
+
+    unsigned int FirstRow;
+    unsigned int NumberOfRows;
+
+    /** The length of the offset from the pixel to its match, row major.*/
+    std::vector<float> Magnitude;
+
+    /** The x and y of the match in the image, row major. Empty for absolute fields, whose channels 0 and 1
+      * already are the match, so the layers can reference the field instead.*/
+    std::vector<float> X;
+    std::vector<float> Y;
+
+    /** The ranges of the x and y of the match and of the magnitude within this band.*/
+    float ChannelMin[2];
+    float ChannelMax[2];
+    float MagnitudeMax;
+  };
+
+  typedef std::function<void(const NNFieldLayerBand&)> BandCallback;
+
+  /** Read an RGB image. If 'map', an uncompressed MetaImage is memory mapped instead, so its pixels are only
+    * read from the file when they are used.*/
+  ImageResult ReadImage(const std::string& fileName, const std::atomic<bool>& cancel,
+                        const ProgressCallback& progress, const bool map = false);
+
+  /** Read (or memory map, if possible and 'map') a nearest neighbor field. A field that is not mapped is read into
+    * memory, which is needed if the file may be rewritten while the field is used. A tiled .nnt field is only opened,
+    * its tiles are read through a cache of 'tileCacheBytes' when they are used. A compact .nnc field is read but not
+    * decoded.*/
+  NNFieldResult ReadNNField(const std::string& fileName, const std::atomic<bool>& cancel,
+                            const ProgressCallback& progress, const bool map = true,
+                            const size_t tileCacheBytes = 256 * 1024 * 1024);
+
+  /** Decode all of 'store' into an NNFieldImageType on all cores, for the code that needs the field in memory.
+    * Throws if it cannot be read. Returns NULL if 'cancel' became true first.*/
+  NNFieldTypes::NNFieldImageType::Pointer ReadNNFieldStore(NNFieldStore* const store, const std::atomic<bool>& cancel);
+
+  /** Compute the NNField layers of 'nnField' interpreted as 'interpretation' in bands of 'rowsPerBand' rows.
+    * The bands are computed on all cores and passed to 'deliver' in order, as soon as they are done.*/
+  void ComputeNNFieldLayerBands(const NNFieldTypes::NNFieldImageType* const nnField,
+                                const NNFieldTypes::INTERPRETATION_ENUM interpretation, const unsigned int generation,
+                                const unsigned int rowsPerBand, const std::atomic<bool>& cancel,
+                                const BandCallback& deliver);
+
+  /** Recompute the NNField layers of the pixels of 'tiles' into the row major 'magnitude', 'matchX' and 'matchY'
+    * (which may be NULL for absolute fields, whose layers view the field), e.g. after these tiles of the field
+    * changed. The ranges are extended by the values of the tiles. The tiles must not overlap.*/
+  void UpdateNNFieldLayerTiles(const NNFieldTypes::NNFieldImageType* const nnField,
+                               const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+                               const std::vector<itk::ImageRegion<2> >& tiles, float* const magnitude,
+                               float* const matchX, float* const matchY, float channelMin[2], float channelMax[2],
+                               float& magnitudeMax);
+}
+
+#endif
@@ -0,0 +1,388 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MappedMetaImage.h"
+
+// STL
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  /** Remove leading and trailing whitespace (including the '\r' of files written on Windows).*/
+  std::string Trim(const std::string& s)
+  {
+    const std::string whitespace = " \t\r\n";
+    const size_t first = s.find_first_not_of(whitespace);
+    if(first == std::string::npos)
+    {
+      return "";
+    }
+    const size_t last = s.find_last_not_of(whitespace);
+    return s.substr(first, last - first + 1);
+  }
+
+  /** MetaImage booleans are written as True/False, but 1/0 also occur.*/
+  bool IsTrue(const std::string& value)
+  {
+    return value == "True" || value == "true" || value == "1";
+  }
+
+  /** The header of a MetaImage is a list of 'Key = Value' lines, terminated by the ElementDataFile line.*/
+  struct MetaImageHeader
+  {
+    std::map<std::string, std::string> Fields;
+
+    /** The byte offset just after the ElementDataFile line.*/
+    size_t EndOfHeader;
+
+    bool Has(const std::string& key) const
+    {
+      return this->Fields.find(key) != this->Fields.end();
+    }
+
+    std::string Get(const std::string& key, const std::string& defaultValue = "") const
+    {
+      std::map<std::string, std::string>::const_iterator iter = this->Fields.find(key);
+      return iter == this->Fields.end() ? defaultValue : iter->second;
+    }
+  };
+
+  /** Read the header. Returns false if no ElementDataFile line was found among the first lines.*/
+  bool ReadHeader(const std::string& fileName, MetaImageHeader& header)
+  {
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if(!file)
+    {
+      return false;
+    }
+
+    // A MetaImage header is short, this prevents scanning binary files that are not MetaImages.
+    const unsigned int maximumNumberOfLines = 100;
+
+    std::string line;
+    for(unsigned int lineId = 0; lineId < maximumNumberOfLines && std::getline(file, line); ++lineId)
+    {
+      const size_t equals = line.find('=');
+      if(equals == std::string::npos)
+      {
+        return false;
+      }
+
+      const std::string key = Trim(line.substr(0, equals));
+      header.Fields[key] = Trim(line.substr(equals + 1));
+
+      if(key == "ElementDataFile")
+      {
+        header.EndOfHeader = static_cast<size_t>(file.tellg());
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  size_t GetFileSize(const std::string& fileName)
+  {
+    struct stat fileStatus;
+    if(stat(fileName.c_str(), &fileStatus) != 0)
+    {
+      throw std::runtime_error("MappedMetaImage: could not stat " + fileName);
+    }
+    return static_cast<size_t>(fileStatus.st_size);
+  }
+
+  bool IsLittleEndian()
+  {
+    const unsigned int one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+  }
+}
+
+MappedMetaImage::MappedMetaImage() : Mapping(NULL), MappingLength(0)
+{
+
+}
+
+MappedMetaImage::~MappedMetaImage()
+{
+  Close();
+}
+
+bool MappedMetaImage::Open(const std::string& fileName)
+{
+  Close();
+
+  size_t size[2];
+  unsigned int numberOfChannels = 0;
+  double spacing[2];
+  double origin[2];
+  void* data = Map(fileName, "MET_FLOAT", sizeof(float), size, numberOfChannels, spacing, origin);
+  if(!data)
+  {
+    return false;
+  }
+
+  ImageType::IndexType corner = {{0, 0}};
+  ImageType::SizeType imageSize = {{size[0], size[1]}};
+  ImageType::RegionType region(corner, imageSize);
+
+  this->Image = ImageType::New();
+  this->Image->SetNumberOfComponentsPerPixel(numberOfChannels);
+  this->Image->SetRegions(region);
+  // 'false' means the image does not own (and so will never free) the memory.
+  this->Image->GetPixelContainer()->SetImportPointer(static_cast<float*>(data), size[0] * size[1] * numberOfChannels, false);
+  this->Image->SetSpacing(spacing);
+  this->Image->SetOrigin(origin);
+
+  return true;
+}
+
+bool MappedMetaImage::OpenRGB(const std::string& fileName)
+{
+  Close();
+
+  size_t size[2];
+  unsigned int numberOfChannels = 0;
+  double spacing[2];
+  double origin[2];
+  void* data = Map(fileName, "MET_UCHAR", sizeof(unsigned char), size, numberOfChannels, spacing, origin);
+  if(!data)
+  {
+    return false;
+  }
+
+  // The pixels are viewed as they are, so only interleaved RGB can be mapped.
+  if(numberOfChannels != 3)
+  {
+    Close();
+    return false;
+  }
+
+  RGBImageType::IndexType corner = {{0, 0}};
+  RGBImageType::SizeType imageSize = {{size[0], size[1]}};
+  RGBImageType::RegionType region(corner, imageSize);
+
+  this->RGBImage = RGBImageType::New();
+  this->RGBImage->SetRegions(region);
+  this->RGBImage->GetPixelContainer()->SetImportPointer(static_cast<RGBImageType::PixelType*>(data),
+                                                        size[0] * size[1], false);
+  this->RGBImage->SetSpacing(spacing);
+  this->RGBImage->SetOrigin(origin);
+
+  return true;
+}
+
+void* MappedMetaImage::Map(const std::string& fileName, const std::string& elementType, const size_t elementSize,
+                           size_t size[2], unsigned int& numberOfChannels, double spacing[2], double origin[2])
+{
+  MetaImageHeader header;
+  if(!ReadHeader(fileName, header))
+  {
+    return NULL;
+  }
+
+  // Only the layout that PatchMatch writes is supported. Anything else is left to itk::ImageFileReader.
+  if(header.Get("NDims") != "2" ||
+     header.Get("ElementType") != elementType ||
+     IsTrue(header.Get("CompressedData", "False")) ||
+     !IsTrue(header.Get("BinaryData", "True")) ||
+     IsTrue(header.Get("BinaryDataByteOrderMSB", "False")) ||
+     IsTrue(header.Get("ElementByteOrderMSB", "False")) ||
+     !IsLittleEndian())
+  {
+    return NULL;
+  }
+
+  std::stringstream ssDimSize(header.Get("DimSize"));
+  if(!(ssDimSize >> size[0] >> size[1]))
+  {
+    return NULL;
+  }
+
+  std::stringstream ssChannels(header.Get("ElementNumberOfChannels", "1"));
+  if(!(ssChannels >> numberOfChannels) || numberOfChannels == 0)
+  {
+    return NULL;
+  }
+
+  const size_t dataLength = size[0] * size[1] * numberOfChannels * elementSize;
+
+  // Find the file and the offset in it at which the pixel data starts.
+  std::string dataFileName;
+  size_t dataOffset = 0;
+  const std::string elementDataFile = header.Get("ElementDataFile");
+  if(elementDataFile == "LOCAL")
+  {
+    dataFileName = fileName;
+    dataOffset = header.EndOfHeader;
+  }
+  else if(elementDataFile == "LIST" || elementDataFile.find('%') != std::string::npos)
+  {
+    // Multi-file data is not supported.
+    return NULL;
+  }
+  else
+  {
+    // The data file is relative to the directory of the header.
+    const size_t slash = fileName.find_last_of('/');
+    dataFileName = (slash == std::string::npos) ? elementDataFile : fileName.substr(0, slash + 1) + elementDataFile;
+  }
+
+  const size_t fileSize = GetFileSize(dataFileName);
+
+  if(header.Has("HeaderSize"))
+  {
+    std::stringstream ssHeaderSize(header.Get("HeaderSize"));
+    long headerSize = 0;
+    ssHeaderSize >> headerSize;
+    if(headerSize == -1)
+    {
+      // -1 means "the data is at the end of the file".
+      if(fileSize < dataLength)
+      {
+        throw std::runtime_error("MappedMetaImage: " + dataFileName + " is smaller than its DimSize requires!");
+      }
+      dataOffset = fileSize - dataLength;
+    }
+    else
+    {
+      dataOffset += static_cast<size_t>(headerSize);
+    }
+  }
+
+  // The elements are used in place, so they must be aligned.
+  if(dataOffset % elementSize != 0)
+  {
+    std::cerr << "MappedMetaImage: the pixels of " << dataFileName << " start at byte " << dataOffset
+              << ", which is not aligned, so it is read instead of mapped. Converting it with --convert to .mha"
+              << " aligns them." << std::endl;
+    return NULL;
+  }
+
+  if(dataOffset + dataLength > fileSize)
+  {
+    throw std::runtime_error("MappedMetaImage: " + dataFileName + " is smaller than its DimSize requires!");
+  }
+
+  const int fileDescriptor = open(dataFileName.c_str(), O_RDONLY);
+  if(fileDescriptor == -1)
+  {
+    throw std::runtime_error("MappedMetaImage: could not open " + dataFileName);
+  }
+
+  // Map the whole file, as the offset of a mapping must be page aligned. PROT_WRITE with MAP_PRIVATE
+  // only gives copy-on-write pages, which is needed because ITK hands out non-const pixel pointers.
+  void* mapping = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+  close(fileDescriptor); // The mapping keeps its own reference to the file.
+
+  if(mapping == MAP_FAILED)
+  {
+    throw std::runtime_error("MappedMetaImage: could not map " + dataFileName);
+  }
+
+  this->Mapping = mapping;
+  this->MappingLength = fileSize;
+
+  spacing[0] = spacing[1] = 1.0;
+  std::stringstream ssSpacing(header.Get("ElementSpacing", "1 1"));
+  ssSpacing >> spacing[0] >> spacing[1];
+
+  origin[0] = origin[1] = 0.0;
+  std::stringstream ssOrigin(header.Get("Offset", "0 0"));
+  ssOrigin >> origin[0] >> origin[1];
+
+  return static_cast<char*>(mapping) + dataOffset;
+}
+
+void MappedMetaImage::Close()
+{
+  this->Image = NULL;
+  this->RGBImage = NULL;
+
+  if(this->Mapping)
+  {
+    munmap(this->Mapping, this->MappingLength);
+    this->Mapping = NULL;
+    this->MappingLength = 0;
+  }
+}
+
+std::string MappedMetaImage::CreateHeader(const itk::Size<2>& size, const unsigned int numberOfChannels,
+                                          const double spacing[2], const double origin[2], const std::string& comment)
+{
+  std::stringstream ssHeader;
+  ssHeader << std::setprecision(17)
+           << "ObjectType = Image\n"
+           << "NDims = 2\n"
+           << "BinaryData = True\n"
+           << "BinaryDataByteOrderMSB = False\n"
+           << "CompressedData = False\n"
+           << "Offset = " << origin[0] << " " << origin[1] << "\n"
+           << "ElementSpacing = " << spacing[0] << " " << spacing[1] << "\n"
+           << "DimSize = " << size[0] << " " << size[1] << "\n"
+           << "ElementNumberOfChannels = " << numberOfChannels << "\n"
+           << "ElementType = MET_FLOAT\n";
+
+  const std::string dataFileLine = "ElementDataFile = LOCAL\n";
+  std::string commentLine = "Comment = " + comment;
+  const size_t length = ssHeader.str().size() + commentLine.size() + 1 + dataFileLine.size();
+  commentLine.append((sizeof(float) - length % sizeof(float)) % sizeof(float), '.');
+
+  ssHeader << commentLine << "\n" << dataFileLine;
+  return ssHeader.str();
+}
+
+void MappedMetaImage::Write(const ImageType* const image, const std::string& fileName)
+{
+  const itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfChannels = image->GetNumberOfComponentsPerPixel();
+  const double spacing[2] = {image->GetSpacing()[0], image->GetSpacing()[1]};
+  const double origin[2] = {image->GetOrigin()[0], image->GetOrigin()[1]};
+  const std::string header = CreateHeader(size, numberOfChannels, spacing, origin, "aligned for mapping");
+
+  std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+  file.write(header.c_str(), header.size());
+  file.write(reinterpret_cast<const char*>(image->GetBufferPointer()),
+             static_cast<std::streamsize>(size[0] * size[1] * numberOfChannels * sizeof(float)));
+  file.close();
+  if(!file)
+  {
+    throw std::runtime_error("MappedMetaImage: could not write " + fileName);
+  }
+}
+
+MappedMetaImage::ImageType* MappedMetaImage::GetImage() const
+{
+  return this->Image.GetPointer();
+}
+
+MappedMetaImage::RGBImageType* MappedMetaImage::GetRGBImage() const
+{
+  return this->RGBImage.GetPointer();
+}
@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MappedMetaImage_H
+#define MappedMetaImage_H
+
+// STL
+#include <string>
+
+// ITK
+#include "itkVectorImage.h"
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** Memory-map the pixel data of an uncompressed 2D MET_FLOAT MetaImage (.mha, or .mhd + .raw)
+  * and expose it as an itk::VectorImage<float, 2> without reading it, or that of an uncompressed
+  * 2D MET_UCHAR MetaImage with 3 channels and expose it as an RGB image.
+  * The operating system only pages in the parts of the file that are actually accessed.
+  * The mapping is private (copy-on-write), so writing to the image never modifies the file.
+  * The images returned by GetImage() and GetRGBImage() must not be used after this object is destroyed or Close()d.
+  */
+class MappedMetaImage
+{
+public:
+  typedef itk::VectorImage<float, 2> ImageType;
+  typedef NNFieldTypes::ImageType RGBImageType;
+
+  MappedMetaImage();
+  ~MappedMetaImage();
+
+  /** Map 'fileName'. Returns false, without throwing, if the file is not a MetaImage this class can
+    * map (compressed, not MET_FLOAT, not 2D, big endian, misaligned, ...), so the caller can fall back
+    * to itk::ImageFileReader. Throws if the file claims to be mappable but is inconsistent.*/
+  bool Open(const std::string& fileName);
+
+  /** Map the RGB image 'fileName', like Open() but for MET_UCHAR files with 3 channels.*/
+  bool OpenRGB(const std::string& fileName);
+
+  /** Release the mapping. */
+  void Close();
+
+  /** The header of an uncompressed MET_FLOAT MetaImage of 'size' with the pixels in the same file. It is padded
+    * with 'comment' so the pixels that follow it are aligned, which ITK does not do, so the file can be mapped.*/
+  static std::string CreateHeader(const itk::Size<2>& size, const unsigned int numberOfChannels,
+                                  const double spacing[2], const double origin[2], const std::string& comment);
+
+  /** Write 'image' to the .mha file 'fileName' with a header from CreateHeader(), so it can be mapped when it is
+    * read again. Throws if it cannot be written.*/
+  static void Write(const ImageType* const image, const std::string& fileName);
+
+  /** The image that views the mapped data. NULL if nothing is mapped.*/
+  ImageType* GetImage() const;
+
+  /** The RGB image that views the mapped data. NULL if no RGB image is mapped.*/
+  RGBImageType* GetRGBImage() const;
+
+private:
+  /** The mapping is owned, so copying is not allowed.*/
+  MappedMetaImage(const MappedMetaImage&);
+  void operator=(const MappedMetaImage&);
+
+  /** Map the pixel data of 'fileName' if its elements are of 'elementType', and return a pointer to it.
+    * Returns NULL if the file cannot be mapped, see Open().*/
+  void* Map(const std::string& fileName, const std::string& elementType, const size_t elementSize,
+            size_t size[2], unsigned int& numberOfChannels, double spacing[2], double origin[2]);
+
+  /** The start of the mapping (not of the pixel data).*/
+  void* Mapping;
+
+  /** The length of the mapping in bytes.*/
+  size_t MappingLength;
+
+  /** The image viewing the mapped pixel data.*/
+  ImageType::Pointer Image;
+
+  /** The RGB image viewing the mapped pixel data.*/
+  RGBImageType::Pointer RGBImage;
+};
+
+#endif
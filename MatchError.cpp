@@ -0,0 +1,216 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MatchError.h"
+
+// STL
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Custom
+#include "Parallel.h"
+#include "PatchDistance.h"
+
+namespace
+{
+  /** Computes the match error of a range of rows with the distance functor it is dispatched to.*/
+  struct RowsVisitor
+  {
+    const unsigned char* Image;
+    const float* NNField;
+    unsigned int NumberOfComponents;
+    int Width;
+    int Height;
+    int Radius;
+    bool Offset;
+    const std::atomic<bool>* Cancel;
+
+    size_t FirstRow;
+    size_t LastRow;
+    float* Error;
+    float MaxError;
+
+    /** The sum of squared differences of the (2 * Radius + 1) pixels tall columns centered
+      * at (x, y) and (x + offsetX, y + offsetY).*/
+    PatchDistance::SumType Column(const int x, const int y, const int offsetX, const int offsetY) const
+    {
+      const size_t rowStride = 3 * static_cast<size_t>(this->Width);
+      const unsigned char* pixel0 = this->Image + (y - this->Radius) * rowStride + 3 * x;
+      const unsigned char* pixel1 = pixel0 + offsetY * static_cast<ptrdiff_t>(rowStride) + 3 * offsetX;
+
+      PatchDistance::SumType sum = 0;
+      for(int row = -this->Radius; row <= this->Radius; ++row)
+      {
+        sum += PatchDistance::SumOfSquaredDifferences(pixel0, pixel1, 3);
+        pixel0 += rowStride;
+        pixel1 += rowStride;
+      }
+      return sum;
+    }
+
+    template <typename TDistance>
+    void operator()(const TDistance& distance)
+    {
+      const size_t rowStride = 3 * static_cast<size_t>(this->Width);
+      const PatchDistance::SumType noBound = std::numeric_limits<PatchDistance::SumType>::max();
+      this->MaxError = 0.0f;
+
+      for(int y = static_cast<int>(this->FirstRow); y < static_cast<int>(this->LastRow); ++y)
+      {
+        if(*this->Cancel)
+        {
+          return;
+        }
+
+        float* errorRow = this->Error + static_cast<size_t>(y) * this->Width;
+        std::fill(errorRow, errorRow + this->Width, 0.0f);
+        if(y < this->Radius || y >= this->Height - this->Radius)
+        {
+          continue;
+        }
+
+        // The run of pixels with the same offset that the current pixel continues, if any.
+        bool runValid = false;
+        int runOffsetX = 0;
+        int runOffsetY = 0;
+        PatchDistance::SumType runSum = 0;
+
+        for(int x = this->Radius; x < this->Width - this->Radius; ++x)
+        {
+          const float* nnFieldPixel = this->NNField + (static_cast<size_t>(y) * this->Width + x) * this->NumberOfComponents;
+          int matchX = static_cast<int>(nnFieldPixel[0]);
+          int matchY = static_cast<int>(nnFieldPixel[1]);
+          if(this->Offset)
+          {
+            matchX += x;
+            matchY += y;
+          }
+
+          if(matchX < this->Radius || matchY < this->Radius ||
+             matchX >= this->Width - this->Radius || matchY >= this->Height - this->Radius)
+          {
+            runValid = false;
+            continue;
+          }
+
+          const int offsetX = matchX - x;
+          const int offsetY = matchY - y;
+
+          if(runValid && offsetX == runOffsetX && offsetY == runOffsetY)
+          {
+            runSum = runSum - Column(x - 1 - this->Radius, y, offsetX, offsetY) + Column(x + this->Radius, y, offsetX, offsetY);
+          }
+          else
+          {
+            const unsigned char* patch0 = this->Image + (y - this->Radius) * rowStride + 3 * (x - this->Radius);
+            const unsigned char* patch1 = this->Image + (matchY - this->Radius) * rowStride + 3 * (matchX - this->Radius);
+            runSum = distance(patch0, patch1, rowStride, noBound);
+            runValid = true;
+            runOffsetX = offsetX;
+            runOffsetY = offsetY;
+          }
+
+          errorRow[x] = static_cast<float>(runSum);
+          this->MaxError = std::max(this->MaxError, errorRow[x]);
+        }
+      }
+    }
+  };
+
+  /** Compute the match error of the rows ['firstRow', 'lastRow') into 'error' on all cores.
+    * Returns the largest error of these rows.*/
+  float ComputeRows(const NNFieldTypes::ImageType* const image, const NNFieldTypes::NNFieldImageType* const nnField,
+                    const NNFieldTypes::INTERPRETATION_ENUM interpretation, const unsigned int patchRadius,
+                    const size_t firstRow, const size_t lastRow, const std::atomic<bool>& cancel,
+                    NNFieldTypes::FloatImageType* const error)
+  {
+    if(image->GetLargestPossibleRegion().GetSize() != nnField->GetLargestPossibleRegion().GetSize() ||
+       error->GetLargestPossibleRegion().GetSize() != nnField->GetLargestPossibleRegion().GetSize())
+    {
+      throw std::runtime_error("MatchError: the image, the NNField and the error must have the same size!");
+    }
+
+    if(nnField->GetNumberOfComponentsPerPixel() < 2)
+    {
+      throw std::runtime_error("MatchError: the NNField must have at least 2 channels!");
+    }
+
+    const itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+
+    RowsVisitor prototype;
+    prototype.Image = reinterpret_cast<const unsigned char*>(image->GetBufferPointer());
+    prototype.NNField = nnField->GetBufferPointer();
+    prototype.NumberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+    prototype.Width = static_cast<int>(size[0]);
+    prototype.Height = static_cast<int>(size[1]);
+    prototype.Radius = static_cast<int>(patchRadius);
+    prototype.Offset = (interpretation == NNFieldTypes::OFFSET);
+    prototype.Cancel = &cancel;
+    prototype.Error = error->GetBufferPointer();
+    prototype.MaxError = 0.0f;
+
+    std::vector<float> maxErrorPerThread(Parallel::GetNumberOfThreads(), 0.0f);
+    Parallel::ForChunks(firstRow, std::min<size_t>(lastRow, size[1]), [&prototype, &maxErrorPerThread, patchRadius]
+                        (const size_t chunkFirstRow, const size_t chunkLastRow, const unsigned int threadId)
+      {
+      RowsVisitor visitor = prototype;
+      visitor.FirstRow = chunkFirstRow;
+      visitor.LastRow = chunkLastRow;
+      PatchDistance::Dispatch<PatchDistance::SSD>(patchRadius, visitor);
+      maxErrorPerThread[threadId] = std::max(maxErrorPerThread[threadId], visitor.MaxError);
+      });
+
+    return *std::max_element(maxErrorPerThread.begin(), maxErrorPerThread.end());
+  }
+}
+
+namespace MatchError
+{
+
+NNFieldTypes::FloatImageType::Pointer Compute(const NNFieldTypes::ImageType* const image,
+                                              const NNFieldTypes::NNFieldImageType* const nnField,
+                                              const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+                                              const unsigned int patchRadius, const std::atomic<bool>& cancel,
+                                              float& maxError)
+{
+  NNFieldTypes::FloatImageType::Pointer error = NNFieldTypes::FloatImageType::New();
+  error->SetRegions(image->GetLargestPossibleRegion());
+  error->Allocate();
+
+  const float rowsMaxError = ComputeRows(image, nnField, interpretation, patchRadius, 0,
+                                         image->GetLargestPossibleRegion().GetSize()[1], cancel, error);
+  if(cancel)
+  {
+    return NNFieldTypes::FloatImageType::Pointer();
+  }
+
+  maxError = rowsMaxError;
+  return error;
+}
+
+float UpdateRows(const NNFieldTypes::ImageType* const image, const NNFieldTypes::NNFieldImageType* const nnField,
+                 const NNFieldTypes::INTERPRETATION_ENUM interpretation, const unsigned int patchRadius,
+                 const unsigned int firstRow, const unsigned int lastRow, NNFieldTypes::FloatImageType* const error)
+{
+  const std::atomic<bool> cancel(false);
+  return ComputeRows(image, nnField, interpretation, patchRadius, firstRow, lastRow, cancel, error);
+}
+
+} // end namespace
@@ -0,0 +1,54 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MatchError_H
+#define MatchError_H
+
+// STL
+#include <atomic>
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** The match error of a whole field: for every pixel, the sum of squared differences between
+  * its patch and the patch the field points to.
+  *
+  * Fields are mostly made of coherent runs, where neighboring pixels match neighboring patches.
+  * Along such a run the error is updated from the previous pixel by removing the column that
+  * leaves the patch and adding the one that enters it, so only the first pixel of a run pays
+  * for a whole patch. Rows are split over all cores.
+  */
+namespace MatchError
+{
+  /** Compute the match error image. Pixels whose patch or match is not entirely inside the image are 0.
+    * 'maxError' is set to the largest error. Returns NULL if 'cancel' became true.
+    * This does not touch Qt or VTK, so it can run on a worker thread.*/
+  NNFieldTypes::FloatImageType::Pointer Compute(const NNFieldTypes::ImageType* const image,
+                                                const NNFieldTypes::NNFieldImageType* const nnField,
+                                                const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+                                                const unsigned int patchRadius, const std::atomic<bool>& cancel,
+                                                float& maxError);
+
+  /** Recompute the rows ['firstRow', 'lastRow') of the match error image 'error', e.g. after these rows of the
+    * NNField changed. Returns the largest error of these rows.*/
+  float UpdateRows(const NNFieldTypes::ImageType* const image, const NNFieldTypes::NNFieldImageType* const nnField,
+                   const NNFieldTypes::INTERPRETATION_ENUM interpretation, const unsigned int patchRadius,
+                   const unsigned int firstRow, const unsigned int lastRow, NNFieldTypes::FloatImageType* const error);
+}
+
+#endif
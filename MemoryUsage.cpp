@@ -0,0 +1,75 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MemoryUsage.h"
+
+// STL
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// POSIX
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace MemoryUsage
+{
+
+size_t GetPeakResidentBytes()
+{
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0;
+  }
+
+#ifdef __APPLE__
+  // ru_maxrss is in bytes on OSX...
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  // ...and in kilobytes on Linux.
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+size_t GetCurrentResidentBytes()
+{
+  // The second field of /proc/self/statm is the resident set size in pages.
+  std::ifstream statm("/proc/self/statm");
+  size_t totalPages = 0;
+  size_t residentPages = 0;
+  if(!(statm >> totalPages >> residentPages))
+  {
+    return 0;
+  }
+
+  return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+std::string GetReport()
+{
+  const double megabyte = 1024.0 * 1024.0;
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1)
+     << "resident " << GetCurrentResidentBytes() / megabyte << " MB, "
+     << "peak " << GetPeakResidentBytes() / megabyte << " MB";
+  return ss.str();
+}
+
+} // end namespace
@@ -0,0 +1,39 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MemoryUsage_H
+#define MemoryUsage_H
+
+// STL
+#include <cstddef>
+#include <string>
+
+/** Query the memory used by this process.*/
+namespace MemoryUsage
+{
+  /** The largest resident set size the process has had so far, in bytes.*/
+  size_t GetPeakResidentBytes();
+
+  /** The current resident set size of the process, in bytes. Returns 0 if it is not available.*/
+  size_t GetCurrentResidentBytes();
+
+  /** Produce a short summary like "resident 120.5 MB, peak 300.2 MB".*/
+  std::string GetReport();
+}
+
+#endif
@@ -0,0 +1,351 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldBatch.h"
+
+// STL
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// ITK
+#include "itkImageFileWriter.h"
+
+// Custom
+#include "CompactNNField.h"
+#include "LoadWorkers.h"
+#include "MappedMetaImage.h"
+#include "NNFieldQuery.h"
+#include "TiledNNField.h"
+
+namespace
+{
+  /** The value after option 'arguments[argumentId]', or throws if there is none.*/
+  std::string GetValue(const std::vector<std::string>& arguments, size_t& argumentId)
+  {
+    if(argumentId + 1 >= arguments.size())
+    {
+      throw std::runtime_error("Missing value after " + arguments[argumentId]);
+    }
+    return arguments[++argumentId];
+  }
+
+  int ToInteger(const std::string& value)
+  {
+    std::stringstream ss(value);
+    int integer;
+    if(!(ss >> integer))
+    {
+      throw std::runtime_error("Not an integer: " + value);
+    }
+    return integer;
+  }
+
+  /** Read one "x y" pair per line. Empty lines and lines starting with # are ignored.*/
+  std::vector<itk::Index<2> > ReadPoints(const std::string& fileName)
+  {
+    std::ifstream fileStream(fileName.c_str());
+    if(!fileStream)
+    {
+      throw std::runtime_error("Could not open " + fileName);
+    }
+
+    std::vector<itk::Index<2> > points;
+    std::string line;
+    while(std::getline(fileStream, line))
+    {
+      if(line.empty() || line[0] == '#')
+      {
+        continue;
+      }
+
+      std::stringstream ss(line);
+      itk::Index<2> point;
+      if(!(ss >> point[0] >> point[1]))
+      {
+        throw std::runtime_error("Could not parse the line \"" + line + "\" of " + fileName);
+      }
+      points.push_back(point);
+    }
+
+    return points;
+  }
+}
+
+namespace NNFieldBatch
+{
+
+bool IsRequested(const int argc, char** argv)
+{
+  return argc > 1 && std::string(argv[1]) == "--batch";
+}
+
+void PrintUsage(std::ostream& stream)
+{
+  stream << "NNFieldInspector --batch Image.png NNField.mha [options]" << std::endl
+         << "  --points points.txt       query the pixels listed in the file, one \"x y\" per line" << std::endl
+         << "  --region x y width height query every pixel of the region" << std::endl
+         << "  --radius r                the patch radius (default 7)" << std::endl
+         << "  --offset                  interpret the field as offsets (default: absolute positions)" << std::endl
+         << "  --output results.csv      write the results here (default: standard output)" << std::endl
+         << "  --overlays directory      also write one PNG per query with the two patches outlined" << std::endl
+         << "NNFieldInspector --convert input output [options]" << std::endl
+         << "  The formats are chosen by the extensions: .mha, tiled .nnt or compact .nnc." << std::endl
+         << "  A .mha output is written so it can be memory mapped." << std::endl
+         << "  --tile-size n             the width and height of the tiles of a .nnt output (default 256)" << std::endl
+         << "  --compress                compress every tile of a .nnt output with zlib" << std::endl;
+}
+
+bool IsConversionRequested(const int argc, char** argv)
+{
+  return argc > 1 && std::string(argv[1]) == "--convert";
+}
+
+int RunConversion(const std::vector<std::string>& arguments)
+{
+  try
+  {
+    if(arguments.size() < 2)
+    {
+      PrintUsage(std::cerr);
+      return EXIT_FAILURE;
+    }
+
+    const std::string inputFileName = arguments[0];
+    const std::string outputFileName = arguments[1];
+    int tileSize = 256;
+    bool compress = false;
+
+    for(size_t argumentId = 2; argumentId < arguments.size(); ++argumentId)
+    {
+      const std::string& argument = arguments[argumentId];
+      if(argument == "--tile-size")
+      {
+        tileSize = ToInteger(GetValue(arguments, argumentId));
+        if(tileSize <= 0)
+        {
+          throw std::runtime_error("The tile size must be positive.");
+        }
+      }
+      else if(argument == "--compress")
+      {
+        compress = true;
+      }
+      else
+      {
+        throw std::runtime_error("Unknown argument " + argument);
+      }
+    }
+
+    std::atomic<bool> cancel(false);
+    LoadWorkers::ProgressCallback ignoreProgress = [](int) {};
+
+    // An uncompressed .mha input is mapped, so a conversion from it does not need the whole field in memory.
+    LoadWorkers::NNFieldResult nnField = LoadWorkers::ReadNNField(inputFileName, cancel, ignoreProgress);
+    if(!nnField.Error.empty())
+    {
+      throw std::runtime_error("Could not load the NNField: " + nnField.Error);
+    }
+    if(!nnField.NNField)
+    {
+      nnField.NNField = LoadWorkers::ReadNNFieldStore(nnField.Store.get(), cancel);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(TiledNNField::IsTiledFileName(outputFileName))
+    {
+      TiledNNField::Write(nnField.NNField.GetPointer(), outputFileName, tileSize, compress, cancel);
+    }
+    else if(CompactNNField::IsCompactFileName(outputFileName))
+    {
+      CompactNNField compact;
+      compact.Encode(nnField.NNField.GetPointer(), cancel);
+      compact.Write(outputFileName);
+      std::cerr << "Encoded " << compact.GetNumberOfBytes() << " bytes." << std::endl;
+    }
+    else if(outputFileName.size() > 4 && outputFileName.compare(outputFileName.size() - 4, 4, ".mha") == 0)
+    {
+      // ITK does not align the pixels after the header, so the field is written with a padded header to be mapped.
+      MappedMetaImage::Write(nnField.NNField.GetPointer(), outputFileName);
+    }
+    else
+    {
+      typedef itk::ImageFileWriter<NNFieldTypes::NNFieldImageType> WriterType;
+      WriterType::Pointer writer = WriterType::New();
+      writer->SetFileName(outputFileName);
+      writer->SetInput(nnField.NNField);
+      try
+      {
+        writer->Update();
+      }
+      catch(itk::ExceptionObject& exception)
+      {
+        throw std::runtime_error(std::string("Could not write the NNField: ") + exception.GetDescription());
+      }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Wrote " << outputFileName << " in " << seconds << " s." << std::endl;
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << exception.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int Run(const std::vector<std::string>& arguments)
+{
+  try
+  {
+    if(arguments.size() < 2)
+    {
+      PrintUsage(std::cerr);
+      return EXIT_FAILURE;
+    }
+
+    const std::string imageFileName = arguments[0];
+    const std::string nnFieldFileName = arguments[1];
+    std::vector<itk::Index<2> > pixels;
+    unsigned int patchRadius = 7;
+    NNFieldTypes::INTERPRETATION_ENUM interpretation = NNFieldTypes::ABSOLUTE;
+    std::string outputFileName;
+    std::string overlayDirectory;
+
+    for(size_t argumentId = 2; argumentId < arguments.size(); ++argumentId)
+    {
+      const std::string& argument = arguments[argumentId];
+      if(argument == "--points")
+      {
+        std::vector<itk::Index<2> > points = ReadPoints(GetValue(arguments, argumentId));
+        pixels.insert(pixels.end(), points.begin(), points.end());
+      }
+      else if(argument == "--region")
+      {
+        const int x = ToInteger(GetValue(arguments, argumentId));
+        const int y = ToInteger(GetValue(arguments, argumentId));
+        const int width = ToInteger(GetValue(arguments, argumentId));
+        const int height = ToInteger(GetValue(arguments, argumentId));
+        for(int row = y; row < y + height; ++row)
+        {
+          for(int column = x; column < x + width; ++column)
+          {
+            itk::Index<2> pixel = {{column, row}};
+            pixels.push_back(pixel);
+          }
+        }
+      }
+      else if(argument == "--radius")
+      {
+        const int radius = ToInteger(GetValue(arguments, argumentId));
+        if(radius < 1)
+        {
+          throw std::runtime_error("The patch radius must be at least 1.");
+        }
+        patchRadius = static_cast<unsigned int>(radius);
+      }
+      else if(argument == "--offset")
+      {
+        interpretation = NNFieldTypes::OFFSET;
+      }
+      else if(argument == "--output")
+      {
+        outputFileName = GetValue(arguments, argumentId);
+      }
+      else if(argument == "--overlays")
+      {
+        overlayDirectory = GetValue(arguments, argumentId);
+      }
+      else
+      {
+        throw std::runtime_error("Unknown argument " + argument);
+      }
+    }
+
+    if(pixels.empty())
+    {
+      throw std::runtime_error("Nothing to query, use --points or --region.");
+    }
+
+    // The loaders are shared with the GUI. Here nothing can cancel them and nobody displays progress.
+    std::atomic<bool> cancel(false);
+    LoadWorkers::ProgressCallback ignoreProgress = [](int) {};
+
+    LoadWorkers::ImageResult image = LoadWorkers::ReadImage(imageFileName, cancel, ignoreProgress);
+    if(!image.Error.empty())
+    {
+      throw std::runtime_error("Could not load the image: " + image.Error);
+    }
+
+    const itk::Size<2> imageSize = image.Image->GetLargestPossibleRegion().GetSize();
+    if(2 * patchRadius + 1 > std::min(imageSize[0], imageSize[1]))
+    {
+      throw std::runtime_error("The patch radius is too large for the image.");
+    }
+
+    LoadWorkers::NNFieldResult nnField = LoadWorkers::ReadNNField(nnFieldFileName, cancel, ignoreProgress);
+    if(!nnField.Error.empty())
+    {
+      throw std::runtime_error("Could not load the NNField: " + nnField.Error);
+    }
+    if(!nnField.NNField)
+    {
+      // NNFieldQuery works on fields in memory.
+      nnField.NNField = LoadWorkers::ReadNNFieldStore(nnField.Store.get(), cancel);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<NNFieldQuery::Result> results = NNFieldQuery::Run(image.Image.GetPointer(), nnField.NNField.GetPointer(),
+                                                                  pixels, patchRadius, interpretation);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Answered " << results.size() << " queries in " << seconds << " s." << std::endl;
+
+    if(outputFileName.empty())
+    {
+      NNFieldQuery::WriteCSV(results, std::cout);
+    }
+    else
+    {
+      std::ofstream outputStream(outputFileName.c_str());
+      if(!outputStream)
+      {
+        throw std::runtime_error("Could not write " + outputFileName);
+      }
+      NNFieldQuery::WriteCSV(results, outputStream);
+    }
+
+    if(!overlayDirectory.empty())
+    {
+      NNFieldQuery::WriteOverlays(image.Image.GetPointer(), results, patchRadius, overlayDirectory);
+    }
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << exception.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+} // end namespace
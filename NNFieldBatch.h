@@ -0,0 +1,49 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldBatch_H
+#define NNFieldBatch_H
+
+// STL
+#include <ostream>
+#include <string>
+#include <vector>
+
+/** The headless mode of the inspector: "NNFieldInspector --batch ...". It reads an image and a field,
+  * answers queries with NNFieldQuery and writes CSV (and optionally overlay PNGs). No QApplication is
+  * created and nothing is rendered, so it runs on machines without a display.
+  */
+namespace NNFieldBatch
+{
+  /** Whether the command line asks for the batch mode.*/
+  bool IsRequested(const int argc, char** argv);
+
+  /** Run the batch mode with the arguments after "--batch". Returns the exit code of the program.*/
+  int Run(const std::vector<std::string>& arguments);
+
+  void PrintUsage(std::ostream& stream);
+
+  /** Whether the command line asks to convert a field between the .mha, tiled .nnt and compact .nnc formats:
+    * "NNFieldInspector --convert ...".*/
+  bool IsConversionRequested(const int argc, char** argv);
+
+  /** Convert a field with the arguments after "--convert". Returns the exit code of the program.*/
+  int RunConversion(const std::vector<std::string>& arguments);
+}
+
+#endif
@@ -0,0 +1,652 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldBenchmark.h"
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// ITK
+#include "itkImageFileWriter.h"
+
+// VTK
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+
+// Custom
+#include "ChannelStatistics.h"
+#include "CoherenceSegmentation.h"
+#include "CompactNNField.h"
+#include "FlowColor.h"
+#include "LoadWorkers.h"
+#include "MappedMetaImage.h"
+#include "MatchError.h"
+#include "MemoryUsage.h"
+#include "NNFieldComparison.h"
+#include "NNFieldQuery.h"
+#include "Parallel.h"
+#include "PatchDistance.h"
+#include "PickOverlay.h"
+#include "ReverseIndex.h"
+#include "TiledNNField.h"
+
+namespace
+{
+  typedef NNFieldTypes::ImageType ImageType;
+  typedef NNFieldTypes::NNFieldImageType NNFieldImageType;
+
+  struct Options
+  {
+    Options() : Repetitions(3), PatchRadius(7), NumberOfPicks(10000), NumberOfPatchPairs(1000000),
+                ScratchDirectory("/tmp") {}
+
+    std::vector<double> Megapixels;
+    unsigned int Repetitions;
+    unsigned int PatchRadius;
+    unsigned int NumberOfPicks;
+    unsigned int NumberOfPatchPairs;
+    std::string ScratchDirectory;
+    std::string OutputFileName;
+    std::string Filter;
+  };
+
+  /** The result of one benchmark at one size.*/
+  struct Record
+  {
+    std::string Name;
+    unsigned int Width;
+    unsigned int Height;
+
+    /** The times of the repetitions, in seconds.*/
+    std::vector<double> Seconds;
+
+    /** What the benchmark processes per repetition (pixels, picks or patch pairs), and what they are.*/
+    double Items;
+    std::string ItemName;
+
+    size_t ResidentBytes;
+    size_t PeakResidentBytes;
+  };
+
+  /** The value after option 'arguments[argumentId]', or throws if there is none.*/
+  std::string GetValue(const std::vector<std::string>& arguments, size_t& argumentId)
+  {
+    if(argumentId + 1 >= arguments.size())
+    {
+      throw std::runtime_error("Missing value after " + arguments[argumentId]);
+    }
+    return arguments[++argumentId];
+  }
+
+  unsigned int ToUnsigned(const std::string& value)
+  {
+    std::stringstream ss(value);
+    unsigned int number;
+    if(!(ss >> number))
+    {
+      throw std::runtime_error("Not a number: " + value);
+    }
+    return number;
+  }
+
+  /** A comma separated list of sizes in megapixels, e.g. "1,10,100".*/
+  std::vector<double> ToMegapixels(const std::string& value)
+  {
+    std::vector<double> megapixels;
+    std::stringstream ss(value);
+    std::string item;
+    while(std::getline(ss, item, ','))
+    {
+      const double size = atof(item.c_str());
+      if(size <= 0.0)
+      {
+        throw std::runtime_error("Not a size in megapixels: " + item);
+      }
+      megapixels.push_back(size);
+    }
+    return megapixels;
+  }
+
+  /** A fast deterministic generator, so every version benchmarks the same data.*/
+  struct Random
+  {
+    explicit Random(const unsigned int seed) : State(seed * 2654435761u + 1u) {}
+
+    unsigned int Next()
+    {
+      this->State ^= this->State << 13;
+      this->State ^= this->State >> 17;
+      this->State ^= this->State << 5;
+      return this->State;
+    }
+
+    unsigned int State;
+  };
+
+  /** Smooth gradients with some noise, so the image compresses like a photo rather than like noise.*/
+  ImageType::Pointer CreateImage(const unsigned int width, const unsigned int height)
+  {
+    ImageType::Pointer image = ImageType::New();
+    itk::Index<2> corner = {{0, 0}};
+    itk::Size<2> size = {{width, height}};
+    image->SetRegions(itk::ImageRegion<2>(corner, size));
+    image->Allocate();
+
+    ImageType::PixelType* const pixels = image->GetBufferPointer();
+    Parallel::For(0, height, [&](const size_t y)
+      {
+      Random random(static_cast<unsigned int>(y));
+      for(unsigned int x = 0; x < width; ++x)
+      {
+        ImageType::PixelType& pixel = pixels[y * width + x];
+        pixel[0] = static_cast<unsigned char>((x * 255) / width + random.Next() % 8);
+        pixel[1] = static_cast<unsigned char>((y * 255) / height + random.Next() % 8);
+        pixel[2] = static_cast<unsigned char>(((x + y) * 127) / (width + height) + random.Next() % 8);
+      }
+      });
+
+    return image;
+  }
+
+  /** An absolute field with a score channel, whose matches are coherent in blocks of 16 x 16 pixels (like the
+    * fields PatchMatch converges to) and always leave room for a patch of 'patchRadius' around them.*/
+  NNFieldImageType::Pointer CreateNNField(const unsigned int width, const unsigned int height,
+                                          const unsigned int patchRadius)
+  {
+    NNFieldImageType::Pointer nnField = NNFieldImageType::New();
+    itk::Index<2> corner = {{0, 0}};
+    itk::Size<2> size = {{width, height}};
+    nnField->SetRegions(itk::ImageRegion<2>(corner, size));
+    nnField->SetNumberOfComponentsPerPixel(3);
+    nnField->Allocate();
+
+    const unsigned int blockSize = 16;
+    const unsigned int validWidth = width - 2 * patchRadius;
+    const unsigned int validHeight = height - 2 * patchRadius;
+    float* const buffer = nnField->GetBufferPointer();
+    Parallel::For(0, height, [&](const size_t y)
+      {
+      Random scoreRandom(static_cast<unsigned int>(y) + 1000003u);
+      for(unsigned int x = 0; x < width; ++x)
+      {
+        Random blockRandom((static_cast<unsigned int>(y) / blockSize) * 65537u + x / blockSize);
+        const unsigned int offsetX = blockRandom.Next() % validWidth;
+        const unsigned int offsetY = blockRandom.Next() % validHeight;
+        float* const pixel = buffer + (y * width + x) * 3;
+        pixel[0] = static_cast<float>(patchRadius + (offsetX + x % blockSize) % validWidth);
+        pixel[1] = static_cast<float>(patchRadius + (offsetY + y % blockSize) % validHeight);
+        pixel[2] = static_cast<float>(scoreRandom.Next() % 100000);
+      }
+      });
+
+    return nnField;
+  }
+
+  /** Throws if reading 'fileName' failed, so a broken path does not get benchmarked as a fast one.*/
+  template <typename TResult>
+  const TResult& CheckRead(const TResult& result, const std::string& fileName)
+  {
+    if(!result.Error.empty())
+    {
+      throw std::runtime_error("Could not read " + fileName + ": " + result.Error);
+    }
+    return result;
+  }
+
+  /** Like CheckRead(), but also throws if the file was read by ITK instead of mapped, so the benchmarks of mapping
+    * never time the fallback.*/
+  template <typename TResult>
+  const TResult& CheckMapped(const TResult& result, const std::string& fileName)
+  {
+    if(!CheckRead(result, fileName).Mapping)
+    {
+      throw std::runtime_error(fileName + " was read instead of mapped!");
+    }
+    return result;
+  }
+
+  template <typename TImage>
+  void WriteImage(const TImage* const image, const std::string& fileName)
+  {
+    typedef itk::ImageFileWriter<TImage> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(fileName);
+    writer->SetInput(image);
+    try
+    {
+      writer->Update();
+    }
+    catch(itk::ExceptionObject& exception)
+    {
+      throw std::runtime_error("Could not write " + fileName + ": " + exception.GetDescription());
+    }
+  }
+
+  /** Time 'function' 'repetitions' times. The result of each repetition is released before the next one starts,
+    * so the memory of the process reflects one repetition.*/
+  Record Time(const std::string& name, const unsigned int width, const unsigned int height, const double items,
+              const std::string& itemName, const unsigned int repetitions, const std::function<void()>& function)
+  {
+    Record record;
+    record.Name = name;
+    record.Width = width;
+    record.Height = height;
+    record.Items = items;
+    record.ItemName = itemName;
+
+    for(unsigned int repetition = 0; repetition < repetitions; ++repetition)
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      function();
+      record.Seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    record.ResidentBytes = MemoryUsage::GetCurrentResidentBytes();
+    record.PeakResidentBytes = MemoryUsage::GetPeakResidentBytes();
+
+    std::sort(record.Seconds.begin(), record.Seconds.end());
+    std::cerr << name << " " << width << "x" << height << ": " << record.Seconds.front() << " s" << std::endl;
+    return record;
+  }
+
+  std::string EscapeJSON(const std::string& value)
+  {
+    std::string escaped;
+    for(size_t i = 0; i < value.size(); ++i)
+    {
+      if(value[i] == '"' || value[i] == '\\')
+      {
+        escaped += '\\';
+      }
+      escaped += value[i];
+    }
+    return escaped;
+  }
+
+  void WriteJSON(const std::vector<Record>& records, const Options& options, std::ostream& stream)
+  {
+    stream << "{" << std::endl
+           << "  \"threads\": " << Parallel::GetNumberOfThreads() << "," << std::endl
+           << "  \"instruction_set\": \"" << PatchDistance::GetInstructionSet() << "\"," << std::endl
+           << "  \"patch_radius\": " << options.PatchRadius << "," << std::endl
+           << "  \"repetitions\": " << options.Repetitions << "," << std::endl
+           << "  \"results\": [" << std::endl;
+
+    for(size_t recordId = 0; recordId < records.size(); ++recordId)
+    {
+      const Record& record = records[recordId];
+      const double best = record.Seconds.front();
+      const double median = record.Seconds[record.Seconds.size() / 2];
+      stream << "    {\"name\": \"" << EscapeJSON(record.Name) << "\""
+             << ", \"width\": " << record.Width << ", \"height\": " << record.Height
+             << ", \"seconds_best\": " << best << ", \"seconds_median\": " << median
+             << ", \"items\": " << record.Items << ", \"item\": \"" << record.ItemName << "\""
+             << ", \"items_per_second\": " << (best > 0.0 ? record.Items / best : 0.0)
+             << ", \"resident_bytes\": " << record.ResidentBytes
+             << ", \"peak_resident_bytes\": " << record.PeakResidentBytes << "}"
+             << (recordId + 1 < records.size() ? "," : "") << std::endl;
+    }
+
+    stream << "  ]" << std::endl << "}" << std::endl;
+  }
+
+  /** Run the benchmarks whose name contains options.Filter for one size, adding their records to 'records'.*/
+  void RunSize(const double megapixels, const Options& options, std::vector<Record>& records)
+  {
+    // Square-ish images, as the layers and overlays do not care about the aspect ratio.
+    const unsigned int width = static_cast<unsigned int>(std::sqrt(megapixels * 1e6 * 4.0 / 3.0));
+    const unsigned int height = static_cast<unsigned int>(megapixels * 1e6 / width);
+    const double numberOfPixels = static_cast<double>(width) * height;
+    if(width <= 2 * options.PatchRadius + 1 || height <= 2 * options.PatchRadius + 1)
+    {
+      throw std::runtime_error("The images must be larger than a patch!");
+    }
+
+    const unsigned int repetitions = options.Repetitions;
+    std::atomic<bool> cancel(false);
+    const LoadWorkers::ProgressCallback ignoreProgress = [](int) {};
+    const std::function<bool(const std::string&)> selected = [&options](const std::string& name)
+    {
+      return options.Filter.empty() || name.find(options.Filter) != std::string::npos;
+    };
+
+    std::cerr << "Creating the " << width << "x" << height << " image and field..." << std::endl;
+    ImageType::Pointer image = CreateImage(width, height);
+    NNFieldImageType::Pointer nnField = CreateNNField(width, height, options.PatchRadius);
+
+    // The files the reading benchmarks read. They are removed when this size is done.
+    std::stringstream ssPrefix;
+    ssPrefix << options.ScratchDirectory << "/NNFieldBenchmark_" << width << "x" << height;
+    const std::string imagePNG = ssPrefix.str() + "_image.png";
+    const std::string imageMHA = ssPrefix.str() + "_image.mha";
+    const std::string nnFieldMHA = ssPrefix.str() + "_field.mha";
+    const std::string nnFieldNNT = ssPrefix.str() + "_field.nnt";
+    const std::string nnFieldNNC = ssPrefix.str() + "_field.nnc";
+    WriteImage(image.GetPointer(), imagePNG);
+    WriteImage(image.GetPointer(), imageMHA);
+    // ITK does not align the pixels of the field after its header, which would keep it from being mapped.
+    MappedMetaImage::Write(nnField.GetPointer(), nnFieldMHA);
+    TiledNNField::Write(nnField.GetPointer(), nnFieldNNT, 256, true, cancel);
+    {
+      CompactNNField compact;
+      compact.Encode(nnField.GetPointer(), cancel);
+      compact.Write(nnFieldNNC);
+    }
+
+    // Reading (LoadImage and LoadNNField).
+    if(selected("read_image_png"))
+    {
+      records.push_back(Time("read_image_png", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        CheckRead(LoadWorkers::ReadImage(imagePNG, cancel, ignoreProgress), imagePNG);
+        }));
+    }
+    if(selected("read_image_mapped"))
+    {
+      // Mapping is lazy, so the pixels are summed to include reading them.
+      records.push_back(Time("read_image_mapped", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        const LoadWorkers::ImageResult result = CheckMapped(LoadWorkers::ReadImage(imageMHA, cancel, ignoreProgress, true),
+                                                            imageMHA);
+        const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(result.Image->GetBufferPointer());
+        volatile unsigned int sum = 0;
+        for(size_t i = 0; i < static_cast<size_t>(numberOfPixels) * 3; i += 64)
+        {
+          sum += bytes[i];
+        }
+        }));
+    }
+    if(selected("read_nnfield_mapped"))
+    {
+      records.push_back(Time("read_nnfield_mapped", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        const LoadWorkers::NNFieldResult result = CheckMapped(LoadWorkers::ReadNNField(nnFieldMHA, cancel, ignoreProgress),
+                                                              nnFieldMHA);
+        const float* const values = result.NNField->GetBufferPointer();
+        volatile float sum = 0.0f;
+        for(size_t i = 0; i < static_cast<size_t>(numberOfPixels) * 3; i += 16)
+        {
+          sum += values[i];
+        }
+        }));
+    }
+    if(selected("read_nnfield_tiled"))
+    {
+      records.push_back(Time("read_nnfield_tiled", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        const LoadWorkers::NNFieldResult result = CheckRead(LoadWorkers::ReadNNField(nnFieldNNT, cancel, ignoreProgress),
+                                                            nnFieldNNT);
+        LoadWorkers::ReadNNFieldStore(result.Store.get(), cancel);
+        }));
+    }
+    if(selected("read_nnfield_compact"))
+    {
+      records.push_back(Time("read_nnfield_compact", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        const LoadWorkers::NNFieldResult result = CheckRead(LoadWorkers::ReadNNField(nnFieldNNC, cancel, ignoreProgress),
+                                                            nnFieldNNC);
+        LoadWorkers::ReadNNFieldStore(result.Store.get(), cancel);
+        }));
+    }
+
+    std::remove(imagePNG.c_str());
+    std::remove(imageMHA.c_str());
+    std::remove(nnFieldMHA.c_str());
+    std::remove(nnFieldNNT.c_str());
+    std::remove(nnFieldNNC.c_str());
+
+    // The pick overlay of PixelClickedEventHandler: allocated once per image, then updated per click.
+    const itk::ImageRegion<2> region = image->GetLargestPossibleRegion();
+    vtkSmartPointer<vtkImageData> overlayImage = vtkSmartPointer<vtkImageData>::New();
+    PickOverlay overlay;
+    overlay.SetImageData(overlayImage);
+    if(selected("pick_overlay_initialize"))
+    {
+      records.push_back(Time("pick_overlay_initialize", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        overlay.Initialize(region);
+        }));
+    }
+    else
+    {
+      overlay.Initialize(region);
+    }
+    if(selected("pick_overlay_update"))
+    {
+      const unsigned char red[3] = {255, 0, 0};
+      const unsigned char green[3] = {0, 255, 0};
+      records.push_back(Time("pick_overlay_update", width, height, options.NumberOfPicks, "picks", repetitions, [&]()
+        {
+        Random random(1);
+        for(unsigned int pick = 0; pick < options.NumberOfPicks; ++pick)
+        {
+          itk::Index<2> pixel = {{random.Next() % width, random.Next() % height}};
+          const itk::Index<2> match = NNFieldQuery::GetMatchCenter(nnField.GetPointer(), pixel, NNFieldTypes::ABSOLUTE);
+          overlay.Clear();
+          overlay.OutlineRegion(NNFieldQuery::GetPatchRegion(pixel, options.PatchRadius), red);
+          overlay.OutlineRegion(NNFieldQuery::GetPatchRegion(match, options.PatchRadius), green);
+          overlay.Modified();
+        }
+        }));
+    }
+
+    // The layers derived from the field.
+    if(selected("layer_bands"))
+    {
+      records.push_back(Time("layer_bands", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        LoadWorkers::ComputeNNFieldLayerBands(nnField.GetPointer(), NNFieldTypes::OFFSET, 0, 64, cancel,
+                                              [](const LoadWorkers::NNFieldLayerBand&) {});
+        }));
+    }
+    if(selected("layer_flow_color"))
+    {
+      std::vector<unsigned char> rgba(static_cast<size_t>(numberOfPixels) * 4);
+      const double origin[2] = {0.0, 0.0};
+      const double spacing[2] = {1.0, 1.0};
+      records.push_back(Time("layer_flow_color", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        FlowColor::Compute(nnField->GetBufferPointer(), 3, width, height, origin, spacing, NNFieldTypes::ABSOLUTE,
+                           0.0f, &rgba[0]);
+        }));
+    }
+    if(selected("layer_coherence"))
+    {
+      records.push_back(Time("layer_coherence", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        CoherenceSegmentation segmentation;
+        segmentation.Build(nnField.GetPointer(), NNFieldTypes::ABSOLUTE, 1.0f, false, cancel);
+        }));
+    }
+    if(selected("layer_match_error"))
+    {
+      records.push_back(Time("layer_match_error", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        float maxError = 0.0f;
+        MatchError::Compute(image.GetPointer(), nnField.GetPointer(), NNFieldTypes::ABSOLUTE, options.PatchRadius,
+                            cancel, maxError);
+        }));
+    }
+    if(selected("layer_source_usage"))
+    {
+      records.push_back(Time("layer_source_usage", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        ReverseIndex index;
+        index.Build(nnField.GetPointer(), NNFieldTypes::ABSOLUTE, cancel);
+        float maxUsage = 0.0f;
+        index.CreateUsageImage(maxUsage);
+        }));
+    }
+    if(selected("channel_statistics"))
+    {
+      records.push_back(Time("channel_statistics", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        ChannelStatistics::Compute(nnField.GetPointer(), cancel);
+        }));
+    }
+    if(selected("comparison"))
+    {
+      records.push_back(Time("comparison", width, height, numberOfPixels, "pixels", repetitions, [&]()
+        {
+        NNFieldComparison::Result result;
+        NNFieldComparison::Compute(nnField.GetPointer(), nnField.GetPointer(), cancel, result);
+        }));
+    }
+
+    // Single patch distances, as computed for a pick (the layers above compute them in bulk).
+    const PatchDistance::MetricEnum metrics[2] = {PatchDistance::SSD, PatchDistance::SAD};
+    const char* const metricNames[2] = {"patch_distance_ssd", "patch_distance_sad"};
+    for(unsigned int metricId = 0; metricId < 2; ++metricId)
+    {
+      if(!selected(metricNames[metricId]))
+      {
+        continue;
+      }
+
+      const unsigned int radius = options.PatchRadius;
+      records.push_back(Time(metricNames[metricId], width, height, options.NumberOfPatchPairs, "patch pairs",
+                             repetitions, [&]()
+        {
+        Random random(2);
+        volatile PatchDistance::SumType sum = 0;
+        for(unsigned int pair = 0; pair < options.NumberOfPatchPairs; ++pair)
+        {
+          itk::Index<2> center0 = {{radius + random.Next() % (width - 2 * radius), radius + random.Next() % (height - 2 * radius)}};
+          itk::Index<2> center1 = {{radius + random.Next() % (width - 2 * radius), radius + random.Next() % (height - 2 * radius)}};
+          sum += PatchDistance::Compute(image.GetPointer(), center0, center1, radius, metrics[metricId]);
+        }
+        }));
+    }
+  }
+}
+
+namespace NNFieldBenchmark
+{
+
+void PrintUsage(std::ostream& stream)
+{
+  stream << "NNFieldBenchmark [options]" << std::endl
+         << "  --megapixels 1,10,100     the sizes of the synthetic images and fields (default 1,10)" << std::endl
+         << "  --repetitions n           how often every benchmark runs, the best and median are reported (default 3)" << std::endl
+         << "  --radius r                the patch radius (default 7)" << std::endl
+         << "  --picks n                 the number of picks of pick_overlay_update (default 10000)" << std::endl
+         << "  --pairs n                 the number of patch pairs of patch_distance_* (default 1000000)" << std::endl
+         << "  --filter text             only run the benchmarks whose name contains text" << std::endl
+         << "  --scratch directory       where the files of the reading benchmarks are written (default /tmp)" << std::endl
+         << "  --output results.json     write the results here (default: standard output)" << std::endl
+         << "The sizes run in the given order and the peak memory is that of the process, so list them ascending." << std::endl;
+}
+
+int Run(const std::vector<std::string>& arguments)
+{
+  try
+  {
+    Options options;
+    for(size_t argumentId = 0; argumentId < arguments.size(); ++argumentId)
+    {
+      const std::string& argument = arguments[argumentId];
+      if(argument == "--megapixels")
+      {
+        options.Megapixels = ToMegapixels(GetValue(arguments, argumentId));
+      }
+      else if(argument == "--repetitions")
+      {
+        options.Repetitions = std::max(1u, ToUnsigned(GetValue(arguments, argumentId)));
+      }
+      else if(argument == "--radius")
+      {
+        options.PatchRadius = ToUnsigned(GetValue(arguments, argumentId));
+      }
+      else if(argument == "--picks")
+      {
+        options.NumberOfPicks = ToUnsigned(GetValue(arguments, argumentId));
+      }
+      else if(argument == "--pairs")
+      {
+        options.NumberOfPatchPairs = ToUnsigned(GetValue(arguments, argumentId));
+      }
+      else if(argument == "--filter")
+      {
+        options.Filter = GetValue(arguments, argumentId);
+      }
+      else if(argument == "--scratch")
+      {
+        options.ScratchDirectory = GetValue(arguments, argumentId);
+      }
+      else if(argument == "--output")
+      {
+        options.OutputFileName = GetValue(arguments, argumentId);
+      }
+      else if(argument == "--help")
+      {
+        PrintUsage(std::cout);
+        return EXIT_SUCCESS;
+      }
+      else
+      {
+        throw std::runtime_error("Unknown argument " + argument);
+      }
+    }
+
+    if(options.Megapixels.empty())
+    {
+      options.Megapixels.push_back(1.0);
+      options.Megapixels.push_back(10.0);
+    }
+
+    std::vector<Record> records;
+    for(size_t sizeId = 0; sizeId < options.Megapixels.size(); ++sizeId)
+    {
+      RunSize(options.Megapixels[sizeId], options, records);
+    }
+
+    if(options.OutputFileName.empty())
+    {
+      WriteJSON(records, options, std::cout);
+    }
+    else
+    {
+      std::ofstream fileStream(options.OutputFileName.c_str());
+      if(!fileStream)
+      {
+        throw std::runtime_error("Could not open " + options.OutputFileName);
+      }
+      WriteJSON(records, options, fileStream);
+    }
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << exception.what() << std::endl;
+    PrintUsage(std::cerr);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+} // end namespace
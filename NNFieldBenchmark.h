@@ -0,0 +1,43 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldBenchmark_H
+#define NNFieldBenchmark_H
+
+// STL
+#include <ostream>
+#include <string>
+#include <vector>
+
+/** The benchmarks of the paths the inspector spends its time in: reading images and fields in every format,
+  * the pick overlay update of a click, the layers derived from the field and the patch distances.
+  *
+  * They run headless on a synthetic image and field of each requested size, which are written to a scratch
+  * directory first so the reading paths go through the file system like they do in the inspector. The results
+  * are written as JSON, one record per benchmark and size, with the best and median time of the repetitions,
+  * the throughput and the memory of the process, so they can be compared across versions.
+  */
+namespace NNFieldBenchmark
+{
+  /** Run the benchmarks with the command line arguments (without the program name). Returns the exit code.*/
+  int Run(const std::vector<std::string>& arguments);
+
+  void PrintUsage(std::ostream& stream);
+}
+
+#endif
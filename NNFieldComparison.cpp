@@ -0,0 +1,151 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldComparison.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Custom
+#include "Parallel.h"
+
+namespace NNFieldComparison
+{
+
+bool Compute(const NNFieldTypes::NNFieldImageType* const referenceNNField,
+             const NNFieldTypes::NNFieldImageType* const nnField, const std::atomic<bool>& cancel, Result& result)
+{
+  const itk::ImageRegion<2> region = referenceNNField->GetLargestPossibleRegion();
+  if(nnField->GetLargestPossibleRegion().GetSize() != region.GetSize())
+  {
+    throw std::runtime_error("NNFieldComparison: the fields do not have the same size!");
+  }
+
+  const unsigned int referenceNumberOfComponents = referenceNNField->GetNumberOfComponentsPerPixel();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  if(referenceNumberOfComponents < 2 || numberOfComponents < 2)
+  {
+    throw std::runtime_error("NNFieldComparison: the NNFields must have at least 2 channels!");
+  }
+  const bool hasScore = referenceNumberOfComponents > 2 && numberOfComponents > 2;
+
+  result.OffsetDifference = NNFieldTypes::FloatImageType::New();
+  result.OffsetDifference->SetRegions(region);
+  result.OffsetDifference->Allocate();
+  result.ScoreDifference = NULL;
+  if(hasScore)
+  {
+    result.ScoreDifference = NNFieldTypes::FloatImageType::New();
+    result.ScoreDifference->SetRegions(region);
+    result.ScoreDifference->Allocate();
+  }
+
+  const size_t width = region.GetSize()[0];
+  const size_t height = region.GetSize()[1];
+  const float* const referenceBuffer = referenceNNField->GetBufferPointer();
+  const float* const buffer = nnField->GetBufferPointer();
+  float* const offsetDifference = result.OffsetDifference->GetBufferPointer();
+  float* const scoreDifference = hasScore ? result.ScoreDifference->GetBufferPointer() : NULL;
+
+  // What every thread found in its rows, combined below.
+  struct ThreadSummary
+  {
+    float MaxOffsetDifference;
+    float MinScoreDifference;
+    float MaxScoreDifference;
+    size_t NumberOfChangedPixels;
+    size_t NumberOfFinitePixels;
+    double SumOfOffsetDifferences;
+  };
+  const ThreadSummary emptySummary = {0.0f, std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0, 0, 0.0};
+  std::vector<ThreadSummary> summaries(Parallel::GetNumberOfThreads(), emptySummary);
+
+  Parallel::ForChunks(0, height, [&](const size_t firstRow, const size_t lastRow, const unsigned int threadId)
+    {
+    ThreadSummary& summary = summaries[threadId];
+    for(size_t y = firstRow; y < lastRow; ++y)
+    {
+      if(cancel)
+      {
+        return;
+      }
+
+      for(size_t pixelId = y * width; pixelId < (y + 1) * width; ++pixelId)
+      {
+        const float* referencePixel = referenceBuffer + pixelId * referenceNumberOfComponents;
+        const float* pixel = buffer + pixelId * numberOfComponents;
+        const float differenceX = pixel[0] - referencePixel[0];
+        const float differenceY = pixel[1] - referencePixel[1];
+        const float difference = std::sqrt(differenceX * differenceX + differenceY * differenceY);
+        offsetDifference[pixelId] = difference;
+
+        // NaN is not equal to 0, so pixels where only one field is undefined count as changed.
+        summary.NumberOfChangedPixels += (difference != 0.0f) ? 1 : 0;
+        if(std::isfinite(difference))
+        {
+          ++summary.NumberOfFinitePixels;
+          summary.SumOfOffsetDifferences += difference;
+          summary.MaxOffsetDifference = std::max(summary.MaxOffsetDifference, difference);
+        }
+
+        if(hasScore)
+        {
+          const float score = pixel[2] - referencePixel[2];
+          scoreDifference[pixelId] = score;
+          if(std::isfinite(score))
+          {
+            summary.MinScoreDifference = std::min(summary.MinScoreDifference, score);
+            summary.MaxScoreDifference = std::max(summary.MaxScoreDifference, score);
+          }
+        }
+      }
+    }
+    });
+
+  if(cancel)
+  {
+    return false;
+  }
+
+  ThreadSummary total = emptySummary;
+  for(size_t threadId = 0; threadId < summaries.size(); ++threadId)
+  {
+    const ThreadSummary& summary = summaries[threadId];
+    total.MaxOffsetDifference = std::max(total.MaxOffsetDifference, summary.MaxOffsetDifference);
+    total.MinScoreDifference = std::min(total.MinScoreDifference, summary.MinScoreDifference);
+    total.MaxScoreDifference = std::max(total.MaxScoreDifference, summary.MaxScoreDifference);
+    total.NumberOfChangedPixels += summary.NumberOfChangedPixels;
+    total.NumberOfFinitePixels += summary.NumberOfFinitePixels;
+    total.SumOfOffsetDifferences += summary.SumOfOffsetDifferences;
+  }
+
+  result.MaxOffsetDifference = total.MaxOffsetDifference;
+  // Without any finite score difference, the range is empty rather than inverted.
+  result.MinScoreDifference = (total.MinScoreDifference <= total.MaxScoreDifference) ? total.MinScoreDifference : 0.0f;
+  result.MaxScoreDifference = (total.MinScoreDifference <= total.MaxScoreDifference) ? total.MaxScoreDifference : 0.0f;
+  result.NumberOfChangedPixels = total.NumberOfChangedPixels;
+  result.MeanOffsetDifference = (total.NumberOfFinitePixels > 0) ?
+                                total.SumOfOffsetDifferences / total.NumberOfFinitePixels : 0.0;
+  return true;
+}
+
+} // end namespace
@@ -0,0 +1,59 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldComparison_H
+#define NNFieldComparison_H
+
+// STL
+#include <atomic>
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** The per pixel differences between two nearest neighbor fields of the same image, e.g. the fields of two
+  * versions of a solver. Both fields are interpreted the same way, so the difference of their offsets is the
+  * difference of their channels 0 and 1, whatever the interpretation. Everything is computed in one pass over
+  * both fields, with rows split over all cores.
+  */
+namespace NNFieldComparison
+{
+  struct Result
+  {
+    /** The length of the difference between the offsets of the fields at every pixel.*/
+    NNFieldTypes::FloatImageType::Pointer OffsetDifference;
+
+    /** The score of the compared field minus that of the reference field (their channel 2) at every pixel,
+      * or NULL if one of them has no score.*/
+    NNFieldTypes::FloatImageType::Pointer ScoreDifference;
+
+    float MaxOffsetDifference;
+    float MinScoreDifference;
+    float MaxScoreDifference;
+
+    /** The number of pixels whose matches differ, and the mean offset difference over all (finite) pixels.*/
+    size_t NumberOfChangedPixels;
+    double MeanOffsetDifference;
+  };
+
+  /** Compare 'nnField' to 'referenceNNField'. Throws if the fields do not have the same size.
+    * Returns false if 'cancel' became true. This does not touch Qt or VTK, so it can run on a worker thread.*/
+  bool Compute(const NNFieldTypes::NNFieldImageType* const referenceNNField,
+               const NNFieldTypes::NNFieldImageType* const nnField, const std::atomic<bool>& cancel, Result& result);
+}
+
+#endif
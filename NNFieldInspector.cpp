@@ -19,6 +19,9 @@
 #include "NNFieldInspector.h"
 
 // STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
 
 // ITK
@@ -29,12 +32,17 @@
 #include "itkVector.h"
 
 // Qt
+#include <QActionGroup>
+#include <QFile>
 #include <QFileDialog>
+#include <QRadioButton>
 #include <QTextEdit> // for help
 #include <QDropEvent>
 #include <QMouseEvent>
 #include <QDrag>
 #include <QMimeData>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 // VTK
 #include <vtkCommand.h>
@@ -54,8 +62,37 @@
 #include "VTKHelpers/VTKHelpers.h"
 
 // Custom
+#include "FlowColor.h"
+#include "LayerImport.h"
+#include "MatchError.h"
+#include "NNFieldQuery.h"
+#include "MemoryUsage.h"
+#include "ParallelPatchMatch.h"
+#include "PatchDistance.h"
 #include "PointSelectionStyle2D.h"
 
+namespace
+{
+  /** Images and fields with more pixels than this are displayed through tiled pyramids. Smaller ones are
+    * displayed directly, which costs less than assembling tiles for them.*/
+  const size_t MinimumNumberOfPixelsForPyramid = 4096 * 4096;
+
+  /** How much memory the computed tiles of the pyramid views may take.*/
+  const size_t ImagePyramidCacheBytes = 128 * 1024 * 1024;
+  const size_t NNFieldPyramidCacheBytes = 256 * 1024 * 1024;
+
+  /** How many frames of a sequence are kept in memory, and how long playback shows each frame (at most).*/
+  const unsigned int SequenceCapacity = 16;
+  const int SequenceFrameMilliseconds = 40;
+
+  /** A watched field that was written again is compared to the current one by tiles of this size, and only the
+    * layers of the tiles that changed are updated.*/
+  const unsigned int NNFieldReloadTileSize = 64;
+
+  /** How long the file of a watched field must stay unchanged before it is read again.*/
+  const int NNFieldReloadDelayMilliseconds = 250;
+}
+
 void NNFieldInspector::on_actionHelp_activated()
 {
   QTextEdit* help=new QTextEdit();
@@ -83,14 +120,101 @@ void NNFieldInspector::SharedConstructor()
 
   this->LastPick[0] = -1;
   this->LastPick[1] = -1;
+  this->LastTargetPick[0] = -1;
+  this->LastTargetPick[1] = -1;
+  this->SequenceFrame = -1;
+  this->SequencePendingFrame = -1;
+  this->LinkedPicksNotifier = NULL;
+  this->SuppressPickPublishing = false;
+
+  this->Interpretation = NNFieldTypes::ABSOLUTE;
+
+  this->NNFieldLayersBuilt = false;
+  this->NNFieldLayerBuildId = 0;
+  this->FoundNNFieldLayersBuildId = 0;
+
+  // Beyond this, the entries used least recently are removed.
+  const unsigned long long maximumDiskLayerCacheBytes = 4ull << 30;
+  this->DiskLayerCache.reset(new LayerCache(LayerCache::GetDefaultDirectory(), maximumDiskLayerCacheBytes));
+
+  this->CancelImageLoading = false;
+  this->CancelNNFieldLoading = false;
+  this->CancelNNFieldLayerBuild = false;
+  this->CancelPatchMatch = false;
+  this->CancelMatchError = false;
+  this->CancelReverseIndex = false;
+  this->CancelCoherence = false;
+  this->CoherenceRestartPending = false;
+  this->CancelComparisonLoading = false;
+  this->CancelComparison = false;
+  this->CancelTargetImageLoading = false;
+  this->CancelChannelStatistics = false;
+  this->CancelImagePyramid = false;
+  this->CancelNNFieldPyramid = false;
+  this->CancelNNFieldReload = false;
+  this->NNFieldChecksumsRestartPending = false;
+  this->MatchErrorMax = 0.0f;
+  this->ImageLoadProgress = -1;
+  this->NNFieldLoadProgress = -1;
+  this->NNFieldLayerProgress = -1;
+  this->ImageLoadTraceStart = -1;
+  this->NNFieldLoadTraceStart = -1;
+
+  // The image, the NNField, the NNField layers and the pyramids of the image and the NNField can be built at the same time.
+  const int numberOfLoadingThreads = 5;
+  if(QThreadPool::globalInstance()->maxThreadCount() < numberOfLoadingThreads)
+  {
+    QThreadPool::globalInstance()->setMaxThreadCount(numberOfLoadingThreads);
+  }
 
-  this->Interpretation = ABSOLUTE;
+  this->connect(&this->ImageLoadWatcher, SIGNAL(finished()), SLOT(slot_ImageLoaded()));
+  this->connect(&this->NNFieldLoadWatcher, SIGNAL(finished()), SLOT(slot_NNFieldLoaded()));
+  this->connect(&this->PatchMatchWatcher, SIGNAL(finished()), SLOT(slot_PatchMatchFinished()));
+  this->connect(&this->MatchErrorWatcher, SIGNAL(finished()), SLOT(slot_MatchErrorComputed()));
+  this->connect(&this->ReverseIndexWatcher, SIGNAL(finished()), SLOT(slot_ReverseIndexBuilt()));
+  this->connect(&this->CoherenceWatcher, SIGNAL(finished()), SLOT(slot_CoherenceComputed()));
+  this->connect(&this->ComparisonLoadWatcher, SIGNAL(finished()), SLOT(slot_ComparisonNNFieldLoaded()));
+  this->connect(&this->ComparisonWatcher, SIGNAL(finished()), SLOT(slot_ComparisonComputed()));
+  this->connect(&this->TargetImageLoadWatcher, SIGNAL(finished()), SLOT(slot_TargetImageLoaded()));
+  this->connect(&this->ChannelStatisticsWatcher, SIGNAL(finished()), SLOT(slot_ChannelStatisticsComputed()));
+  this->connect(&this->ImagePyramidWatcher, SIGNAL(finished()), SLOT(slot_ImagePyramidBuilt()));
+  this->connect(&this->NNFieldPyramidWatcher, SIGNAL(finished()), SLOT(slot_NNFieldPyramidBuilt()));
+  this->connect(&this->NNFieldReloadWatcher, SIGNAL(finished()), SLOT(slot_NNFieldReloaded()));
+
+  this->NNFieldReloadTimer.setSingleShot(true);
+  this->NNFieldReloadTimer.setInterval(NNFieldReloadDelayMilliseconds);
+  this->connect(&this->NNFieldReloadTimer, SIGNAL(timeout()), SLOT(slot_NNFieldReloadTimeout()));
+  this->connect(&this->NNFieldFileWatcher, SIGNAL(fileChanged(QString)), SLOT(slot_NNFieldFileChanged()));
+
+  this->PyramidViewTimer.setSingleShot(true);
+  this->PyramidViewTimer.setInterval(0);
+  this->connect(&this->PyramidViewTimer, SIGNAL(timeout()), SLOT(slot_UpdatePyramidViews()));
+
+  // Snapshots arriving faster than this are skipped, the worker never waits for the display.
+  const int millisecondsBetweenSnapshots = 50;
+  this->PatchMatchSnapshotTimer.setInterval(millisecondsBetweenSnapshots);
+  this->connect(&this->PatchMatchSnapshotTimer, SIGNAL(timeout()), SLOT(slot_PatchMatchSnapshotTimeout()));
+
+  // Playback waits for frames that are not read yet, rather than skipping them.
+  this->SequencePlaybackTimer.setInterval(SequenceFrameMilliseconds);
+  this->connect(&this->SequencePlaybackTimer, SIGNAL(timeout()), SLOT(slot_SequencePlaybackTimeout()));
+  this->widgetSequence->hide();
+
+  // The stages of the last traced operation are shown next to the messages of the status bar.
+  this->TraceLabel = new QLabel(this);
+  this->statusbar->addPermanentWidget(this->TraceLabel);
+  this->TraceLabel->hide();
+  Trace::SetThreadName("GUI");
 
   // Turn slices visibility off to prevent errors that there is not yet data.
   this->ImageLayer.ImageSlice->VisibilityOff();
   this->NNFieldMagnitudeLayer.ImageSlice->VisibilityOff();
   this->NNFieldXLayer.ImageSlice->VisibilityOff();
   this->NNFieldYLayer.ImageSlice->VisibilityOff();
+  this->FlowColorLayer.ImageSlice->VisibilityOff();
+  this->CoherenceLayer.ImageSlice->VisibilityOff();
+  this->MatchErrorLayer.ImageSlice->VisibilityOff();
+  this->SourceUsageLayer.ImageSlice->VisibilityOff();
   this->PickLayer.ImageSlice->VisibilityOff();
 
   this->Renderer = vtkSmartPointer<vtkRenderer>::New();
@@ -101,8 +225,14 @@ void NNFieldInspector::SharedConstructor()
   this->Renderer->AddViewProp(this->NNFieldMagnitudeLayer.ImageSlice);
   this->Renderer->AddViewProp(this->NNFieldXLayer.ImageSlice);
   this->Renderer->AddViewProp(this->NNFieldYLayer.ImageSlice);
+  this->Renderer->AddViewProp(this->FlowColorLayer.ImageSlice);
+  this->Renderer->AddViewProp(this->CoherenceLayer.ImageSlice);
+  this->Renderer->AddViewProp(this->MatchErrorLayer.ImageSlice);
+  this->Renderer->AddViewProp(this->SourceUsageLayer.ImageSlice);
   this->Renderer->AddViewProp(this->PickLayer.ImageSlice);
 
+  this->PickLayerOverlay.SetImageData(this->PickLayer.ImageData);
+
   this->NNField = NNFieldImageType::New();
   this->Image = ImageType::New();
 
@@ -122,10 +252,50 @@ void NNFieldInspector::SharedConstructor()
   this->Camera.SetInteractorStyle(this->SelectionStyle);
 
   this->qvtkWidget->GetInteractor()->AddObserver(vtkCommand::KeyPressEvent, this, &NNFieldInspector::KeypressCallbackFunction);
+
+  this->Renderer->AddObserver(vtkCommand::EndEvent, this, &NNFieldInspector::RendererEndCallback);
+
+  // The right pane is only shown while a field is compared or a target image is set.
+  QActionGroup* rightPaneLayers = new QActionGroup(this);
+  rightPaneLayers->addAction(this->actionShowComparisonField);
+  rightPaneLayers->addAction(this->actionShowOffsetDifference);
+  rightPaneLayers->addAction(this->actionShowScoreDifference);
+  this->qvtkWidgetRight->hide();
+
+  this->ComparisonFieldLayer.ImageSlice->VisibilityOff();
+  this->OffsetDifferenceLayer.ImageSlice->VisibilityOff();
+  this->ScoreDifferenceLayer.ImageSlice->VisibilityOff();
+  this->TargetImageLayer.ImageSlice->VisibilityOff();
+  this->PickLayerRight.ImageSlice->VisibilityOff();
+
+  this->RendererRight = vtkSmartPointer<vtkRenderer>::New();
+  this->qvtkWidgetRight->GetRenderWindow()->AddRenderer(this->RendererRight);
+  this->RendererRight->AddViewProp(this->ComparisonFieldLayer.ImageSlice);
+  this->RendererRight->AddViewProp(this->OffsetDifferenceLayer.ImageSlice);
+  this->RendererRight->AddViewProp(this->ScoreDifferenceLayer.ImageSlice);
+  this->RendererRight->AddViewProp(this->TargetImageLayer.ImageSlice);
+  this->RendererRight->AddViewProp(this->PickLayerRight.ImageSlice);
+
+  this->PickLayerRightOverlay.SetImageData(this->PickLayerRight.ImageData);
+
+  vtkSmartPointer<vtkPointPicker> pointPickerRight = vtkSmartPointer<vtkPointPicker>::New();
+  this->qvtkWidgetRight->GetRenderWindow()->GetInteractor()->SetPicker(pointPickerRight);
+
+  // Picks in the right pane are handled like those in the left pane, so the panes are linked.
+  this->SelectionStyleRight = PointSelectionStyle2D::New();
+  this->SelectionStyleRight->SetCurrentRenderer(this->RendererRight);
+  this->qvtkWidgetRight->GetRenderWindow()->GetInteractor()->SetInteractorStyle(this->SelectionStyleRight);
+  this->SelectionStyleRight->AddObserver(PointSelectionStyle2D::PixelClickedEvent, this,
+                                         &NNFieldInspector::PixelClickedEventHandler);
+
+  this->CameraRight.SetRenderer(this->RendererRight);
+  this->CameraRight.SetRenderWindow(this->qvtkWidgetRight->GetRenderWindow());
+  this->CameraRight.SetInteractorStyle(this->SelectionStyleRight);
 }
 
 NNFieldInspector::NNFieldInspector(const std::string& imageFileName,
-                                   const std::string& nnFieldFileName) : PatchRadius(7)
+                                   const std::string& nnFieldFileName) :
+  ImagePyramidView(ImagePyramidCacheBytes), NNFieldPyramidView(NNFieldPyramidCacheBytes), PatchRadius(7)
 {
   SharedConstructor();
   this->ImageFileName = imageFileName;
@@ -133,304 +303,3294 @@ NNFieldInspector::NNFieldInspector(const std::string& imageFileName,
 }
 
 // Constructor
-NNFieldInspector::NNFieldInspector() : PatchRadius(7)
+NNFieldInspector::NNFieldInspector() :
+  ImagePyramidView(ImagePyramidCacheBytes), NNFieldPyramidView(NNFieldPyramidCacheBytes), PatchRadius(7)
 {
   SharedConstructor();
 };
 
 void NNFieldInspector::LoadNNField(const std::string& fileName)
 {
-  typedef itk::ImageFileReader<NNFieldImageType> NNFieldReaderType;
-  NNFieldReaderType::Pointer nnFieldReader = NNFieldReaderType::New();
-  nnFieldReader->SetFileName(fileName);
-  nnFieldReader->Update();
+  // A field that is opened on its own replaces the sequence.
+  CloseNNFieldSequence();
+
+  // Only one field is loaded at a time.
+  this->CancelNNFieldLoading = true;
+  this->NNFieldLoadWatcher.waitForFinished();
+  this->CancelNNFieldLoading = false;
 
-  ITKHelpers::DeepCopy(nnFieldReader->GetOutput(), this->NNField.GetPointer());
+  this->NNFieldLoadProgress = 0;
+  UpdateLoadingStatus();
+  this->NNFieldLoadTraceStart = Trace::Now();
+  this->LoadingNNFieldFileName = fileName;
 
-  // Extract the first two channels
+  // A watched file is rewritten by the solver, which truncates it first. The pages of a mapping past its new end
+  // cannot be read (SIGBUS), so a watched field is read into memory.
+  const bool map = !this->actionWatchNNField->isChecked();
+
+  // The worker reports back through queued calls, so the slots always run on the GUI thread.
+  std::function<LoadWorkers::NNFieldResult()> work = [this, fileName, map]()
   {
-  std::vector<unsigned int> channels;
-  channels.push_back(0);
-  channels.push_back(1);
+    Trace::Scope scope("ReadNNField");
+    return LoadWorkers::ReadNNField(fileName, this->CancelNNFieldLoading, [this](int percent)
+      {
+      QMetaObject::invokeMethod(this, "slot_NNFieldLoadProgress", Qt::QueuedConnection, Q_ARG(int, percent));
+      }, map);
+  };
+  this->NNFieldLoadWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::slot_NNFieldLoaded()
+{
+  Trace::Operation operation("LoadNNField", this->NNFieldLoadTraceStart, "ReadNNField (worker)");
 
-  typedef itk::VectorImage<int, 2> VectorImageType;
-  VectorImageType::Pointer vectorImage = VectorImageType::New();
-  vectorImage->SetNumberOfComponentsPerPixel(2);
-  vectorImage->SetRegions(this->NNField->GetLargestPossibleRegion());
-  vectorImage->Allocate();
+  LoadWorkers::NNFieldResult result = this->NNFieldLoadWatcher.result();
+  this->NNFieldLoadProgress = -1;
+  UpdateLoadingStatus();
 
-  ITKHelpers::ExtractChannels(this->NNField.GetPointer(), channels, vectorImage.GetPointer());
-  ITKVTKHelpers::ITKImageToVTKMagnitudeImage(vectorImage.GetPointer(), this->NNFieldMagnitudeLayer.ImageData);
+  if(result.Cancelled)
+  {
+    this->statusbar->showMessage("Loading the NNField was cancelled.");
+    return;
+  }
+
+  if(!result.Error.empty())
+  {
+    std::cerr << "Could not load the NNField: " << result.Error << std::endl;
+    this->statusbar->showMessage(QString("Could not load the NNField: ") + result.Error.c_str());
+    return;
   }
 
-  ITKVTKHelpers::ITKImageChannelToVTKImage(this->NNField.GetPointer(), 0, this->NNFieldXLayer.ImageData);
+  {
+    Trace::Scope scope("SetNNField");
+    if(result.Store)
+    {
+      SetStoredNNField(result.Store);
+    }
+    else
+    {
+      SetNNField(result.NNField, result.Mapping);
+
+      // The reverse index is built as soon as a field is loaded, so the first query does not wait for it.
+      StartReverseIndexBuild();
+    }
+  }
 
-  ITKVTKHelpers::ITKImageChannelToVTKImage(this->NNField.GetPointer(), 1, this->NNFieldYLayer.ImageData);
+  this->LoadedNNFieldFileName = this->LoadingNNFieldFileName;
+  UpdateNNFieldFileWatch();
+  StartNNFieldChecksums();
 
-  UpdateDisplayedImages();
+  std::cout << "Loaded NNField, memory: " << MemoryUsage::GetReport() << std::endl;
+  this->statusbar->showMessage(QString("Loaded NNField (") + MemoryUsage::GetReport().c_str() + ")");
 
-  this->Renderer->ResetCamera();
+  ResetCamera(GetNNFieldRegion());
 
   Refresh();
 }
 
-void NNFieldInspector::Refresh()
+void NNFieldInspector::SetNNField(NNFieldImageType* const nnField, const std::shared_ptr<void>& bufferOwner)
 {
-  this->qvtkWidget->GetRenderWindow()->Render();
+  // The layers and the pyramid reference the buffer of the current field, which is released below.
+  StopNNFieldLayerBuild();
+  ClearNNFieldLayerCaches();
+  StopNNFieldPyramidBuild();
+  InvalidateMatchError();
+  InvalidateReverseIndex();
+  InvalidateCoherence();
+  InvalidateComparison();
+  InvalidateFlowColorLayer();
+  StopChannelStatistics();
+  for(unsigned int layerId = 0; layerId < this->ExtraChannelLayers.size(); ++layerId)
+  {
+    this->ExtraChannelLayers[layerId]->ImageData->Initialize();
+  }
+  this->NNFieldMagnitudeLayer.ImageData->Initialize();
+  this->NNFieldXLayer.ImageData->Initialize();
+  this->NNFieldYLayer.ImageData->Initialize();
+
+  this->NNField = nnField;
+  // This is only done once this->NNField no longer refers to the previous buffer, as it may release it.
+  this->NNFieldBufferOwner = bufferOwner;
+  this->StoredNNField.reset();
+
+  // Whoever sets a field read from a file of its own sets its name again.
+  this->LoadedNNFieldFileName.clear();
+  this->NNFieldTileChecksums.clear();
+  if(!this->NNFieldFileWatcher.files().isEmpty())
+  {
+    UpdateNNFieldFileWatch();
+  }
+
+  // The extra channels are views of the field, so they are cheap to set up. Their statistics need a pass over it.
+  UpdateExtraChannelLayers();
+  StartChannelStatistics();
+
+  if(IsNNFieldDisplayedByPyramid())
+  {
+    StartNNFieldPyramidBuild();
+  }
+
+  // The comparison field is compared to the new field, if they have the same size.
+  StartComparison();
+
+  // The NNField layers are only built here if one of them is displayed. This also renders.
+  UpdateDisplayedImages();
 }
 
-void NNFieldInspector::LoadImage(const std::string& fileName)
+void NNFieldInspector::SetStoredNNField(const std::shared_ptr<NNFieldStore>& store)
 {
-  typedef itk::ImageFileReader<ImageType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fileName);
-  reader->Update();
+  // Stops the workers of the current field and empties the layers. Nothing is started for an empty field.
+  SetNNField(NNFieldImageType::New(), std::shared_ptr<void>());
 
-  ITKHelpers::DeepCopy(reader->GetOutput(), this->Image.GetPointer());
+  this->StoredNNField = store;
+  UpdateExtraChannelLayers();
 
-  ITKVTKHelpers::ITKImageToVTKRGBImage(this->Image.GetPointer(), this->ImageLayer.ImageData);
+  // The ranges recorded in the file replace the passes over the field that set the lookup tables otherwise.
+  SetStoredNNFieldLookupTables();
+  for(unsigned int channel = 2; channel < store->GetNumberOfComponents(); ++channel)
+  {
+    LayerImport::SetGrayscaleLookupTable(*this->ExtraChannelLayers[channel - 2], store->GetChannelMin(channel),
+                                         store->GetChannelMax(channel), channel);
 
-  UpdateDisplayedImages();
+    std::stringstream ss;
+    ss << "Channel " << channel << " [" << store->GetChannelMin(channel) << ", " << store->GetChannelMax(channel) << "]";
+    this->ExtraChannelRadioButtons[channel - 2]->setToolTip(ss.str().c_str());
+  }
 
-  this->Renderer->ResetCamera();
+  StartNNFieldPyramidBuild();
+  UpdateDisplayedImages();
 
-  this->qvtkWidget->GetRenderWindow()->Render();
+  this->statusbar->showMessage("The match error, source usage and channel statistics need a field in memory (.mha).");
 }
 
-void NNFieldInspector::on_actionFlipHorizontally_activated()
+itk::ImageRegion<2> NNFieldInspector::GetNNFieldRegion() const
 {
-  this->Camera.FlipHorizontally();
+  if(this->StoredNNField)
+  {
+    return this->StoredNNField->GetRegion();
+  }
+  return this->NNField->GetLargestPossibleRegion();
 }
 
-void NNFieldInspector::on_actionFlipVertically_activated()
+unsigned int NNFieldInspector::GetNNFieldNumberOfComponents() const
 {
-  this->Camera.FlipVertically();
+  if(this->StoredNNField)
+  {
+    return this->StoredNNField->GetNumberOfComponents();
+  }
+  return this->NNField->GetNumberOfComponentsPerPixel();
 }
 
-void NNFieldInspector::on_actionOpenImage_activated()
+bool NNFieldInspector::GetNNFieldPixel(const itk::Index<2>& index, std::vector<float>& pixel)
 {
-  // Get a filename to open
-  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".",
-                                                  "Image Files (*.jpg *.jpeg *.bmp *.png)");
+  pixel.resize(GetNNFieldNumberOfComponents());
+  if(!this->StoredNNField)
+  {
+    const NNFieldImageType::PixelType nnFieldPixel = this->NNField->GetPixel(index);
+    std::copy(&nnFieldPixel[0], &nnFieldPixel[0] + pixel.size(), pixel.begin());
+    return true;
+  }
 
-  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
-  if(fileName.toStdString().empty())
+  try
+  {
+    this->StoredNNField->GetPixel(index, &pixel[0]);
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << "Could not read the NNField: " << exception.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void NNFieldInspector::StartNNFieldLayerBuild()
+{
+  const NNFieldLayerCache& cache = this->NNFieldLayerCaches[this->Interpretation];
+  if(cache.Complete)
+  {
+    // The layers of this interpretation were built before.
+    if(!IsNNFieldDisplayedByPyramid())
     {
-    std::cout << "Filename was empty." << std::endl;
-    return;
+      this->NNFieldXLayer.ImageData->ShallowCopy(cache.X);
+      this->NNFieldYLayer.ImageData->ShallowCopy(cache.Y);
+      this->NNFieldMagnitudeLayer.ImageData->ShallowCopy(cache.Magnitude);
     }
+    SetNNFieldLayerLookupTables(cache.ChannelMin, cache.ChannelMax, cache.MagnitudeMax);
+    this->NNFieldLayersBuilt = true;
+    return;
+  }
 
-  LoadImage(fileName.toStdString());
+  // Building the layers touches every pixel of the field, so this is deferred until they are needed.
+  // For absolute fields the X and Y layers are views of the field, for offset fields they are filled in as the
+  // bands arrive, like the magnitude layer. When the field is displayed through its pyramid, the bands only
+  // provide the ranges of the layers.
+  if(!IsNNFieldDisplayedByPyramid())
+  {
+    const itk::Size<2> size = this->NNField->GetLargestPossibleRegion().GetSize();
+    std::vector<Layer*> bandLayers(1, &this->NNFieldMagnitudeLayer);
+    if(this->Interpretation == NNFieldTypes::ABSOLUTE)
+    {
+      LayerImport::WrapVectorImageChannel(this->NNField.GetPointer(), 0, this->NNFieldXLayer);
+      LayerImport::WrapVectorImageChannel(this->NNField.GetPointer(), 1, this->NNFieldYLayer);
+    }
+    else
+    {
+      bandLayers.push_back(&this->NNFieldXLayer);
+      bandLayers.push_back(&this->NNFieldYLayer);
+    }
 
-  this->Camera.SetCameraPositionPNG();
-}
+    for(unsigned int layerId = 0; layerId < bandLayers.size(); ++layerId)
+    {
+      vtkImageData* const imageData = bandLayers[layerId]->ImageData;
+      imageData->Initialize();
+      imageData->SetDimensions(size[0], size[1], 1);
+      imageData->AllocateScalars(VTK_FLOAT, 1);
+      float* values = static_cast<float*>(imageData->GetScalarPointer());
+      std::fill(values, values + static_cast<size_t>(size[0]) * size[1], 0.0f);
+    }
+  }
 
+  for(unsigned int channel = 0; channel < 2; ++channel)
+  {
+    this->NNFieldChannelMin[channel] = std::numeric_limits<float>::max();
+    this->NNFieldChannelMax[channel] = -std::numeric_limits<float>::max();
+  }
+  this->NNFieldMagnitudeMax = 0.0f;
+  this->NNFieldLayerRowsBuilt = 0;
+
+  this->NNFieldLayersBuilt = true;
+  this->NNFieldLayerBuildId++;
+  this->CancelNNFieldLayerBuild = false;
+  this->NNFieldLayerProgress = 0;
+  UpdateLoadingStatus();
+  this->LastProgressiveRender.start();
+
+  // The worker holds its own references, so the field (and its mapping) outlive it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+  const unsigned int buildId = this->NNFieldLayerBuildId;
+  const INTERPRETATION_ENUM interpretation = this->Interpretation;
+
+  // Only complete layers of fields in memory are cached, the fields of PatchMatch change with every snapshot. The
+  // frames of a sequence that is playing are only read, writing each of them would evict the fields being inspected.
+  std::shared_ptr<LayerCache> diskCache;
+  if(!IsNNFieldDisplayedByPyramid() && !this->PatchMatchSnapshots)
+  {
+    diskCache = this->DiskLayerCache;
+  }
+  const bool writeDiskCache = !this->SequencePlaybackTimer.isActive();
 
-void NNFieldInspector::on_actionOpenNNField_activated()
-{
-  // Get a filename to open
-  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".",
-                                                  "Image Files (*.mha)");
+  std::function<void()> work = [this, nnField, bufferOwner, buildId, interpretation, diskCache, writeDiskCache]()
+  {
+    // The X and Y layers of absolute fields view the field, so they are not cached.
+    std::vector<std::string> layerNames(1, "Magnitude");
+    if(interpretation != NNFieldTypes::ABSOLUTE)
+    {
+      layerNames.push_back("X");
+      layerNames.push_back("Y");
+    }
 
-  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
-  if(fileName.toStdString().empty())
+    std::unique_ptr<LayerCache::Writer> writer;
+    if(diskCache)
     {
-    std::cout << "Filename was empty." << std::endl;
-    return;
+      std::vector<LayerCache::HashType> keyParts;
+      {
+        Trace::Scope scope("HashNNField");
+        keyParts.push_back(LayerCache::Hash(nnField.GetPointer(), this->CancelNNFieldLayerBuild));
+      }
+      // The build is stopped whenever the field is replaced (e.g. by every frame of a sequence), which must not wait
+      // for the hash.
+      if(this->CancelNNFieldLayerBuild)
+      {
+        return;
+      }
+      keyParts.push_back(interpretation);
+      const std::string key = LayerCache::MakeKey("nnfieldlayers", keyParts);
+
+      std::shared_ptr<LayerCache::Entry> entry = diskCache->Find(key);
+      bool complete = static_cast<bool>(entry);
+      for(unsigned int layerId = 0; complete && layerId < layerNames.size(); ++layerId)
+      {
+        complete = entry->GetLayer(layerNames[layerId]) &&
+                   entry->GetLayer(layerNames[layerId])->GetLargestPossibleRegion() == nnField->GetLargestPossibleRegion();
+      }
+      if(complete)
+      {
+        QMutexLocker locker(&this->PendingBandsMutex);
+        this->FoundNNFieldLayers = entry;
+        this->FoundNNFieldLayersBuildId = buildId;
+        QMetaObject::invokeMethod(this, "slot_NNFieldLayersFoundOnDisk", Qt::QueuedConnection);
+        return;
+      }
+
+      if(writeDiskCache)
+      {
+        try
+        {
+          writer.reset(new LayerCache::Writer(*diskCache, key, layerNames, nnField->GetLargestPossibleRegion().GetSize()));
+        }
+        catch(std::runtime_error& exception)
+        {
+          std::cerr << exception.what() << std::endl;
+        }
+      }
     }
 
-  LoadNNField(fileName.toStdString());
+    // The ranges of the layers are kept with the entry, so they need not be computed when it is read.
+    float channelMin[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float channelMax[2] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+    float magnitudeMax = 0.0f;
+    unsigned int numberOfRows = 0;
+
+    const unsigned int rowsPerBand = 64;
+    LoadWorkers::ComputeNNFieldLayerBands(nnField.GetPointer(), interpretation, buildId, rowsPerBand,
+                                          this->CancelNNFieldLayerBuild,
+      [&](const LoadWorkers::NNFieldLayerBand& band)
+      {
+      if(writer)
+      {
+        writer->WriteRows(0, band.FirstRow, &band.Magnitude[0], band.NumberOfRows);
+        if(!band.X.empty())
+        {
+          writer->WriteRows(1, band.FirstRow, &band.X[0], band.NumberOfRows);
+          writer->WriteRows(2, band.FirstRow, &band.Y[0], band.NumberOfRows);
+        }
+        for(unsigned int channel = 0; channel < 2; ++channel)
+        {
+          channelMin[channel] = std::min(channelMin[channel], band.ChannelMin[channel]);
+          channelMax[channel] = std::max(channelMax[channel], band.ChannelMax[channel]);
+        }
+        magnitudeMax = std::max(magnitudeMax, band.MagnitudeMax);
+        numberOfRows += band.NumberOfRows;
+      }
+
+      QMutexLocker locker(&this->PendingBandsMutex);
+      this->PendingBands.push_back(band);
+      // Bands that arrive while the GUI is busy are collected and handled together.
+      if(this->PendingBands.size() == 1)
+      {
+        QMetaObject::invokeMethod(this, "slot_NNFieldLayerBandsReady", Qt::QueuedConnection);
+      }
+      });
+
+    // A stopped build leaves rows out, so its entry is discarded.
+    if(writer && numberOfRows == nnField->GetLargestPossibleRegion().GetSize()[1])
+    {
+      writer->SetValue("ChannelMin0", channelMin[0]);
+      writer->SetValue("ChannelMin1", channelMin[1]);
+      writer->SetValue("ChannelMax0", channelMax[0]);
+      writer->SetValue("ChannelMax1", channelMax[1]);
+      writer->SetValue("MagnitudeMax", magnitudeMax);
+      writer->Commit();
+    }
+  };
+  this->NNFieldLayerWatcher.setFuture(QtConcurrent::run(work));
 }
 
-void NNFieldInspector::PixelClickedEventHandler(vtkObject* caller, long unsigned int eventId,
-                                                void* callData)
+void NNFieldInspector::StopNNFieldLayerBuild()
 {
-  if(!this->Image)
-  {
-    std::cerr << "Image must be set before clicking!" << std::endl;
-    return;
-  }
+  this->CancelNNFieldLayerBuild = true;
+  this->NNFieldLayerWatcher.waitForFinished();
+
+  // Any bands still queued belong to the stopped build.
+  this->NNFieldLayerBuildId++;
+  this->NNFieldLayersBuilt = false;
+  this->NNFieldLayerProgress = -1;
+  UpdateLoadingStatus();
+}
 
-  if(!this->NNField)
+void NNFieldInspector::slot_NNFieldLayerBandsReady()
+{
+  std::vector<LoadWorkers::NNFieldLayerBand> bands;
   {
-    std::cerr << "NNField must be set before clicking!" << std::endl;
-    return;
+  QMutexLocker locker(&this->PendingBandsMutex);
+  bands.swap(this->PendingBands);
   }
 
-  double* pixel = reinterpret_cast<double*>(callData);
-
-  //std::cout << "Picked " << pixel[0] << " " << pixel[1] << std::endl;
-
-  itk::Index<2> pickedIndex = {{static_cast<unsigned int>(pixel[0]), static_cast<unsigned int>(pixel[1])}};
-
-  // Store the pick
-  this->LastPick[0] = pickedIndex[0];
-  this->LastPick[1] = pickedIndex[1];
+  const itk::Size<2> size = this->NNField->GetLargestPossibleRegion().GetSize();
+  const bool copyLayers = !IsNNFieldDisplayedByPyramid();
+  bool anyCurrentBand = false;
 
-  std::cout << "Picked index: " << pickedIndex << std::endl;
+  for(unsigned int bandId = 0; bandId < bands.size(); ++bandId)
+  {
+    const LoadWorkers::NNFieldLayerBand& band = bands[bandId];
+    if(band.Generation != this->NNFieldLayerBuildId)
+    {
+      continue;
+    }
+    anyCurrentBand = true;
 
-  std::stringstream ssSelected;
-  ssSelected << pickedIndex;
-  this->lblSelected->setText(ssSelected.str().c_str());
+    if(copyLayers)
+    {
+      float* magnitude = static_cast<float*>(this->NNFieldMagnitudeLayer.ImageData->GetScalarPointer(0, band.FirstRow, 0));
+      std::copy(band.Magnitude.begin(), band.Magnitude.end(), magnitude);
+      if(!band.X.empty())
+      {
+        float* matchX = static_cast<float*>(this->NNFieldXLayer.ImageData->GetScalarPointer(0, band.FirstRow, 0));
+        std::copy(band.X.begin(), band.X.end(), matchX);
+        float* matchY = static_cast<float*>(this->NNFieldYLayer.ImageData->GetScalarPointer(0, band.FirstRow, 0));
+        std::copy(band.Y.begin(), band.Y.end(), matchY);
+      }
+    }
 
-  itk::ImageRegion<2> pickedRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pickedIndex, this->PatchRadius);
+    for(unsigned int channel = 0; channel < 2; ++channel)
+    {
+      this->NNFieldChannelMin[channel] = std::min(this->NNFieldChannelMin[channel], band.ChannelMin[channel]);
+      this->NNFieldChannelMax[channel] = std::max(this->NNFieldChannelMax[channel], band.ChannelMax[channel]);
+    }
+    this->NNFieldMagnitudeMax = std::max(this->NNFieldMagnitudeMax, band.MagnitudeMax);
+    this->NNFieldLayerRowsBuilt += band.NumberOfRows;
+  }
 
-  if(!this->Image->GetLargestPossibleRegion().IsInside(pickedRegion))
+  if(!anyCurrentBand)
   {
-    std::cout << "Picked patch that is not entirely inside image!" << std::endl;
     return;
   }
 
-  NNFieldImageType::PixelType nnFieldPixel = this->NNField->GetPixel(pickedIndex);
-
-  if(this->Interpretation == OFFSET)
+  if(copyLayers)
   {
-    this->BestMatchCenter = {{static_cast<unsigned int>(nnFieldPixel[0]) + pickedIndex[0],
-                        static_cast<unsigned int>(nnFieldPixel[1]) + pickedIndex[1]}};
+    this->NNFieldMagnitudeLayer.ImageData->Modified();
+    this->NNFieldXLayer.ImageData->Modified();
+    this->NNFieldYLayer.ImageData->Modified();
   }
-  else if(this->Interpretation == ABSOLUTE)
+  SetNNFieldLayerLookupTables(this->NNFieldChannelMin, this->NNFieldChannelMax, this->NNFieldMagnitudeMax);
+
+  const bool finished = (this->NNFieldLayerRowsBuilt == size[1]);
+  this->NNFieldLayerProgress = finished ? -1 : static_cast<int>((100 * this->NNFieldLayerRowsBuilt) / size[1]);
+  UpdateLoadingStatus();
+  if(finished)
   {
-    this->BestMatchCenter = {{static_cast<unsigned int>(nnFieldPixel[0]),
-                        static_cast<unsigned int>(nnFieldPixel[1])}};
+    CacheNNFieldLayers();
   }
-  else
+
+  // Rendering after every band would make the GUI, rather than the worker, the bottleneck.
+  const int minimumMillisecondsBetweenRenders = 50;
+  if(finished || this->LastProgressiveRender.elapsed() > minimumMillisecondsBetweenRenders)
   {
-    throw std::runtime_error("Invalid Interpretation value set!");
+    Refresh();
+    this->LastProgressiveRender.restart();
   }
+}
 
-  itk::ImageRegion<2> matchRegion =
-        ITKHelpers::GetRegionInRadiusAroundPixel(this->BestMatchCenter, this->PatchRadius);
-  std::cout << "Best match center: " << this->BestMatchCenter << std::endl;
-
-  std::stringstream ssBestMatch;
-  ssBestMatch << this->BestMatchCenter;
-  this->lblNN->setText(ssBestMatch.str().c_str());
-
-  // Highlight patches
-  ImageType::PixelType red;
-  red[0] = 255; red[1] = 0; red[2] = 0;
-
-  ImageType::PixelType green;
-  green[0] = 0; green[1] = 255; green[2] = 0;
-
-  ImageType::Pointer tempImage = ImageType::New();
-  tempImage->SetRegions(this->Image->GetLargestPossibleRegion());
-  tempImage->Allocate();
-  tempImage->FillBuffer(itk::NumericTraits<ImageType::PixelType>::ZeroValue());
-
-  ITKHelpers::OutlineRegion(tempImage.GetPointer(), pickedRegion, red);
-  tempImage->SetPixel(ITKHelpers::GetRegionCenter(pickedRegion), red);
+void NNFieldInspector::slot_NNFieldLayersFoundOnDisk()
+{
+  std::shared_ptr<LayerCache::Entry> entry;
+  unsigned int buildId = 0;
+  {
+    QMutexLocker locker(&this->PendingBandsMutex);
+    entry.swap(this->FoundNNFieldLayers);
+    buildId = this->FoundNNFieldLayersBuildId;
+  }
 
-  ITKHelpers::OutlineRegion(tempImage.GetPointer(), matchRegion, green);
-  tempImage->SetPixel(ITKHelpers::GetRegionCenter(matchRegion), green);
+  if(!entry || buildId != this->NNFieldLayerBuildId)
+  {
+    return;
+  }
 
-  typedef itk::Image<float, 2> FloatImageType;
-  FloatImageType::Pointer magnitudeImage = FloatImageType::New();
-  ITKHelpers::MagnitudeImage(tempImage.GetPointer(), magnitudeImage.GetPointer());
+  // The layers view the mapped files, so only the pages that are displayed are read.
+  LayerImport::WrapFloatImage(entry->GetLayer("Magnitude"), this->NNFieldMagnitudeLayer);
+  if(this->Interpretation != NNFieldTypes::ABSOLUTE)
+  {
+    LayerImport::WrapFloatImage(entry->GetLayer("X"), this->NNFieldXLayer);
+    LayerImport::WrapFloatImage(entry->GetLayer("Y"), this->NNFieldYLayer);
+  }
 
-  // 4 for RGBA
-  ITKVTKHelpers::InitializeVTKImage(this->Image->GetLargestPossibleRegion(), 4, this->PickLayer.ImageData);
-  VTKHelpers::MakeImageTransparent(this->PickLayer.ImageData);
-  std::vector<itk::Index<2> > nonZeroPixels = ITKHelpers::GetNonZeroPixels(magnitudeImage.GetPointer());
-  ITKVTKHelpers::SetPixelTransparency(this->PickLayer.ImageData, nonZeroPixels, VTKHelpers::OPAQUE_PIXEL);
+  this->NNFieldChannelMin[0] = entry->GetValue("ChannelMin0", 0.0f);
+  this->NNFieldChannelMin[1] = entry->GetValue("ChannelMin1", 0.0f);
+  this->NNFieldChannelMax[0] = entry->GetValue("ChannelMax0", 1.0f);
+  this->NNFieldChannelMax[1] = entry->GetValue("ChannelMax1", 1.0f);
+  this->NNFieldMagnitudeMax = entry->GetValue("MagnitudeMax", 1.0f);
+  this->NNFieldLayerRowsBuilt = this->NNField->GetLargestPossibleRegion().GetSize()[1];
+  SetNNFieldLayerLookupTables(this->NNFieldChannelMin, this->NNFieldChannelMax, this->NNFieldMagnitudeMax);
 
-  // 'true' means 'already initialized'
-  ITKVTKHelpers::ITKImageToVTKRGBImage(tempImage.GetPointer(), this->PickLayer.ImageData, true);
-  this->PickLayer.ImageSlice->VisibilityOn();
+  this->NNFieldLayerProgress = -1;
+  UpdateLoadingStatus();
+  CacheNNFieldLayers();
+  this->NNFieldLayerCaches[this->Interpretation].DiskEntry = entry;
 
   Refresh();
 }
 
-void NNFieldInspector::SetPatchRadius(const unsigned int patchRadius)
+void NNFieldInspector::CacheNNFieldLayers()
 {
-  this->PatchRadius = patchRadius;
+  NNFieldLayerCache& cache = this->NNFieldLayerCaches[this->Interpretation];
+  cache.Complete = true;
+  std::copy(this->NNFieldChannelMin, this->NNFieldChannelMin + 2, cache.ChannelMin);
+  std::copy(this->NNFieldChannelMax, this->NNFieldChannelMax + 2, cache.ChannelMax);
+  cache.MagnitudeMax = this->NNFieldMagnitudeMax;
+
+  // The next build of the other interpretation allocates new scalars for the layers, so these keep theirs.
+  if(!IsNNFieldDisplayedByPyramid())
+  {
+    cache.X = vtkSmartPointer<vtkImageData>::New();
+    cache.X->ShallowCopy(this->NNFieldXLayer.ImageData);
+    cache.Y = vtkSmartPointer<vtkImageData>::New();
+    cache.Y->ShallowCopy(this->NNFieldYLayer.ImageData);
+    cache.Magnitude = vtkSmartPointer<vtkImageData>::New();
+    cache.Magnitude->ShallowCopy(this->NNFieldMagnitudeLayer.ImageData);
+  }
 }
 
-void NNFieldInspector::on_radRGB_clicked()
+void NNFieldInspector::ClearNNFieldLayerCaches()
 {
-  UpdateDisplayedImages();
+  for(unsigned int interpretation = 0; interpretation < 2; ++interpretation)
+  {
+    this->NNFieldLayerCaches[interpretation] = NNFieldLayerCache();
+  }
 }
 
-void NNFieldInspector::on_radNNFieldMagnitude_clicked()
+void NNFieldInspector::SetNNFieldLayerLookupTables(const float channelMin[2], const float channelMax[2],
+                                                   const float magnitudeMax)
 {
-  UpdateDisplayedImages();
+  const bool viewsField = (this->Interpretation == NNFieldTypes::ABSOLUTE);
+  LayerImport::SetGrayscaleLookupTable(this->NNFieldXLayer, channelMin[0], channelMax[0], 0);
+  LayerImport::SetGrayscaleLookupTable(this->NNFieldYLayer, channelMin[1], channelMax[1], viewsField ? 1 : 0);
+  LayerImport::SetGrayscaleLookupTable(this->NNFieldMagnitudeLayer, 0.0f, magnitudeMax);
 }
 
-void NNFieldInspector::on_radNNFieldX_clicked()
+void NNFieldInspector::SetStoredNNFieldLookupTables()
 {
-  UpdateDisplayedImages();
+  // The ranges of the match and of the offset follow from the ranges of the channels and of the pixels.
+  const itk::Size<2> size = this->StoredNNField->GetRegion().GetSize();
+  const float pixelMax[2] = {static_cast<float>(size[0] - 1), static_cast<float>(size[1] - 1)};
+  const bool absolute = (this->Interpretation == NNFieldTypes::ABSOLUTE);
+
+  float matchMin[2];
+  float matchMax[2];
+  float offsetSquaredMax = 0.0f;
+  for(unsigned int channel = 0; channel < 2; ++channel)
+  {
+    const float minValue = this->StoredNNField->GetChannelMin(channel);
+    const float maxValue = this->StoredNNField->GetChannelMax(channel);
+    matchMin[channel] = minValue;
+    matchMax[channel] = absolute ? maxValue : maxValue + pixelMax[channel];
+    const float offsetMin = absolute ? minValue - pixelMax[channel] : minValue;
+    const float offsetMax = maxValue;
+    offsetSquaredMax += std::max(offsetMin * offsetMin, offsetMax * offsetMax);
+  }
+  SetNNFieldLayerLookupTables(matchMin, matchMax, std::sqrt(offsetSquaredMax));
 }
 
-void NNFieldInspector::on_radNNFieldY_clicked()
+void NNFieldInspector::Refresh()
 {
-  UpdateDisplayedImages();
-}
+  Trace::Operation operation("Refresh");
 
-void NNFieldInspector::UpdateDisplayedImages()
-{
-  this->NNFieldMagnitudeLayer.ImageSlice->SetVisibility(this->radNNFieldMagnitude->isChecked());
-  this->NNFieldXLayer.ImageSlice->SetVisibility(this->radNNFieldX->isChecked());
-  this->NNFieldYLayer.ImageSlice->SetVisibility(this->radNNFieldY->isChecked());
-  this->ImageLayer.ImageSlice->SetVisibility(this->radRGB->isChecked());
-  this->qvtkWidget->GetRenderWindow()->Render();
+  {
+    Trace::Scope scope("Render");
+    this->qvtkWidget->GetRenderWindow()->Render();
+  }
+  if(this->ComparisonNNField || this->TargetImage)
+  {
+    Trace::Scope scope("RenderRight");
+    this->qvtkWidgetRight->GetRenderWindow()->Render();
+  }
 }
 
-void NNFieldInspector::on_actionInterpretAsOffsetField_activated()
+void NNFieldInspector::LoadImage(const std::string& fileName)
 {
-  this->Interpretation = OFFSET;
-}
+  // Only one image is loaded at a time.
+  this->CancelImageLoading = true;
+  this->ImageLoadWatcher.waitForFinished();
+  this->CancelImageLoading = false;
 
-void NNFieldInspector::on_actionInterpretAsAbsoluteField_activated()
-{
-  this->Interpretation = ABSOLUTE;
+  this->ImageLoadProgress = 0;
+  UpdateLoadingStatus();
+  this->ImageLoadTraceStart = Trace::Now();
+
+  // The worker reports back through queued calls, so the slots always run on the GUI thread.
+  std::function<LoadWorkers::ImageResult()> work = [this, fileName]()
+  {
+    Trace::Scope scope("ReadImage");
+    return LoadWorkers::ReadImage(fileName, this->CancelImageLoading, [this](int percent)
+      {
+      QMetaObject::invokeMethod(this, "slot_ImageLoadProgress", Qt::QueuedConnection, Q_ARG(int, percent));
+      });
+  };
+  this->ImageLoadWatcher.setFuture(QtConcurrent::run(work));
 }
 
-void NNFieldInspector::KeypressCallbackFunction(vtkObject* caller, long unsigned int eventId, void* callData)
+void NNFieldInspector::slot_ImageLoaded()
 {
-  std::cout << "KeypressCallbackFunction" << std::endl;
+  Trace::Operation operation("LoadImage", this->ImageLoadTraceStart, "ReadImage (worker)");
 
-  if(this->LastPick[0] == -1)
+  LoadWorkers::ImageResult result = this->ImageLoadWatcher.result();
+  this->ImageLoadProgress = -1;
+  UpdateLoadingStatus();
+
+  if(result.Cancelled)
   {
-    std::cerr << "You cannot use the arrow keys until a click has been made." << std::endl;
+    this->statusbar->showMessage("Loading the image was cancelled.");
     return;
   }
 
-  vtkRenderWindowInteractor *iren = vtkRenderWindowInteractor::SafeDownCast(caller);
+  if(!result.Error.empty())
+  {
+    std::cerr << "Could not load the image: " << result.Error << std::endl;
+    this->statusbar->showMessage(QString("Could not load the image: ") + result.Error.c_str());
+    return;
+  }
 
-  if(!iren)
+  // The match error worker and the pyramid read the current image, which may be released below.
+  InvalidateMatchError();
+  StopImagePyramidBuild();
+
+  // The ImageLayer references the reader's buffer directly, or the visible tiles of its pyramid once it is built.
+  this->Image = result.Image;
   {
-    throw std::runtime_error("The iren cast failed!");
+    Trace::Scope scope("WrapRGBImage");
+    if(IsImageDisplayedByPyramid())
+    {
+      this->ImageLayer.ImageData->Initialize();
+      StartImagePyramidBuild();
+    }
+    else
+    {
+      LayerImport::WrapRGBImage(this->Image.GetPointer(), this->ImageLayer);
+    }
   }
 
-  std::string pressedKey = iren->GetKeySym();
+  // The pick overlay is allocated once per image and then only updated incrementally.
+  {
+    Trace::Scope scope("InitializePickOverlay");
+    this->PickLayerOverlay.Initialize(this->Image->GetLargestPossibleRegion());
+    this->PickLayer.ImageSlice->VisibilityOff();
+    if(!this->TargetImage)
+    {
+      this->PickLayerRightOverlay.Initialize(this->Image->GetLargestPossibleRegion());
+      this->PickLayerRight.ImageSlice->VisibilityOff();
+    }
+  }
 
-  double fakeClick[2];
-  fakeClick[0] = this->LastPick[0];
-  fakeClick[1] = this->LastPick[1];
+  std::cout << "Loaded image, memory: " << MemoryUsage::GetReport() << std::endl;
+  this->statusbar->showMessage(QString("Loaded image (") + MemoryUsage::GetReport().c_str() + ")");
 
-  if(pressedKey == "Up")
+  UpdateDisplayedImages();
+
+  ResetCamera(this->Image->GetLargestPossibleRegion());
+
+  this->Camera.SetCameraPositionPNG();
+
+  Trace::Scope scope("Render");
+  this->qvtkWidget->GetRenderWindow()->Render();
+}
+
+void NNFieldInspector::slot_ImageLoadProgress(int percent)
+{
+  if(this->ImageLoadWatcher.isRunning())
   {
-    fakeClick[1] += 1;
+    this->ImageLoadProgress = percent;
+    UpdateLoadingStatus();
   }
-  else if(pressedKey == "Down")
+}
+
+void NNFieldInspector::slot_NNFieldLoadProgress(int percent)
+{
+  if(this->NNFieldLoadWatcher.isRunning())
   {
-    fakeClick[1] -= 1;
+    this->NNFieldLoadProgress = percent;
+    UpdateLoadingStatus();
   }
-  else if(pressedKey == "Left")
+}
+
+void NNFieldInspector::UpdateLoadingStatus()
+{
+  std::stringstream ss;
+  if(this->ImageLoadProgress >= 0)
   {
-    fakeClick[0] -= 1;
+    ss << "Image: " << this->ImageLoadProgress << "%  ";
   }
-  else if(pressedKey == "Right")
+  if(this->NNFieldLoadProgress >= 0)
   {
-    fakeClick[0] += 1;
+    ss << "NNField: " << this->NNFieldLoadProgress << "%  ";
   }
-  else
+  if(this->NNFieldLayerProgress >= 0)
   {
-    return;
+    ss << "NNField layers: " << this->NNFieldLayerProgress << "%  ";
   }
 
-  PixelClickedEventHandler(NULL, 0, fakeClick);
-}
+  if(!ss.str().empty())
+  {
+    ss << "(Esc to cancel)";
+    this->statusbar->showMessage(ss.str().c_str());
+  }
+}
+
+void NNFieldInspector::on_actionCancelLoading_activated()
+{
+  this->CancelImageLoading = true;
+  this->CancelNNFieldLoading = true;
+  this->CancelPatchMatch = true;
+  this->CancelMatchError = true;
+  this->CancelReverseIndex = true;
+  this->CancelCoherence = true;
+  this->CancelComparisonLoading = true;
+  this->CancelComparison = true;
+  this->CancelTargetImageLoading = true;
+  this->CancelChannelStatistics = true;
+  this->CancelImagePyramid = true;
+  this->CancelNNFieldPyramid = true;
+
+  if(this->NNFieldLayerWatcher.isRunning())
+  {
+    StopNNFieldLayerBuild();
+    this->statusbar->showMessage("Building the NNField layers was cancelled.");
+  }
+}
+
+void NNFieldInspector::on_actionFlipHorizontally_activated()
+{
+  this->Camera.FlipHorizontally();
+}
+
+void NNFieldInspector::on_actionFlipVertically_activated()
+{
+  this->Camera.FlipVertically();
+}
+
+void NNFieldInspector::on_actionTraceTimings_triggered()
+{
+  const bool enabled = this->actionTraceTimings->isChecked();
+  if(enabled)
+  {
+    // The label is set through the event loop, so repainting it is not part of the operation it shows.
+    QLabel* traceLabel = this->TraceLabel;
+    Trace::SetOperationCallback([traceLabel](const std::string& summary)
+      {
+      QMetaObject::invokeMethod(traceLabel, "setText", Qt::QueuedConnection, Q_ARG(QString, QString(summary.c_str())));
+      });
+    this->TraceLabel->setText("Timings: click or load something");
+  }
+  else
+  {
+    Trace::SetOperationCallback(Trace::OperationCallback());
+  }
+  Trace::SetEnabled(enabled);
+  this->TraceLabel->setVisible(enabled);
+}
+
+void NNFieldInspector::on_actionExportTrace_activated()
+{
+  if(Trace::GetNumberOfEvents() == 0)
+  {
+    this->statusbar->showMessage("Nothing has been traced, turn on View > Show Timings first.");
+    return;
+  }
+
+  QString fileName = QFileDialog::getSaveFileName(this, "Export Trace", "trace.json", "Chrome Trace (*.json)");
+  if(fileName.toStdString().empty())
+  {
+    return;
+  }
+
+  try
+  {
+    Trace::WriteChromeTrace(fileName.toStdString());
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << exception.what() << std::endl;
+    this->statusbar->showMessage(exception.what());
+    return;
+  }
+
+  std::stringstream ss;
+  ss << "Wrote " << Trace::GetNumberOfEvents() << " events to " << fileName.toStdString()
+     << " (open it in chrome://tracing or Perfetto).";
+  this->statusbar->showMessage(ss.str().c_str());
+}
+
+void NNFieldInspector::on_actionLinkPicks_triggered()
+{
+  delete this->LinkedPicksNotifier;
+  this->LinkedPicksNotifier = NULL;
+  this->LinkedPicks.Close();
+
+  if(!this->actionLinkPicks->isChecked())
+  {
+    this->statusbar->showMessage("Picks are no longer linked.");
+    return;
+  }
+
+  try
+  {
+    this->LinkedPicks.Open(PickChannel::GetDefaultDirectory());
+  }
+  catch(std::runtime_error& exception)
+  {
+    std::cerr << exception.what() << std::endl;
+    this->statusbar->showMessage(exception.what());
+    this->actionLinkPicks->setChecked(false);
+    return;
+  }
+
+  this->LinkedPicksNotifier = new QSocketNotifier(this->LinkedPicks.GetFileDescriptor(), QSocketNotifier::Read, this);
+  this->connect(this->LinkedPicksNotifier, SIGNAL(activated(int)), SLOT(slot_LinkedPicksReadable()));
+  this->statusbar->showMessage("Picks are linked with the other inspectors that link their picks.");
+}
+
+void NNFieldInspector::on_actionFlipRightHorizontally_activated()
+{
+  this->CameraRight.FlipHorizontally();
+}
+
+void NNFieldInspector::on_actionFlipRightVertically_activated()
+{
+  this->CameraRight.FlipVertically();
+}
+
+void NNFieldInspector::on_actionShowComparisonField_triggered()
+{
+  UpdateRightPane();
+}
+
+void NNFieldInspector::on_actionShowOffsetDifference_triggered()
+{
+  UpdateRightPane();
+}
+
+void NNFieldInspector::on_actionShowScoreDifference_triggered()
+{
+  UpdateRightPane();
+}
+
+void NNFieldInspector::on_actionOpenImageRight_activated()
+{
+  QString fileName = QFileDialog::getOpenFileName(this, "Open Comparison NNField", ".",
+                                                  "Image Files (*.mha *.nnt *.nnc)");
+  if(fileName.toStdString().empty())
+  {
+    return;
+  }
+
+  LoadComparisonNNField(fileName.toStdString());
+}
+
+void NNFieldInspector::on_actionCloseComparison_activated()
+{
+  this->CancelComparisonLoading = true;
+  this->ComparisonLoadWatcher.waitForFinished();
+  InvalidateComparison();
+
+  this->ComparisonFieldLayer.ImageData->Initialize();
+  this->ComparisonNNField = NULL;
+  this->ComparisonNNFieldBufferOwner.reset();
+  UpdateRightPane();
+}
+
+void NNFieldInspector::on_actionOpenNNFieldSequence_activated()
+{
+  QString fileName = QFileDialog::getOpenFileName(this, "Open a Frame of the NNField Sequence", ".",
+                                                  "Image Files (*.mha *.nnt *.nnc)");
+  if(fileName.toStdString().empty())
+  {
+    return;
+  }
+
+  OpenNNFieldSequence(fileName.toStdString());
+}
+
+void NNFieldInspector::on_actionCloseNNFieldSequence_activated()
+{
+  CloseNNFieldSequence();
+}
+
+void NNFieldInspector::on_sldFrame_valueChanged(int frame)
+{
+  if(this->Sequence && frame != this->SequenceFrame)
+  {
+    ShowSequenceFrame(frame);
+  }
+}
+
+void NNFieldInspector::on_btnPlaySequence_clicked()
+{
+  if(this->btnPlaySequence->isChecked())
+  {
+    this->btnPlaySequence->setText("Pause");
+    this->SequencePlaybackTimer.start();
+  }
+  else
+  {
+    this->btnPlaySequence->setText("Play");
+    this->SequencePlaybackTimer.stop();
+  }
+}
+
+void NNFieldInspector::on_actionOpenTargetImage_activated()
+{
+  QString fileName = QFileDialog::getOpenFileName(this, "Open Target Image", ".",
+                                                  "Image Files (*.mha *.mhd *.jpg *.jpeg *.bmp *.png)");
+  if(fileName.toStdString().empty())
+  {
+    return;
+  }
+
+  LoadTargetImage(fileName.toStdString());
+}
+
+void NNFieldInspector::on_actionCloseTargetImage_activated()
+{
+  this->CancelTargetImageLoading = true;
+  this->TargetImageLoadWatcher.waitForFinished();
+
+  // The reverse index and the match error refer to the images the matches were in.
+  InvalidateReverseIndex();
+  InvalidateMatchError();
+
+  // The layer views the image, which must be released before its mapping.
+  this->TargetImageLayer.ImageData->Initialize();
+  this->TargetImage = NULL;
+  this->TargetImageMapping.reset();
+  this->LastTargetPick[0] = -1;
+  this->LastTargetPick[1] = -1;
+
+  if(this->Image->GetLargestPossibleRegion().GetNumberOfPixels() > 0)
+  {
+    this->PickLayerRightOverlay.Initialize(this->Image->GetLargestPossibleRegion());
+  }
+  this->PickLayerRight.ImageSlice->VisibilityOff();
+  if(this->ComparisonNNField)
+  {
+    ResetCamera(this->ComparisonNNField->GetLargestPossibleRegion(), this->RendererRight);
+  }
+  UpdateRightPane();
+  UpdateDisplayedImages();
+  RefreshLastPick();
+}
+
+void NNFieldInspector::on_actionOpenImage_activated()
+{
+  // Get a filename to open
+  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".",
+                                                  "Image Files (*.jpg *.jpeg *.bmp *.png)");
+
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  LoadImage(fileName.toStdString());
+}
+
+
+void NNFieldInspector::on_actionOpenNNField_activated()
+{
+  // Get a filename to open
+  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".",
+                                                  "Image Files (*.mha *.nnt *.nnc)");
+
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  LoadNNField(fileName.toStdString());
+}
+
+void NNFieldInspector::on_actionWatchNNField_triggered()
+{
+  UpdateNNFieldFileWatch();
+
+  if(!this->actionWatchNNField->isChecked())
+  {
+    this->NNFieldReloadTimer.stop();
+    this->statusbar->showMessage("The NNField file is no longer watched.");
+    return;
+  }
+
+  if(this->LoadedNNFieldFileName.empty())
+  {
+    this->statusbar->showMessage("The file of the next NNField that is opened will be watched.");
+    return;
+  }
+
+  // A field that was loaded before views its file if it is mapped, so it is copied into memory (see LoadNNField()).
+  if(this->NNFieldBufferOwner && !this->StoredNNField)
+  {
+    Trace::Scope scope("CopyMappedNNField");
+    const std::string fileName = this->LoadedNNFieldFileName;
+    NNFieldImageType::Pointer nnField = NNFieldImageType::New();
+    nnField->SetRegions(this->NNField->GetLargestPossibleRegion());
+    nnField->SetNumberOfComponentsPerPixel(this->NNField->GetNumberOfComponentsPerPixel());
+    nnField->SetSpacing(this->NNField->GetSpacing());
+    nnField->SetOrigin(this->NNField->GetOrigin());
+    nnField->Allocate();
+    const size_t numberOfValues = this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() *
+                                  this->NNField->GetNumberOfComponentsPerPixel();
+    std::copy(this->NNField->GetBufferPointer(), this->NNField->GetBufferPointer() + numberOfValues,
+              nnField->GetBufferPointer());
+
+    SetNNField(nnField, std::shared_ptr<void>());
+    StartReverseIndexBuild();
+    this->LoadedNNFieldFileName = fileName;
+    UpdateNNFieldFileWatch();
+    RefreshLastPick();
+  }
+
+  StartNNFieldChecksums();
+  this->statusbar->showMessage(QString("Watching ") + this->LoadedNNFieldFileName.c_str());
+}
+
+void NNFieldInspector::UpdateNNFieldFileWatch()
+{
+  const QStringList watchedFiles = this->NNFieldFileWatcher.files();
+  if(!watchedFiles.isEmpty())
+  {
+    this->NNFieldFileWatcher.removePaths(watchedFiles);
+  }
+
+  if(this->actionWatchNNField->isChecked() && !this->LoadedNNFieldFileName.empty())
+  {
+    this->NNFieldFileWatcher.addPath(this->LoadedNNFieldFileName.c_str());
+  }
+}
+
+void NNFieldInspector::slot_NNFieldFileChanged()
+{
+  // Every change restarts the delay, so the file is read once the solver is done writing it.
+  this->NNFieldReloadTimer.start();
+}
+
+void NNFieldInspector::slot_NNFieldReloadTimeout()
+{
+  if(!this->actionWatchNNField->isChecked() || this->LoadedNNFieldFileName.empty())
+  {
+    return;
+  }
+
+  // A file that is replaced rather than rewritten is no longer watched, and its replacement may not be there yet.
+  if(!QFile::exists(this->LoadedNNFieldFileName.c_str()))
+  {
+    this->NNFieldReloadTimer.start();
+    return;
+  }
+  UpdateNNFieldFileWatch();
+
+  // A reload that is running may have read the file before this change, so this one waits for it.
+  if(this->NNFieldReloadWatcher.isRunning())
+  {
+    this->NNFieldReloadTimer.start();
+    return;
+  }
+
+  StartNNFieldReload();
+}
+
+void NNFieldInspector::StartNNFieldChecksums()
+{
+  if(!this->actionWatchNNField->isChecked() || this->LoadedNNFieldFileName.empty() || this->StoredNNField)
+  {
+    return;
+  }
+
+  // A reload of the previous field is of no use any more. It is cancelled rather than waited for, and
+  // slot_NNFieldReloaded() starts the checksums once it has stopped.
+  if(this->NNFieldReloadWatcher.isRunning())
+  {
+    this->CancelNNFieldReload = true;
+    this->NNFieldChecksumsRestartPending = true;
+    return;
+  }
+
+  this->CancelNNFieldReload = false;
+  this->NNFieldChecksumsRestartPending = false;
+
+  // The worker holds its own references, so the field (and its mapping) outlive it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+
+  std::function<NNFieldReloadResult()> work = [nnField, bufferOwner]()
+  {
+    Trace::Scope scope("NNFieldChecksums");
+    NNFieldReloadResult result;
+    result.PreviousField = nnField;
+    result.Checksums = TileChecksums::Compute(nnField.GetPointer(), NNFieldReloadTileSize);
+    return result;
+  };
+  this->NNFieldReloadWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::StartNNFieldReload()
+{
+  this->CancelNNFieldReload = false;
+  this->statusbar->showMessage("The NNField file changed, reading it...");
+
+  const std::string fileName = this->LoadedNNFieldFileName;
+  NNFieldImageType::Pointer previousField = this->NNField;
+  std::shared_ptr<void> previousBufferOwner = this->NNFieldBufferOwner;
+  const std::vector<TileChecksums::ChecksumType> previousChecksums = this->NNFieldTileChecksums;
+
+  std::function<NNFieldReloadResult()> work = [this, fileName, previousField, previousBufferOwner, previousChecksums]()
+  {
+    Trace::Scope scope("ReloadNNField");
+    NNFieldReloadResult result;
+    result.PreviousField = previousField;
+    // Not mapped, see LoadNNField().
+    result.Load = LoadWorkers::ReadNNField(fileName, this->CancelNNFieldReload, [](int) {}, false);
+    const NNFieldImageType* const nnField = result.Load.NNField.GetPointer();
+    if(!nnField)
+    {
+      return result;
+    }
+
+    // The checksums are kept for the next change, even if the fields cannot be compared this time.
+    result.Checksums = TileChecksums::Compute(nnField, NNFieldReloadTileSize);
+    if(!previousChecksums.empty() &&
+       nnField->GetLargestPossibleRegion() == previousField->GetLargestPossibleRegion() &&
+       nnField->GetNumberOfComponentsPerPixel() == previousField->GetNumberOfComponentsPerPixel())
+    {
+      result.ChangedTiles = TileChecksums::FindChangedTiles(previousChecksums, result.Checksums);
+      result.Compared = true;
+    }
+    return result;
+  };
+  this->NNFieldReloadWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::slot_NNFieldReloaded()
+{
+  if(this->NNFieldChecksumsRestartPending)
+  {
+    // Another field was set while this ran, so its result is stale.
+    this->NNFieldChecksumsRestartPending = false;
+    StartNNFieldChecksums();
+    return;
+  }
+
+  NNFieldReloadResult result = this->NNFieldReloadWatcher.result();
+
+  // Another field was set meanwhile.
+  if(result.PreviousField != this->NNField || this->LoadedNNFieldFileName.empty() || result.Load.Cancelled)
+  {
+    return;
+  }
+
+  if(!result.Load.Error.empty())
+  {
+    // The next change of the file tries again.
+    std::cerr << "Could not reload the NNField: " << result.Load.Error << std::endl;
+    this->statusbar->showMessage(QString("Could not reload the NNField: ") + result.Load.Error.c_str());
+    return;
+  }
+
+  if(!result.Load.NNField && !result.Load.Store)
+  {
+    // Only the checksums of the current field were computed.
+    this->NNFieldTileChecksums = result.Checksums;
+    return;
+  }
+
+  if(result.Compared && !IsNNFieldDisplayedByPyramid())
+  {
+    if(result.ChangedTiles.empty())
+    {
+      this->statusbar->showMessage("The NNField file was written, but none of its tiles changed.");
+      return;
+    }
+    ApplyChangedNNFieldTiles(result);
+    return;
+  }
+
+  // The field is replaced as a whole, but the camera and the pick are kept.
+  const std::string fileName = this->LoadedNNFieldFileName;
+  {
+    Trace::Operation operation("ReloadNNField");
+    if(result.Load.Store)
+    {
+      SetStoredNNField(result.Load.Store);
+    }
+    else
+    {
+      SetNNField(result.Load.NNField, result.Load.Mapping);
+      StartReverseIndexBuild();
+    }
+  }
+  this->LoadedNNFieldFileName = fileName;
+  this->NNFieldTileChecksums = result.Checksums;
+  UpdateNNFieldFileWatch();
+
+  this->statusbar->showMessage("Reloaded the NNField.");
+  RefreshLastPick();
+}
+
+void NNFieldInspector::ApplyChangedNNFieldTiles(const NNFieldReloadResult& result)
+{
+  Trace::Operation operation("ApplyChangedNNFieldTiles");
+
+  NNFieldImageType* const nnField = result.Load.NNField;
+  const std::vector<itk::ImageRegion<2> > allTiles =
+    TileChecksums::GetTiles(nnField->GetLargestPossibleRegion(), NNFieldReloadTileSize);
+  std::vector<itk::ImageRegion<2> > tiles;
+  for(size_t changedTileId = 0; changedTileId < result.ChangedTiles.size(); ++changedTileId)
+  {
+    tiles.push_back(allTiles[result.ChangedTiles[changedTileId]]);
+  }
+
+  // The rows the changed tiles span, merged into ranges [first, last). The tiles are numbered row major.
+  std::vector<std::pair<unsigned int, unsigned int> > rowRanges;
+  for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+  {
+    const unsigned int firstRow = tiles[tileId].GetIndex()[1] - nnField->GetLargestPossibleRegion().GetIndex()[1];
+    const unsigned int lastRow = firstRow + tiles[tileId].GetSize()[1];
+    if(!rowRanges.empty() && firstRow <= rowRanges.back().second)
+    {
+      rowRanges.back().second = std::max(rowRanges.back().second, lastRow);
+    }
+    else
+    {
+      rowRanges.push_back(std::make_pair(firstRow, lastRow));
+    }
+  }
+
+  // The match that is displayed for the pick, to tell whether it has to be redone. It is not read from the previous
+  // field, which may already show the new file if it viewed it.
+  const itk::Index<2> pick = {{this->LastPick[0], this->LastPick[1]}};
+  const itk::Index<2> previousMatch = this->BestMatchCenter;
+  const bool picked = (this->LastPick[0] != -1) && nnField->GetLargestPossibleRegion().IsInside(pick);
+
+  // The complete layers of the current interpretation are updated tile by tile. Everything else that depends on
+  // the field starts over, the workers hold their own references to the previous one.
+  const bool updateLayers = this->NNFieldLayerCaches[this->Interpretation].Complete;
+  if(!updateLayers)
+  {
+    StopNNFieldLayerBuild();
+    this->NNFieldMagnitudeLayer.ImageData->Initialize();
+    this->NNFieldXLayer.ImageData->Initialize();
+    this->NNFieldYLayer.ImageData->Initialize();
+  }
+  for(unsigned int interpretation = 0; interpretation < 2; ++interpretation)
+  {
+    if(interpretation != static_cast<unsigned int>(this->Interpretation) || !updateLayers)
+    {
+      this->NNFieldLayerCaches[interpretation] = NNFieldLayerCache();
+    }
+  }
+  if(!this->MatchErrorImage)
+  {
+    InvalidateMatchError();
+  }
+  InvalidateReverseIndex();
+  InvalidateCoherence();
+  InvalidateComparison();
+  StopChannelStatistics();
+
+  // The previous field (and the mapping it may view) is only released when this returns, after the layers that
+  // view it have been switched to the new one.
+  NNFieldImageType::Pointer previousField = this->NNField;
+  std::shared_ptr<void> previousBufferOwner = this->NNFieldBufferOwner;
+  this->NNField = nnField;
+  this->NNFieldBufferOwner = result.Load.Mapping;
+  this->NNFieldTileChecksums = result.Checksums;
+  UpdateExtraChannelLayers();
+
+  if(updateLayers)
+  {
+    Trace::Scope scope("UpdateNNFieldLayerTiles");
+    NNFieldLayerCache& cache = this->NNFieldLayerCaches[this->Interpretation];
+    const bool absolute = (this->Interpretation == NNFieldTypes::ABSOLUTE);
+    if(absolute)
+    {
+      // The X and Y layers view the field.
+      LayerImport::WrapVectorImageChannel(this->NNField.GetPointer(), 0, this->NNFieldXLayer);
+      LayerImport::WrapVectorImageChannel(this->NNField.GetPointer(), 1, this->NNFieldYLayer);
+      cache.X->ShallowCopy(this->NNFieldXLayer.ImageData);
+      cache.Y->ShallowCopy(this->NNFieldYLayer.ImageData);
+    }
+
+    // The ranges can only grow, shrinking them would need a pass over the whole field.
+    LoadWorkers::UpdateNNFieldLayerTiles(this->NNField.GetPointer(), this->Interpretation, tiles,
+      static_cast<float*>(this->NNFieldMagnitudeLayer.ImageData->GetScalarPointer()),
+      absolute ? NULL : static_cast<float*>(this->NNFieldXLayer.ImageData->GetScalarPointer()),
+      absolute ? NULL : static_cast<float*>(this->NNFieldYLayer.ImageData->GetScalarPointer()),
+      cache.ChannelMin, cache.ChannelMax, cache.MagnitudeMax);
+    std::copy(cache.ChannelMin, cache.ChannelMin + 2, this->NNFieldChannelMin);
+    std::copy(cache.ChannelMax, cache.ChannelMax + 2, this->NNFieldChannelMax);
+    this->NNFieldMagnitudeMax = cache.MagnitudeMax;
+
+    this->NNFieldMagnitudeLayer.ImageData->Modified();
+    this->NNFieldXLayer.ImageData->Modified();
+    this->NNFieldYLayer.ImageData->Modified();
+    SetNNFieldLayerLookupTables(cache.ChannelMin, cache.ChannelMax, cache.MagnitudeMax);
+  }
+
+  if(this->MatchErrorImage)
+  {
+    // The error of a pixel only depends on its own match, so only the rows of the changed tiles are recomputed.
+    Trace::Scope scope("UpdateMatchErrorRows");
+    for(size_t rangeId = 0; rangeId < rowRanges.size(); ++rangeId)
+    {
+      const float maxError = MatchError::UpdateRows(this->Image.GetPointer(), this->NNField.GetPointer(),
+                                                    this->Interpretation, this->PatchRadius, rowRanges[rangeId].first,
+                                                    rowRanges[rangeId].second, this->MatchErrorImage.GetPointer());
+      this->MatchErrorMax = std::max(this->MatchErrorMax, maxError);
+    }
+    this->MatchErrorLayer.ImageData->Modified();
+    LayerImport::SetGrayscaleLookupTable(this->MatchErrorLayer, 0.0f, this->MatchErrorMax);
+  }
+
+  // The colors saturate at the longest offset of the whole field if no scale is set, so only then are they redone.
+  vtkImageData* const flowColor = this->FlowColorLayer.ImageData;
+  if(flowColor->GetNumberOfPoints() > 0 && this->spinFlowScale->value() > 0)
+  {
+    Trace::Scope scope("UpdateFlowColorRows");
+    const unsigned int width = this->NNField->GetLargestPossibleRegion().GetSize()[0];
+    const unsigned int numberOfComponents = this->NNField->GetNumberOfComponentsPerPixel();
+    const double spacing[2] = {1.0, 1.0};
+    for(size_t rangeId = 0; rangeId < rowRanges.size(); ++rangeId)
+    {
+      const unsigned int firstRow = rowRanges[rangeId].first;
+      const double origin[2] = {0.0, static_cast<double>(firstRow)};
+      FlowColor::Compute(this->NNField->GetBufferPointer() + static_cast<size_t>(firstRow) * width * numberOfComponents,
+                         numberOfComponents, width, rowRanges[rangeId].second - firstRow, origin, spacing,
+                         this->Interpretation, static_cast<float>(this->spinFlowScale->value()),
+                         static_cast<unsigned char*>(flowColor->GetScalarPointer(0, firstRow, 0)));
+    }
+    flowColor->Modified();
+  }
+  else
+  {
+    InvalidateFlowColorLayer();
+  }
+
+  StartChannelStatistics();
+  StartComparison();
+  StartReverseIndexBuild();
+
+  std::stringstream ss;
+  ss << "Reloaded the NNField: " << tiles.size() << " of " << allTiles.size() << " tiles changed.";
+  this->statusbar->showMessage(ss.str().c_str());
+
+  // This restarts the layers that are displayed and were not updated, and renders.
+  UpdateDisplayedImages();
+
+  if(picked && NNFieldQuery::GetMatchCenter(nnField, pick, this->Interpretation) != previousMatch)
+  {
+    RefreshLastPick();
+  }
+}
+
+void NNFieldInspector::PixelClickedEventHandler(vtkObject* caller, long unsigned int eventId,
+                                                void* callData)
+{
+  Trace::Operation operation("PixelClicked");
+
+  if(!this->Image)
+  {
+    std::cerr << "Image must be set before clicking!" << std::endl;
+    return;
+  }
+
+  if(!this->NNField)
+  {
+    std::cerr << "NNField must be set before clicking!" << std::endl;
+    return;
+  }
+
+  double* pixel = reinterpret_cast<double*>(callData);
+
+  //std::cout << "Picked " << pixel[0] << " " << pixel[1] << std::endl;
+
+  itk::Index<2> pickedIndex = {{static_cast<unsigned int>(pixel[0]), static_cast<unsigned int>(pixel[1])}};
+
+  // With a target image, the right pane displays it, so its picks select target patches.
+  if(this->TargetImage && caller == this->SelectionStyleRight)
+  {
+    ShowTargetPick(pickedIndex);
+    return;
+  }
+  this->LastTargetPick[0] = -1;
+  this->LastTargetPick[1] = -1;
+
+  // Store the pick
+  this->LastPick[0] = pickedIndex[0];
+  this->LastPick[1] = pickedIndex[1];
+
+  std::cout << "Picked index: " << pickedIndex << std::endl;
+
+  std::stringstream ssSelected;
+  ssSelected << pickedIndex;
+  this->lblSelected->setText(ssSelected.str().c_str());
+
+  itk::ImageRegion<2> pickedRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pickedIndex, this->PatchRadius);
+
+  if(!this->Image->GetLargestPossibleRegion().IsInside(pickedRegion))
+  {
+    std::cout << "Picked patch that is not entirely inside image!" << std::endl;
+    return;
+  }
+
+  if(!GetNNFieldRegion().IsInside(pickedIndex))
+  {
+    std::cout << "Picked pixel is not inside the NNField!" << std::endl;
+    return;
+  }
+
+  // A stored field reads the tile of the pixel through its cache, or decodes its block.
+  std::vector<float> nnFieldPixel;
+  {
+    Trace::Scope scope("Query");
+    if(!GetNNFieldPixel(pickedIndex, nnFieldPixel))
+    {
+      return;
+    }
+
+    this->BestMatchCenter = NNFieldQuery::GetMatchCenter(&nnFieldPixel[0], pickedIndex, this->Interpretation);
+  }
+
+  itk::ImageRegion<2> matchRegion =
+        ITKHelpers::GetRegionInRadiusAroundPixel(this->BestMatchCenter, this->PatchRadius);
+  std::cout << "Best match center: " << this->BestMatchCenter << std::endl;
+
+  std::stringstream ssBestMatch;
+  ssBestMatch << this->BestMatchCenter;
+  this->lblNN->setText(ssBestMatch.str().c_str());
+
+  // The channels after X and Y hold the score of the match (e.g. the patch distance), if the field has them.
+  std::stringstream ssScore;
+  for(unsigned int channel = 2; channel < nnFieldPixel.size(); ++channel)
+  {
+    if(channel > 2)
+    {
+      ssScore << ", ";
+    }
+    ssScore << nnFieldPixel[channel];
+    if(channel < this->NNFieldChannelStatistics.size())
+    {
+      ssScore << " (" << ChannelStatistics::DescribeRank(this->NNFieldChannelStatistics[channel], nnFieldPixel[channel]) << ")";
+    }
+  }
+  this->lblScore->setText(ssScore.str().empty() ? "-" : ssScore.str().c_str());
+
+  // The coherent segment of the pick is shown by the tooltip of the picked pixel, the status bar shows its sources.
+  std::stringstream ssSegment;
+  if(this->NNFieldCoherence && this->NNFieldCoherence->GetSize() == GetNNFieldRegion().GetSize())
+  {
+    const size_t pixelId = static_cast<size_t>(pickedIndex[1]) * GetNNFieldRegion().GetSize()[0] + pickedIndex[0];
+    const unsigned int segment = this->NNFieldCoherence->GetSegment(pixelId);
+    ssSegment << "Coherent segment " << segment << " of " << this->NNFieldCoherence->GetSegmentArea(segment)
+              << " pixels" << (this->NNFieldCoherence->IsDiscontinuous(pixelId) ? ", at a discontinuity" : "");
+  }
+  this->lblSelected->setToolTip(ssSegment.str().c_str());
+
+  // The match is in the target image, if one is set.
+  std::stringstream ssDistance;
+  {
+    Trace::Scope scope("PatchDistance");
+    if(GetMatchImage()->GetLargestPossibleRegion().IsInside(matchRegion))
+    {
+      ssDistance << "SSD " << PatchDistance::Compute(this->Image, pickedIndex, GetMatchImage(), this->BestMatchCenter,
+                                                     this->PatchRadius, PatchDistance::SSD)
+                 << ", SAD " << PatchDistance::Compute(this->Image, pickedIndex, GetMatchImage(), this->BestMatchCenter,
+                                                       this->PatchRadius, PatchDistance::SAD);
+    }
+    else
+    {
+      ssDistance << "match is not entirely inside the image";
+    }
+  }
+  this->lblDistance->setText(ssDistance.str().c_str());
+
+  // Highlight patches. Only the previously drawn outlines are erased, so this does not depend on the image size.
+  const unsigned char red[3] = {255, 0, 0};
+  const unsigned char green[3] = {0, 255, 0};
+
+  {
+    Trace::Scope scope("Overlay");
+    this->PickLayerOverlay.Clear();
+    this->PickLayerOverlay.OutlineRegion(pickedRegion, red);
+    if(this->TargetImage)
+    {
+      this->PickLayerRightOverlay.Clear();
+      this->PickLayerRightOverlay.OutlineRegion(matchRegion, green);
+      this->PickLayerRightOverlay.Modified();
+      this->PickLayerRight.ImageSlice->VisibilityOn();
+    }
+    else
+    {
+      this->PickLayerOverlay.OutlineRegion(matchRegion, green);
+    }
+  }
+
+  {
+    Trace::Scope scope("ComparisonPick");
+    ShowComparisonPick(pickedIndex, pickedRegion, nnFieldPixel);
+  }
+
+  // The sources of a target patch are shown by clicking it in the right pane.
+  if(this->chkShowSources->isChecked() && !this->TargetImage)
+  {
+    Trace::Scope scope("Sources");
+    if(this->NNFieldReverseIndex)
+    {
+      // Only the sources themselves are touched, so this does not depend on the image size.
+      const unsigned char blue[3] = {0, 0, 255};
+      const size_t width = this->Image->GetLargestPossibleRegion().GetSize()[0];
+      const size_t numberOfSources = this->NNFieldReverseIndex->ForEachSourceInRegion(pickedRegion,
+        [this, width, &blue](const unsigned int source)
+        {
+        itk::Index<2> sourceIndex = {{static_cast<itk::IndexValueType>(source % width),
+                                      static_cast<itk::IndexValueType>(source / width)}};
+        this->PickLayerOverlay.SetPixel(sourceIndex, blue);
+        });
+
+      std::stringstream ssSources;
+      ssSources << numberOfSources << " pixels match inside the clicked patch (blue).";
+      this->statusbar->showMessage(ssSources.str().c_str());
+    }
+    else
+    {
+      StartReverseIndexBuild();
+      this->statusbar->showMessage("Building the reverse index, the sources are shown when it is done.");
+    }
+  }
+  this->PickLayerOverlay.Modified();
+
+  this->PickLayer.ImageSlice->VisibilityOn();
+
+  // The other inspectors render the pick while this one does.
+  if(this->LinkedPicks.IsOpen() && !this->SuppressPickPublishing)
+  {
+    Trace::Scope scope("PublishPick");
+    const int match[2] = {static_cast<int>(this->BestMatchCenter[0]), static_cast<int>(this->BestMatchCenter[1])};
+    this->LinkedPicks.Publish(this->LastPick, match);
+  }
+
+  Refresh();
+}
+
+void NNFieldInspector::SetPatchRadius(const unsigned int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+  this->spinPatchRadius->setValue(patchRadius);
+}
+
+void NNFieldInspector::on_spinPatchRadius_valueChanged(int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+
+  InvalidateMatchError();
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_spinFlowScale_valueChanged(int)
+{
+  InvalidateFlowColorLayer();
+  this->ComparisonFieldLayer.ImageData->Initialize();
+  UpdateRightPane();
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_sldCoherenceThreshold_valueChanged(int)
+{
+  std::stringstream ss;
+  ss << GetCoherenceThreshold();
+  this->lblCoherenceThresholdValue->setText(ss.str().c_str());
+
+  // The displayed segments are replaced when the new ones arrive, so the slider can be moved smoothly.
+  if(this->NNFieldCoherence || this->CoherenceWatcher.isRunning())
+  {
+    StartCoherenceComputation();
+  }
+}
+
+void NNFieldInspector::on_chkCoherenceEightConnected_clicked()
+{
+  if(this->NNFieldCoherence || this->CoherenceWatcher.isRunning())
+  {
+    StartCoherenceComputation();
+  }
+}
+
+void NNFieldInspector::on_radRGB_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radNNFieldMagnitude_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radNNFieldX_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radNNFieldY_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radFlowColor_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radCoherence_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radMatchError_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_radSourceUsage_clicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_chkShowSources_clicked()
+{
+  RefreshLastPick();
+}
+
+void NNFieldInspector::UpdateDisplayedImages()
+{
+  Trace::Operation operation("UpdateDisplayedImages");
+
+  const bool nnFieldLayerDisplayed = this->radNNFieldMagnitude->isChecked() ||
+                                     this->radNNFieldX->isChecked() || this->radNNFieldY->isChecked();
+  if(nnFieldLayerDisplayed && !this->NNFieldLayersBuilt &&
+     this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() > 0)
+  {
+    StartNNFieldLayerBuild();
+  }
+
+  if(this->radMatchError->isChecked() && !this->MatchErrorImage && !this->MatchErrorWatcher.isRunning() &&
+     this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() > 0 &&
+     this->NNField->GetLargestPossibleRegion() == this->Image->GetLargestPossibleRegion() && !this->TargetImage)
+  {
+    StartMatchErrorComputation();
+  }
+
+  if(this->radSourceUsage->isChecked() && !this->TargetImage)
+  {
+    StartReverseIndexBuild();
+  }
+
+  if(this->radCoherence->isChecked() && !this->NNFieldCoherence && !this->CoherenceWatcher.isRunning() &&
+     this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() > 0)
+  {
+    StartCoherenceComputation();
+  }
+
+  if(this->radFlowColor->isChecked() && this->FlowColorLayer.ImageData->GetNumberOfPoints() == 0)
+  {
+    Trace::Scope scope("FlowColor");
+    UpdateFlowColorLayer();
+  }
+
+  this->NNFieldMagnitudeLayer.ImageSlice->SetVisibility(this->radNNFieldMagnitude->isChecked());
+  this->NNFieldXLayer.ImageSlice->SetVisibility(this->radNNFieldX->isChecked());
+  this->NNFieldYLayer.ImageSlice->SetVisibility(this->radNNFieldY->isChecked());
+  this->FlowColorLayer.ImageSlice->SetVisibility(this->radFlowColor->isChecked() &&
+                                                 this->FlowColorLayer.ImageData->GetNumberOfPoints() > 0);
+  this->CoherenceLayer.ImageSlice->SetVisibility(this->radCoherence->isChecked() && this->CoherenceImage.IsNotNull());
+  this->MatchErrorLayer.ImageSlice->SetVisibility(this->radMatchError->isChecked() && this->MatchErrorImage.IsNotNull());
+  this->SourceUsageLayer.ImageSlice->SetVisibility(this->radSourceUsage->isChecked() && this->SourceUsageImage.IsNotNull() &&
+                                                   !this->TargetImage);
+  for(unsigned int layerId = 0; layerId < this->ExtraChannelLayers.size(); ++layerId)
+  {
+    this->ExtraChannelLayers[layerId]->ImageSlice->SetVisibility(this->ExtraChannelRadioButtons[layerId]->isChecked());
+  }
+  this->ImageLayer.ImageSlice->SetVisibility(this->radRGB->isChecked());
+
+  Trace::Scope scope("Render");
+  this->qvtkWidget->GetRenderWindow()->Render();
+}
+
+void NNFieldInspector::on_actionInterpretAsOffsetField_activated()
+{
+  SetInterpretation(NNFieldTypes::OFFSET);
+}
+
+void NNFieldInspector::on_actionInterpretAsAbsoluteField_activated()
+{
+  SetInterpretation(NNFieldTypes::ABSOLUTE);
+}
+
+void NNFieldInspector::SetInterpretation(const INTERPRETATION_ENUM interpretation)
+{
+  if(interpretation == this->Interpretation)
+  {
+    return;
+  }
+  this->Interpretation = interpretation;
+
+  InvalidateMatchError();
+  InvalidateReverseIndex();
+  InvalidateCoherence();
+  InvalidateFlowColorLayer();
+
+  // The layers are rebuilt (or taken from the cache) by UpdateDisplayedImages if one of them is displayed.
+  StopNNFieldLayerBuild();
+  if(this->StoredNNField)
+  {
+    SetStoredNNFieldLookupTables();
+  }
+  if(this->NNFieldPyramidView.GetPyramid())
+  {
+    ShowNNFieldPyramidView();
+  }
+  UpdateDisplayedImages();
+
+  // The differences do not depend on the interpretation, but the offsets of the comparison field do.
+  this->ComparisonFieldLayer.ImageData->Initialize();
+  UpdateRightPane();
+
+  RefreshLastPick();
+}
+
+void NNFieldInspector::StartMatchErrorComputation()
+{
+  this->CancelMatchError = false;
+  this->statusbar->showMessage("Computing the match error... (Esc to cancel)");
+
+  // The worker holds its own references, so its inputs outlive it even if they are replaced.
+  ImageType::Pointer image = this->Image;
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+  const INTERPRETATION_ENUM interpretation = this->Interpretation;
+  const unsigned int patchRadius = this->PatchRadius;
+
+  // Like the NNField layers, only the errors of fields that are not changing are cached.
+  std::shared_ptr<LayerCache> diskCache;
+  if(!this->PatchMatchSnapshots && !this->SequencePlaybackTimer.isActive())
+  {
+    diskCache = this->DiskLayerCache;
+  }
+
+  std::function<MatchErrorResult()> work = [this, image, nnField, bufferOwner, interpretation, patchRadius, diskCache]()
+  {
+    MatchErrorResult result;
+    result.MaxError = 0.0f;
+
+    std::string key;
+    if(diskCache)
+    {
+      std::vector<LayerCache::HashType> keyParts;
+      keyParts.push_back(LayerCache::Hash(image.GetPointer(), this->CancelMatchError));
+      keyParts.push_back(LayerCache::Hash(nnField.GetPointer(), this->CancelMatchError));
+      if(this->CancelMatchError)
+      {
+        return result;
+      }
+      keyParts.push_back(interpretation);
+      keyParts.push_back(patchRadius);
+      key = LayerCache::MakeKey("matcherror", keyParts);
+
+      result.DiskEntry = diskCache->Find(key);
+      if(result.DiskEntry && result.DiskEntry->GetLayer("MatchError") &&
+         result.DiskEntry->GetLayer("MatchError")->GetLargestPossibleRegion() == nnField->GetLargestPossibleRegion())
+      {
+        result.Image = result.DiskEntry->GetLayer("MatchError");
+        result.MaxError = result.DiskEntry->GetValue("MaxError", 1.0f);
+        return result;
+      }
+      result.DiskEntry.reset();
+    }
+
+    try
+    {
+      result.Image = MatchError::Compute(image.GetPointer(), nnField.GetPointer(), interpretation, patchRadius,
+                                         this->CancelMatchError, result.MaxError);
+    }
+    catch(std::runtime_error& exception)
+    {
+      std::cerr << exception.what() << std::endl;
+    }
+
+    if(diskCache && result.Image)
+    {
+      try
+      {
+        const itk::Size<2> size = result.Image->GetLargestPossibleRegion().GetSize();
+        LayerCache::Writer writer(*diskCache, key, std::vector<std::string>(1, "MatchError"), size);
+        writer.WriteRows(0, 0, result.Image->GetBufferPointer(), size[1]);
+        writer.SetValue("MaxError", result.MaxError);
+        writer.Commit();
+      }
+      catch(std::runtime_error& exception)
+      {
+        std::cerr << exception.what() << std::endl;
+      }
+    }
+    return result;
+  };
+  this->MatchErrorWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::InvalidateMatchError()
+{
+  this->CancelMatchError = true;
+  this->MatchErrorWatcher.waitForFinished();
+
+  this->MatchErrorLayer.ImageData->Initialize();
+  this->MatchErrorLayer.ImageSlice->VisibilityOff();
+  this->MatchErrorImage = NULL;
+  this->MatchErrorDiskEntry.reset();
+}
+
+void NNFieldInspector::UpdateExtraChannelLayers()
+{
+  const unsigned int numberOfExtraChannels =
+    std::max(2u, GetNNFieldNumberOfComponents()) - 2;
+
+  // Only when the number of channels changes (not for every PatchMatch snapshot) are widgets added or removed.
+  while(this->ExtraChannelLayers.size() > numberOfExtraChannels)
+  {
+    if(this->ExtraChannelRadioButtons.back()->isChecked())
+    {
+      this->radRGB->setChecked(true);
+    }
+    delete this->ExtraChannelRadioButtons.back();
+    this->ExtraChannelRadioButtons.pop_back();
+
+    this->Renderer->RemoveViewProp(this->ExtraChannelLayers.back()->ImageSlice);
+    this->ExtraChannelLayers.pop_back();
+  }
+
+  while(this->ExtraChannelLayers.size() < numberOfExtraChannels)
+  {
+    const unsigned int channel = this->ExtraChannelLayers.size() + 2;
+
+    std::shared_ptr<Layer> layer(new Layer);
+    layer->ImageSlice->VisibilityOff();
+    // Below the pick layer, which is always on top.
+    this->Renderer->RemoveViewProp(this->PickLayer.ImageSlice);
+    this->Renderer->AddViewProp(layer->ImageSlice);
+    this->Renderer->AddViewProp(this->PickLayer.ImageSlice);
+    this->ExtraChannelLayers.push_back(layer);
+
+    // Channel 2 is the patch distance if the field was written by PatchMatch.
+    std::stringstream ss;
+    ss << "Channel " << channel;
+    QRadioButton* radioButton = new QRadioButton(ss.str().c_str(), this->centralwidget);
+    this->horizontalLayout->addWidget(radioButton);
+    this->connect(radioButton, SIGNAL(clicked()), SLOT(slot_ExtraChannelClicked()));
+    this->ExtraChannelRadioButtons.push_back(radioButton);
+  }
+
+  for(unsigned int layerId = 0; layerId < numberOfExtraChannels; ++layerId)
+  {
+    if(IsNNFieldDisplayedByPyramid())
+    {
+      // The data comes from the pyramid view, only the channel is selected here.
+      LayerImport::SetGrayscaleLookupTable(*this->ExtraChannelLayers[layerId], 0.0f, 1.0f, layerId + 2);
+    }
+    else
+    {
+      LayerImport::WrapVectorImageChannel(this->NNField.GetPointer(), layerId + 2, *this->ExtraChannelLayers[layerId]);
+    }
+  }
+}
+
+void NNFieldInspector::slot_ExtraChannelClicked()
+{
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::StartChannelStatistics()
+{
+  if(this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  this->CancelChannelStatistics = false;
+
+  // The worker holds its own references, so the field outlives it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+
+  std::function<std::vector<ChannelStatistics::Statistics>()> work = [this, nnField, bufferOwner]()
+  {
+    return ChannelStatistics::Compute(nnField.GetPointer(), this->CancelChannelStatistics);
+  };
+  this->ChannelStatisticsWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::StopChannelStatistics()
+{
+  this->CancelChannelStatistics = true;
+  this->ChannelStatisticsWatcher.waitForFinished();
+  this->NNFieldChannelStatistics.clear();
+}
+
+void NNFieldInspector::slot_ChannelStatisticsComputed()
+{
+  std::vector<ChannelStatistics::Statistics> statistics = this->ChannelStatisticsWatcher.result();
+  if(statistics.size() != this->NNField->GetNumberOfComponentsPerPixel())
+  {
+    // Cancelled.
+    return;
+  }
+  this->NNFieldChannelStatistics = statistics;
+
+  for(unsigned int channel = 0; channel < statistics.size(); ++channel)
+  {
+    const ChannelStatistics::Statistics& channelStatistics = statistics[channel];
+    std::cout << "Channel " << channel << ": min " << channelStatistics.Min << ", median " << channelStatistics.Median
+              << ", 90th percentile " << channelStatistics.Percentile90 << ", 99th percentile "
+              << channelStatistics.Percentile99 << ", max " << channelStatistics.Max << std::endl;
+
+    if(channel >= 2)
+    {
+      // A few outliers (e.g. at the border) would otherwise make everything else dark.
+      const float maxValue = (channelStatistics.Percentile99 > channelStatistics.Min) ?
+                             channelStatistics.Percentile99 : channelStatistics.Max;
+      LayerImport::SetGrayscaleLookupTable(*this->ExtraChannelLayers[channel - 2], channelStatistics.Min, maxValue,
+                                           channel);
+
+      std::stringstream ss;
+      ss << "Channel " << channel << " [" << channelStatistics.Min << ", " << channelStatistics.Max << "]";
+      this->ExtraChannelRadioButtons[channel - 2]->setToolTip(ss.str().c_str());
+    }
+  }
+
+  // The score of the last pick can now be ranked.
+  RefreshLastPick();
+}
+
+bool NNFieldInspector::IsNNFieldInUse() const
+{
+  return this->NNFieldLayerWatcher.isRunning() || this->MatchErrorWatcher.isRunning() ||
+         this->ReverseIndexWatcher.isRunning() || this->CoherenceWatcher.isRunning() ||
+         this->ComparisonWatcher.isRunning() ||
+         this->ChannelStatisticsWatcher.isRunning() ||
+         this->NNFieldPyramidWatcher.isRunning();
+}
+
+bool NNFieldInspector::IsImageDisplayedByPyramid() const
+{
+  return this->Image->GetLargestPossibleRegion().GetNumberOfPixels() > MinimumNumberOfPixelsForPyramid;
+}
+
+bool NNFieldInspector::IsNNFieldDisplayedByPyramid() const
+{
+  // A stored field is not in memory as an image, so it is always displayed through its pyramid.
+  if(this->StoredNNField)
+  {
+    return true;
+  }
+  return this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() > MinimumNumberOfPixelsForPyramid;
+}
+
+void NNFieldInspector::StartImagePyramidBuild()
+{
+  this->CancelImagePyramid = false;
+
+  // The worker holds its own reference, so the image outlives it even if it is replaced.
+  ImageType::Pointer image = this->Image;
+
+  std::function<std::shared_ptr<ImagePyramidType>()> work = [this, image]()
+  {
+    const itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+    std::shared_ptr<ImagePyramidType> pyramid(
+      new ImagePyramidType(reinterpret_cast<const unsigned char*>(image->GetBufferPointer()), size[0], size[1], 3));
+    if(!pyramid->Build(this->CancelImagePyramid))
+    {
+      pyramid.reset();
+    }
+    return pyramid;
+  };
+  this->ImagePyramidWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::StopImagePyramidBuild()
+{
+  this->CancelImagePyramid = true;
+  this->ImagePyramidWatcher.waitForFinished();
+  this->ImagePyramidView.SetPyramid(std::shared_ptr<const ImagePyramidType>());
+}
+
+void NNFieldInspector::slot_ImagePyramidBuilt()
+{
+  std::shared_ptr<ImagePyramidType> pyramid = this->ImagePyramidWatcher.result();
+  // A build that completed just before it was stopped references a buffer that may be gone.
+  if(!pyramid || this->CancelImagePyramid)
+  {
+    return;
+  }
+
+  this->ImagePyramidView.SetPyramid(pyramid);
+  slot_UpdatePyramidViews();
+}
+
+void NNFieldInspector::StartNNFieldPyramidBuild()
+{
+  this->CancelNNFieldPyramid = false;
+
+  if(this->StoredNNField)
+  {
+    // Level 0 is read from the store (through its tile cache or decoded), also to compute the stored levels.
+    std::shared_ptr<NNFieldStore> store = this->StoredNNField;
+    std::function<std::shared_ptr<NNFieldPyramidType>()> work = [this, store]()
+    {
+      const unsigned int numberOfComponents = store->GetNumberOfComponents();
+      NNFieldPyramidType::Level0Reader reader =
+        [store, numberOfComponents](const unsigned int firstX, const unsigned int firstY, const unsigned int width,
+                                    const unsigned int height, float* const out, const size_t outRowStride)
+        {
+        const itk::Index<2> index = {{firstX, firstY}};
+        const itk::Size<2> size = {{width, height}};
+        try
+        {
+          store->ReadRegion(itk::ImageRegion<2>(index, size), out, outRowStride);
+        }
+        catch(std::runtime_error& exception)
+        {
+          // The reader is called on the threads of the pyramid, which must not throw.
+          std::cerr << "Could not read the NNField: " << exception.what() << std::endl;
+          for(unsigned int row = 0; row < height; ++row)
+          {
+            std::fill(out + row * outRowStride, out + row * outRowStride + width * numberOfComponents, 0.0f);
+          }
+        }
+        };
+
+      const itk::Size<2> size = store->GetRegion().GetSize();
+      std::shared_ptr<NNFieldPyramidType> pyramid(new NNFieldPyramidType(reader, size[0], size[1], numberOfComponents));
+      if(!pyramid->Build(this->CancelNNFieldPyramid))
+      {
+        pyramid.reset();
+      }
+      return pyramid;
+    };
+    this->NNFieldPyramidWatcher.setFuture(QtConcurrent::run(work));
+    return;
+  }
+
+  // The worker holds its own references, so the field outlives it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+
+  std::function<std::shared_ptr<NNFieldPyramidType>()> work = [this, nnField, bufferOwner]()
+  {
+    const itk::Size<2> size = nnField->GetLargestPossibleRegion().GetSize();
+    std::shared_ptr<NNFieldPyramidType> pyramid(
+      new NNFieldPyramidType(nnField->GetBufferPointer(), size[0], size[1], nnField->GetNumberOfComponentsPerPixel()));
+    if(!pyramid->Build(this->CancelNNFieldPyramid))
+    {
+      pyramid.reset();
+    }
+    return pyramid;
+  };
+  this->NNFieldPyramidWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::StopNNFieldPyramidBuild()
+{
+  this->CancelNNFieldPyramid = true;
+  this->NNFieldPyramidWatcher.waitForFinished();
+  this->NNFieldPyramidView.SetPyramid(std::shared_ptr<const NNFieldPyramidType>());
+}
+
+void NNFieldInspector::slot_NNFieldPyramidBuilt()
+{
+  std::shared_ptr<NNFieldPyramidType> pyramid = this->NNFieldPyramidWatcher.result();
+  // A build that completed just before it was stopped references a buffer that may be gone.
+  if(!pyramid || this->CancelNNFieldPyramid)
+  {
+    return;
+  }
+
+  this->NNFieldPyramidView.SetPyramid(pyramid);
+  slot_UpdatePyramidViews();
+}
+
+void NNFieldInspector::RendererEndCallback(vtkObject* caller, long unsigned int eventId, void* callData)
+{
+  // The view is updated after the render, so an interaction is never slowed down by assembling tiles.
+  // If the visible tiles did not change, the update does nothing.
+  if(this->ImagePyramidView.GetPyramid() || this->NNFieldPyramidView.GetPyramid())
+  {
+    this->PyramidViewTimer.start();
+  }
+}
+
+void NNFieldInspector::slot_UpdatePyramidViews()
+{
+  itk::ImageRegion<2> visibleRegion;
+  double imagePixelsPerScreenPixel = 0.0;
+  if(!GetVisibleRegion(visibleRegion, imagePixelsPerScreenPixel))
+  {
+    return;
+  }
+
+  bool changed = false;
+  if(this->ImagePyramidView.Update(visibleRegion, imagePixelsPerScreenPixel))
+  {
+    // The layer shares the scalars of the view.
+    this->ImageLayer.ImageData->ShallowCopy(this->ImagePyramidView.GetOutput());
+    changed = true;
+  }
+
+  if(this->NNFieldPyramidView.Update(visibleRegion, imagePixelsPerScreenPixel))
+  {
+    ShowNNFieldPyramidView();
+    changed = true;
+  }
+
+  if(changed)
+  {
+    Refresh();
+  }
+}
+
+void NNFieldInspector::ShowNNFieldPyramidView()
+{
+  vtkImageData* view = this->NNFieldPyramidView.GetOutput();
+  const bool absolute = (this->Interpretation == NNFieldTypes::ABSOLUTE);
+
+  // The extra channel layers select their channel with their lookup table, so they all share the view.
+  // So do the X and Y layers of absolute fields.
+  for(unsigned int layerId = 0; layerId < this->ExtraChannelLayers.size(); ++layerId)
+  {
+    this->ExtraChannelLayers[layerId]->ImageData->ShallowCopy(view);
+  }
+
+  std::vector<Layer*> derivedLayers(1, &this->NNFieldMagnitudeLayer);
+  if(absolute)
+  {
+    this->NNFieldXLayer.ImageData->ShallowCopy(view);
+    this->NNFieldYLayer.ImageData->ShallowCopy(view);
+  }
+  else
+  {
+    derivedLayers.push_back(&this->NNFieldXLayer);
+    derivedLayers.push_back(&this->NNFieldYLayer);
+  }
+  for(unsigned int layerId = 0; layerId < derivedLayers.size(); ++layerId)
+  {
+    vtkImageData* const imageData = derivedLayers[layerId]->ImageData;
+    imageData->Initialize();
+    imageData->CopyStructure(view);
+    imageData->AllocateScalars(VTK_FLOAT, 1);
+  }
+
+  // The derived layers are only computed for the assembled pixels, whose positions are the centers of the level 0
+  // pixels they cover. Above level 0 the magnitude is that of the mean of the vectors a pixel covers, rather than
+  // the mean of their magnitudes.
+  const int* dimensions = view->GetDimensions();
+  const double* origin = view->GetOrigin();
+  const double* spacing = view->GetSpacing();
+  const unsigned int numberOfComponents = view->GetNumberOfScalarComponents();
+  const float* const field = static_cast<const float*>(view->GetScalarPointer());
+  float* const magnitude = static_cast<float*>(this->NNFieldMagnitudeLayer.ImageData->GetScalarPointer());
+  float* const matchX = absolute ? NULL : static_cast<float*>(this->NNFieldXLayer.ImageData->GetScalarPointer());
+  float* const matchY = absolute ? NULL : static_cast<float*>(this->NNFieldYLayer.ImageData->GetScalarPointer());
+  if(!field)
+  {
+    return;
+  }
+
+  for(int y = 0; y < dimensions[1]; ++y)
+  {
+    const float positionY = static_cast<float>(origin[1] + y * spacing[1]);
+    for(int x = 0; x < dimensions[0]; ++x)
+    {
+      const size_t pixelId = static_cast<size_t>(y) * dimensions[0] + x;
+      const float* pixel = field + pixelId * numberOfComponents;
+      const float positionX = static_cast<float>(origin[0] + x * spacing[0]);
+      float offset[2] = {pixel[0], pixel[1]};
+      if(absolute)
+      {
+        offset[0] -= positionX;
+        offset[1] -= positionY;
+      }
+      else
+      {
+        matchX[pixelId] = pixel[0] + positionX;
+        matchY[pixelId] = pixel[1] + positionY;
+      }
+      magnitude[pixelId] = std::sqrt(offset[0] * offset[0] + offset[1] * offset[1]);
+    }
+  }
+  for(unsigned int layerId = 0; layerId < derivedLayers.size(); ++layerId)
+  {
+    derivedLayers[layerId]->ImageData->Modified();
+  }
+
+  // The colors follow the view. They are only computed while they are displayed.
+  if(this->radFlowColor->isChecked())
+  {
+    UpdateFlowColorLayer();
+    this->FlowColorLayer.ImageSlice->SetVisibility(this->FlowColorLayer.ImageData->GetNumberOfPoints() > 0);
+  }
+  else
+  {
+    InvalidateFlowColorLayer();
+  }
+}
+
+void NNFieldInspector::UpdateFlowColorLayer()
+{
+  vtkImageData* const imageData = this->FlowColorLayer.ImageData;
+  imageData->Initialize();
+
+  const float* field = NULL;
+  unsigned int numberOfComponents = 0;
+  unsigned int size[2] = {0, 0};
+  double origin[2] = {0.0, 0.0};
+  double spacing[2] = {1.0, 1.0};
+  if(this->NNFieldPyramidView.GetPyramid())
+  {
+    vtkImageData* const view = this->NNFieldPyramidView.GetOutput();
+    field = static_cast<const float*>(view->GetScalarPointer());
+    if(!field)
+    {
+      // No tiles are assembled yet, ShowNNFieldPyramidView colors them once they are.
+      return;
+    }
+    imageData->CopyStructure(view);
+    numberOfComponents = view->GetNumberOfScalarComponents();
+    const int* dimensions = view->GetDimensions();
+    size[0] = dimensions[0];
+    size[1] = dimensions[1];
+    std::copy(view->GetOrigin(), view->GetOrigin() + 2, origin);
+    std::copy(view->GetSpacing(), view->GetSpacing() + 2, spacing);
+  }
+  else
+  {
+    const itk::Size<2> fieldSize = this->NNField->GetLargestPossibleRegion().GetSize();
+    if(fieldSize[0] == 0 || fieldSize[1] == 0)
+    {
+      return;
+    }
+    field = this->NNField->GetBufferPointer();
+    numberOfComponents = this->NNField->GetNumberOfComponentsPerPixel();
+    size[0] = fieldSize[0];
+    size[1] = fieldSize[1];
+    imageData->SetDimensions(size[0], size[1], 1);
+    imageData->SetOrigin(0.0, 0.0, 0.0);
+    imageData->SetSpacing(1.0, 1.0, 1.0);
+  }
+
+  // The RGBA scalars are displayed directly, without a lookup table.
+  imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+  FlowColor::Compute(field, numberOfComponents, size[0], size[1], origin, spacing, this->Interpretation,
+                     static_cast<float>(this->spinFlowScale->value()),
+                     static_cast<unsigned char*>(imageData->GetScalarPointer()));
+  imageData->Modified();
+}
+
+void NNFieldInspector::InvalidateFlowColorLayer()
+{
+  this->FlowColorLayer.ImageData->Initialize();
+  this->FlowColorLayer.ImageSlice->VisibilityOff();
+}
+
+bool NNFieldInspector::GetVisibleRegion(itk::ImageRegion<2>& visibleRegion, double& imagePixelsPerScreenPixel) const
+{
+  const int* size = this->Renderer->GetSize();
+  const int* origin = this->Renderer->GetOrigin();
+  if(size[0] <= 0 || size[1] <= 0)
+  {
+    return false;
+  }
+
+  double minimum[2] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+  double maximum[2] = {-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()};
+
+  // The ray through each corner of the renderer is intersected with the plane of the layers (z = 0),
+  // which works for both parallel and perspective projections and for flipped cameras.
+  for(unsigned int corner = 0; corner < 4; ++corner)
+  {
+    const double displayX = origin[0] + ((corner & 1) ? size[0] : 0);
+    const double displayY = origin[1] + ((corner & 2) ? size[1] : 0);
+
+    double nearPoint[4];
+    this->Renderer->SetDisplayPoint(displayX, displayY, 0.0);
+    this->Renderer->DisplayToWorld();
+    this->Renderer->GetWorldPoint(nearPoint);
+
+    double farPoint[4];
+    this->Renderer->SetDisplayPoint(displayX, displayY, 1.0);
+    this->Renderer->DisplayToWorld();
+    this->Renderer->GetWorldPoint(farPoint);
+
+    if(nearPoint[3] == 0.0 || farPoint[3] == 0.0)
+    {
+      return false;
+    }
+    for(unsigned int dimension = 0; dimension < 3; ++dimension)
+    {
+      nearPoint[dimension] /= nearPoint[3];
+      farPoint[dimension] /= farPoint[3];
+    }
+
+    if(nearPoint[2] == farPoint[2])
+    {
+      // The camera looks along the plane.
+      return false;
+    }
+    const double t = nearPoint[2] / (nearPoint[2] - farPoint[2]);
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      const double position = nearPoint[dimension] + t * (farPoint[dimension] - nearPoint[dimension]);
+      minimum[dimension] = std::min(minimum[dimension], position);
+      maximum[dimension] = std::max(maximum[dimension], position);
+    }
+  }
+
+  imagePixelsPerScreenPixel = std::max((maximum[0] - minimum[0]) / size[0], (maximum[1] - minimum[1]) / size[1]);
+
+  // Positions far outside the image do not matter, so they are clamped to keep the region representable.
+  const double limit = 1e9;
+  itk::Index<2> index;
+  itk::Size<2> regionSize;
+  for(unsigned int dimension = 0; dimension < 2; ++dimension)
+  {
+    const double first = std::floor(std::max(minimum[dimension], -limit));
+    const double last = std::ceil(std::min(maximum[dimension], limit));
+    index[dimension] = static_cast<itk::IndexValueType>(first);
+    regionSize[dimension] = static_cast<itk::SizeValueType>(std::max(last - first, 0.0)) + 1;
+  }
+  visibleRegion = itk::ImageRegion<2>(index, regionSize);
+  return true;
+}
+
+void NNFieldInspector::ResetCamera(const itk::ImageRegion<2>& region, vtkRenderer* renderer)
+{
+  if(!renderer)
+  {
+    renderer = this->Renderer;
+  }
+
+  if(region.GetNumberOfPixels() == 0)
+  {
+    renderer->ResetCamera();
+    return;
+  }
+
+  double bounds[6] = {static_cast<double>(region.GetIndex()[0]),
+                      static_cast<double>(region.GetIndex()[0] + static_cast<itk::IndexValueType>(region.GetSize()[0]) - 1),
+                      static_cast<double>(region.GetIndex()[1]),
+                      static_cast<double>(region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]) - 1),
+                      0.0, 0.0};
+  renderer->ResetCamera(bounds);
+}
+
+void NNFieldInspector::StartReverseIndexBuild()
+{
+  if(this->NNFieldReverseIndex || this->ReverseIndexWatcher.isRunning() ||
+     this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  this->CancelReverseIndex = false;
+
+  // The worker holds its own references, so the field outlives it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+  const INTERPRETATION_ENUM interpretation = this->Interpretation;
+
+  // The targets are the pixels of the image the matches are in.
+  const itk::Size<2> targetSize = this->TargetImage ? this->TargetImage->GetLargestPossibleRegion().GetSize() :
+                                                      nnField->GetLargestPossibleRegion().GetSize();
+
+  std::function<ReverseIndexResult()> work = [this, nnField, bufferOwner, interpretation, targetSize]()
+  {
+    ReverseIndexResult result;
+    result.MaxUsage = 0.0f;
+
+    std::shared_ptr<ReverseIndex> index(new ReverseIndex);
+    try
+    {
+      if(index->Build(nnField.GetPointer(), interpretation, targetSize, this->CancelReverseIndex))
+      {
+        result.Index = index;
+        result.Usage = index->CreateUsageImage(result.MaxUsage);
+      }
+    }
+    catch(std::runtime_error& exception)
+    {
+      std::cerr << exception.what() << std::endl;
+    }
+    return result;
+  };
+  this->ReverseIndexWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::InvalidateReverseIndex()
+{
+  this->CancelReverseIndex = true;
+  this->ReverseIndexWatcher.waitForFinished();
+
+  this->SourceUsageLayer.ImageData->Initialize();
+  this->SourceUsageLayer.ImageSlice->VisibilityOff();
+  this->SourceUsageImage = NULL;
+  this->NNFieldReverseIndex.reset();
+}
+
+void NNFieldInspector::StartCoherenceComputation()
+{
+  if(this->CoherenceWatcher.isRunning())
+  {
+    this->CancelCoherence = true;
+    this->CoherenceRestartPending = true;
+    return;
+  }
+
+  if(this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  this->CancelCoherence = false;
+  this->CoherenceRestartPending = false;
+
+  // The worker holds its own references, so the field outlives it even if it is replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+  const INTERPRETATION_ENUM interpretation = this->Interpretation;
+  const float threshold = GetCoherenceThreshold();
+  const bool eightConnected = this->chkCoherenceEightConnected->isChecked();
+
+  std::function<CoherenceResult()> work = [this, nnField, bufferOwner, interpretation, threshold, eightConnected]()
+  {
+    CoherenceResult result;
+    std::shared_ptr<CoherenceSegmentation> segmentation(new CoherenceSegmentation);
+    try
+    {
+      if(segmentation->Build(nnField.GetPointer(), interpretation, threshold, eightConnected, this->CancelCoherence))
+      {
+        result.Colors = segmentation->CreateColorImage();
+        result.Segmentation = segmentation;
+      }
+    }
+    catch(std::runtime_error& exception)
+    {
+      std::cerr << exception.what() << std::endl;
+    }
+    return result;
+  };
+  this->CoherenceWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::InvalidateCoherence()
+{
+  this->CancelCoherence = true;
+  this->CoherenceWatcher.waitForFinished();
+  this->CoherenceRestartPending = false;
+
+  this->CoherenceLayer.ImageData->Initialize();
+  this->CoherenceLayer.ImageSlice->VisibilityOff();
+  this->CoherenceImage = NULL;
+  this->NNFieldCoherence.reset();
+}
+
+float NNFieldInspector::GetCoherenceThreshold() const
+{
+  return this->sldCoherenceThreshold->value() / 10.0f;
+}
+
+void NNFieldInspector::slot_CoherenceComputed()
+{
+  if(this->CoherenceRestartPending)
+  {
+    // The threshold or the neighborhood changed while this segmentation was running.
+    StartCoherenceComputation();
+    return;
+  }
+
+  CoherenceResult result = this->CoherenceWatcher.result();
+  if(!result.Segmentation)
+  {
+    return;
+  }
+
+  // The layer references the buffer of the colors.
+  this->NNFieldCoherence = result.Segmentation;
+  this->CoherenceImage = result.Colors;
+  LayerImport::WrapRGBImage(this->CoherenceImage.GetPointer(), this->CoherenceLayer);
+
+  const CoherenceSegmentation& segmentation = *this->NNFieldCoherence;
+  const itk::Size<2> size = segmentation.GetSize();
+  const size_t numberOfPixels = size[0] * size[1];
+
+  std::stringstream ss;
+  ss << segmentation.GetNumberOfSegments() << " coherent segments, "
+     << (100.0 * segmentation.GetNumberOfDiscontinuousPixels()) / std::max<size_t>(numberOfPixels, 1)
+     << "% of the pixels are discontinuous (white)";
+  this->statusbar->showMessage(ss.str().c_str());
+
+  // The area histogram is shown by the tooltip of the layer, in powers of two.
+  const std::vector<size_t> histogram = segmentation.ComputeAreaHistogram();
+  std::stringstream ssHistogram;
+  ssHistogram << "Segments by area (pixels):";
+  for(size_t bin = 0; bin < histogram.size(); ++bin)
+  {
+    ssHistogram << "\n" << (static_cast<size_t>(1) << bin) << " - " << (static_cast<size_t>(2) << bin) - 1
+                << ": " << histogram[bin];
+  }
+  this->radCoherence->setToolTip(ssHistogram.str().c_str());
+
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::LoadComparisonNNField(const std::string& fileName)
+{
+  // Only one comparison field is loaded at a time.
+  this->CancelComparisonLoading = true;
+  this->ComparisonLoadWatcher.waitForFinished();
+  this->CancelComparisonLoading = false;
+  this->statusbar->showMessage("Loading the comparison NNField...");
+
+  std::function<LoadWorkers::NNFieldResult()> work = [this, fileName]()
+  {
+    LoadWorkers::NNFieldResult result = LoadWorkers::ReadNNField(fileName, this->CancelComparisonLoading, [](int) {});
+    // The differences are computed over the whole field, so stored fields are decoded into memory.
+    if(result.Store && result.Error.empty())
+    {
+      try
+      {
+        result.NNField = LoadWorkers::ReadNNFieldStore(result.Store.get(), this->CancelComparisonLoading);
+        result.Cancelled = !result.NNField;
+      }
+      catch(std::runtime_error& exception)
+      {
+        result.Error = exception.what();
+      }
+      result.Store.reset();
+    }
+    return result;
+  };
+  this->ComparisonLoadWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::slot_ComparisonNNFieldLoaded()
+{
+  LoadWorkers::NNFieldResult result = this->ComparisonLoadWatcher.result();
+  if(result.Cancelled)
+  {
+    this->statusbar->showMessage("Loading the comparison NNField was cancelled.");
+    return;
+  }
+
+  if(!result.Error.empty() || !result.NNField)
+  {
+    std::cerr << "Could not load the comparison NNField: " << result.Error << std::endl;
+    this->statusbar->showMessage(QString("Could not load the comparison NNField: ") + result.Error.c_str());
+    return;
+  }
+
+  // The difference layers reference the buffers computed from the previous comparison field.
+  InvalidateComparison();
+  this->ComparisonFieldLayer.ImageData->Initialize();
+  this->ComparisonNNField = result.NNField;
+  this->ComparisonNNFieldBufferOwner = result.Mapping;
+
+  UpdateRightPane();
+  if(!this->TargetImage)
+  {
+    ResetCamera(this->ComparisonNNField->GetLargestPossibleRegion(), this->RendererRight);
+    this->CameraRight.SetCameraPositionPNG();
+  }
+  StartComparison();
+
+  std::cout << "Loaded comparison NNField, memory: " << MemoryUsage::GetReport() << std::endl;
+  RefreshLastPick();
+  Refresh();
+}
+
+void NNFieldInspector::StartComparison()
+{
+  if(!this->ComparisonNNField || this->ComparisonWatcher.isRunning() ||
+     this->NNField->GetLargestPossibleRegion().GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  if(this->NNField->GetLargestPossibleRegion().GetSize() != this->ComparisonNNField->GetLargestPossibleRegion().GetSize())
+  {
+    this->statusbar->showMessage("The comparison NNField does not have the size of the NNField, so they are not compared.");
+    return;
+  }
+
+  this->CancelComparison = false;
+
+  // The worker holds its own references, so the fields outlive it even if they are replaced.
+  NNFieldImageType::Pointer nnField = this->NNField;
+  std::shared_ptr<void> bufferOwner = this->NNFieldBufferOwner;
+  NNFieldImageType::Pointer comparisonNNField = this->ComparisonNNField;
+  std::shared_ptr<void> comparisonBufferOwner = this->ComparisonNNFieldBufferOwner;
+
+  std::function<NNFieldComparison::Result()> work = [this, nnField, bufferOwner, comparisonNNField, comparisonBufferOwner]()
+  {
+    NNFieldComparison::Result result;
+    try
+    {
+      if(!NNFieldComparison::Compute(nnField.GetPointer(), comparisonNNField.GetPointer(), this->CancelComparison, result))
+      {
+        result = NNFieldComparison::Result();
+      }
+    }
+    catch(std::runtime_error& exception)
+    {
+      std::cerr << exception.what() << std::endl;
+      result = NNFieldComparison::Result();
+    }
+    return result;
+  };
+  this->ComparisonWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::InvalidateComparison()
+{
+  this->CancelComparison = true;
+  this->ComparisonWatcher.waitForFinished();
+
+  this->OffsetDifferenceLayer.ImageData->Initialize();
+  this->ScoreDifferenceLayer.ImageData->Initialize();
+  this->OffsetDifferenceLayer.ImageSlice->VisibilityOff();
+  this->ScoreDifferenceLayer.ImageSlice->VisibilityOff();
+  this->ComparisonDifferences = NNFieldComparison::Result();
+}
+
+void NNFieldInspector::slot_ComparisonComputed()
+{
+  NNFieldComparison::Result result = this->ComparisonWatcher.result();
+  if(!result.OffsetDifference)
+  {
+    // Cancelled, or the fields could not be compared.
+    return;
+  }
+
+  // The layers reference the buffers of the result.
+  this->ComparisonDifferences = result;
+  LayerImport::WrapFloatImage(result.OffsetDifference.GetPointer(), this->OffsetDifferenceLayer);
+  LayerImport::SetHeatMapLookupTable(this->OffsetDifferenceLayer, 0.0f, std::max(result.MaxOffsetDifference, 1.0f));
+  if(result.ScoreDifference)
+  {
+    LayerImport::WrapFloatImage(result.ScoreDifference.GetPointer(), this->ScoreDifferenceLayer);
+    // Symmetric around 0, so pixels whose score did not change are in the middle of the heat map.
+    const float range = std::max(std::max(-result.MinScoreDifference, result.MaxScoreDifference), 1e-6f);
+    LayerImport::SetHeatMapLookupTable(this->ScoreDifferenceLayer, -range, range);
+  }
+
+  const size_t numberOfPixels = result.OffsetDifference->GetLargestPossibleRegion().GetNumberOfPixels();
+  std::stringstream ss;
+  ss << "Compared the fields: " << (100.0 * result.NumberOfChangedPixels) / std::max<size_t>(numberOfPixels, 1)
+     << "% of the matches differ, mean offset difference " << result.MeanOffsetDifference
+     << ", largest " << result.MaxOffsetDifference;
+  if(result.ScoreDifference)
+  {
+    ss << ", score difference in [" << result.MinScoreDifference << ", " << result.MaxScoreDifference << "]";
+  }
+  std::cout << ss.str() << std::endl;
+  this->statusbar->showMessage(ss.str().c_str());
+
+  UpdateRightPane();
+}
+
+void NNFieldInspector::UpdateRightPane()
+{
+  if(!this->ComparisonNNField && !this->TargetImage)
+  {
+    this->qvtkWidgetRight->hide();
+    return;
+  }
+  this->qvtkWidgetRight->show();
+
+  // The target image is not over the pixels of the field, so the comparison layers are not displayed with it.
+  this->TargetImageLayer.ImageSlice->SetVisibility(this->TargetImage.IsNotNull());
+  if(this->TargetImage || !this->ComparisonNNField)
+  {
+    this->ComparisonFieldLayer.ImageSlice->VisibilityOff();
+    this->OffsetDifferenceLayer.ImageSlice->VisibilityOff();
+    this->ScoreDifferenceLayer.ImageSlice->VisibilityOff();
+    this->qvtkWidgetRight->GetRenderWindow()->Render();
+    return;
+  }
+
+  if(this->ComparisonFieldLayer.ImageData->GetNumberOfPoints() == 0)
+  {
+    const itk::Size<2> size = this->ComparisonNNField->GetLargestPossibleRegion().GetSize();
+    const double origin[2] = {0.0, 0.0};
+    const double spacing[2] = {1.0, 1.0};
+    vtkImageData* const imageData = this->ComparisonFieldLayer.ImageData;
+    imageData->SetDimensions(size[0], size[1], 1);
+    imageData->SetOrigin(0.0, 0.0, 0.0);
+    imageData->SetSpacing(1.0, 1.0, 1.0);
+    imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+    FlowColor::Compute(this->ComparisonNNField->GetBufferPointer(), this->ComparisonNNField->GetNumberOfComponentsPerPixel(),
+                       size[0], size[1], origin, spacing, this->Interpretation,
+                       static_cast<float>(this->spinFlowScale->value()),
+                       static_cast<unsigned char*>(imageData->GetScalarPointer()));
+    imageData->Modified();
+  }
+
+  this->ComparisonFieldLayer.ImageSlice->SetVisibility(this->actionShowComparisonField->isChecked());
+  this->OffsetDifferenceLayer.ImageSlice->SetVisibility(this->actionShowOffsetDifference->isChecked() &&
+                                                        this->ComparisonDifferences.OffsetDifference.IsNotNull());
+  this->ScoreDifferenceLayer.ImageSlice->SetVisibility(this->actionShowScoreDifference->isChecked() &&
+                                                       this->ComparisonDifferences.ScoreDifference.IsNotNull());
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void NNFieldInspector::ShowComparisonPick(const itk::Index<2>& pickedIndex, const itk::ImageRegion<2>& pickedRegion,
+                                          const std::vector<float>& nnFieldPixel)
+{
+  if(!this->ComparisonNNField || !this->ComparisonNNField->GetLargestPossibleRegion().IsInside(pickedIndex))
+  {
+    return;
+  }
+
+  const unsigned int numberOfComponents = this->ComparisonNNField->GetNumberOfComponentsPerPixel();
+  const float* comparisonPixel = this->ComparisonNNField->GetBufferPointer() +
+                                 this->ComparisonNNField->ComputeOffset(pickedIndex) * numberOfComponents;
+  const itk::Index<2> matchCenter = NNFieldQuery::GetMatchCenter(comparisonPixel, pickedIndex, this->Interpretation);
+
+  const float differenceX = comparisonPixel[0] - nnFieldPixel[0];
+  const float differenceY = comparisonPixel[1] - nnFieldPixel[1];
+  std::stringstream ss;
+  ss << "Comparison field: match " << matchCenter << ", "
+     << std::sqrt(differenceX * differenceX + differenceY * differenceY) << " pixels from the match of the NNField";
+  if(numberOfComponents > 2 && nnFieldPixel.size() > 2)
+  {
+    ss << ", score " << comparisonPixel[2] << " (" << comparisonPixel[2] - nnFieldPixel[2] << " relative to the NNField)";
+  }
+  std::cout << ss.str() << std::endl;
+  this->statusbar->showMessage(ss.str().c_str());
+
+  // With a target image, the pick and the match of the NNField are already drawn, so the match of the comparison
+  // field is added in yellow.
+  const unsigned char red[3] = {255, 0, 0};
+  const unsigned char green[3] = {0, 255, 0};
+  const unsigned char yellow[3] = {255, 255, 0};
+  if(!this->TargetImage)
+  {
+    this->PickLayerRightOverlay.Clear();
+    this->PickLayerRightOverlay.OutlineRegion(pickedRegion, red);
+  }
+  this->PickLayerRightOverlay.OutlineRegion(ITKHelpers::GetRegionInRadiusAroundPixel(matchCenter, this->PatchRadius),
+                                            this->TargetImage ? yellow : green);
+  this->PickLayerRightOverlay.Modified();
+  this->PickLayerRight.ImageSlice->VisibilityOn();
+}
+
+void NNFieldInspector::OpenNNFieldSequence(const std::string& fileName)
+{
+  std::string pattern;
+  unsigned int frame = 0;
+  unsigned int firstFrame = 0;
+  unsigned int lastFrame = 0;
+  if(!NNFieldSequence::FindSequence(fileName, pattern, frame, firstFrame, lastFrame))
+  {
+    this->statusbar->showMessage("The file name has no frame number, so it is not part of a sequence.");
+    return;
+  }
+
+  CloseNNFieldSequence();
+
+  // The frames are announced through queued calls, so slot_SequenceFrameReady runs on the GUI thread.
+  this->Sequence.reset(new NNFieldSequence(pattern, firstFrame, lastFrame, SequenceCapacity,
+    [this](const unsigned int readFrame)
+    {
+    QMetaObject::invokeMethod(this, "slot_SequenceFrameReady", Qt::QueuedConnection,
+                              Q_ARG(int, static_cast<int>(readFrame)));
+    }));
+  std::cout << "Opened the sequence " << pattern << ", frames " << firstFrame << " to " << lastFrame << std::endl;
+
+  this->sldFrame->blockSignals(true);
+  this->sldFrame->setRange(firstFrame, lastFrame);
+  this->sldFrame->setValue(frame);
+  this->sldFrame->blockSignals(false);
+  this->widgetSequence->show();
+
+  ShowSequenceFrame(frame);
+}
+
+void NNFieldInspector::CloseNNFieldSequence()
+{
+  if(!this->Sequence)
+  {
+    return;
+  }
+
+  this->SequencePlaybackTimer.stop();
+  this->btnPlaySequence->setChecked(false);
+  this->btnPlaySequence->setText("Play");
+  this->widgetSequence->hide();
+
+  // Waits for the background thread. The displayed frame keeps its field alive.
+  this->Sequence.reset();
+  this->SequenceFrame = -1;
+  this->SequencePendingFrame = -1;
+}
+
+void NNFieldInspector::ShowSequenceFrame(const unsigned int frame)
+{
+  this->Sequence->SetCurrentFrame(frame);
+
+  std::stringstream ssFrame;
+  ssFrame << frame << " / " << this->Sequence->GetLastFrame();
+
+  std::shared_ptr<NNFieldSequence::Frame> data = this->Sequence->GetFrame(frame);
+  if(!data)
+  {
+    this->SequencePendingFrame = frame;
+    ssFrame << " (reading)";
+    this->lblFrame->setText(ssFrame.str().c_str());
+    return;
+  }
+  this->SequencePendingFrame = -1;
+  this->SequenceFrame = frame;
+  this->lblFrame->setText(ssFrame.str().c_str());
+
+  if(!data->Error.empty())
+  {
+    std::cerr << "Could not read " << this->Sequence->GetFileName(frame) << ": " << data->Error << std::endl;
+    this->statusbar->showMessage(QString("Could not read the frame: ") + data->Error.c_str());
+    return;
+  }
+
+  // The frame is the buffer owner, so its field stays alive while it is displayed, also after the ring buffer
+  // dropped it. The camera is only reset if the frames do not all have the same size.
+  const bool sizeChanged = GetNNFieldRegion() != data->NNField->GetLargestPossibleRegion();
+  SetNNField(data->NNField, data);
+  if(sizeChanged)
+  {
+    ResetCamera(GetNNFieldRegion());
+  }
+
+  // The pick stays where it is, so the match can be followed through the frames.
+  RefreshLastPick();
+  Refresh();
+}
+
+void NNFieldInspector::slot_SequenceFrameReady(int frame)
+{
+  if(this->Sequence && frame == this->SequencePendingFrame)
+  {
+    ShowSequenceFrame(frame);
+  }
+}
+
+void NNFieldInspector::slot_SequencePlaybackTimeout()
+{
+  if(!this->Sequence || this->SequencePendingFrame != -1)
+  {
+    return;
+  }
+
+  // Playback loops. Setting the slider shows the frame, or marks it pending until it is read.
+  const int nextFrame = (this->SequenceFrame >= static_cast<int>(this->Sequence->GetLastFrame())) ?
+                        static_cast<int>(this->Sequence->GetFirstFrame()) : this->SequenceFrame + 1;
+  this->sldFrame->setValue(nextFrame);
+}
+
+void NNFieldInspector::slot_LinkedPicksReadable()
+{
+  // Picks that arrived while this one was busy (e.g. held arrow keys) are skipped, only the newest is shown.
+  PickChannel::Record record;
+  bool received = false;
+  while(this->LinkedPicks.Receive(record))
+  {
+    received = true;
+  }
+
+  // A stored field leaves NNField empty, so the region of the field that is displayed is tested.
+  if(!received || GetNNFieldRegion().GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  // Shown before the pick is handled, so a readout of the pick in the status bar replaces it.
+  std::stringstream ssFollowing;
+  ssFollowing << "Following the pick of process " << record.Sender << " (its match is " << record.Match[0] << " "
+              << record.Match[1] << ")";
+  this->statusbar->showMessage(ssFollowing.str().c_str());
+
+  this->SuppressPickPublishing = true;
+  double fakeClick[2];
+  fakeClick[0] = record.Pick[0];
+  fakeClick[1] = record.Pick[1];
+  PixelClickedEventHandler(NULL, 0, fakeClick);
+  this->SuppressPickPublishing = false;
+}
+
+void NNFieldInspector::LoadTargetImage(const std::string& fileName)
+{
+  // Only one target image is loaded at a time.
+  this->CancelTargetImageLoading = true;
+  this->TargetImageLoadWatcher.waitForFinished();
+  this->CancelTargetImageLoading = false;
+  this->statusbar->showMessage("Loading the target image...");
+
+  // A mapped image is only paged in where it is displayed or compared, so a large target opens at once.
+  std::function<LoadWorkers::ImageResult()> work = [this, fileName]()
+  {
+    return LoadWorkers::ReadImage(fileName, this->CancelTargetImageLoading, [](int) {}, true);
+  };
+  this->TargetImageLoadWatcher.setFuture(QtConcurrent::run(work));
+}
+
+void NNFieldInspector::slot_TargetImageLoaded()
+{
+  LoadWorkers::ImageResult result = this->TargetImageLoadWatcher.result();
+  if(result.Cancelled)
+  {
+    this->statusbar->showMessage("Loading the target image was cancelled.");
+    return;
+  }
+
+  if(!result.Error.empty() || !result.Image)
+  {
+    std::cerr << "Could not load the target image: " << result.Error << std::endl;
+    this->statusbar->showMessage(QString("Could not load the target image: ") + result.Error.c_str());
+    return;
+  }
+
+  // The reverse index and the match error refer to the images the matches were in.
+  InvalidateReverseIndex();
+  InvalidateMatchError();
+
+  // The layer references the reader's buffer (or the mapping) directly.
+  this->TargetImageLayer.ImageData->Initialize();
+  this->TargetImage = result.Image;
+  this->TargetImageMapping = result.Mapping;
+  LayerImport::WrapRGBImage(this->TargetImage.GetPointer(), this->TargetImageLayer);
+  this->LastTargetPick[0] = -1;
+  this->LastTargetPick[1] = -1;
+
+  this->PickLayerRightOverlay.Initialize(this->TargetImage->GetLargestPossibleRegion());
+  this->PickLayerRight.ImageSlice->VisibilityOff();
+
+  UpdateRightPane();
+  ResetCamera(this->TargetImage->GetLargestPossibleRegion(), this->RendererRight);
+  this->CameraRight.SetCameraPositionPNG();
+  UpdateDisplayedImages();
+
+  std::cout << "Loaded target image" << (this->TargetImageMapping ? " (mapped)" : "") << ", memory: "
+            << MemoryUsage::GetReport() << std::endl;
+  RefreshLastPick();
+  Refresh();
+}
+
+NNFieldInspector::ImageType* NNFieldInspector::GetMatchImage() const
+{
+  return this->TargetImage ? this->TargetImage.GetPointer() : this->Image.GetPointer();
+}
+
+void NNFieldInspector::ShowTargetPick(const itk::Index<2>& pickedIndex)
+{
+  if(!this->TargetImage->GetLargestPossibleRegion().IsInside(pickedIndex))
+  {
+    return;
+  }
+
+  this->LastTargetPick[0] = pickedIndex[0];
+  this->LastTargetPick[1] = pickedIndex[1];
+  std::cout << "Picked target index: " << pickedIndex << std::endl;
+
+  const itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pickedIndex, this->PatchRadius);
+
+  const unsigned char red[3] = {255, 0, 0};
+  const unsigned char blue[3] = {0, 0, 255};
+  this->PickLayerRightOverlay.Clear();
+  this->PickLayerRightOverlay.OutlineRegion(targetRegion, red);
+  this->PickLayerRightOverlay.Modified();
+  this->PickLayerRight.ImageSlice->VisibilityOn();
+
+  // The pixels of the left pane whose match is inside the clicked patch.
+  this->PickLayerOverlay.Clear();
+  if(this->NNFieldReverseIndex)
+  {
+    const size_t width = GetNNFieldRegion().GetSize()[0];
+    const size_t numberOfSources = this->NNFieldReverseIndex->ForEachSourceInRegion(targetRegion,
+      [this, width, &blue](const unsigned int source)
+      {
+      itk::Index<2> sourceIndex = {{static_cast<itk::IndexValueType>(source % width),
+                                    static_cast<itk::IndexValueType>(source / width)}};
+      this->PickLayerOverlay.SetPixel(sourceIndex, blue);
+      });
+
+    std::stringstream ssSources;
+    ssSources << numberOfSources << " pixels match inside the clicked target patch (blue).";
+    this->statusbar->showMessage(ssSources.str().c_str());
+  }
+  else
+  {
+    StartReverseIndexBuild();
+    this->statusbar->showMessage("Building the reverse index, the sources are shown when it is done.");
+  }
+  this->PickLayerOverlay.Modified();
+  this->PickLayer.ImageSlice->VisibilityOn();
+
+  Refresh();
+}
+
+void NNFieldInspector::slot_ReverseIndexBuilt()
+{
+  ReverseIndexResult result = this->ReverseIndexWatcher.result();
+  if(!result.Index)
+  {
+    return;
+  }
+
+  this->NNFieldReverseIndex = result.Index;
+
+  // The layer references the buffer of the usage image.
+  this->SourceUsageImage = result.Usage;
+  LayerImport::WrapFloatImage(this->SourceUsageImage.GetPointer(), this->SourceUsageLayer);
+  LayerImport::SetHeatMapLookupTable(this->SourceUsageLayer, 0.0f, std::max(result.MaxUsage, 1.0f));
+
+  UpdateDisplayedImages();
+
+  // A pick made while the index was being built did not show its sources yet.
+  if(this->TargetImage && this->LastTargetPick[0] != -1)
+  {
+    itk::Index<2> targetPick = {{this->LastTargetPick[0], this->LastTargetPick[1]}};
+    ShowTargetPick(targetPick);
+  }
+  else if(this->chkShowSources->isChecked())
+  {
+    RefreshLastPick();
+  }
+}
+
+void NNFieldInspector::slot_MatchErrorComputed()
+{
+  MatchErrorResult result = this->MatchErrorWatcher.result();
+  if(!result.Image)
+  {
+    // Cancelled, either by the user or because an input changed.
+    return;
+  }
+
+  // The layer references the buffer of the result, or the mapped file it was read from.
+  this->MatchErrorImage = result.Image;
+  this->MatchErrorDiskEntry = result.DiskEntry;
+  this->MatchErrorMax = std::max(result.MaxError, 1.0f);
+  LayerImport::WrapFloatImage(this->MatchErrorImage.GetPointer(), this->MatchErrorLayer);
+  LayerImport::SetGrayscaleLookupTable(this->MatchErrorLayer, 0.0f, this->MatchErrorMax);
+
+  std::stringstream ss;
+  ss << "Match error computed, largest error " << result.MaxError;
+  this->statusbar->showMessage(ss.str().c_str());
+
+  UpdateDisplayedImages();
+}
+
+void NNFieldInspector::on_actionComputeNNField_activated()
+{
+  if(this->Image->GetLargestPossibleRegion().GetNumberOfPixels() == 0)
+  {
+    std::cerr << "An image must be loaded before computing a NNField!" << std::endl;
+    return;
+  }
+
+  if(this->PatchMatchWatcher.isRunning())
+  {
+    std::cerr << "PatchMatch is already running." << std::endl;
+    return;
+  }
+
+  CloseNNFieldSequence();
+
+  this->CancelPatchMatch = false;
+  this->PatchMatchTime.start();
+  this->statusbar->showMessage("Running PatchMatch... (Esc to stop and keep the current field)");
+
+  // The worker holds its own references, so the image and the snapshots outlive it even if another image is loaded.
+  ImageType::Pointer image = this->Image;
+  const unsigned int patchRadius = this->PatchRadius;
+  const unsigned int numberOfIterations = this->spinIterations->value();
+  std::shared_ptr<TripleBuffer<PatchMatchSnapshot> > snapshots(new TripleBuffer<PatchMatchSnapshot>);
+  this->PatchMatchSnapshots = snapshots;
+
+  std::function<NNFieldImageType::Pointer()> work =
+    [this, image, patchRadius, numberOfIterations, snapshots]() -> NNFieldImageType::Pointer
+  {
+    ParallelPatchMatch patchMatch;
+    patchMatch.SetImage(image.GetPointer());
+    patchMatch.SetPatchRadius(patchRadius);
+    patchMatch.SetNumberOfIterations(numberOfIterations);
+    patchMatch.SetCancel(&this->CancelPatchMatch);
+
+    unsigned int numberOfCompletedIterations = 0;
+    patchMatch.SetIterationCallback([&patchMatch, &numberOfCompletedIterations, image, snapshots]
+                                    (unsigned int iteration, double seconds, size_t numberOfImprovedPixels)
+      {
+      std::cout << "PatchMatch iteration " << iteration + 1 << ": " << seconds << " s, "
+                << numberOfImprovedPixels << " pixels improved." << std::endl;
+      numberOfCompletedIterations = iteration + 1;
+
+      // The write buffer is never read by the GUI, so this does not need to wait for it.
+      PatchMatchSnapshot& snapshot = snapshots->GetWriteBuffer();
+      snapshot.Values.resize(3 * patchMatch.GetNumberOfPixels());
+      patchMatch.CopyFieldTo(&snapshot.Values[0]);
+      snapshot.Region = image->GetLargestPossibleRegion();
+      snapshot.Iteration = iteration;
+      snapshot.Seconds = seconds;
+      snapshot.NumberOfImprovedPixels = numberOfImprovedPixels;
+      snapshots->Publish();
+      });
+
+    NNFieldImageType::Pointer nnField;
+    try
+    {
+      nnField = patchMatch.Compute();
+    }
+    catch(std::runtime_error& exception)
+    {
+      std::cerr << exception.what() << std::endl;
+      QMetaObject::invokeMethod(this->statusbar, "showMessage", Qt::QueuedConnection,
+                                Q_ARG(QString, QString(exception.what())));
+      return NNFieldImageType::Pointer();
+    }
+
+    // When stopped early, the field of the last completed iteration is kept.
+    if(numberOfCompletedIterations == 0)
+    {
+      return NNFieldImageType::Pointer();
+    }
+    return nnField;
+  };
+  this->PatchMatchWatcher.setFuture(QtConcurrent::run(work));
+  this->PatchMatchSnapshotTimer.start();
+}
+
+void NNFieldInspector::slot_PatchMatchSnapshotTimeout()
+{
+  // A snapshot is only displayed once the layers of the previous one are complete, so the
+  // layer workers are never stopped halfway and the displayed layers are always whole.
+  if(!this->PatchMatchSnapshots || IsNNFieldInUse() || !this->PatchMatchSnapshots->Consume())
+  {
+    return;
+  }
+
+  // After Consume() the worker may write into the buffer of the previous snapshot, so the displayed
+  // field must be replaced before anything reads it again. Only the GUI thread reads it until then.
+  PatchMatchSnapshot& snapshot = this->PatchMatchSnapshots->GetReadBuffer();
+
+  NNFieldImageType::Pointer liveField = NNFieldImageType::New();
+  liveField->SetNumberOfComponentsPerPixel(3);
+  liveField->SetRegions(snapshot.Region);
+  liveField->GetPixelContainer()->SetImportPointer(&snapshot.Values[0], snapshot.Values.size(), false);
+
+  // ParallelPatchMatch writes the absolute position of the match. The interpretation is only set once the previous
+  // snapshot is no longer displayed, as it refreshes what depends on it (which reads the field).
+  SetNNField(liveField, this->PatchMatchSnapshots);
+  SetInterpretation(NNFieldTypes::ABSOLUTE);
+  RefreshLastPick();
+
+  const size_t numberOfPixels = snapshot.Values.size() / 3;
+  std::stringstream ss;
+  ss << "PatchMatch iteration " << snapshot.Iteration + 1 << "/" << this->spinIterations->value()
+     << ": " << snapshot.Seconds << " s, "
+     << (100.0 * snapshot.NumberOfImprovedPixels) / std::max<size_t>(numberOfPixels, 1) << "% of the pixels improved"
+     << " (Esc to stop and keep this field)";
+  this->statusbar->showMessage(ss.str().c_str());
+}
+
+void NNFieldInspector::slot_PatchMatchFinished()
+{
+  this->PatchMatchSnapshotTimer.stop();
+
+  NNFieldImageType::Pointer nnField = this->PatchMatchWatcher.result();
+  if(!nnField)
+  {
+    if(this->CancelPatchMatch)
+    {
+      this->statusbar->showMessage("PatchMatch was cancelled.");
+    }
+    // Nothing was published, or the display still shows a snapshot (which the worker no longer writes).
+    this->PatchMatchSnapshots.reset();
+    return;
+  }
+
+  // The final field owns its buffer, so the snapshots are released once it is displayed.
+  SetNNField(nnField, std::shared_ptr<void>());
+  SetInterpretation(NNFieldTypes::ABSOLUTE);
+  this->PatchMatchSnapshots.reset();
+  StartReverseIndexBuild();
+
+  std::stringstream ss;
+  ss << "PatchMatch " << (this->CancelPatchMatch ? "stopped early" : "finished") << " after "
+     << this->PatchMatchTime.elapsed() / 1000.0 << " s";
+  std::cout << ss.str() << std::endl;
+  this->statusbar->showMessage(ss.str().c_str());
+
+  // Show the new match of the last pick.
+  RefreshLastPick();
+}
+
+void NNFieldInspector::RefreshLastPick()
+{
+  if(this->LastPick[0] == -1)
+  {
+    return;
+  }
+
+  // The other inspectors have already seen this pick.
+  const bool suppressPickPublishing = this->SuppressPickPublishing;
+  this->SuppressPickPublishing = true;
+
+  double fakeClick[2];
+  fakeClick[0] = this->LastPick[0];
+  fakeClick[1] = this->LastPick[1];
+  PixelClickedEventHandler(NULL, 0, fakeClick);
+
+  this->SuppressPickPublishing = suppressPickPublishing;
+}
+
+void NNFieldInspector::KeypressCallbackFunction(vtkObject* caller, long unsigned int eventId, void* callData)
+{
+  std::cout << "KeypressCallbackFunction" << std::endl;
+
+  if(this->LastPick[0] == -1)
+  {
+    std::cerr << "You cannot use the arrow keys until a click has been made." << std::endl;
+    return;
+  }
+
+  vtkRenderWindowInteractor *iren = vtkRenderWindowInteractor::SafeDownCast(caller);
+
+  if(!iren)
+  {
+    throw std::runtime_error("The iren cast failed!");
+  }
+
+  std::string pressedKey = iren->GetKeySym();
+
+  double fakeClick[2];
+  fakeClick[0] = this->LastPick[0];
+  fakeClick[1] = this->LastPick[1];
+
+  if(pressedKey == "Up")
+  {
+    fakeClick[1] += 1;
+  }
+  else if(pressedKey == "Down")
+  {
+    fakeClick[1] -= 1;
+  }
+  else if(pressedKey == "Left")
+  {
+    fakeClick[0] -= 1;
+  }
+  else if(pressedKey == "Right")
+  {
+    fakeClick[0] += 1;
+  }
+  else
+  {
+    return;
+  }
+
+  PixelClickedEventHandler(NULL, 0, fakeClick);
+}
 
 void NNFieldInspector::showEvent(QShowEvent* event)
 {
@@ -440,15 +3600,54 @@ void NNFieldInspector::showEvent(QShowEvent* event)
   }
   else
   {
+    // These run concurrently, the camera is positioned when the image arrives.
     LoadImage(this->ImageFileName);
     LoadNNField(this->NNFieldFileName);
-    this->Camera.SetCameraPositionPNG();
   }
 }
 
 void NNFieldInspector::closeEvent(QCloseEvent* event)
 {
   std::cout << "Exiting..." << std::endl;
+
+  // The label the timings are shown in goes away with this object.
+  Trace::SetOperationCallback(Trace::OperationCallback());
+  this->LinkedPicks.Close();
+
+  // Workers refer to this object, so they must finish before it goes away.
+  this->CancelImageLoading = true;
+  this->CancelNNFieldLoading = true;
+  this->CancelNNFieldLayerBuild = true;
+  this->CancelPatchMatch = true;
+  this->CancelMatchError = true;
+  this->CancelReverseIndex = true;
+  this->CancelCoherence = true;
+  this->CancelComparisonLoading = true;
+  this->CancelComparison = true;
+  this->CancelTargetImageLoading = true;
+  this->CancelChannelStatistics = true;
+  this->CancelImagePyramid = true;
+  this->CancelNNFieldPyramid = true;
+  this->CancelNNFieldReload = true;
+  this->PatchMatchSnapshotTimer.stop();
+  this->PyramidViewTimer.stop();
+  this->NNFieldReloadTimer.stop();
+  CloseNNFieldSequence();
+  this->ImageLoadWatcher.waitForFinished();
+  this->NNFieldLoadWatcher.waitForFinished();
+  this->NNFieldLayerWatcher.waitForFinished();
+  this->PatchMatchWatcher.waitForFinished();
+  this->MatchErrorWatcher.waitForFinished();
+  this->ReverseIndexWatcher.waitForFinished();
+  this->CoherenceWatcher.waitForFinished();
+  this->ComparisonLoadWatcher.waitForFinished();
+  this->ComparisonWatcher.waitForFinished();
+  this->TargetImageLoadWatcher.waitForFinished();
+  this->ChannelStatisticsWatcher.waitForFinished();
+  this->ImagePyramidWatcher.waitForFinished();
+  this->NNFieldPyramidWatcher.waitForFinished();
+  this->NNFieldReloadWatcher.waitForFinished();
+
   QApplication::exit();
 }
 
@@ -22,24 +22,51 @@
 #include "ui_NNFieldInspector.h"
 
 // VTK
+#include <vtkImageData.h>
 #include <vtkSmartPointer.h>
 #include <vtkSeedWidget.h>
 #include <vtkPointHandleRepresentation2D.h>
 #include <vtkRenderer.h>
 
-// ITK
-#include "itkImage.h"
-#include "itkVectorImage.h"
-
 // Qt
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QLabel>
 #include <QMainWindow>
+#include <QMutex>
+#include <QSocketNotifier>
+#include <QTime>
+#include <QTimer>
+class QRadioButton;
+
+// STL
+#include <atomic>
+#include <memory>
+#include <vector>
 
 // Submodules
 #include "ITKVTKCamera/ITKVTKCamera.h"
 #include "Layer/Layer.h"
 
 // Custom
+#include "ChannelStatistics.h"
+#include "CoherenceSegmentation.h"
+#include "LayerCache.h"
+#include "LoadWorkers.h"
+#include "MappedMetaImage.h"
+#include "NNFieldComparison.h"
+#include "NNFieldSequence.h"
+#include "NNFieldTypes.h"
+#include "PickChannel.h"
+#include "PickOverlay.h"
 #include "PointSelectionStyle2D.h"
+#include "PyramidView.h"
+#include "NNFieldStore.h"
+#include "ReverseIndex.h"
+#include "TileChecksums.h"
+#include "TiledPyramid.h"
+#include "Trace.h"
+#include "TripleBuffer.h"
 
 class NNFieldInspector : public QMainWindow, public Ui::NNFieldInspector
 {
@@ -49,10 +76,13 @@ public:
   /** If the NNField is interpreted as an absolute position field, the NNPatch is specified
     * directly by the value at the field pixel. If it is interpreted as an offset field, the
     * NNPatch is specified by the field pixel location + the field pixel value. */
-  enum INTERPRETATION_ENUM {OFFSET, ABSOLUTE};
+  typedef NNFieldTypes::INTERPRETATION_ENUM INTERPRETATION_ENUM;
+
+  typedef NNFieldTypes::ImageType ImageType;
+  typedef NNFieldTypes::NNFieldImageType NNFieldImageType;
 
-  typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
-  typedef itk::VectorImage<float, 2> NNFieldImageType;
+  typedef TiledPyramid<unsigned char> ImagePyramidType;
+  typedef TiledPyramid<float> NNFieldPyramidType;
 
   /** Constructor */
   NNFieldInspector();
@@ -65,6 +95,8 @@ public slots:
 
   void on_actionOpenImage_activated();
   void on_actionOpenNNField_activated();
+  void on_actionWatchNNField_triggered();
+  void on_actionCancelLoading_activated();
 
   void on_actionHelp_activated();
   void on_actionQuit_activated();
@@ -72,14 +104,119 @@ public slots:
   void on_actionFlipHorizontally_activated();
   void on_actionFlipVertically_activated();
 
+  // Timings of the operations
+  void on_actionTraceTimings_triggered();
+  void on_actionExportTrace_activated();
+
+  // Picks shared with the other inspectors on this machine
+  void on_actionLinkPicks_triggered();
+
+  // Right pane (the comparison field)
+  void on_actionOpenImageRight_activated();
+  void on_actionCloseComparison_activated();
+  void on_actionFlipRightHorizontally_activated();
+  void on_actionFlipRightVertically_activated();
+  void on_actionShowComparisonField_triggered();
+  void on_actionShowOffsetDifference_triggered();
+  void on_actionShowScoreDifference_triggered();
+
+  // Sequences of fields
+  void on_actionOpenNNFieldSequence_activated();
+  void on_actionCloseNNFieldSequence_activated();
+  void on_sldFrame_valueChanged(int frame);
+  void on_btnPlaySequence_clicked();
+
+  // Right pane (the target image of cross-image fields)
+  void on_actionOpenTargetImage_activated();
+  void on_actionCloseTargetImage_activated();
+
   // Edit menu
   void on_actionInterpretAsOffsetField_activated();
   void on_actionInterpretAsAbsoluteField_activated();
+  void on_actionComputeNNField_activated();
+
+  void on_spinPatchRadius_valueChanged(int patchRadius);
+  void on_spinFlowScale_valueChanged(int maximumMagnitude);
+  void on_sldCoherenceThreshold_valueChanged(int tenthsOfPixels);
+  void on_chkCoherenceEightConnected_clicked();
 
   void on_radRGB_clicked();
   void on_radNNFieldMagnitude_clicked();
   void on_radNNFieldX_clicked();
   void on_radNNFieldY_clicked();
+  void on_radFlowColor_clicked();
+  void on_radCoherence_clicked();
+  void on_radMatchError_clicked();
+  void on_radSourceUsage_clicked();
+  void on_chkShowSources_clicked();
+
+private slots:
+
+  /** Called on the GUI thread when a load started by LoadImage or LoadNNField finishes.*/
+  void slot_ImageLoaded();
+  void slot_NNFieldLoaded();
+
+  /** Called on the GUI thread with the progress of the loading workers.*/
+  void slot_ImageLoadProgress(int percent);
+  void slot_NNFieldLoadProgress(int percent);
+
+  /** Called on the GUI thread when the comparison field has been loaded, and when it has been compared to the NNField.*/
+  void slot_ComparisonNNFieldLoaded();
+  void slot_ComparisonComputed();
+
+  /** Called on the GUI thread when a frame of the sequence has been read by its background thread.*/
+  void slot_SequenceFrameReady(int frame);
+
+  /** Advance playback to the next frame, if it has been read.*/
+  void slot_SequencePlaybackTimeout();
+
+  /** Called on the GUI thread when other inspectors have published picks. Only the newest one is shown.*/
+  void slot_LinkedPicksReadable();
+
+  /** Called when the file of the watched NNField changed. It is read once it stopped changing for a moment.*/
+  void slot_NNFieldFileChanged();
+  void slot_NNFieldReloadTimeout();
+
+  /** Called on the GUI thread when the watched NNField has been read again and compared to the current one, or
+    * when the checksums of the current one have been computed.*/
+  void slot_NNFieldReloaded();
+
+  /** Called on the GUI thread when the target image has been loaded (or mapped).*/
+  void slot_TargetImageLoaded();
+
+  /** Called on the GUI thread when bands of the NNField layers have been computed.*/
+  void slot_NNFieldLayerBandsReady();
+
+  /** The layer worker found the NNField layers in the disk cache.*/
+  void slot_NNFieldLayersFoundOnDisk();
+
+  /** Called on the GUI thread while PatchMatch runs, to display the newest snapshot of the field.*/
+  void slot_PatchMatchSnapshotTimeout();
+
+  /** Called on the GUI thread when PatchMatch is done.*/
+  void slot_PatchMatchFinished();
+
+  /** Called on the GUI thread when the match error has been computed.*/
+  void slot_MatchErrorComputed();
+
+  /** Called on the GUI thread when the reverse index has been built.*/
+  void slot_ReverseIndexBuilt();
+
+  /** Display the coherent segments, or start the next segmentation if the threshold changed meanwhile.*/
+  void slot_CoherenceComputed();
+
+  /** Called on the GUI thread when the statistics of the NNField channels have been computed.*/
+  void slot_ChannelStatisticsComputed();
+
+  /** Called when one of the radio buttons of the extra channels is clicked.*/
+  void slot_ExtraChannelClicked();
+
+  /** Called on the GUI thread when the pyramid of the image or of the NNField has been built.*/
+  void slot_ImagePyramidBuilt();
+  void slot_NNFieldPyramidBuilt();
+
+  /** Assemble the visible tiles of the pyramids into their layers, if the view changed since the last time.*/
+  void slot_UpdatePyramidViews();
 
 private:
 
@@ -90,6 +227,9 @@ private:
   void PixelClickedEventHandler(vtkObject* caller, long unsigned int eventId,
                                 void* callData);
 
+  /** Called after every render, to update the pyramid views if the camera or the window size changed.*/
+  void RendererEndCallback(vtkObject* caller, long unsigned int eventId, void* callData);
+
   /** Functionality shared by all constructors.*/
   void SharedConstructor();
 
@@ -99,12 +239,376 @@ private:
   /** The image over which the nearest neighbor field is defined.*/
   ImageType::Pointer Image;
 
-  /** Load an image.*/
+  /** Start loading an image on a worker thread. slot_ImageLoaded is called when it is done.*/
   void LoadImage(const std::string& fileName);
 
-  /** Load a nearest neighbor field.*/
+  /** Start loading a nearest neighbor field on a worker thread. slot_NNFieldLoaded is called when it is done.*/
   void LoadNNField(const std::string& fileName);
 
+  /** Replace the NNField. 'bufferOwner' must own the buffer 'nnField' views (a memory mapping or
+    * the PatchMatch snapshots), if it does not own its buffer itself.*/
+  void SetNNField(NNFieldImageType* const nnField, const std::shared_ptr<void>& bufferOwner);
+
+  /** Keeps the buffer of the NNField alive when the NNField does not own it. NULL otherwise.*/
+  std::shared_ptr<void> NNFieldBufferOwner;
+
+  /** Replace the NNField by a field that is only read through 'store' (a tiled or a compact field). NNField is then
+    * empty, so the layers that need the whole field in memory (match error, source usage, statistics) are not available.*/
+  void SetStoredNNField(const std::shared_ptr<NNFieldStore>& store);
+
+  /** The tiled or compact field, if one is displayed. NULL otherwise.*/
+  std::shared_ptr<NNFieldStore> StoredNNField;
+
+  /** The region and the number of channels of the NNField or of the stored field.*/
+  itk::ImageRegion<2> GetNNFieldRegion() const;
+  unsigned int GetNNFieldNumberOfComponents() const;
+
+  /** Read the channels of the pixel at 'index' of the NNField or of the stored field into 'pixel'.
+    * Returns false if it could not be read.*/
+  bool GetNNFieldPixel(const itk::Index<2>& index, std::vector<float>& pixel);
+
+  /** Redo the last pick, e.g. after the NNField changed.*/
+  void RefreshLastPick();
+
+  /** Start computing the NNField layers from the NNField on a worker thread.
+    * The layers are displayed progressively as bands of rows arrive in slot_NNFieldLayerBandsReady.*/
+  void StartNNFieldLayerBuild();
+
+  /** Stop computing the NNField layers and wait for the worker to finish.*/
+  void StopNNFieldLayerBuild();
+
+  /** Whether the NNField layers have been (or are being) built from the current NNField.*/
+  bool NNFieldLayersBuilt;
+
+  /** Incremented for every layer build, so bands of a stopped build can be recognized.*/
+  unsigned int NNFieldLayerBuildId;
+
+  /** The bands computed by the layer worker that the GUI has not handled yet.*/
+  std::vector<LoadWorkers::NNFieldLayerBand> PendingBands;
+  QMutex PendingBandsMutex;
+
+  /** The entry of the disk cache the layer worker found instead of computing the bands, and the build it belongs to.
+    * Guarded by PendingBandsMutex.*/
+  std::shared_ptr<LayerCache::Entry> FoundNNFieldLayers;
+  unsigned int FoundNNFieldLayersBuildId;
+
+  /** The NNField layers and match errors computed before, shared by all inspectors of the user, so reopening a
+    * field shows them without computing them again.*/
+  std::shared_ptr<LayerCache> DiskLayerCache;
+
+  /** The ranges of the NNField layers over the bands handled so far.*/
+  float NNFieldChannelMin[2];
+  float NNFieldChannelMax[2];
+  float NNFieldMagnitudeMax;
+  unsigned int NNFieldLayerRowsBuilt;
+
+  /** The complete NNField layers of one interpretation of the current field.*/
+  struct NNFieldLayerCache
+  {
+    NNFieldLayerCache() : Complete(false) {}
+
+    bool Complete;
+
+    /** Shallow copies of the data of the X, Y and magnitude layers. NULL if the field is displayed through its
+      * pyramid, whose views are converted when they are shown, so only the ranges are kept then.*/
+    vtkSmartPointer<vtkImageData> X;
+    vtkSmartPointer<vtkImageData> Y;
+    vtkSmartPointer<vtkImageData> Magnitude;
+
+    /** The entry of the disk cache whose mapped files the layers view, if they were read from it.*/
+    std::shared_ptr<LayerCache::Entry> DiskEntry;
+
+    float ChannelMin[2];
+    float ChannelMax[2];
+    float MagnitudeMax;
+  };
+
+  /** The layers of both interpretations (indexed by INTERPRETATION_ENUM), so switching back and forth only
+    * computes them once.*/
+  NNFieldLayerCache NNFieldLayerCaches[2];
+
+  /** Keep the layers that were just completed in NNFieldLayerCaches.*/
+  void CacheNNFieldLayers();
+
+  /** Forget the cached layers, because the field changed.*/
+  void ClearNNFieldLayerCaches();
+
+  /** Set the lookup tables of the X, Y and magnitude layers. The X and Y layers select channels 0 and 1 of the
+    * field for absolute fields, and display their own single channel images otherwise.*/
+  void SetNNFieldLayerLookupTables(const float channelMin[2], const float channelMax[2], const float magnitudeMax);
+
+  /** Set the lookup tables of the layers of the stored field from the channel ranges it records.*/
+  void SetStoredNNFieldLookupTables();
+
+  /** Limits how often the partially built layers are rendered.*/
+  QTime LastProgressiveRender;
+
+  /** Watch the workers.*/
+  QFutureWatcher<LoadWorkers::ImageResult> ImageLoadWatcher;
+  QFutureWatcher<LoadWorkers::NNFieldResult> NNFieldLoadWatcher;
+  QFutureWatcher<void> NNFieldLayerWatcher;
+
+  /** Set to ask the corresponding worker to stop.*/
+  std::atomic<bool> CancelImageLoading;
+  std::atomic<bool> CancelNNFieldLoading;
+  std::atomic<bool> CancelNNFieldLayerBuild;
+  std::atomic<bool> CancelPatchMatch;
+
+  /** Watch the PatchMatch worker. The result is NULL if it failed or was cancelled before the first iteration.*/
+  QFutureWatcher<NNFieldImageType::Pointer> PatchMatchWatcher;
+
+  /** Measures the whole PatchMatch run.*/
+  QTime PatchMatchTime;
+
+  /** The field after a PatchMatch iteration, as published by the worker.*/
+  struct PatchMatchSnapshot
+  {
+    /** The three interleaved channels of the field, row major.*/
+    std::vector<float> Values;
+    itk::ImageRegion<2> Region;
+    unsigned int Iteration;
+    double Seconds;
+    size_t NumberOfImprovedPixels;
+  };
+
+  /** The worker publishes a snapshot after each iteration and never waits for the GUI. The GUI polls
+    * for the newest one with PatchMatchSnapshotTimer and displays it without copying.*/
+  std::shared_ptr<TripleBuffer<PatchMatchSnapshot> > PatchMatchSnapshots;
+  QTimer PatchMatchSnapshotTimer;
+
+  /** The match error of every pixel, computed on a worker thread.*/
+  struct MatchErrorResult
+  {
+    NNFieldTypes::FloatImageType::Pointer Image;
+    float MaxError;
+
+    /** The entry of the disk cache whose mapped file the image views, if it was read from it.*/
+    std::shared_ptr<LayerCache::Entry> DiskEntry;
+  };
+
+  /** Start computing the match error layer on a worker thread, for the current image, NNField,
+    * patch radius and interpretation. slot_MatchErrorComputed is called when it is done.*/
+  void StartMatchErrorComputation();
+
+  /** Forget the match error layer (and stop computing it), because something it depends on changed.*/
+  void InvalidateMatchError();
+
+  /** Color the offsets of the NNField (or of its assembled tiles, if it is displayed by a pyramid) into the
+    * FlowColorLayer. The colors saturate at the offset length of spinFlowScale, or at the longest offset if it is 0.*/
+  void UpdateFlowColorLayer();
+
+  /** Forget the FlowColorLayer, because the field, the interpretation or the scale changed.*/
+  void InvalidateFlowColorLayer();
+
+  /** The match error displayed by MatchErrorLayer. It is kept until something it depends on changes,
+    * so switching between layers does not recompute it.*/
+  NNFieldTypes::FloatImageType::Pointer MatchErrorImage;
+  std::shared_ptr<LayerCache::Entry> MatchErrorDiskEntry;
+  float MatchErrorMax;
+
+  QFutureWatcher<MatchErrorResult> MatchErrorWatcher;
+  std::atomic<bool> CancelMatchError;
+
+  /** The reverse index of the NNField and the source usage computed from it, on a worker thread.*/
+  struct ReverseIndexResult
+  {
+    std::shared_ptr<ReverseIndex> Index;
+    NNFieldTypes::FloatImageType::Pointer Usage;
+    float MaxUsage;
+  };
+
+  /** Start building the reverse index of the current NNField and interpretation on a worker thread,
+    * unless it exists or is being built. slot_ReverseIndexBuilt is called when it is done.*/
+  void StartReverseIndexBuild();
+
+  /** Forget the reverse index (and stop building it), because the NNField or its interpretation changed.*/
+  void InvalidateReverseIndex();
+
+  /** Which pixels match inside a clicked patch. NULL until it is built.*/
+  std::shared_ptr<ReverseIndex> NNFieldReverseIndex;
+
+  /** The number of sources of every pixel, displayed by SourceUsageLayer.*/
+  NNFieldTypes::FloatImageType::Pointer SourceUsageImage;
+
+  QFutureWatcher<ReverseIndexResult> ReverseIndexWatcher;
+  std::atomic<bool> CancelReverseIndex;
+
+  /** The coherent segments of the NNField and their colors, computed on a worker thread.*/
+  struct CoherenceResult
+  {
+    std::shared_ptr<const CoherenceSegmentation> Segmentation;
+    NNFieldTypes::ImageType::Pointer Colors;
+  };
+
+  /** Start segmenting the current NNField with the current threshold and neighborhood on a worker thread.
+    * If a segmentation is running, it is cancelled and this one starts once it has stopped, so moving the
+    * threshold slider only ever runs one segmentation. The displayed segments stay until the new ones arrive.*/
+  void StartCoherenceComputation();
+
+  /** Forget the coherent segments (and stop computing them), because the NNField or its interpretation changed.*/
+  void InvalidateCoherence();
+
+  /** The offset difference (in pixels) up to which neighbors are coherent, from sldCoherenceThreshold.*/
+  float GetCoherenceThreshold() const;
+
+  /** The coherent segments of the NNField, NULL until they are computed.*/
+  std::shared_ptr<const CoherenceSegmentation> NNFieldCoherence;
+
+  /** The colors of the segments, displayed by CoherenceLayer.*/
+  NNFieldTypes::ImageType::Pointer CoherenceImage;
+
+  QFutureWatcher<CoherenceResult> CoherenceWatcher;
+  std::atomic<bool> CancelCoherence;
+
+  /** Whether the running segmentation is outdated, so another one starts when it finishes.*/
+  bool CoherenceRestartPending;
+
+  /** Start loading the field to compare the NNField to. It is always read into memory, also if it is tiled or compact.*/
+  void LoadComparisonNNField(const std::string& fileName);
+
+  /** The field displayed in the right pane, e.g. the field of another version of the solver for the same image.
+    * It is interpreted like the NNField. NULL if nothing is compared.*/
+  NNFieldImageType::Pointer ComparisonNNField;
+  std::shared_ptr<void> ComparisonNNFieldBufferOwner;
+
+  QFutureWatcher<LoadWorkers::NNFieldResult> ComparisonLoadWatcher;
+  std::atomic<bool> CancelComparisonLoading;
+
+  /** Start comparing the comparison field to the NNField on a worker thread, if both have the same size.
+    * slot_ComparisonComputed is called when it is done.*/
+  void StartComparison();
+
+  /** Forget the differences (and stop computing them), because one of the fields changed.*/
+  void InvalidateComparison();
+
+  /** The differences between the fields, displayed by the difference layers. NULL images until they are computed.*/
+  NNFieldComparison::Result ComparisonDifferences;
+
+  QFutureWatcher<NNFieldComparison::Result> ComparisonWatcher;
+  std::atomic<bool> CancelComparison;
+
+  /** Color the comparison field like the FlowColorLayer, and show the layer of the right pane that is selected.*/
+  void UpdateRightPane();
+
+  /** Draw the pick, and the match of the comparison field, into the right pane and report how the comparison field
+    * differs there from 'nnFieldPixel' (the picked pixel of the NNField).*/
+  void ShowComparisonPick(const itk::Index<2>& pickedIndex, const itk::ImageRegion<2>& pickedRegion,
+                          const std::vector<float>& nnFieldPixel);
+
+  /** Start loading the image the matches of the NNField are in, if it is not the image the field is defined over
+    * (e.g. a reference plate, or the next frame of a video). Uncompressed MetaImages are memory mapped.*/
+  void LoadTargetImage(const std::string& fileName);
+
+  /** The image the matches are in, displayed in the right pane. NULL if the matches are in Image.*/
+  ImageType::Pointer TargetImage;
+
+  /** Keeps the mapping alive if TargetImage views a memory mapped file.*/
+  std::shared_ptr<MappedMetaImage> TargetImageMapping;
+
+  QFutureWatcher<LoadWorkers::ImageResult> TargetImageLoadWatcher;
+  std::atomic<bool> CancelTargetImageLoading;
+
+  /** The image the matches of the NNField are in: TargetImage if it is set, Image otherwise.*/
+  ImageType* GetMatchImage() const;
+
+  /** Outline the clicked patch of the target image and, if the reverse index is built, its sources in the left pane.*/
+  void ShowTargetPick(const itk::Index<2>& pickedIndex);
+
+  /** Open the numbered sequence of fields 'fileName' is a frame of and display that frame. The frames around
+    * the current one are read in the background, so stepping and playback do not wait for the disk.*/
+  void OpenNNFieldSequence(const std::string& fileName);
+
+  /** Stop playback and the background thread of the sequence. The displayed field stays.*/
+  void CloseNNFieldSequence();
+
+  /** Display 'frame' of the sequence and redo the last pick on it, or display it as soon as it is read.*/
+  void ShowSequenceFrame(const unsigned int frame);
+
+  /** The sequence that is played, NULL if none is open.*/
+  std::shared_ptr<NNFieldSequence> Sequence;
+
+  /** The frame that is displayed, and the frame to display as soon as it is read (or -1).*/
+  int SequenceFrame;
+  int SequencePendingFrame;
+
+  QTimer SequencePlaybackTimer;
+
+  /** Make ExtraChannelLayers display the channels after X and Y of the current NNField, adding or
+    * removing layers and radio buttons if the number of channels changed.*/
+  void UpdateExtraChannelLayers();
+
+  /** The layers of the channels after X and Y (e.g. the patch distance written by PatchMatch),
+    * and the radio buttons that select them. They are views of the NNField buffer.*/
+  std::vector<std::shared_ptr<Layer> > ExtraChannelLayers;
+  std::vector<QRadioButton*> ExtraChannelRadioButtons;
+
+  /** Start computing the statistics of all channels of the NNField on a worker thread.*/
+  void StartChannelStatistics();
+
+  /** Stop computing the statistics and forget them.*/
+  void StopChannelStatistics();
+
+  /** The statistics of every channel of the NNField. Empty until they are computed.*/
+  std::vector<ChannelStatistics::Statistics> NNFieldChannelStatistics;
+
+  QFutureWatcher<std::vector<ChannelStatistics::Statistics> > ChannelStatisticsWatcher;
+  std::atomic<bool> CancelChannelStatistics;
+
+  /** Whether any worker is reading the buffer of the NNField.*/
+  bool IsNNFieldInUse() const;
+
+  /** Whether the image and the NNField are too large to be displayed directly, so their layers display the visible
+    * tiles of a multi-resolution pyramid instead. The match error, source usage and pick layers are always direct.*/
+  bool IsImageDisplayedByPyramid() const;
+  bool IsNNFieldDisplayedByPyramid() const;
+
+  /** Start building the pyramid of the current image or NNField on a worker thread.*/
+  void StartImagePyramidBuild();
+  void StartNNFieldPyramidBuild();
+
+  /** Stop building the pyramid and stop displaying it, because the image or the NNField it references is replaced.*/
+  void StopImagePyramidBuild();
+  void StopNNFieldPyramidBuild();
+
+  /** Make the NNField layers display the assembled tiles of NNFieldPyramidView.*/
+  void ShowNNFieldPyramidView();
+
+  /** The part of the image plane that is visible in the renderer (in pixels), and how many pixels one screen pixel covers.
+    * Returns false if the renderer has no size yet.*/
+  bool GetVisibleRegion(itk::ImageRegion<2>& visibleRegion, double& imagePixelsPerScreenPixel) const;
+
+  /** Make 'region' fill 'renderer' (the left pane by default). Layers displayed through a pyramid may still be
+    * empty, so the bounds of the props cannot be used.*/
+  void ResetCamera(const itk::ImageRegion<2>& region, vtkRenderer* renderer = NULL);
+
+  /** The visible tiles of the image and of the NNField.*/
+  PyramidView<unsigned char> ImagePyramidView;
+  PyramidView<float> NNFieldPyramidView;
+
+  QFutureWatcher<std::shared_ptr<ImagePyramidType> > ImagePyramidWatcher;
+  QFutureWatcher<std::shared_ptr<NNFieldPyramidType> > NNFieldPyramidWatcher;
+  std::atomic<bool> CancelImagePyramid;
+  std::atomic<bool> CancelNNFieldPyramid;
+
+  /** Coalesces the renders of an interaction into one update of the pyramid views.*/
+  QTimer PyramidViewTimer;
+
+  /** The progress of each worker in percent, or -1 if it is not running.*/
+  int ImageLoadProgress;
+  int NNFieldLoadProgress;
+  int NNFieldLayerProgress;
+
+  /** Show the progress of the running workers in the status bar.*/
+  void UpdateLoadingStatus();
+
+  /** When the image and the NNField loads were started (from Trace::Now()), so their traced operations include
+    * the reading on the worker.*/
+  long long ImageLoadTraceStart;
+  long long NNFieldLoadTraceStart;
+
+  /** Shows the stages of the last traced operation in the status bar, next to its messages.*/
+  QLabel* TraceLabel;
+
   /** The layer used to display the RGB image.*/
   Layer ImageLayer;
 
@@ -117,14 +621,43 @@ private:
   /** The layer used to display the Y component of the nearest neighbor field.*/
   Layer NNFieldYLayer;
 
+  /** The layer used to display the offsets of the nearest neighbor field in color: the hue is their direction,
+    * the saturation their length.*/
+  Layer FlowColorLayer;
+
+  /** The layer used to display the coherent segments of the nearest neighbor field and its discontinuities.*/
+  Layer CoherenceLayer;
+
+  /** The layer used to display the distance between the patch at each pixel and its match.*/
+  Layer MatchErrorLayer;
+
+  /** The layer used to display how many pixels match at each pixel.*/
+  Layer SourceUsageLayer;
+
   /** The layer used to do the picking. This layer is always on top and is transparent everywhere
     * except the outline of the current patch and its best match.
     */
   Layer PickLayer;
 
+  /** Draws the patch outlines into the PickLayer incrementally.*/
+  PickOverlay PickLayerOverlay;
+
   /** An object to handle flipping the camera.*/
   ITKVTKCamera Camera;
 
+  /** The right pane displays the comparison field (in flow colors) or its differences to the NNField. Its picks are
+    * handled by PixelClickedEventHandler like those of the left pane, so both panes always show the same pick.
+    * While a target image is set, the right pane displays it instead, and its picks select patches of the target.*/
+  vtkSmartPointer<vtkRenderer> RendererRight;
+  PointSelectionStyle2D* SelectionStyleRight;
+  ITKVTKCamera CameraRight;
+  Layer ComparisonFieldLayer;
+  Layer OffsetDifferenceLayer;
+  Layer ScoreDifferenceLayer;
+  Layer TargetImageLayer;
+  Layer PickLayerRight;
+  PickOverlay PickLayerRightOverlay;
+
   /** The radius of the patches.*/
   unsigned int PatchRadius;
 
@@ -140,9 +673,81 @@ private:
   /** How to interpret the NNfield */
   INTERPRETATION_ENUM Interpretation;
 
+  /** Switch the interpretation. Everything derived from the field is updated, from the cache if possible,
+    * and the last pick is redone.*/
+  void SetInterpretation(const INTERPRETATION_ENUM interpretation);
+
   /** The last pick.*/
   int LastPick[2];
 
+  /** The last pick in the target image, or -1 if the last pick was in the left pane.*/
+  int LastTargetPick[2];
+
+  /** Shares the picks with the other inspectors on this machine while View > Link Picks is checked.*/
+  PickChannel LinkedPicks;
+  QSocketNotifier* LinkedPicksNotifier;
+
+  /** Set while the last pick is redone or a pick of another inspector is shown, so it is not published.*/
+  bool SuppressPickPublishing;
+
+  /** The file the current NNField was read from. Empty if it was not read from a file of its own (e.g. it was
+    * computed by PatchMatch or is a frame of a sequence), then there is nothing to watch.*/
+  std::string LoadedNNFieldFileName;
+
+  /** The file being read by LoadNNField.*/
+  std::string LoadingNNFieldFileName;
+
+  /** Watches LoadedNNFieldFileName while File > Reload NNField When It Changes is checked.*/
+  QFileSystemWatcher NNFieldFileWatcher;
+
+  /** Solvers write the file in several steps, so it is only read once it stopped changing for a moment.*/
+  QTimer NNFieldReloadTimer;
+
+  /** The checksums of the tiles of the current field, taken when it was read. A mapped file that is rewritten in
+    * place changes the field in memory as well, so comparing to the field itself could miss changes.
+    * Empty if they have not been computed (yet).*/
+  std::vector<TileChecksums::ChecksumType> NNFieldTileChecksums;
+
+  /** The field read again from LoadedNNFieldFileName, or only the checksums of the current field.*/
+  struct NNFieldReloadResult
+  {
+    NNFieldReloadResult() : Compared(false) {}
+
+    /** The field that was current when the worker started, the result is dropped if it is no longer.*/
+    NNFieldImageType::Pointer PreviousField;
+
+    /** Empty if only the checksums of PreviousField were computed.*/
+    LoadWorkers::NNFieldResult Load;
+
+    /** The checksums of the tiles of the field that was read (or of PreviousField).*/
+    std::vector<TileChecksums::ChecksumType> Checksums;
+
+    /** Whether the field that was read was compared to PreviousField, which needs fields in memory of the same
+      * size and the checksums of PreviousField. Otherwise it replaces PreviousField as a whole.*/
+    bool Compared;
+    std::vector<unsigned int> ChangedTiles;
+  };
+
+  /** Watch LoadedNNFieldFileName, or nothing if watching is off.*/
+  void UpdateNNFieldFileWatch();
+
+  /** Start computing the checksums of the tiles of the current field on a worker thread, if it is watched.*/
+  void StartNNFieldChecksums();
+
+  /** Start reading LoadedNNFieldFileName again on a worker thread and comparing it to the current field.*/
+  void StartNNFieldReload();
+
+  /** Replace the current field by the one that was read again, updating the layers only where tiles changed.
+    * The pick is redone if its match changed.*/
+  void ApplyChangedNNFieldTiles(const NNFieldReloadResult& result);
+
+  QFutureWatcher<NNFieldReloadResult> NNFieldReloadWatcher;
+  std::atomic<bool> CancelNNFieldReload;
+
+  /** Whether the running reload or checksums belong to a replaced field, so the checksums of the current one
+    * start when it finishes.*/
+  bool NNFieldChecksumsRestartPending;
+
   /** Refresh the window.*/
   void Refresh();
 
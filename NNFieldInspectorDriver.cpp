@@ -21,10 +21,21 @@
 
 #include <stdexcept>
 
+#include "NNFieldBatch.h"
 #include "NNFieldInspector.h"
 
 int main( int argc, char** argv )
 {
+  // The batch mode must not touch the display, so it runs before the QApplication is created.
+  if(NNFieldBatch::IsRequested(argc, argv))
+  {
+    return NNFieldBatch::Run(std::vector<std::string>(argv + 2, argv + argc));
+  }
+  if(NNFieldBatch::IsConversionRequested(argc, argv))
+  {
+    return NNFieldBatch::RunConversion(std::vector<std::string>(argv + 2, argv + argc));
+  }
+
   QApplication app( argc, argv );
 
   QApplication::setStyle(new QCleanlooksStyle);
@@ -34,7 +45,9 @@ int main( int argc, char** argv )
   if(argc == 1)
   {
     std::cout << "Using no arguments. Potential arguments are:" << std::endl
-              << "Image.png NNField.mha" << std::endl;
+              << "Image.png NNField.mha" << std::endl
+              << "or, without a window:" << std::endl;
+    NNFieldBatch::PrintUsage(std::cout);
     nnFieldInspector = new NNFieldInspector;
   }
   else if(argc == 3)
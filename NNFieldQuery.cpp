@@ -0,0 +1,241 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldQuery.h"
+
+// STL
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// ITK
+#include "itkImageFileWriter.h"
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  typedef NNFieldTypes::ImageType ImageType;
+
+  /** The memory all the canvases of WriteOverlays() may take together. Each is a copy of the image, so for large
+    * images fewer are drawn at the same time than there are cores.*/
+  const size_t MaximumCanvasBytes = static_cast<size_t>(1) << 30;
+
+  /** Set the pixels of the outline of 'region' (clipped to the image) to 'color', remembering
+    * their previous values in 'saved' so they can be restored.*/
+  void DrawOutline(ImageType* const image, itk::ImageRegion<2> region, const ImageType::PixelType& color,
+                   std::vector<std::pair<itk::Index<2>, ImageType::PixelType> >& saved)
+  {
+    const itk::ImageRegion<2> imageRegion = image->GetLargestPossibleRegion();
+    const itk::Index<2> corner = region.GetIndex();
+    const itk::Size<2> size = region.GetSize();
+    for(itk::IndexValueType y = corner[1]; y < corner[1] + static_cast<itk::IndexValueType>(size[1]); ++y)
+    {
+      for(itk::IndexValueType x = corner[0]; x < corner[0] + static_cast<itk::IndexValueType>(size[0]); ++x)
+      {
+        const bool onOutline = (y == corner[1] || y == corner[1] + static_cast<itk::IndexValueType>(size[1]) - 1 ||
+                                x == corner[0] || x == corner[0] + static_cast<itk::IndexValueType>(size[0]) - 1);
+        itk::Index<2> index = {{x, y}};
+        if(onOutline && imageRegion.IsInside(index))
+        {
+          saved.push_back(std::make_pair(index, image->GetPixel(index)));
+          image->SetPixel(index, color);
+        }
+      }
+    }
+  }
+}
+
+namespace NNFieldQuery
+{
+
+itk::Index<2> GetMatchCenter(const NNFieldTypes::NNFieldImageType* const nnField, const itk::Index<2>& pixel,
+                             const NNFieldTypes::INTERPRETATION_ENUM interpretation)
+{
+  const NNFieldTypes::NNFieldImageType::PixelType nnFieldPixel = nnField->GetPixel(pixel);
+  return GetMatchCenter(&nnFieldPixel[0], pixel, interpretation);
+}
+
+itk::Index<2> GetMatchCenter(const float* const nnFieldPixel, const itk::Index<2>& pixel,
+                             const NNFieldTypes::INTERPRETATION_ENUM interpretation)
+{
+  itk::Index<2> matchCenter = {{static_cast<itk::IndexValueType>(nnFieldPixel[0]),
+                                static_cast<itk::IndexValueType>(nnFieldPixel[1])}};
+  if(interpretation == NNFieldTypes::OFFSET)
+  {
+    matchCenter[0] += pixel[0];
+    matchCenter[1] += pixel[1];
+  }
+  else if(interpretation != NNFieldTypes::ABSOLUTE)
+  {
+    throw std::runtime_error("Invalid Interpretation value set!");
+  }
+
+  return matchCenter;
+}
+
+itk::ImageRegion<2> GetPatchRegion(const itk::Index<2>& center, const unsigned int patchRadius)
+{
+  itk::Index<2> corner = {{center[0] - static_cast<itk::IndexValueType>(patchRadius),
+                           center[1] - static_cast<itk::IndexValueType>(patchRadius)}};
+  itk::Size<2> size = {{2 * patchRadius + 1, 2 * patchRadius + 1}};
+  return itk::ImageRegion<2>(corner, size);
+}
+
+std::vector<Result> Run(const NNFieldTypes::ImageType* const image, const NNFieldTypes::NNFieldImageType* const nnField,
+                        const std::vector<itk::Index<2> >& pixels, const unsigned int patchRadius,
+                        const NNFieldTypes::INTERPRETATION_ENUM interpretation)
+{
+  if(image->GetLargestPossibleRegion() != nnField->GetLargestPossibleRegion())
+  {
+    throw std::runtime_error("NNFieldQuery: the image and the NNField must have the same size!");
+  }
+
+  // Queries outside of the field are dropped here, so the workers only see valid pixels.
+  std::vector<itk::Index<2> > insidePixels;
+  insidePixels.reserve(pixels.size());
+  for(size_t queryId = 0; queryId < pixels.size(); ++queryId)
+  {
+    if(nnField->GetLargestPossibleRegion().IsInside(pixels[queryId]))
+    {
+      insidePixels.push_back(pixels[queryId]);
+    }
+    else
+    {
+      std::cerr << "Skipping query " << pixels[queryId] << ", it is outside of the field." << std::endl;
+    }
+  }
+
+  const itk::ImageRegion<2> imageRegion = image->GetLargestPossibleRegion();
+  const unsigned int numberOfChannels = nnField->GetNumberOfComponentsPerPixel();
+
+  std::vector<Result> results(insidePixels.size());
+  Parallel::For(0, insidePixels.size(), [&](const size_t queryId)
+    {
+    Result& result = results[queryId];
+    result.Pixel = insidePixels[queryId];
+    result.MatchCenter = GetMatchCenter(nnField, result.Pixel, interpretation);
+
+    const NNFieldTypes::NNFieldImageType::PixelType nnFieldPixel = nnField->GetPixel(result.Pixel);
+    for(unsigned int channel = 2; channel < numberOfChannels; ++channel)
+    {
+      result.Scores.push_back(nnFieldPixel[channel]);
+    }
+
+    result.Valid = imageRegion.IsInside(GetPatchRegion(result.Pixel, patchRadius)) &&
+                   imageRegion.IsInside(GetPatchRegion(result.MatchCenter, patchRadius));
+    if(result.Valid)
+    {
+      result.SSD = PatchDistance::Compute(image, result.Pixel, result.MatchCenter, patchRadius, PatchDistance::SSD);
+      result.SAD = PatchDistance::Compute(image, result.Pixel, result.MatchCenter, patchRadius, PatchDistance::SAD);
+    }
+    });
+
+  return results;
+}
+
+void WriteCSV(const std::vector<Result>& results, std::ostream& stream)
+{
+  size_t numberOfScores = 0;
+  for(size_t resultId = 0; resultId < results.size(); ++resultId)
+  {
+    numberOfScores = std::max(numberOfScores, results[resultId].Scores.size());
+  }
+
+  stream << "x,y,match_x,match_y,valid,ssd,sad";
+  for(size_t scoreId = 0; scoreId < numberOfScores; ++scoreId)
+  {
+    stream << ",channel" << scoreId + 2;
+  }
+  stream << std::endl;
+
+  for(size_t resultId = 0; resultId < results.size(); ++resultId)
+  {
+    const Result& result = results[resultId];
+    stream << result.Pixel[0] << "," << result.Pixel[1] << "," << result.MatchCenter[0] << "," << result.MatchCenter[1]
+           << "," << result.Valid << "," << result.SSD << "," << result.SAD;
+    for(size_t scoreId = 0; scoreId < result.Scores.size(); ++scoreId)
+    {
+      stream << "," << result.Scores[scoreId];
+    }
+    stream << std::endl;
+  }
+}
+
+void WriteOverlays(const NNFieldTypes::ImageType* const image, const std::vector<Result>& results,
+                   const unsigned int patchRadius, const std::string& directory)
+{
+  ImageType::PixelType red;
+  red[0] = 255; red[1] = 0; red[2] = 0;
+  ImageType::PixelType green;
+  green[0] = 0; green[1] = 255; green[2] = 0;
+
+  // Every canvas is a copy of the image drawn into by one thread, which restores the outline pixels after each
+  // query, so a query costs its outlines and the PNG encoding, not a copy of the image.
+  const size_t canvasBytes = std::max<size_t>(image->GetLargestPossibleRegion().GetNumberOfPixels() *
+                                              sizeof(ImageType::PixelType), 1);
+  size_t numberOfCanvases = std::min<size_t>(Parallel::GetNumberOfThreads(), results.size());
+  numberOfCanvases = std::max<size_t>(1, std::min(numberOfCanvases, MaximumCanvasBytes / canvasBytes));
+  Parallel::For(0, numberOfCanvases, [&](const size_t canvasId)
+    {
+    const size_t chunkBegin = results.size() * canvasId / numberOfCanvases;
+    const size_t chunkEnd = results.size() * (canvasId + 1) / numberOfCanvases;
+
+    ImageType::Pointer canvas = ImageType::New();
+    canvas->SetRegions(image->GetLargestPossibleRegion());
+    canvas->Allocate();
+    std::copy(image->GetBufferPointer(), image->GetBufferPointer() + image->GetLargestPossibleRegion().GetNumberOfPixels(),
+              canvas->GetBufferPointer());
+
+    typedef itk::ImageFileWriter<ImageType> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetInput(canvas);
+
+    std::vector<std::pair<itk::Index<2>, ImageType::PixelType> > saved;
+    for(size_t resultId = chunkBegin; resultId < chunkEnd; ++resultId)
+    {
+      const Result& result = results[resultId];
+      DrawOutline(canvas, GetPatchRegion(result.Pixel, patchRadius), red, saved);
+      DrawOutline(canvas, GetPatchRegion(result.MatchCenter, patchRadius), green, saved);
+      canvas->Modified();
+
+      std::stringstream fileName;
+      fileName << directory << "/query_" << result.Pixel[0] << "_" << result.Pixel[1] << ".png";
+      writer->SetFileName(fileName.str());
+      try
+      {
+        writer->Update();
+      }
+      catch(itk::ExceptionObject& exception)
+      {
+        std::cerr << "Could not write " << fileName.str() << ": " << exception.GetDescription() << std::endl;
+      }
+
+      // Restore in reverse order, so pixels drawn twice get their original value back.
+      for(size_t savedId = saved.size(); savedId > 0; --savedId)
+      {
+        canvas->SetPixel(saved[savedId - 1].first, saved[savedId - 1].second);
+      }
+      saved.clear();
+    }
+    });
+}
+
+} // end namespace
@@ -0,0 +1,78 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldQuery_H
+#define NNFieldQuery_H
+
+// STL
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Custom
+#include "NNFieldTypes.h"
+#include "PatchDistance.h"
+
+/** Answer "where does this pixel point, and how good is the match" for many pixels at once.
+  * This is what a click does in the GUI, without Qt or VTK, so it can run headless.
+  */
+namespace NNFieldQuery
+{
+  struct Result
+  {
+    Result() : Valid(false), SSD(0), SAD(0) {}
+
+    itk::Index<2> Pixel;
+    itk::Index<2> MatchCenter;
+
+    /** Whether both patches are entirely inside the image, so the distances could be computed.*/
+    bool Valid;
+    PatchDistance::SumType SSD;
+    PatchDistance::SumType SAD;
+
+    /** The channels of the field after X and Y at the pixel (e.g. the stored patch distance).*/
+    std::vector<float> Scores;
+  };
+
+  /** The center of the match of 'pixel'.*/
+  itk::Index<2> GetMatchCenter(const NNFieldTypes::NNFieldImageType* const nnField, const itk::Index<2>& pixel,
+                               const NNFieldTypes::INTERPRETATION_ENUM interpretation);
+
+  /** The center of the match of 'pixel', whose channels in the field are 'nnFieldPixel'.*/
+  itk::Index<2> GetMatchCenter(const float* const nnFieldPixel, const itk::Index<2>& pixel,
+                               const NNFieldTypes::INTERPRETATION_ENUM interpretation);
+
+  /** The region of the patch of radius 'patchRadius' centered at 'center'.*/
+  itk::ImageRegion<2> GetPatchRegion(const itk::Index<2>& center, const unsigned int patchRadius);
+
+  /** Answer all queries, distributed over all cores. Pixels outside of the field are skipped.*/
+  std::vector<Result> Run(const NNFieldTypes::ImageType* const image, const NNFieldTypes::NNFieldImageType* const nnField,
+                          const std::vector<itk::Index<2> >& pixels, const unsigned int patchRadius,
+                          const NNFieldTypes::INTERPRETATION_ENUM interpretation);
+
+  /** Write the results as CSV, with a header line.*/
+  void WriteCSV(const std::vector<Result>& results, std::ostream& stream);
+
+  /** Write one PNG per result into 'directory' (named query_<x>_<y>.png), showing the image with the
+    * patch of the query outlined in red and its match in green, like the GUI does. In parallel, with as many copies
+    * of the image as fit in 1 GB.*/
+  void WriteOverlays(const NNFieldTypes::ImageType* const image, const std::vector<Result>& results,
+                     const unsigned int patchRadius, const std::string& directory);
+}
+
+#endif
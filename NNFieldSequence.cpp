@@ -0,0 +1,309 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldSequence.h"
+
+// STL
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Custom
+#include "LoadWorkers.h"
+
+namespace
+{
+  bool FileExists(const std::string& fileName)
+  {
+    struct stat fileStatus;
+    return stat(fileName.c_str(), &fileStatus) == 0;
+  }
+
+  std::string FormatFrame(const std::string& prefix, const unsigned int digits, const std::string& suffix,
+                          const unsigned int frame)
+  {
+    std::stringstream ss;
+    ss << frame;
+    std::string number = ss.str();
+    if(number.size() < digits)
+    {
+      number.insert(0, digits - number.size(), '0');
+    }
+    return prefix + number + suffix;
+  }
+}
+
+NNFieldSequence::NNFieldSequence(const std::string& pattern, const unsigned int firstFrame,
+                                 const unsigned int lastFrame, const unsigned int capacity,
+                                 const FrameCallback& frameReady) :
+  Digits(0), FirstFrame(firstFrame), LastFrame(lastFrame), CurrentFrame(firstFrame), FrameReady(frameReady), Stop(false)
+{
+  // The pattern is not passed to printf, so only the one conversion it needs is accepted.
+  const size_t percent = pattern.find('%');
+  if(percent == std::string::npos || pattern.find('%', percent + 1) != std::string::npos)
+  {
+    throw std::runtime_error("NNFieldSequence: the pattern must contain exactly one %d!");
+  }
+
+  size_t position = percent + 1;
+  if(position < pattern.size() && pattern[position] == '0')
+  {
+    const size_t digitsEnd = pattern.find_first_not_of("0123456789", position);
+    this->Digits = static_cast<unsigned int>(atoi(pattern.substr(position, digitsEnd - position).c_str()));
+    position = digitsEnd;
+  }
+  if(position == std::string::npos || position >= pattern.size() || pattern[position] != 'd')
+  {
+    throw std::runtime_error("NNFieldSequence: the pattern must contain exactly one %d!");
+  }
+
+  if(lastFrame < firstFrame || capacity == 0)
+  {
+    throw std::runtime_error("NNFieldSequence: the sequence and the ring buffer must not be empty!");
+  }
+
+  this->Prefix = pattern.substr(0, percent);
+  this->Suffix = pattern.substr(position + 1);
+
+  Slot emptySlot;
+  emptySlot.FrameNumber = -1;
+  this->Slots.resize(std::min(capacity, lastFrame - firstFrame + 1), emptySlot);
+
+  this->Thread = std::thread(&NNFieldSequence::Prefetch, this);
+}
+
+NNFieldSequence::~NNFieldSequence()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Stop = true;
+  }
+  this->Wake.notify_all();
+  this->Thread.join();
+}
+
+bool NNFieldSequence::FindSequence(const std::string& fileName, std::string& pattern, unsigned int& frame,
+                                   unsigned int& firstFrame, unsigned int& lastFrame)
+{
+  // Only the file name is searched for the number, not the directories.
+  const size_t slash = fileName.find_last_of('/');
+  const size_t nameBegin = (slash == std::string::npos) ? 0 : slash + 1;
+
+  const size_t numberEnd = fileName.find_last_of("0123456789");
+  if(numberEnd == std::string::npos || numberEnd < nameBegin)
+  {
+    return false;
+  }
+  const size_t numberBegin = fileName.find_last_not_of("0123456789", numberEnd) + 1;
+
+  const std::string prefix = fileName.substr(0, numberBegin);
+  const std::string suffix = fileName.substr(numberEnd + 1);
+  const std::string number = fileName.substr(numberBegin, numberEnd + 1 - numberBegin);
+  frame = static_cast<unsigned int>(strtoul(number.c_str(), NULL, 10));
+
+  // A number with leading zeros is zero padded, one without could be either.
+  const unsigned int digits = (number.size() > 1 && number[0] == '0') ? static_cast<unsigned int>(number.size()) : 0;
+
+  firstFrame = frame;
+  while(firstFrame > 0 && FileExists(FormatFrame(prefix, digits, suffix, firstFrame - 1)))
+  {
+    --firstFrame;
+  }
+  lastFrame = frame;
+  while(FileExists(FormatFrame(prefix, digits, suffix, lastFrame + 1)))
+  {
+    ++lastFrame;
+  }
+
+  std::stringstream ssPattern;
+  ssPattern << prefix << "%";
+  if(digits > 0)
+  {
+    ssPattern << "0" << digits;
+  }
+  ssPattern << "d" << suffix;
+  pattern = ssPattern.str();
+
+  return true;
+}
+
+std::string NNFieldSequence::GetFileName(const unsigned int frame) const
+{
+  return FormatFrame(this->Prefix, this->Digits, this->Suffix, frame);
+}
+
+void NNFieldSequence::SetCurrentFrame(const unsigned int frame)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->CurrentFrame = std::min(std::max(frame, this->FirstFrame), this->LastFrame);
+  }
+  this->Wake.notify_all();
+}
+
+std::shared_ptr<NNFieldSequence::Frame> NNFieldSequence::GetFrame(const unsigned int frame)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  const Slot& slot = this->Slots[frame % this->Slots.size()];
+  if(slot.FrameNumber != static_cast<long long>(frame))
+  {
+    return std::shared_ptr<Frame>();
+  }
+  return slot.Data;
+}
+
+unsigned int NNFieldSequence::GetFirstFrame() const
+{
+  return this->FirstFrame;
+}
+
+unsigned int NNFieldSequence::GetLastFrame() const
+{
+  return this->LastFrame;
+}
+
+bool NNFieldSequence::IsInWindow(const unsigned int frame) const
+{
+  const unsigned int capacity = static_cast<unsigned int>(this->Slots.size());
+
+  // A quarter of the window is behind the current frame, but the window does not extend past the sequence.
+  unsigned int windowBegin = std::max(this->CurrentFrame, this->FirstFrame + capacity / 4) - capacity / 4;
+  windowBegin = std::min(windowBegin, this->LastFrame + 1 - capacity);
+
+  return frame >= windowBegin && frame < windowBegin + capacity;
+}
+
+bool NNFieldSequence::FindFrameToRead(unsigned int& frame) const
+{
+  const unsigned int capacity = static_cast<unsigned int>(this->Slots.size());
+
+  // The frames from the current one on are wanted first (playback), then the ones before it (stepping back).
+  for(unsigned int candidate = this->CurrentFrame; candidate <= this->LastFrame && IsInWindow(candidate); ++candidate)
+  {
+    if(this->Slots[candidate % capacity].FrameNumber != static_cast<long long>(candidate))
+    {
+      frame = candidate;
+      return true;
+    }
+  }
+
+  for(unsigned int candidate = this->CurrentFrame; candidate > this->FirstFrame && IsInWindow(candidate - 1); --candidate)
+  {
+    if(this->Slots[(candidate - 1) % capacity].FrameNumber != static_cast<long long>(candidate - 1))
+    {
+      frame = candidate - 1;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void NNFieldSequence::Prefetch()
+{
+  while(true)
+  {
+    unsigned int frame = 0;
+    {
+      std::unique_lock<std::mutex> lock(this->Mutex);
+      while(!this->Stop && !FindFrameToRead(frame))
+      {
+        this->Wake.wait(lock);
+      }
+      if(this->Stop)
+      {
+        return;
+      }
+    }
+
+    // The mutex is not held while reading, so the GUI can take the frames that are ready meanwhile.
+    std::shared_ptr<Frame> data = ReadFrame(frame);
+    if(this->Stop)
+    {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      // The window may have moved on while the frame was read.
+      if(!IsInWindow(frame))
+      {
+        continue;
+      }
+      Slot& slot = this->Slots[frame % this->Slots.size()];
+      slot.FrameNumber = frame;
+      slot.Data = data;
+    }
+
+    if(this->FrameReady)
+    {
+      this->FrameReady(frame);
+    }
+  }
+}
+
+std::shared_ptr<NNFieldSequence::Frame> NNFieldSequence::ReadFrame(const unsigned int frame) const
+{
+  std::shared_ptr<Frame> data(new Frame);
+
+  LoadWorkers::NNFieldResult result = LoadWorkers::ReadNNField(GetFileName(frame), this->Stop, [](int) {});
+  if(!result.Error.empty() || result.Cancelled)
+  {
+    data->Error = result.Error;
+    return data;
+  }
+
+  // Stored fields are decoded here rather than when they are displayed.
+  if(result.Store)
+  {
+    try
+    {
+      data->NNField = LoadWorkers::ReadNNFieldStore(result.Store.get(), this->Stop);
+    }
+    catch(std::runtime_error& exception)
+    {
+      data->Error = exception.what();
+    }
+    return data;
+  }
+
+  data->NNField = result.NNField;
+  data->Mapping = result.Mapping;
+
+  // A mapped field is paged in here, so displaying it does not wait for the disk either.
+  if(data->Mapping)
+  {
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t numberOfBytes = data->NNField->GetLargestPossibleRegion().GetNumberOfPixels() *
+                                 data->NNField->GetNumberOfComponentsPerPixel() * sizeof(float);
+    const volatile unsigned char* const bytes = reinterpret_cast<const unsigned char*>(data->NNField->GetBufferPointer());
+    unsigned char sum = 0;
+    for(size_t offset = 0; offset < numberOfBytes; offset += pageSize)
+    {
+      sum += bytes[offset];
+    }
+    (void)sum;
+  }
+
+  return data;
+}
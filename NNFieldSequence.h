@@ -0,0 +1,137 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldSequence_H
+#define NNFieldSequence_H
+
+// STL
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Custom
+#include "MappedMetaImage.h"
+#include "NNFieldTypes.h"
+
+/** A numbered sequence of nearest neighbor fields (e.g. one per video frame), such as field_0001.mha,
+  * field_0002.mha, ... The fields around the current frame are read on a background thread into a ring buffer
+  * of a fixed number of frames, so stepping or scrubbing through the sequence does not wait for the disk.
+  *
+  * The ring buffer covers a window of frames that starts a quarter of its capacity before the current frame,
+  * so stepping back is prefetched too. Frame 'f' is kept in slot f % capacity, so the frames of the window
+  * never share a slot. Moving the current frame only changes which frames the background thread reads next,
+  * frames that are already read stay until their slot is needed by the window.
+  *
+  * This class does not depend on Qt. The frame callback is called on the background thread.
+  */
+class NNFieldSequence
+{
+public:
+  /** A frame of the sequence, read completely into memory (or mapped and paged in).*/
+  struct Frame
+  {
+    NNFieldTypes::NNFieldImageType::Pointer NNField;
+
+    /** Keeps the mapping alive if NNField views a memory mapped file.*/
+    std::shared_ptr<MappedMetaImage> Mapping;
+
+    /** Non-empty if reading the frame failed.*/
+    std::string Error;
+  };
+
+  /** Called with the number of a frame when it has been read.*/
+  typedef std::function<void(unsigned int)> FrameCallback;
+
+  /** Open the sequence of 'pattern', which contains one %d (or zero padded %0Nd) for the frame number, from
+    * 'firstFrame' to 'lastFrame'. 'capacity' frames are kept in memory. Throws if the pattern is not valid.*/
+  NNFieldSequence(const std::string& pattern, const unsigned int firstFrame, const unsigned int lastFrame,
+                  const unsigned int capacity, const FrameCallback& frameReady);
+
+  /** Stops the background thread.*/
+  ~NNFieldSequence();
+
+  /** Find the sequence 'fileName' is frame 'frame' of: its last run of digits is the frame number, and the
+    * sequence extends over the existing files with consecutive numbers. Returns false if 'fileName' has no number.*/
+  static bool FindSequence(const std::string& fileName, std::string& pattern, unsigned int& frame,
+                           unsigned int& firstFrame, unsigned int& lastFrame);
+
+  /** The file name of 'frame'.*/
+  std::string GetFileName(const unsigned int frame) const;
+
+  /** Make 'frame' the current frame, so it and the frames around it are read next.*/
+  void SetCurrentFrame(const unsigned int frame);
+
+  /** The frame 'frame', or NULL if it has not been read yet.*/
+  std::shared_ptr<Frame> GetFrame(const unsigned int frame);
+
+  unsigned int GetFirstFrame() const;
+  unsigned int GetLastFrame() const;
+
+private:
+  /** The thread is owned, so copying is not allowed.*/
+  NNFieldSequence(const NNFieldSequence&);
+  void operator=(const NNFieldSequence&);
+
+  /** The loop of the background thread: read the most wanted frame of the window that is not read yet.*/
+  void Prefetch();
+
+  /** The frame of the window that should be read next, by priority: the current frame, the frames after it,
+    * then the frames before it. Returns false if all of them are read. Must be called with Mutex locked.*/
+  bool FindFrameToRead(unsigned int& frame) const;
+
+  /** Whether 'frame' is in the window of the current frame. Must be called with Mutex locked.*/
+  bool IsInWindow(const unsigned int frame) const;
+
+  /** Read 'frame' from its file.*/
+  std::shared_ptr<Frame> ReadFrame(const unsigned int frame) const;
+
+  /** The parts of the pattern before and after the frame number, and the number of digits it is padded to.*/
+  std::string Prefix;
+  std::string Suffix;
+  unsigned int Digits;
+
+  unsigned int FirstFrame;
+  unsigned int LastFrame;
+
+  /** A slot of the ring buffer.*/
+  struct Slot
+  {
+    /** The frame in this slot, or -1.*/
+    long long FrameNumber;
+    std::shared_ptr<Frame> Data;
+  };
+  std::vector<Slot> Slots;
+
+  unsigned int CurrentFrame;
+
+  FrameCallback FrameReady;
+
+  /** Guards Slots and CurrentFrame. Wake is notified when the current frame changes or the thread should stop.*/
+  std::mutex Mutex;
+  std::condition_variable Wake;
+  std::atomic<bool> Stop;
+
+  std::thread Thread;
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldStore_H
+#define NNFieldStore_H
+
+// ITK
+#include "itkImageRegion.h"
+
+/** A nearest neighbor field that is not kept as an NNFieldImageType (e.g. because it is read from a tiled file
+  * or kept encoded), so its pixels are only accessible through these functions. The channels of a pixel are
+  * interleaved like in NNFieldImageType.
+  */
+class NNFieldStore
+{
+public:
+  virtual ~NNFieldStore() {}
+
+  virtual itk::ImageRegion<2> GetRegion() const = 0;
+  virtual unsigned int GetNumberOfComponents() const = 0;
+
+  /** The range of 'channel' over the whole field.*/
+  virtual float GetChannelMin(const unsigned int channel) const = 0;
+  virtual float GetChannelMax(const unsigned int channel) const = 0;
+
+  /** Write the channels of the pixel at 'index' to 'pixel'. Thread safe. Throws if it cannot be read.*/
+  virtual void GetPixel(const itk::Index<2>& index, float* const pixel) = 0;
+
+  /** Write the pixels of 'region' (which must be inside the field) row by row to 'out', with 'outRowStride'
+    * floats from one row to the next. Thread safe. Throws if they cannot be read.*/
+  virtual void ReadRegion(const itk::ImageRegion<2>& region, float* const out, const size_t outRowStride) = 0;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldTypes_H
+#define NNFieldTypes_H
+
+// ITK
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkCovariantVector.h"
+
+/** The types shared by the GUI and the code that runs without it.*/
+namespace NNFieldTypes
+{
+  /** The image over which a nearest neighbor field is defined.*/
+  typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+  /** A nearest neighbor field. Channels 0 and 1 are the x and y of the match,
+    * further channels (if any) are written by the solver (e.g. the patch distance).*/
+  typedef itk::VectorImage<float, 2> NNFieldImageType;
+
+  /** A scalar image computed from a field, e.g. the match error.*/
+  typedef itk::Image<float, 2> FloatImageType;
+
+  /** Whether channels 0 and 1 of a field are the position of the match relative to the pixel (OFFSET)
+    * or in the image (ABSOLUTE).*/
+  enum INTERPRETATION_ENUM {OFFSET, ABSOLUTE};
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef Parallel_H
+#define Parallel_H
+
+// STL
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/** Minimal helpers to split a loop over all cores. These do not depend on Qt, so they can be
+  * used by the code that also runs without a GUI.
+  */
+namespace Parallel
+{
+  /** The number of threads to use (the number of cores, at least 1).*/
+  inline unsigned int GetNumberOfThreads()
+  {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  /** Split [begin, end) into at most GetNumberOfThreads() contiguous chunks and call
+    * function(chunkBegin, chunkEnd, threadId) for each chunk on its own thread.
+    * The calling thread processes the first chunk. Returns when all chunks are done.
+    * 'function' must not throw.
+    */
+  template <typename TFunction>
+  void ForChunks(const size_t begin, const size_t end, const TFunction& function)
+  {
+    if(end <= begin)
+    {
+      return;
+    }
+
+    const size_t numberOfThreads = std::min<size_t>(GetNumberOfThreads(), end - begin);
+    const size_t chunkSize = (end - begin + numberOfThreads - 1) / numberOfThreads;
+
+    std::vector<std::thread> threads;
+    for(size_t threadId = 1; threadId < numberOfThreads; ++threadId)
+    {
+      const size_t chunkBegin = begin + threadId * chunkSize;
+      const size_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+      if(chunkBegin < chunkEnd)
+      {
+        threads.push_back(std::thread(function, chunkBegin, chunkEnd, static_cast<unsigned int>(threadId)));
+      }
+    }
+
+    function(begin, std::min(end, begin + chunkSize), 0u);
+
+    for(size_t threadId = 0; threadId < threads.size(); ++threadId)
+    {
+      threads[threadId].join();
+    }
+  }
+
+  /** Call function(i) for every i in [begin, end), distributed over all cores.*/
+  template <typename TFunction>
+  void For(const size_t begin, const size_t end, const TFunction& function)
+  {
+    ForChunks(begin, end, [&function](const size_t chunkBegin, const size_t chunkEnd, const unsigned int)
+      {
+      for(size_t i = chunkBegin; i < chunkEnd; ++i)
+      {
+        function(i);
+      }
+      });
+  }
+}
+
+#endif
@@ -0,0 +1,375 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ParallelPatchMatch.h"
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+// Custom
+#include "Parallel.h"
+#include "PatchDistance.h"
+
+namespace
+{
+  /** Give each band of each pass its own, reproducible, random sequence.*/
+  unsigned int MakeSeed(const unsigned int randomSeed, const unsigned int pass, const unsigned int firstRow)
+  {
+    return randomSeed * 2654435761u + pass * 40503u + firstRow * 97u + 1u;
+  }
+
+  /** The height of the bands. It does not depend on the number of cores, so neither do the band borders and the
+    * random sequences of the bands, and a seed gives the same field on every machine.*/
+  const unsigned int RowsPerBand = 32;
+
+  /** The bound to pass to the distance functors for a match of distance 'distance'.*/
+  PatchDistance::SumType ToBound(const float distance)
+  {
+    if(distance >= static_cast<float>(std::numeric_limits<PatchDistance::SumType>::max()))
+    {
+      return std::numeric_limits<PatchDistance::SumType>::max();
+    }
+    return static_cast<PatchDistance::SumType>(distance);
+  }
+}
+
+/** Runs ProcessBand with the distance functor it is dispatched to.*/
+struct ParallelPatchMatch::ProcessBandVisitor
+{
+  ParallelPatchMatch* PatchMatch;
+  unsigned int FirstRow;
+  unsigned int LastRow;
+  unsigned int Iteration;
+  size_t NumberOfImprovedPixels;
+
+  template <typename TDistance>
+  void operator()(const TDistance& distance)
+  {
+    this->NumberOfImprovedPixels = this->PatchMatch->ProcessBand(this->FirstRow, this->LastRow, this->Iteration, distance);
+  }
+};
+
+ParallelPatchMatch::ParallelPatchMatch() : Image(NULL), PatchRadius(7), NumberOfIterations(5),
+  RandomSeed(0), Cancel(NULL), Width(0), Height(0)
+{
+
+}
+
+void ParallelPatchMatch::SetImage(const ImageType* const image)
+{
+  this->Image = image;
+}
+
+void ParallelPatchMatch::SetPatchRadius(const unsigned int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+}
+
+void ParallelPatchMatch::SetNumberOfIterations(const unsigned int numberOfIterations)
+{
+  this->NumberOfIterations = numberOfIterations;
+}
+
+void ParallelPatchMatch::SetRandomSeed(const unsigned int randomSeed)
+{
+  this->RandomSeed = randomSeed;
+}
+
+void ParallelPatchMatch::SetIterationCallback(const IterationCallback& callback)
+{
+  this->Callback = callback;
+}
+
+void ParallelPatchMatch::SetCancel(const std::atomic<bool>* const cancel)
+{
+  this->Cancel = cancel;
+}
+
+bool ParallelPatchMatch::IsValidCenter(const int x, const int y) const
+{
+  const int radius = static_cast<int>(this->PatchRadius);
+  return x >= radius && y >= radius && x < this->Width - radius && y < this->Height - radius;
+}
+
+bool ParallelPatchMatch::IsAllowedMatch(const int queryX, const int queryY, const int x, const int y) const
+{
+  const int radius = static_cast<int>(this->PatchRadius);
+  return IsValidCenter(x, y) && (std::abs(x - queryX) > radius || std::abs(y - queryY) > radius);
+}
+
+const unsigned char* ParallelPatchMatch::GetPatchPointer(const int x, const int y) const
+{
+  const int radius = static_cast<int>(this->PatchRadius);
+  const size_t pixelId = static_cast<size_t>(y - radius) * this->Width + (x - radius);
+  return reinterpret_cast<const unsigned char*>(this->Image->GetBufferPointer() + pixelId);
+}
+
+float ParallelPatchMatch::Distance(const int x0, const int y0, const int x1, const int y1, const float bound) const
+{
+  const PatchDistance::Functor<PatchDistance::SSD> distance(this->PatchRadius);
+  return static_cast<float>(distance(GetPatchPointer(x0, y0), GetPatchPointer(x1, y1), 3 * static_cast<size_t>(this->Width),
+                                     ToBound(bound)));
+}
+
+template <typename TDistance>
+bool ParallelPatchMatch::TryCandidate(const size_t pixelId, const int queryX, const int queryY, const int x, const int y,
+                                      const TDistance& distanceFunctor)
+{
+  if(!IsAllowedMatch(queryX, queryY, x, y) || (x == this->MatchX[pixelId] && y == this->MatchY[pixelId]))
+  {
+    return false;
+  }
+
+  const float distance = static_cast<float>(distanceFunctor(GetPatchPointer(queryX, queryY), GetPatchPointer(x, y),
+                                                            3 * static_cast<size_t>(this->Width),
+                                                            ToBound(this->MatchDistance[pixelId])));
+  if(distance < this->MatchDistance[pixelId])
+  {
+    this->MatchX[pixelId] = x;
+    this->MatchY[pixelId] = y;
+    this->MatchDistance[pixelId] = distance;
+    return true;
+  }
+
+  return false;
+}
+
+void ParallelPatchMatch::RandomInitialization()
+{
+  const int radius = static_cast<int>(this->PatchRadius);
+  const int validWidth = this->Width - 2 * radius;
+  const int validHeight = this->Height - 2 * radius;
+
+  Parallel::For(0, this->Height, [this, radius, validWidth, validHeight](const size_t row)
+    {
+    const int y = static_cast<int>(row);
+    std::minstd_rand random(MakeSeed(this->RandomSeed, 0, y));
+
+    for(int x = 0; x < this->Width; ++x)
+    {
+      const size_t pixelId = static_cast<size_t>(y) * this->Width + x;
+
+      // Pixels without a complete patch point at themselves.
+      this->MatchX[pixelId] = x;
+      this->MatchY[pixelId] = y;
+      this->MatchDistance[pixelId] = 0.0f;
+
+      if(!IsValidCenter(x, y))
+      {
+        continue;
+      }
+
+      // If no allowed match is found below, propagation and random search will find one.
+      this->MatchDistance[pixelId] = std::numeric_limits<float>::max();
+
+      // Only a small part of the image is excluded, so this practically always succeeds quickly.
+      const unsigned int maximumNumberOfTries = 100;
+      for(unsigned int tryId = 0; tryId < maximumNumberOfTries; ++tryId)
+      {
+        const int candidateX = radius + static_cast<int>(random() % validWidth);
+        const int candidateY = radius + static_cast<int>(random() % validHeight);
+        if(IsAllowedMatch(x, y, candidateX, candidateY))
+        {
+          this->MatchX[pixelId] = candidateX;
+          this->MatchY[pixelId] = candidateY;
+          this->MatchDistance[pixelId] = Distance(x, y, candidateX, candidateY, std::numeric_limits<float>::max());
+          break;
+        }
+      }
+    }
+    });
+}
+
+size_t ParallelPatchMatch::ProcessBand(const unsigned int firstRow, const unsigned int lastRow, const unsigned int iteration)
+{
+  // The distance is computed millions of times per iteration, so the band is processed with
+  // the functor specialized for the patch radius, if there is one.
+  ProcessBandVisitor visitor = {this, firstRow, lastRow, iteration, 0};
+  PatchDistance::Dispatch<PatchDistance::SSD>(this->PatchRadius, visitor);
+  return visitor.NumberOfImprovedPixels;
+}
+
+template <typename TDistance>
+size_t ParallelPatchMatch::ProcessBand(const unsigned int firstRow, const unsigned int lastRow, const unsigned int iteration,
+                                       const TDistance& distance)
+{
+  // Alternate the scan order so that good matches travel in all directions.
+  const bool forward = (iteration % 2 == 0);
+  const int step = forward ? 1 : -1;
+
+  const int yBegin = forward ? static_cast<int>(firstRow) : static_cast<int>(lastRow) - 1;
+  const int yEnd = forward ? static_cast<int>(lastRow) : static_cast<int>(firstRow) - 1;
+  const int xBegin = forward ? 0 : this->Width - 1;
+  const int xEnd = forward ? this->Width : -1;
+
+  const int searchRadius = std::max(this->Width, this->Height);
+
+  std::minstd_rand random(MakeSeed(this->RandomSeed, iteration + 1, firstRow));
+
+  size_t numberOfImprovedPixels = 0;
+
+  for(int y = yBegin; y != yEnd; y += step)
+  {
+    for(int x = xBegin; x != xEnd; x += step)
+    {
+      if(!IsValidCenter(x, y))
+      {
+        continue;
+      }
+
+      const size_t pixelId = static_cast<size_t>(y) * this->Width + x;
+      bool improved = false;
+
+      // Propagation: the neighbor that was just visited in x, and the one in the previous row.
+      const int neighborX = x - step;
+      if(neighborX >= 0 && neighborX < this->Width)
+      {
+        const size_t neighborId = pixelId - step;
+        improved |= TryCandidate(pixelId, x, y, this->MatchX[neighborId] + step, this->MatchY[neighborId], distance);
+      }
+
+      const int neighborY = y - step;
+      if(neighborY >= 0 && neighborY < this->Height)
+      {
+        const size_t neighborId = pixelId - step * this->Width;
+        improved |= TryCandidate(pixelId, x, y, this->MatchX[neighborId], this->MatchY[neighborId] + step, distance);
+      }
+
+      // Random search in windows of exponentially decreasing size around the best match.
+      for(int windowRadius = searchRadius; windowRadius >= 1; windowRadius /= 2)
+      {
+        const int candidateX = this->MatchX[pixelId] + static_cast<int>(random() % (2 * windowRadius + 1)) - windowRadius;
+        const int candidateY = this->MatchY[pixelId] + static_cast<int>(random() % (2 * windowRadius + 1)) - windowRadius;
+        improved |= TryCandidate(pixelId, x, y, candidateX, candidateY, distance);
+      }
+
+      if(improved)
+      {
+        numberOfImprovedPixels++;
+      }
+    }
+  }
+
+  return numberOfImprovedPixels;
+}
+
+void ParallelPatchMatch::CopyFieldTo(float* const out) const
+{
+  const size_t numberOfPixels = this->MatchX.size();
+  for(size_t pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+  {
+    out[3 * pixelId] = static_cast<float>(this->MatchX[pixelId]);
+    out[3 * pixelId + 1] = static_cast<float>(this->MatchY[pixelId]);
+    out[3 * pixelId + 2] = this->MatchDistance[pixelId];
+  }
+}
+
+size_t ParallelPatchMatch::GetNumberOfPixels() const
+{
+  return this->MatchX.size();
+}
+
+ParallelPatchMatch::NNFieldImageType::Pointer ParallelPatchMatch::CreateField() const
+{
+  NNFieldImageType::Pointer nnField = NNFieldImageType::New();
+  nnField->SetNumberOfComponentsPerPixel(3);
+  nnField->SetRegions(this->Image->GetLargestPossibleRegion());
+  nnField->Allocate();
+
+  CopyFieldTo(nnField->GetBufferPointer());
+
+  return nnField;
+}
+
+ParallelPatchMatch::NNFieldImageType::Pointer ParallelPatchMatch::Compute()
+{
+  if(!this->Image)
+  {
+    throw std::runtime_error("ParallelPatchMatch: the image must be set before calling Compute()!");
+  }
+
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  this->Width = static_cast<int>(size[0]);
+  this->Height = static_cast<int>(size[1]);
+
+  // There must be room for a patch, and for a second patch whose center is not inside the first one.
+  const int radius = static_cast<int>(this->PatchRadius);
+  const int validWidth = this->Width - 2 * radius;
+  const int validHeight = this->Height - 2 * radius;
+  if(validWidth < 1 || validHeight < 1 || (validWidth <= radius + 1 && validHeight <= radius + 1))
+  {
+    throw std::runtime_error("ParallelPatchMatch: the image is too small for this patch radius!");
+  }
+
+  const size_t numberOfPixels = static_cast<size_t>(this->Width) * this->Height;
+  this->MatchX.assign(numberOfPixels, 0);
+  this->MatchY.assign(numberOfPixels, 0);
+  this->MatchDistance.assign(numberOfPixels, 0.0f);
+
+  RandomInitialization();
+
+  const unsigned int numberOfBands = (this->Height + RowsPerBand - 1) / RowsPerBand;
+
+  for(unsigned int iteration = 0; iteration < this->NumberOfIterations; ++iteration)
+  {
+    if(this->Cancel && *this->Cancel)
+    {
+      break;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Phase 0 processes the even bands, phase 1 the odd ones. Bands running at the same time are
+    // never adjacent, so the rows they read across their borders are not being written.
+    std::vector<size_t> numberOfImprovedPixelsPerBand(numberOfBands, 0);
+    for(unsigned int phase = 0; phase < 2; ++phase)
+    {
+      const unsigned int numberOfBandsInPhase = (numberOfBands + 1 - phase) / 2;
+      Parallel::For(0, numberOfBandsInPhase,
+                    [this, phase, iteration, &numberOfImprovedPixelsPerBand](const size_t bandIdInPhase)
+        {
+        const unsigned int bandId = static_cast<unsigned int>(2 * bandIdInPhase + phase);
+        const unsigned int firstRow = bandId * RowsPerBand;
+        const unsigned int lastRow = std::min<unsigned int>(firstRow + RowsPerBand, this->Height);
+        if(firstRow < lastRow)
+        {
+          numberOfImprovedPixelsPerBand[bandId] = ProcessBand(firstRow, lastRow, iteration);
+        }
+        });
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(this->Callback)
+    {
+      size_t numberOfImprovedPixels = 0;
+      for(unsigned int bandId = 0; bandId < numberOfBands; ++bandId)
+      {
+        numberOfImprovedPixels += numberOfImprovedPixelsPerBand[bandId];
+      }
+      this->Callback(iteration, seconds, numberOfImprovedPixels);
+    }
+  }
+
+  return CreateField();
+}
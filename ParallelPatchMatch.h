@@ -0,0 +1,127 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ParallelPatchMatch_H
+#define ParallelPatchMatch_H
+
+// STL
+#include <atomic>
+#include <functional>
+#include <vector>
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** Compute a nearest neighbor field of an image with itself using PatchMatch, on all cores.
+  *
+  * The rows of the image are split into bands of a fixed height. Each iteration scans every band in one direction
+  * (alternating between iterations), propagating good matches from the already visited neighbors
+  * and then doing a random search. The even bands are processed in parallel first, then the odd
+  * bands, so no two bands that run at the same time are adjacent. This keeps propagation across
+  * band borders free of races. As the bands do not depend on the number of cores, a random seed gives the same
+  * field on every machine.
+  *
+  * The output has three channels: the absolute x and y of the center of the best match, and the
+  * sum of squared differences between the two patches. Pixels closer than the patch radius to the
+  * border have no complete patch; they point at themselves with a distance of 0.
+  */
+class ParallelPatchMatch
+{
+public:
+  typedef NNFieldTypes::ImageType ImageType;
+  typedef NNFieldTypes::NNFieldImageType NNFieldImageType;
+
+  /** Called on the computing thread after each iteration with the iteration number (starting at 0),
+    * its wall time in seconds, and the number of pixels whose match improved during it.
+    * CopyFieldTo() may be called from the callback to take a snapshot of the field.*/
+  typedef std::function<void(unsigned int, double, size_t)> IterationCallback;
+
+  ParallelPatchMatch();
+
+  void SetImage(const ImageType* const image);
+  void SetPatchRadius(const unsigned int patchRadius);
+  void SetNumberOfIterations(const unsigned int numberOfIterations);
+  void SetRandomSeed(const unsigned int randomSeed);
+  void SetIterationCallback(const IterationCallback& callback);
+
+  /** If set, Compute() stops after the current pass when this becomes true.*/
+  void SetCancel(const std::atomic<bool>* const cancel);
+
+  /** Run PatchMatch. Returns the field after the last completed iteration (also when cancelled).*/
+  NNFieldImageType::Pointer Compute();
+
+  /** Write the current field (3 interleaved channels per pixel, row major) to 'out'.*/
+  void CopyFieldTo(float* const out) const;
+
+  /** The number of pixels of the image being processed.*/
+  size_t GetNumberOfPixels() const;
+
+private:
+  /** Give every pixel a random valid match.*/
+  void RandomInitialization();
+
+  /** Propagate and search for the rows [firstRow, lastRow). Returns the number of pixels whose match improved.*/
+  size_t ProcessBand(const unsigned int firstRow, const unsigned int lastRow, const unsigned int iteration);
+
+  /** ProcessBand with a PatchDistance functor for the patch radius.*/
+  template <typename TDistance>
+  size_t ProcessBand(const unsigned int firstRow, const unsigned int lastRow, const unsigned int iteration,
+                     const TDistance& distance);
+  struct ProcessBandVisitor;
+
+  /** Try the match centered at (x, y) for the pixel at 'pixelId', keeping it if it is better.
+    * Returns whether it was kept.*/
+  template <typename TDistance>
+  bool TryCandidate(const size_t pixelId, const int queryX, const int queryY, const int x, const int y,
+                    const TDistance& distance);
+
+  /** The sum of squared differences of the patches centered at the two pixels. Stops early (and returns
+    * a value >= 'bound') once the partial sum is at least 'bound'.*/
+  float Distance(const int x0, const int y0, const int x1, const int y1, const float bound) const;
+
+  /** The first byte of the top left pixel of the patch centered at (x, y).*/
+  const unsigned char* GetPatchPointer(const int x, const int y) const;
+
+  /** Whether a patch centered at (x, y) is completely inside the image.*/
+  bool IsValidCenter(const int x, const int y) const;
+
+  /** Whether the patch at (x, y) may be used as the match of the patch at (queryX, queryY).
+    * A patch whose center lies inside the query patch is a trivial match, so it is excluded.*/
+  bool IsAllowedMatch(const int queryX, const int queryY, const int x, const int y) const;
+
+  /** Write the current state into a new field.*/
+  NNFieldImageType::Pointer CreateField() const;
+
+  const ImageType* Image;
+  unsigned int PatchRadius;
+  unsigned int NumberOfIterations;
+  unsigned int RandomSeed;
+  IterationCallback Callback;
+  const std::atomic<bool>* Cancel;
+
+  /** The size of the image.*/
+  int Width;
+  int Height;
+
+  /** The current best match of every pixel, row major.*/
+  std::vector<int> MatchX;
+  std::vector<int> MatchY;
+  std::vector<float> MatchDistance;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PatchDistance.h"
+
+// STL
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+  typedef NNFieldTypes::ImageType ImageType;
+
+  /** A pointer to the first byte of the top left pixel of the patch centered at 'center'.*/
+  const unsigned char* GetPatchPointer(const ImageType* const image, const itk::Index<2>& center, const unsigned int radius)
+  {
+    itk::Index<2> corner = {{center[0] - static_cast<int>(radius), center[1] - static_cast<int>(radius)}};
+    return reinterpret_cast<const unsigned char*>(image->GetBufferPointer() + image->ComputeOffset(corner));
+  }
+
+  void CheckPatches(const ImageType* const image, const itk::Index<2>& center0, const itk::Index<2>& center1,
+                    const unsigned int radius)
+  {
+    const itk::ImageRegion<2> region = image->GetLargestPossibleRegion();
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      const itk::IndexValueType first = region.GetIndex()[dimension] + static_cast<itk::IndexValueType>(radius);
+      const itk::IndexValueType last = region.GetIndex()[dimension] + static_cast<itk::IndexValueType>(region.GetSize()[dimension]) -
+                                       1 - static_cast<itk::IndexValueType>(radius);
+      if(center0[dimension] < first || center0[dimension] > last || center1[dimension] < first || center1[dimension] > last)
+      {
+        throw std::runtime_error("PatchDistance: the patches must be entirely inside the image!");
+      }
+    }
+  }
+
+  /** Applies the functor it is dispatched to on one pair of patches.*/
+  struct PatchPairVisitor
+  {
+    const unsigned char* Patch0;
+    const unsigned char* Patch1;
+    size_t RowStride;
+    PatchDistance::SumType Result;
+
+    template <typename TFunctor>
+    void operator()(const TFunctor& functor)
+    {
+      this->Result = functor(this->Patch0, this->Patch1, this->RowStride, std::numeric_limits<PatchDistance::SumType>::max());
+    }
+  };
+}
+
+namespace PatchDistance
+{
+
+SumType Compute(const NNFieldTypes::ImageType* const image, const itk::Index<2>& center0,
+                const itk::Index<2>& center1, const unsigned int radius, const MetricEnum metric)
+{
+  CheckPatches(image, center0, center1, radius);
+
+  PatchPairVisitor visitor;
+  visitor.Patch0 = GetPatchPointer(image, center0, radius);
+  visitor.Patch1 = GetPatchPointer(image, center1, radius);
+  visitor.RowStride = 3 * image->GetLargestPossibleRegion().GetSize()[0];
+
+  if(metric == SSD)
+  {
+    Dispatch<SSD>(radius, visitor);
+  }
+  else if(metric == SAD)
+  {
+    Dispatch<SAD>(radius, visitor);
+  }
+  else
+  {
+    throw std::runtime_error("PatchDistance: invalid metric!");
+  }
+
+  return visitor.Result;
+}
+
+SumType Compute(const NNFieldTypes::ImageType* const image0, const itk::Index<2>& center0,
+                const NNFieldTypes::ImageType* const image1, const itk::Index<2>& center1,
+                const unsigned int radius, const MetricEnum metric)
+{
+  CheckPatches(image0, center0, center0, radius);
+  CheckPatches(image1, center1, center1, radius);
+
+  // The rows of the patches are at different strides, so this is summed row by row. It is only used for single picks.
+  const unsigned char* patch0 = GetPatchPointer(image0, center0, radius);
+  const unsigned char* patch1 = GetPatchPointer(image1, center1, radius);
+  const size_t rowStride0 = 3 * image0->GetLargestPossibleRegion().GetSize()[0];
+  const size_t rowStride1 = 3 * image1->GetLargestPossibleRegion().GetSize()[0];
+  const unsigned int rowLength = 3 * (2 * radius + 1);
+
+  SumType sum = 0;
+  for(unsigned int row = 0; row < 2 * radius + 1; ++row)
+  {
+    if(metric == SSD)
+    {
+      sum += SumOfSquaredDifferences(patch0 + row * rowStride0, patch1 + row * rowStride1, rowLength);
+    }
+    else if(metric == SAD)
+    {
+      sum += SumOfAbsoluteDifferences(patch0 + row * rowStride0, patch1 + row * rowStride1, rowLength);
+    }
+    else
+    {
+      throw std::runtime_error("PatchDistance: invalid metric!");
+    }
+  }
+
+  return sum;
+}
+
+} // end namespace
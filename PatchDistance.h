@@ -0,0 +1,248 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PatchDistance_H
+#define PatchDistance_H
+
+// STL
+#include <cstddef>
+#include <cstdlib>
+
+// SIMD
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE4_1__)
+  #include <smmintrin.h>
+#endif
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** Distances between square patches of an RGB image (3 unsigned chars per pixel, interleaved).
+  *
+  * The functors work on raw buffers: a patch is given by a pointer to the first byte of its
+  * top left pixel, and the rows of the image are 'rowStride' bytes apart. The row kernels use
+  * AVX2 or SSE4.1 when the compiler targets them (see NNFieldInspector_USE_NATIVE_ARCH in
+  * CMakeLists.txt) and a scalar loop otherwise. The functors are specialized on the patch radius,
+  * so for the common radii the length of a row is a compile time constant and the kernels unroll.
+  * A radius of 0 selects the generic functor, which takes the radius at run time.
+  *
+  * All functors accept a 'bound' and may stop (returning a value >= bound) once the partial
+  * sum reaches it, which is what searching for a better match needs.
+  */
+namespace PatchDistance
+{
+  enum MetricEnum {SSD, SAD};
+
+  /** The distance of a whole patch. A row fits in 32 bits for any radius, but large patches do not.*/
+  typedef unsigned long long SumType;
+
+  /** The instruction set the row kernels were compiled for, for display.*/
+  inline const char* GetInstructionSet()
+  {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_1__)
+    return "SSE4.1";
+#else
+    return "scalar";
+#endif
+  }
+
+  /** The sum of squared differences of 'length' bytes.*/
+  inline unsigned int SumOfSquaredDifferences(const unsigned char* a, const unsigned char* b, const unsigned int length)
+  {
+    unsigned int i = 0;
+    unsigned int sum = 0;
+
+#if defined(__AVX2__)
+    // 16 bytes are widened to 16 bit, subtracted, and squared and pairwise added into 32 bit by madd.
+    __m256i sums = _mm256_setzero_si256();
+    for(; i + 16 <= length; i += 16)
+    {
+      const __m256i a16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+      const __m256i b16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+      const __m256i difference = _mm256_sub_epi16(a16, b16);
+      sums = _mm256_add_epi32(sums, _mm256_madd_epi16(difference, difference));
+    }
+    __m128i sums128 = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    sums128 = _mm_add_epi32(sums128, _mm_shuffle_epi32(sums128, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums128 = _mm_add_epi32(sums128, _mm_shuffle_epi32(sums128, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = static_cast<unsigned int>(_mm_cvtsi128_si32(sums128));
+#elif defined(__SSE4_1__)
+    __m128i sums = _mm_setzero_si128();
+    for(; i + 8 <= length; i += 8)
+    {
+      const __m128i a16 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)));
+      const __m128i b16 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)));
+      const __m128i difference = _mm_sub_epi16(a16, b16);
+      sums = _mm_add_epi32(sums, _mm_madd_epi16(difference, difference));
+    }
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = static_cast<unsigned int>(_mm_cvtsi128_si32(sums));
+#endif
+
+    // The bytes that do not fill a whole vector (all of them for the scalar version).
+    // Loading past the end of the row could read past the end of the image.
+    for(; i < length; ++i)
+    {
+      const int difference = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+      sum += difference * difference;
+    }
+
+    return sum;
+  }
+
+  /** The sum of absolute differences of 'length' bytes.*/
+  inline unsigned int SumOfAbsoluteDifferences(const unsigned char* a, const unsigned char* b, const unsigned int length)
+  {
+    unsigned int i = 0;
+    unsigned int sum = 0;
+
+#if defined(__AVX2__)
+    // psadbw sums the absolute differences of each group of 8 bytes into a 64 bit lane.
+    __m256i sums = _mm256_setzero_si256();
+    for(; i + 32 <= length; i += 32)
+    {
+      const __m256i a8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i b8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      sums = _mm256_add_epi64(sums, _mm256_sad_epu8(a8, b8));
+    }
+    __m128i sums128 = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    for(; i + 16 <= length; i += 16)
+    {
+      const __m128i a8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i b8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      sums128 = _mm_add_epi64(sums128, _mm_sad_epu8(a8, b8));
+    }
+    sums128 = _mm_add_epi64(sums128, _mm_unpackhi_epi64(sums128, sums128));
+    sum = static_cast<unsigned int>(_mm_cvtsi128_si32(sums128));
+#elif defined(__SSE4_1__)
+    __m128i sums = _mm_setzero_si128();
+    for(; i + 16 <= length; i += 16)
+    {
+      const __m128i a8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i b8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      sums = _mm_add_epi64(sums, _mm_sad_epu8(a8, b8));
+    }
+    sums = _mm_add_epi64(sums, _mm_unpackhi_epi64(sums, sums));
+    sum = static_cast<unsigned int>(_mm_cvtsi128_si32(sums));
+#endif
+
+    for(; i < length; ++i)
+    {
+      sum += std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+    }
+
+    return sum;
+  }
+
+  /** The row kernel of each metric.*/
+  template <MetricEnum TMetric>
+  struct RowKernel;
+
+  template <>
+  struct RowKernel<SSD>
+  {
+    static unsigned int Compute(const unsigned char* a, const unsigned char* b, const unsigned int length)
+    {
+      return SumOfSquaredDifferences(a, b, length);
+    }
+  };
+
+  template <>
+  struct RowKernel<SAD>
+  {
+    static unsigned int Compute(const unsigned char* a, const unsigned char* b, const unsigned int length)
+    {
+      return SumOfAbsoluteDifferences(a, b, length);
+    }
+  };
+
+  /** The distance between two patches of radius TRadius, or of the radius given to the constructor if TRadius is 0.*/
+  template <MetricEnum TMetric, unsigned int TRadius = 0>
+  class Functor
+  {
+  public:
+    explicit Functor(const unsigned int radius = TRadius) : Radius(TRadius > 0 ? TRadius : radius) {}
+
+    unsigned int GetRadius() const
+    {
+      return this->Radius;
+    }
+
+    SumType operator()(const unsigned char* patch0, const unsigned char* patch1, const size_t rowStride,
+                       const SumType bound) const
+    {
+      // For a TRadius > 0 both of these are constants, so the row kernel is unrolled for them.
+      const unsigned int rowLength = 3 * (2 * (TRadius > 0 ? TRadius : this->Radius) + 1);
+      const unsigned int numberOfRows = 2 * (TRadius > 0 ? TRadius : this->Radius) + 1;
+
+      SumType sum = 0;
+      for(unsigned int row = 0; row < numberOfRows; ++row)
+      {
+        sum += RowKernel<TMetric>::Compute(patch0, patch1, rowLength);
+
+        // Most candidates are worse than the current match, which is usually clear after a few rows.
+        if(sum >= bound)
+        {
+          return sum;
+        }
+
+        patch0 += rowStride;
+        patch1 += rowStride;
+      }
+
+      return sum;
+    }
+
+  private:
+    unsigned int Radius;
+  };
+
+  /** Call visitor(functor) with the Functor<TMetric, radius> specialized for 'radius', or with the
+    * generic one if 'radius' is not one of the specialized radii.*/
+  template <MetricEnum TMetric, typename TVisitor>
+  void Dispatch(const unsigned int radius, TVisitor& visitor)
+  {
+    switch(radius)
+    {
+      case 2: visitor(Functor<TMetric, 2>()); break;
+      case 3: visitor(Functor<TMetric, 3>()); break;
+      case 4: visitor(Functor<TMetric, 4>()); break;
+      case 5: visitor(Functor<TMetric, 5>()); break;
+      case 7: visitor(Functor<TMetric, 7>()); break;
+      case 10: visitor(Functor<TMetric, 10>()); break;
+      default: visitor(Functor<TMetric>(radius)); break;
+    }
+  }
+
+  /** The distance between the patches of 'image' centered at 'center0' and 'center1'.
+    * Throws if either patch is not entirely inside the image.*/
+  SumType Compute(const NNFieldTypes::ImageType* const image, const itk::Index<2>& center0,
+                  const itk::Index<2>& center1, const unsigned int radius, const MetricEnum metric);
+
+  /** The distance between the patch of 'image0' centered at 'center0' and the patch of 'image1' centered at
+    * 'center1', for fields whose matches are in another image. Throws if a patch is not entirely inside its image.*/
+  SumType Compute(const NNFieldTypes::ImageType* const image0, const itk::Index<2>& center0,
+                  const NNFieldTypes::ImageType* const image1, const itk::Index<2>& center1,
+                  const unsigned int radius, const MetricEnum metric);
+}
+
+#endif
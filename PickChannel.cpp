@@ -0,0 +1,264 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PickChannel.h"
+
+// STL
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Custom
+#include "PrivateDirectory.h"
+
+namespace
+{
+  const char Magic[4] = {'N', 'N', 'P', 'K'};
+  const uint32_t Version = 1;
+
+  const std::string SocketExtension = ".sock";
+
+  /** A record as it is sent. All members run on this machine, so the values are in its byte order.*/
+  struct WireRecord
+  {
+    char Magic[4];
+    uint32_t Version;
+    int32_t Sender;
+    uint32_t Sequence;
+    int32_t Pick[2];
+    int32_t Match[2];
+  };
+
+  /** The address of the socket 'fileName'. Throws if the path is too long for a socket address.*/
+  sockaddr_un GetAddress(const std::string& fileName)
+  {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(fileName.size() >= sizeof(address.sun_path))
+    {
+      throw std::runtime_error("PickChannel: the socket path " + fileName + " is too long!");
+    }
+    memcpy(address.sun_path, fileName.c_str(), fileName.size());
+    return address;
+  }
+
+  bool EndsWith(const std::string& text, const std::string& suffix)
+  {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+}
+
+PickChannel::PickChannel() : FileDescriptor(-1), NextSequence(0)
+{
+}
+
+PickChannel::~PickChannel()
+{
+  Close();
+}
+
+std::string PickChannel::GetDefaultDirectory()
+{
+  const char* runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+  if(runtimeDirectory && runtimeDirectory[0] != '\0')
+  {
+    return std::string(runtimeDirectory) + "/NNFieldInspector";
+  }
+
+  std::stringstream ss;
+  ss << "/tmp/NNFieldInspector-" << getuid();
+  return ss.str();
+}
+
+void PickChannel::Open(const std::string& directory)
+{
+  Close();
+
+  // Only the user may publish to and list the members. Otherwise another user could inject picks, or have Publish()
+  // remove the sockets of a directory it links to.
+  try
+  {
+    PrivateDirectory::Create(directory);
+  }
+  catch(std::runtime_error& exception)
+  {
+    throw std::runtime_error(std::string("PickChannel: ") + exception.what());
+  }
+
+  std::stringstream ssFileName;
+  ssFileName << directory << "/" << getpid() << SocketExtension;
+  const sockaddr_un address = GetAddress(ssFileName.str());
+
+  const int fileDescriptor = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if(fileDescriptor < 0)
+  {
+    throw std::runtime_error(std::string("PickChannel: could not create a socket: ") + strerror(errno));
+  }
+  fcntl(fileDescriptor, F_SETFL, fcntl(fileDescriptor, F_GETFL) | O_NONBLOCK);
+  fcntl(fileDescriptor, F_SETFD, FD_CLOEXEC);
+
+  // A socket with this name can only be left behind by an earlier process with the same id.
+  unlink(address.sun_path);
+  if(bind(fileDescriptor, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+  {
+    const std::string error = strerror(errno);
+    close(fileDescriptor);
+    throw std::runtime_error("PickChannel: could not bind " + ssFileName.str() + ": " + error);
+  }
+
+  this->Directory = directory;
+  this->SocketFileName = ssFileName.str();
+  this->FileDescriptor = fileDescriptor;
+}
+
+void PickChannel::Close()
+{
+  if(this->FileDescriptor < 0)
+  {
+    return;
+  }
+
+  close(this->FileDescriptor);
+  unlink(this->SocketFileName.c_str());
+  this->FileDescriptor = -1;
+  this->Directory.clear();
+  this->SocketFileName.clear();
+}
+
+bool PickChannel::IsOpen() const
+{
+  return this->FileDescriptor >= 0;
+}
+
+int PickChannel::GetFileDescriptor() const
+{
+  return this->FileDescriptor;
+}
+
+unsigned int PickChannel::Publish(const int pick[2], const int match[2])
+{
+  if(this->FileDescriptor < 0)
+  {
+    return 0;
+  }
+
+  WireRecord wireRecord;
+  memcpy(wireRecord.Magic, Magic, sizeof(Magic));
+  wireRecord.Version = Version;
+  wireRecord.Sender = getpid();
+  wireRecord.Sequence = this->NextSequence++;
+  wireRecord.Pick[0] = pick[0];
+  wireRecord.Pick[1] = pick[1];
+  wireRecord.Match[0] = match[0];
+  wireRecord.Match[1] = match[1];
+
+  // The members are whoever has a socket in the directory right now.
+  DIR* directory = opendir(this->Directory.c_str());
+  if(!directory)
+  {
+    return 0;
+  }
+
+  unsigned int numberOfReceivers = 0;
+  while(dirent* entry = readdir(directory))
+  {
+    const std::string fileName = this->Directory + "/" + entry->d_name;
+    if(!EndsWith(fileName, SocketExtension) || fileName == this->SocketFileName)
+    {
+      continue;
+    }
+
+    sockaddr_un address;
+    try
+    {
+      address = GetAddress(fileName);
+    }
+    catch(std::runtime_error&)
+    {
+      continue;
+    }
+
+    if(sendto(this->FileDescriptor, &wireRecord, sizeof(wireRecord), 0,
+              reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == static_cast<ssize_t>(sizeof(wireRecord)))
+    {
+      numberOfReceivers++;
+    }
+    else if(errno == ECONNREFUSED || errno == ENOENT)
+    {
+      // Nobody listens on the socket any more, its member exited without closing the channel.
+      unlink(fileName.c_str());
+    }
+    // Otherwise (EAGAIN, ENOBUFS) the queue of the member is full and it misses this record.
+  }
+  closedir(directory);
+
+  return numberOfReceivers;
+}
+
+bool PickChannel::Receive(Record& record)
+{
+  if(this->FileDescriptor < 0)
+  {
+    return false;
+  }
+
+  while(true)
+  {
+    // One more byte than a record, so longer datagrams are recognized rather than truncated.
+    char buffer[sizeof(WireRecord) + 1];
+    const ssize_t numberOfBytes = recv(this->FileDescriptor, buffer, sizeof(buffer), 0);
+    if(numberOfBytes < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+
+    WireRecord wireRecord;
+    if(numberOfBytes != static_cast<ssize_t>(sizeof(wireRecord)))
+    {
+      continue;
+    }
+    memcpy(&wireRecord, buffer, sizeof(wireRecord));
+    if(memcmp(wireRecord.Magic, Magic, sizeof(Magic)) != 0 || wireRecord.Version != Version)
+    {
+      continue;
+    }
+
+    record.Sender = wireRecord.Sender;
+    record.Sequence = wireRecord.Sequence;
+    record.Pick[0] = wireRecord.Pick[0];
+    record.Pick[1] = wireRecord.Pick[1];
+    record.Match[0] = wireRecord.Match[0];
+    record.Match[1] = wireRecord.Match[1];
+    return true;
+  }
+}
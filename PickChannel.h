@@ -0,0 +1,98 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PickChannel_H
+#define PickChannel_H
+
+// STL
+#include <string>
+
+/** A publish/subscribe channel for picks between the inspectors running on this machine, so they can follow
+  * each other's clicks and arrow key steps (e.g. one inspector per solver version or per frame).
+  *
+  * Every member binds a Unix datagram socket named after its process id in a directory private to the user.
+  * Publishing sends one fixed size binary record to the socket of every other member, so there is no broker and
+  * members can come and go at any time. Sockets left behind by members that exited are removed when publishing
+  * to them fails. A record is a few dozen bytes that never leave the kernel, so delivery takes microseconds.
+  *
+  * The socket is non-blocking: watch GetFileDescriptor() for reading (e.g. with a QSocketNotifier) and call
+  * Receive() until it returns false. This does not depend on Qt.
+  */
+class PickChannel
+{
+public:
+  /** A pick of another member.*/
+  struct Record
+  {
+    /** The process id of the member that published the pick.*/
+    int Sender;
+
+    /** Counts the picks of the sender, so a receiver can tell whether it missed some.*/
+    unsigned int Sequence;
+
+    int Pick[2];
+
+    /** The center of the best match of the pick in the field of the sender.*/
+    int Match[2];
+  };
+
+  PickChannel();
+
+  /** Leaves the channel.*/
+  ~PickChannel();
+
+  /** The default directory of the channel: NNFieldInspector in $XDG_RUNTIME_DIR if it is set, otherwise
+    * /tmp/NNFieldInspector-<user id>.*/
+  static std::string GetDefaultDirectory();
+
+  /** Join the channel in 'directory', which is created (readable only by the user) if it does not exist.
+    * Throws if the socket cannot be created, or if the directory is not private to the user (see PrivateDirectory.h).*/
+  void Open(const std::string& directory);
+
+  /** Leave the channel. Nothing happens if it is not open.*/
+  void Close();
+
+  bool IsOpen() const;
+
+  /** The socket to watch for records, or -1 if the channel is not open.*/
+  int GetFileDescriptor() const;
+
+  /** Send a pick and its match to every other member. Members that cannot keep up lose the record rather than
+    * slowing this one down. Returns the number of members it was sent to.*/
+  unsigned int Publish(const int pick[2], const int match[2]);
+
+  /** Read the next record that was sent to this member. Returns false if there is none. Datagrams that are not
+    * records of this version are skipped.*/
+  bool Receive(Record& record);
+
+private:
+  /** The socket is owned, so copying is not allowed.*/
+  PickChannel(const PickChannel&);
+  void operator=(const PickChannel&);
+
+  std::string Directory;
+
+  /** The path of the socket of this member.*/
+  std::string SocketFileName;
+
+  int FileDescriptor;
+
+  unsigned int NextSequence;
+};
+
+#endif
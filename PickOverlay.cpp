@@ -0,0 +1,128 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PickOverlay.h"
+
+// STL
+#include <stdexcept>
+
+// VTK
+#include <vtkImageData.h>
+
+// Submodules
+#include "ITKVTKHelpers/ITKVTKHelpers.h"
+#include "VTKHelpers/VTKHelpers.h"
+
+PickOverlay::PickOverlay()
+{
+
+}
+
+void PickOverlay::SetImageData(vtkImageData* const imageData)
+{
+  this->ImageData = imageData;
+}
+
+void PickOverlay::Initialize(const itk::ImageRegion<2>& region)
+{
+  if(!this->ImageData)
+  {
+    throw std::runtime_error("PickOverlay::Initialize: ImageData must be set first!");
+  }
+
+  this->Region = region;
+  this->DrawnPixels.clear();
+
+  // 4 for RGBA
+  ITKVTKHelpers::InitializeVTKImage(region, 4, this->ImageData);
+  VTKHelpers::MakeImageTransparent(this->ImageData);
+}
+
+void PickOverlay::Clear()
+{
+  for(unsigned int i = 0; i < this->DrawnPixels.size(); ++i)
+  {
+    unsigned char* pixel = static_cast<unsigned char*>(
+          this->ImageData->GetScalarPointer(this->DrawnPixels[i][0], this->DrawnPixels[i][1], 0));
+    pixel[3] = VTKHelpers::TRANSPARENT_PIXEL;
+  }
+
+  this->DrawnPixels.clear();
+}
+
+void PickOverlay::SetPixel(const itk::Index<2>& index, const unsigned char color[3])
+{
+  if(!this->Region.IsInside(index))
+  {
+    return;
+  }
+
+  unsigned char* pixel = static_cast<unsigned char*>(this->ImageData->GetScalarPointer(index[0], index[1], 0));
+
+  // A pixel that is already opaque is already in the list, so it does not need to be remembered twice.
+  if(pixel[3] != VTKHelpers::OPAQUE_PIXEL)
+  {
+    this->DrawnPixels.push_back(index);
+  }
+
+  pixel[0] = color[0];
+  pixel[1] = color[1];
+  pixel[2] = color[2];
+  pixel[3] = VTKHelpers::OPAQUE_PIXEL;
+}
+
+void PickOverlay::OutlineRegion(const itk::ImageRegion<2>& region, const unsigned char color[3])
+{
+  const itk::Index<2> corner = region.GetIndex();
+  const itk::Size<2> size = region.GetSize();
+
+  if(size[0] == 0 || size[1] == 0)
+  {
+    return;
+  }
+
+  const itk::Index<2>::IndexValueType lastX = corner[0] + static_cast<itk::Index<2>::IndexValueType>(size[0]) - 1;
+  const itk::Index<2>::IndexValueType lastY = corner[1] + static_cast<itk::Index<2>::IndexValueType>(size[1]) - 1;
+
+  // Top and bottom rows
+  for(itk::Index<2>::IndexValueType x = corner[0]; x <= lastX; ++x)
+  {
+    itk::Index<2> top = {{x, corner[1]}};
+    SetPixel(top, color);
+    itk::Index<2> bottom = {{x, lastY}};
+    SetPixel(bottom, color);
+  }
+
+  // Left and right columns
+  for(itk::Index<2>::IndexValueType y = corner[1]; y <= lastY; ++y)
+  {
+    itk::Index<2> left = {{corner[0], y}};
+    SetPixel(left, color);
+    itk::Index<2> right = {{lastX, y}};
+    SetPixel(right, color);
+  }
+
+  itk::Index<2> center = {{corner[0] + static_cast<itk::Index<2>::IndexValueType>(size[0]/2),
+                           corner[1] + static_cast<itk::Index<2>::IndexValueType>(size[1]/2)}};
+  SetPixel(center, color);
+}
+
+void PickOverlay::Modified()
+{
+  this->ImageData->Modified();
+}
@@ -0,0 +1,72 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PickOverlay_H
+#define PickOverlay_H
+
+// STL
+#include <vector>
+
+// ITK
+#include "itkImageRegion.h"
+
+// VTK
+#include <vtkSmartPointer.h>
+
+class vtkImageData;
+
+/** A persistent, transparent RGBA overlay on which patch outlines are drawn.
+  * The overlay is allocated once per image. After that, every pixel that is drawn is
+  * remembered so that Clear() only has to reset those pixels, making a pick cost
+  * proportional to the patch perimeter instead of the image size.
+  */
+class PickOverlay
+{
+public:
+  PickOverlay();
+
+  /** Set the RGBA image that the overlay draws into (typically the ImageData of a Layer).*/
+  void SetImageData(vtkImageData* const imageData);
+
+  /** Allocate a fully transparent overlay covering 'region'. This is the only full-image pass.*/
+  void Initialize(const itk::ImageRegion<2>& region);
+
+  /** Make every pixel drawn since the last Clear() transparent again.*/
+  void Clear();
+
+  /** Draw the outline of 'region' (clipped to the overlay) and mark its center pixel.*/
+  void OutlineRegion(const itk::ImageRegion<2>& region, const unsigned char color[3]);
+
+  /** Draw a single opaque pixel. Pixels outside of the overlay are ignored.*/
+  void SetPixel(const itk::Index<2>& index, const unsigned char color[3]);
+
+  /** Notify VTK that the overlay changed. Call this once after a batch of drawing.*/
+  void Modified();
+
+private:
+  /** The RGBA image that is drawn into.*/
+  vtkSmartPointer<vtkImageData> ImageData;
+
+  /** The region covered by the overlay.*/
+  itk::ImageRegion<2> Region;
+
+  /** Every pixel that has been made opaque since the last Clear().*/
+  std::vector<itk::Index<2> > DrawnPixels;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PrivateDirectory_H
+#define PrivateDirectory_H
+
+// STL
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Directories only this user may use. A directory with a predictable name in a shared place such as /tmp can be
+  * created (or replaced by a symbolic link) by another user beforehand, so one that already exists is only used if
+  * it is a real directory of this user that no one else may read, write or enter.
+  */
+namespace PrivateDirectory
+{
+  /** Whether 'directory' is a directory, not a link to one, owned by this user and without group or other
+    * permissions.*/
+  inline bool IsPrivate(const std::string& directory)
+  {
+    struct stat status;
+    return lstat(directory.c_str(), &status) == 0 && S_ISDIR(status.st_mode) && status.st_uid == getuid() &&
+           (status.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+  }
+
+  /** Create 'directory' (its parent must exist) if it does not exist. Throws if it cannot be created, or if it is
+    * not private (see IsPrivate()).*/
+  inline void Create(const std::string& directory)
+  {
+    if(mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+      throw std::runtime_error("Could not create " + directory + ": " + strerror(errno));
+    }
+    if(!IsPrivate(directory))
+    {
+      throw std::runtime_error(directory + " is not a directory that only this user may access, so it is not used!");
+    }
+  }
+}
+
+#endif
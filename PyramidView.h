@@ -0,0 +1,237 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PyramidView_H
+#define PyramidView_H
+
+// STL
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// ITK
+#include "itkImageRegion.h"
+
+// VTK
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTypeTraits.h>
+
+// Custom
+#include "LRUCache.h"
+#include "Parallel.h"
+#include "TiledPyramid.h"
+
+/** Assembles the tiles of a TiledPyramid that are visible on the screen into a vtkImageData.
+  *
+  * The level is chosen from the zoom, and only the visible tiles (plus one tile around them, so short pans do not
+  * show empty borders) are assembled. The spacing and origin of the output place its pixels over the level 0
+  * pixels they cover, so picking and the full resolution layers line up with it. Tiles that the pyramid computes
+  * rather than stores are kept in a bounded LRU cache, so panning back and forth does not compute them again.
+  * The cost of an update depends on the size of the screen, not on the size of the image.
+  */
+template <typename TComponent>
+class PyramidView
+{
+public:
+  typedef TiledPyramid<TComponent> PyramidType;
+
+  explicit PyramidView(const size_t maximumCacheBytes) : Cache(maximumCacheBytes), Valid(false), Level(0)
+  {
+    this->Output = vtkSmartPointer<vtkImageData>::New();
+  }
+
+  /** Display 'pyramid', or nothing if it is NULL. The output is only assembled by the next Update().*/
+  void SetPyramid(const std::shared_ptr<const PyramidType>& pyramid)
+  {
+    this->Pyramid = pyramid;
+    this->Cache.Clear();
+    this->Output->Initialize();
+    this->Valid = false;
+  }
+
+  const std::shared_ptr<const PyramidType>& GetPyramid() const
+  {
+    return this->Pyramid;
+  }
+
+  /** Assemble the tiles needed to show 'visibleRegion' (in level 0 pixels, it may extend past the image) when
+    * one screen pixel is 'imagePixelsPerScreenPixel' level 0 pixels wide. Returns whether the output changed,
+    * which it does not if the same tiles are needed as for the previous update.*/
+  bool Update(const itk::ImageRegion<2>& visibleRegion, const double imagePixelsPerScreenPixel)
+  {
+    if(!this->Pyramid)
+    {
+      return false;
+    }
+
+    const PyramidType& pyramid = *this->Pyramid;
+    const unsigned int level = pyramid.ChooseLevel(imagePixelsPerScreenPixel);
+    const long long tilePixels = static_cast<long long>(PyramidType::TileSize) << level;
+
+    const unsigned int numberOfTiles[2] = {pyramid.GetNumberOfTilesX(level), pyramid.GetNumberOfTilesY(level)};
+    unsigned int firstTile[2];
+    unsigned int lastTile[2];
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      const long long first = visibleRegion.GetIndex()[dimension];
+      const long long last = first + static_cast<long long>(visibleRegion.GetSize()[dimension]) - 1;
+      // Rounds down also for negative positions.
+      const long long firstVisibleTile = (first >= 0) ? first / tilePixels : -((tilePixels - 1 - first) / tilePixels);
+      const long long lastVisibleTile = (last >= 0) ? last / tilePixels : -1;
+      firstTile[dimension] = static_cast<unsigned int>(
+        std::min<long long>(std::max<long long>(firstVisibleTile - 1, 0), numberOfTiles[dimension] - 1));
+      lastTile[dimension] = static_cast<unsigned int>(
+        std::min<long long>(std::max<long long>(lastVisibleTile + 1, firstTile[dimension]), numberOfTiles[dimension] - 1));
+    }
+
+    if(this->Valid && level == this->Level &&
+       std::equal(firstTile, firstTile + 2, this->FirstTile) && std::equal(lastTile, lastTile + 2, this->LastTile))
+    {
+      return false;
+    }
+
+    this->Valid = true;
+    this->Level = level;
+    std::copy(firstTile, firstTile + 2, this->FirstTile);
+    std::copy(lastTile, lastTile + 2, this->LastTile);
+
+    Assemble();
+    return true;
+  }
+
+  /** The assembled tiles. Layers display it through vtkImageData::ShallowCopy, which shares its scalars.
+    * Every update allocates new scalars, so a layer keeps displaying the previous ones until it is updated.*/
+  vtkImageData* GetOutput() const
+  {
+    return this->Output;
+  }
+
+  /** The level of the output.*/
+  unsigned int GetLevel() const
+  {
+    return this->Level;
+  }
+
+  size_t GetCacheNumberOfBytes() const
+  {
+    return this->Cache.GetNumberOfBytes();
+  }
+
+private:
+  typedef std::vector<TComponent> TileType;
+
+  /** Copy the tiles [FirstTile, LastTile] of Level into a new output.*/
+  void Assemble()
+  {
+    const PyramidType& pyramid = *this->Pyramid;
+    const unsigned int tileSize = PyramidType::TileSize;
+    const unsigned int numberOfComponents = pyramid.GetNumberOfComponents();
+
+    const unsigned int firstPixel[2] = {this->FirstTile[0] * tileSize, this->FirstTile[1] * tileSize};
+    const unsigned int size[2] = {std::min((this->LastTile[0] + 1) * tileSize, pyramid.GetWidth(this->Level)) - firstPixel[0],
+                                  std::min((this->LastTile[1] + 1) * tileSize, pyramid.GetHeight(this->Level)) - firstPixel[1]};
+
+    // A pixel of the level covers 'scale' x 'scale' level 0 pixels, and is placed at their center.
+    const double scale = static_cast<double>(1u << this->Level);
+    this->Output->Initialize();
+    this->Output->SetDimensions(size[0], size[1], 1);
+    this->Output->SetSpacing(scale, scale, 1.0);
+    this->Output->SetOrigin(firstPixel[0] * scale + (scale - 1.0) / 2.0, firstPixel[1] * scale + (scale - 1.0) / 2.0, 0.0);
+    this->Output->AllocateScalars(vtkTypeTraits<TComponent>::VTKTypeID(), numberOfComponents);
+
+    std::vector<PyramidTileIndex> tiles;
+    for(unsigned int y = this->FirstTile[1]; y <= this->LastTile[1]; ++y)
+    {
+      for(unsigned int x = this->FirstTile[0]; x <= this->LastTile[0]; ++x)
+      {
+        PyramidTileIndex tile = {this->Level, x, y};
+        tiles.push_back(tile);
+      }
+    }
+
+    // The tiles of computed levels come from the cache, the missing ones are computed on all cores.
+    std::vector<std::shared_ptr<const TileType> > cachedTiles(tiles.size());
+    if(!pyramid.IsResident(this->Level))
+    {
+      std::vector<size_t> missingTiles;
+      for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+      {
+        cachedTiles[tileId] = this->Cache.Find(tiles[tileId]);
+        if(!cachedTiles[tileId])
+        {
+          missingTiles.push_back(tileId);
+        }
+      }
+
+      std::vector<std::shared_ptr<TileType> > computedTiles(missingTiles.size());
+      Parallel::For(0, missingTiles.size(), [&](const size_t missingId)
+        {
+        const PyramidTileIndex& tile = tiles[missingTiles[missingId]];
+        const size_t rowStride = static_cast<size_t>(pyramid.GetTileWidth(tile)) * numberOfComponents;
+        computedTiles[missingId].reset(new TileType(rowStride * pyramid.GetTileHeight(tile)));
+        pyramid.CopyTile(tile, &(*computedTiles[missingId])[0], rowStride);
+        });
+
+      for(size_t missingId = 0; missingId < missingTiles.size(); ++missingId)
+      {
+        const size_t tileId = missingTiles[missingId];
+        cachedTiles[tileId] = computedTiles[missingId];
+        this->Cache.Insert(tiles[tileId], cachedTiles[tileId], computedTiles[missingId]->size() * sizeof(TComponent));
+      }
+    }
+
+    TComponent* const out = static_cast<TComponent*>(this->Output->GetScalarPointer());
+    const size_t outRowStride = static_cast<size_t>(size[0]) * numberOfComponents;
+    Parallel::For(0, tiles.size(), [&](const size_t tileId)
+      {
+      const PyramidTileIndex& tile = tiles[tileId];
+      TComponent* const tileOut = out + static_cast<size_t>(tile.Y * tileSize - firstPixel[1]) * outRowStride +
+                                  static_cast<size_t>(tile.X * tileSize - firstPixel[0]) * numberOfComponents;
+      if(!cachedTiles[tileId])
+      {
+        pyramid.CopyTile(tile, tileOut, outRowStride);
+        return;
+      }
+
+      const size_t rowStride = static_cast<size_t>(pyramid.GetTileWidth(tile)) * numberOfComponents;
+      const TComponent* const in = &(*cachedTiles[tileId])[0];
+      for(unsigned int row = 0; row < pyramid.GetTileHeight(tile); ++row)
+      {
+        std::copy(in + row * rowStride, in + (row + 1) * rowStride, tileOut + row * outRowStride);
+      }
+      });
+
+    this->Output->Modified();
+  }
+
+  std::shared_ptr<const PyramidType> Pyramid;
+
+  /** The computed tiles that were displayed recently.*/
+  LRUCache<PyramidTileIndex, TileType> Cache;
+
+  vtkSmartPointer<vtkImageData> Output;
+
+  /** The level and the range of tiles of the output, if Valid.*/
+  bool Valid;
+  unsigned int Level;
+  unsigned int FirstTile[2];
+  unsigned int LastTile[2];
+};
+
+#endif
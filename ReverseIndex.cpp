@@ -0,0 +1,200 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ReverseIndex.h"
+
+// STL
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  /** Marks a source whose match is outside of the field.*/
+  const unsigned int NoTarget = std::numeric_limits<unsigned int>::max();
+}
+
+ReverseIndex::ReverseIndex()
+{
+  this->Size.Fill(0);
+}
+
+itk::Size<2> ReverseIndex::GetSize() const
+{
+  return this->Size;
+}
+
+bool ReverseIndex::Build(const NNFieldTypes::NNFieldImageType* const nnField,
+                         const NNFieldTypes::INTERPRETATION_ENUM interpretation, const std::atomic<bool>& cancel)
+{
+  return Build(nnField, interpretation, nnField->GetLargestPossibleRegion().GetSize(), cancel);
+}
+
+bool ReverseIndex::Build(const NNFieldTypes::NNFieldImageType* const nnField,
+                         const NNFieldTypes::INTERPRETATION_ENUM interpretation, const itk::Size<2>& targetSize,
+                         const std::atomic<bool>& cancel)
+{
+  this->Offsets.clear();
+  this->Sources.clear();
+  this->Size = targetSize;
+
+  const int width = static_cast<int>(nnField->GetLargestPossibleRegion().GetSize()[0]);
+  const int height = static_cast<int>(nnField->GetLargestPossibleRegion().GetSize()[1]);
+  const size_t numberOfPixels = static_cast<size_t>(width) * height;
+  const int targetWidth = static_cast<int>(targetSize[0]);
+  const int targetHeight = static_cast<int>(targetSize[1]);
+  const size_t numberOfTargets = static_cast<size_t>(targetWidth) * targetHeight;
+  if(numberOfPixels >= NoTarget || numberOfTargets >= NoTarget)
+  {
+    throw std::runtime_error("ReverseIndex: the field has too many pixels!");
+  }
+
+  if(nnField->GetNumberOfComponentsPerPixel() < 2)
+  {
+    throw std::runtime_error("ReverseIndex: the NNField must have at least 2 channels!");
+  }
+
+  const float* buffer = nnField->GetBufferPointer();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  const bool offset = (interpretation == NNFieldTypes::OFFSET);
+
+  // 1) The target of every source, and the number of sources of every target.
+  std::vector<unsigned int> targets(numberOfPixels);
+  std::unique_ptr<std::atomic<unsigned int>[]> counts(new std::atomic<unsigned int>[numberOfTargets]);
+
+  Parallel::For(0, numberOfTargets, [&counts](const size_t target)
+    {
+    counts[target].store(0, std::memory_order_relaxed);
+    });
+
+  Parallel::For(0, height, [&](const size_t y)
+    {
+    if(cancel)
+    {
+      return;
+    }
+
+    for(int x = 0; x < width; ++x)
+    {
+      const size_t pixelId = y * width + x;
+      int targetX = static_cast<int>(buffer[pixelId * numberOfComponents]);
+      int targetY = static_cast<int>(buffer[pixelId * numberOfComponents + 1]);
+      if(offset)
+      {
+        targetX += x;
+        targetY += static_cast<int>(y);
+      }
+
+      if(targetX < 0 || targetY < 0 || targetX >= targetWidth || targetY >= targetHeight)
+      {
+        targets[pixelId] = NoTarget;
+        continue;
+      }
+
+      const unsigned int target = static_cast<unsigned int>(targetY) * targetWidth + targetX;
+      targets[pixelId] = target;
+      counts[target].fetch_add(1, std::memory_order_relaxed);
+    }
+    });
+
+  if(cancel)
+  {
+    return false;
+  }
+
+  // 2) Exclusive prefix sum of the counts. Every thread sums its chunk, the chunk totals are
+  // scanned, and every thread then writes the offsets of its chunk starting from its chunk's total.
+  std::vector<unsigned int> chunkTotals(Parallel::GetNumberOfThreads() + 1, 0);
+  Parallel::ForChunks(0, numberOfTargets, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    unsigned int total = 0;
+    for(size_t target = chunkBegin; target < chunkEnd; ++target)
+    {
+      total += counts[target].load(std::memory_order_relaxed);
+    }
+    chunkTotals[threadId + 1] = total;
+    });
+
+  for(size_t threadId = 1; threadId < chunkTotals.size(); ++threadId)
+  {
+    chunkTotals[threadId] += chunkTotals[threadId - 1];
+  }
+
+  this->Offsets.resize(numberOfTargets + 1);
+  this->Offsets[numberOfTargets] = chunkTotals.back();
+  Parallel::ForChunks(0, numberOfTargets, [&](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    unsigned int offset = chunkTotals[threadId];
+    for(size_t target = chunkBegin; target < chunkEnd; ++target)
+    {
+      this->Offsets[target] = offset;
+      offset += counts[target].load(std::memory_order_relaxed);
+      // From here on, the counts are the next free position of each target.
+      counts[target].store(this->Offsets[target], std::memory_order_relaxed);
+    }
+    });
+
+  // 3) Scatter the sources into their groups.
+  this->Sources.resize(this->Offsets[numberOfTargets]);
+  Parallel::For(0, height, [&](const size_t y)
+    {
+    for(size_t pixelId = y * width; pixelId < (y + 1) * width; ++pixelId)
+    {
+      if(targets[pixelId] != NoTarget)
+      {
+        this->Sources[counts[targets[pixelId]].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(pixelId);
+      }
+    }
+    });
+
+  // 4) The threads filled the groups in any order, sort them so the index does not depend on it.
+  Parallel::For(0, numberOfTargets, [this](const size_t target)
+    {
+    if(this->Offsets[target + 1] - this->Offsets[target] > 1)
+    {
+      std::sort(this->Sources.begin() + this->Offsets[target], this->Sources.begin() + this->Offsets[target + 1]);
+    }
+    });
+
+  return true;
+}
+
+NNFieldTypes::FloatImageType::Pointer ReverseIndex::CreateUsageImage(float& maxUsage) const
+{
+  NNFieldTypes::FloatImageType::Pointer usage = NNFieldTypes::FloatImageType::New();
+  usage->SetRegions(itk::ImageRegion<2>(this->Size));
+  usage->Allocate();
+
+  float* buffer = usage->GetBufferPointer();
+  std::vector<float> maxUsagePerThread(Parallel::GetNumberOfThreads(), 0.0f);
+  Parallel::ForChunks(0, this->Offsets.empty() ? 0 : this->Offsets.size() - 1,
+                      [this, buffer, &maxUsagePerThread](const size_t chunkBegin, const size_t chunkEnd, const unsigned int threadId)
+    {
+    for(size_t target = chunkBegin; target < chunkEnd; ++target)
+    {
+      buffer[target] = static_cast<float>(this->Offsets[target + 1] - this->Offsets[target]);
+      maxUsagePerThread[threadId] = std::max(maxUsagePerThread[threadId], buffer[target]);
+    }
+    });
+
+  maxUsage = *std::max_element(maxUsagePerThread.begin(), maxUsagePerThread.end());
+  return usage;
+}
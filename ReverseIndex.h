@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ReverseIndex_H
+#define ReverseIndex_H
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** The inverse of a nearest neighbor field: for every target pixel, the source pixels whose match is centered there.
+  *
+  * The sources are stored grouped by target (compressed sparse rows): the sources of target t are
+  * Sources[Offsets[t]] to Sources[Offsets[t + 1]], in increasing order. As the targets of a row of
+  * the image are consecutive, the sources of a row of targets are consecutive too, so the sources
+  * of a patch are found with one lookup per row of the patch.
+  *
+  * Build() is a parallel counting sort of the source pixels on their target.
+  */
+class ReverseIndex
+{
+public:
+  ReverseIndex();
+
+  /** Build the index of 'nnField'. Sources whose match is outside of the field are left out.
+    * Returns false (and leaves the index empty) if 'cancel' became true.*/
+  bool Build(const NNFieldTypes::NNFieldImageType* const nnField, const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+             const std::atomic<bool>& cancel);
+
+  /** Build the index of a field whose matches are in another image, of size 'targetSize'.
+    * Sources whose match is outside of that image are left out.*/
+  bool Build(const NNFieldTypes::NNFieldImageType* const nnField, const NNFieldTypes::INTERPRETATION_ENUM interpretation,
+             const itk::Size<2>& targetSize, const std::atomic<bool>& cancel);
+
+  /** Call function(sourcePixelId) for every source whose match is centered inside 'region'.
+    * Pixel ids are row major. Returns the number of sources.*/
+  template <typename TFunction>
+  size_t ForEachSourceInRegion(itk::ImageRegion<2> region, const TFunction& function) const
+  {
+    if(!region.Crop(itk::ImageRegion<2>(this->Size)))
+    {
+      return 0;
+    }
+
+    size_t numberOfSources = 0;
+    for(itk::IndexValueType y = region.GetIndex()[1]; y < region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]); ++y)
+    {
+      const size_t firstTarget = static_cast<size_t>(y) * this->Size[0] + region.GetIndex()[0];
+      const size_t endTarget = firstTarget + region.GetSize()[0];
+      for(unsigned int i = this->Offsets[firstTarget]; i < this->Offsets[endTarget]; ++i)
+      {
+        function(this->Sources[i]);
+      }
+      numberOfSources += this->Offsets[endTarget] - this->Offsets[firstTarget];
+    }
+
+    return numberOfSources;
+  }
+
+  /** An image of the number of sources of every target. 'maxUsage' is set to the largest number.*/
+  NNFieldTypes::FloatImageType::Pointer CreateUsageImage(float& maxUsage) const;
+
+  /** The size of the image the targets are in.*/
+  itk::Size<2> GetSize() const;
+
+private:
+  /** The size of the image the targets are in.*/
+  itk::Size<2> Size;
+
+  /** Offsets into Sources for every target, plus one at the end.*/
+  std::vector<unsigned int> Offsets;
+
+  /** The source pixel ids, grouped by target.*/
+  std::vector<unsigned int> Sources;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "TileChecksums.h"
+
+// STL
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// POSIX
+#include <stdint.h>
+
+// Custom
+#include "Hash64.h"
+#include "Parallel.h"
+
+namespace
+{
+  /** Add 'numberOfBytes' bytes to the two lanes of 'hash'. Two lanes are enough for the multiplications to overlap
+    * with the loads of a tile row.*/
+  void AddBytes(const unsigned char* const data, const size_t numberOfBytes, uint64_t hash[2])
+  {
+    size_t offset = 0;
+    for(; offset + 16 <= numberOfBytes; offset += 16)
+    {
+      uint64_t words[2];
+      memcpy(words, data + offset, sizeof(words));
+      hash[0] = Hash64::Mix(hash[0], words[0]);
+      hash[1] = Hash64::Mix(hash[1], words[1]);
+    }
+
+    uint64_t tail[2] = {0, 0};
+    memcpy(tail, data + offset, numberOfBytes - offset);
+    hash[0] = Hash64::Mix(hash[0], tail[0] ^ numberOfBytes);
+    hash[1] = Hash64::Mix(hash[1], tail[1]);
+  }
+}
+
+namespace TileChecksums
+{
+
+std::vector<itk::ImageRegion<2> > GetTiles(const itk::ImageRegion<2>& region, const unsigned int tileSize)
+{
+  if(tileSize == 0)
+  {
+    throw std::runtime_error("TileChecksums: the tile size must be positive!");
+  }
+
+  std::vector<itk::ImageRegion<2> > tiles;
+  const itk::Index<2> begin = region.GetIndex();
+  const itk::Size<2> size = region.GetSize();
+  for(itk::SizeValueType y = 0; y < size[1]; y += tileSize)
+  {
+    for(itk::SizeValueType x = 0; x < size[0]; x += tileSize)
+    {
+      itk::Index<2> tileIndex = {{begin[0] + static_cast<itk::IndexValueType>(x), begin[1] + static_cast<itk::IndexValueType>(y)}};
+      itk::Size<2> tileSize2D = {{std::min<itk::SizeValueType>(tileSize, size[0] - x),
+                                  std::min<itk::SizeValueType>(tileSize, size[1] - y)}};
+      tiles.push_back(itk::ImageRegion<2>(tileIndex, tileSize2D));
+    }
+  }
+  return tiles;
+}
+
+std::vector<ChecksumType> Compute(const NNFieldTypes::NNFieldImageType* const nnField, const unsigned int tileSize)
+{
+  const itk::ImageRegion<2> region = nnField->GetLargestPossibleRegion();
+  const std::vector<itk::ImageRegion<2> > tiles = GetTiles(region, tileSize);
+  const size_t numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  const size_t rowStride = region.GetSize()[0] * numberOfComponents;
+  const float* const buffer = nnField->GetBufferPointer();
+
+  std::vector<ChecksumType> checksums(tiles.size());
+  Parallel::For(0, tiles.size(), [&](const size_t tileId)
+    {
+    const itk::ImageRegion<2>& tile = tiles[tileId];
+    const size_t firstX = tile.GetIndex()[0] - region.GetIndex()[0];
+    const size_t firstY = tile.GetIndex()[1] - region.GetIndex()[1];
+    const size_t rowBytes = tile.GetSize()[0] * numberOfComponents * sizeof(float);
+
+    // The size of the tile is part of the checksum, so tiles of fields with other sizes never match.
+    uint64_t hash[2] = {Hash64::Mix(tile.GetSize()[0], numberOfComponents), Hash64::Mix(tile.GetSize()[1], tileId)};
+    for(size_t y = firstY; y < firstY + tile.GetSize()[1]; ++y)
+    {
+      const float* row = buffer + y * rowStride + firstX * numberOfComponents;
+      AddBytes(reinterpret_cast<const unsigned char*>(row), rowBytes, hash);
+    }
+    checksums[tileId] = Hash64::Finalize(Hash64::Mix(hash[0], hash[1]));
+    });
+
+  return checksums;
+}
+
+std::vector<unsigned int> FindChangedTiles(const std::vector<ChecksumType>& checksums0,
+                                           const std::vector<ChecksumType>& checksums1)
+{
+  if(checksums0.size() != checksums1.size())
+  {
+    throw std::runtime_error("TileChecksums: the checksums are of fields with different tiles!");
+  }
+
+  std::vector<unsigned int> changedTiles;
+  for(size_t tileId = 0; tileId < checksums0.size(); ++tileId)
+  {
+    if(checksums0[tileId] != checksums1[tileId])
+    {
+      changedTiles.push_back(tileId);
+    }
+  }
+  return changedTiles;
+}
+
+} // end namespace
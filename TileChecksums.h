@@ -0,0 +1,54 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TileChecksums_H
+#define TileChecksums_H
+
+// STL
+#include <vector>
+
+// ITK
+#include "itkImageRegion.h"
+
+// Custom
+#include "NNFieldTypes.h"
+
+/** Checksums of the square tiles of a field, so a field that was written again (e.g. by a solver during a run)
+  * can be compared to the one that is displayed without keeping a copy of it, and only the tiles that changed
+  * are updated.
+  *
+  * The tiles are numbered row major. Each checksum is a finalized 64-bit multiply-rotate hash of the rows of the tile,
+  * computed on all cores. Reading the pixels is the bottleneck, so a field is checksummed about as fast as it
+  * can be read from memory.
+  */
+namespace TileChecksums
+{
+  typedef unsigned long long ChecksumType;
+
+  /** The tiles of 'tileSize' x 'tileSize' pixels covering 'region', clipped to it, row major.*/
+  std::vector<itk::ImageRegion<2> > GetTiles(const itk::ImageRegion<2>& region, const unsigned int tileSize);
+
+  /** The checksum of the pixels of every tile of 'nnField', in the order of GetTiles().*/
+  std::vector<ChecksumType> Compute(const NNFieldTypes::NNFieldImageType* const nnField, const unsigned int tileSize);
+
+  /** The numbers of the tiles whose checksums differ. Both must be of fields with the same size and tiles.*/
+  std::vector<unsigned int> FindChangedTiles(const std::vector<ChecksumType>& checksums0,
+                                             const std::vector<ChecksumType>& checksums1);
+}
+
+#endif
@@ -0,0 +1,450 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "TiledNNField.h"
+
+// STL
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ITK
+#include "itk_zlib.h"
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+  const char Magic[8] = {'N', 'N', 'T', 'I', 'L', 'E', 'S', '1'};
+
+  /** The size of the header before the channel ranges: the magic and five uint32.*/
+  const size_t FixedHeaderSize = sizeof(Magic) + 5 * sizeof(unsigned int);
+
+  enum CompressionEnum {NONE = 0, ZLIB = 1};
+
+  /** The largest width, height and tile size a file may have, so their sums fit in an unsigned int.*/
+  const unsigned int MaximumSize = 1u << 30;
+
+  // The values are written and read in the byte order of the machine, which must be little endian like the files.
+  static_assert(sizeof(unsigned int) == 4 && sizeof(unsigned long long) == 8 && sizeof(float) == 4,
+                "The .nnt format needs 32 bit unsigned int and float and 64 bit unsigned long long.");
+
+  template <typename T>
+  void WriteValues(std::ostream& stream, const T* const values, const size_t numberOfValues)
+  {
+    stream.write(reinterpret_cast<const char*>(values), numberOfValues * sizeof(T));
+  }
+
+  /** Read exactly 'numberOfBytes' at 'offset', or throw.*/
+  void ReadBytes(const int fileDescriptor, const unsigned long long offset, void* const out, const size_t numberOfBytes)
+  {
+    size_t numberOfBytesRead = 0;
+    while(numberOfBytesRead < numberOfBytes)
+    {
+      const ssize_t result = pread(fileDescriptor, static_cast<char*>(out) + numberOfBytesRead,
+                                   numberOfBytes - numberOfBytesRead, offset + numberOfBytesRead);
+      if(result <= 0)
+      {
+        throw std::runtime_error("TiledNNField: the file is truncated or could not be read!");
+      }
+      numberOfBytesRead += result;
+    }
+  }
+}
+
+TiledNNField::TiledNNField(const size_t maximumCacheBytes) : FileDescriptor(-1), Width(0), Height(0),
+  NumberOfComponents(0), TileSize(0), Compressed(false), Cache(maximumCacheBytes)
+{
+}
+
+TiledNNField::~TiledNNField()
+{
+  if(this->FileDescriptor >= 0)
+  {
+    close(this->FileDescriptor);
+  }
+}
+
+bool TiledNNField::IsTiledFileName(const std::string& fileName)
+{
+  const std::string extension = ".nnt";
+  return fileName.size() >= extension.size() &&
+         fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool TiledNNField::Write(const NNFieldImageType* const nnField, const std::string& fileName, const unsigned int tileSize,
+                         const bool compress, const std::atomic<bool>& cancel)
+{
+  const itk::Size<2> size = nnField->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfComponents = nnField->GetNumberOfComponentsPerPixel();
+  if(tileSize == 0 || size[0] == 0 || size[1] == 0)
+  {
+    throw std::runtime_error("TiledNNField: the field and the tiles must not be empty!");
+  }
+
+  const float* const buffer = nnField->GetBufferPointer();
+  const size_t rowStride = static_cast<size_t>(size[0]) * numberOfComponents;
+
+  // The ranges are stored, so the layers can be displayed without reading the whole field.
+  std::vector<std::vector<float> > threadMin(Parallel::GetNumberOfThreads(),
+                                             std::vector<float>(numberOfComponents, std::numeric_limits<float>::max()));
+  std::vector<std::vector<float> > threadMax(Parallel::GetNumberOfThreads(),
+                                             std::vector<float>(numberOfComponents, -std::numeric_limits<float>::max()));
+  Parallel::ForChunks(0, size[1], [&](const size_t firstRow, const size_t lastRow, const unsigned int threadId)
+    {
+    std::vector<float>& channelMin = threadMin[threadId];
+    std::vector<float>& channelMax = threadMax[threadId];
+    for(const float* value = buffer + firstRow * rowStride; value < buffer + lastRow * rowStride; value += numberOfComponents)
+    {
+      for(unsigned int channel = 0; channel < numberOfComponents; ++channel)
+      {
+        channelMin[channel] = std::min(channelMin[channel], value[channel]);
+        channelMax[channel] = std::max(channelMax[channel], value[channel]);
+      }
+    }
+    });
+  for(unsigned int threadId = 1; threadId < threadMin.size(); ++threadId)
+  {
+    for(unsigned int channel = 0; channel < numberOfComponents; ++channel)
+    {
+      threadMin[0][channel] = std::min(threadMin[0][channel], threadMin[threadId][channel]);
+      threadMax[0][channel] = std::max(threadMax[0][channel], threadMax[threadId][channel]);
+    }
+  }
+
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  if(!file)
+  {
+    throw std::runtime_error("TiledNNField: could not open " + fileName + " for writing!");
+  }
+
+  const unsigned int header[5] = {static_cast<unsigned int>(size[0]), static_cast<unsigned int>(size[1]),
+                                  numberOfComponents, tileSize, compress ? ZLIB : NONE};
+  file.write(Magic, sizeof(Magic));
+  WriteValues(file, header, 5);
+  WriteValues(file, &threadMin[0][0], numberOfComponents);
+  WriteValues(file, &threadMax[0][0], numberOfComponents);
+
+  // The offsets are only known once the tiles are written, so they are filled in at the end.
+  const unsigned int numberOfTilesX = (size[0] + tileSize - 1) / tileSize;
+  const unsigned int numberOfTilesY = (size[1] + tileSize - 1) / tileSize;
+  const size_t numberOfTiles = static_cast<size_t>(numberOfTilesX) * numberOfTilesY;
+  std::vector<unsigned long long> tileOffsets(numberOfTiles + 1, 0);
+  const std::streamoff offsetsPosition = file.tellp();
+  WriteValues(file, &tileOffsets[0], tileOffsets.size());
+  unsigned long long offset = offsetsPosition + tileOffsets.size() * sizeof(unsigned long long);
+
+  // The tiles are encoded in batches on all cores and written in order, so only one batch is in memory at a time.
+  const size_t batchSize = 4 * Parallel::GetNumberOfThreads();
+  std::vector<std::vector<unsigned char> > batch;
+  std::atomic<bool> compressionFailed(false);
+  for(size_t firstTile = 0; firstTile < numberOfTiles && !cancel; firstTile += batchSize)
+  {
+    const size_t lastTile = std::min(firstTile + batchSize, numberOfTiles);
+    batch.assign(lastTile - firstTile, std::vector<unsigned char>());
+
+    Parallel::For(firstTile, lastTile, [&](const size_t tileId)
+      {
+      const unsigned int firstX = static_cast<unsigned int>(tileId % numberOfTilesX) * tileSize;
+      const unsigned int firstY = static_cast<unsigned int>(tileId / numberOfTilesX) * tileSize;
+      const size_t tileRowStride = static_cast<size_t>(std::min<unsigned int>(tileSize, size[0] - firstX)) * numberOfComponents;
+      const unsigned int tileHeight = std::min<unsigned int>(tileSize, size[1] - firstY);
+
+      std::vector<float> pixels(tileRowStride * tileHeight);
+      for(unsigned int row = 0; row < tileHeight; ++row)
+      {
+        const float* in = buffer + (firstY + row) * rowStride + static_cast<size_t>(firstX) * numberOfComponents;
+        std::copy(in, in + tileRowStride, &pixels[row * tileRowStride]);
+      }
+
+      std::vector<unsigned char>& encoded = batch[tileId - firstTile];
+      const uLong numberOfBytes = pixels.size() * sizeof(float);
+      if(!compress)
+      {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&pixels[0]);
+        encoded.assign(bytes, bytes + numberOfBytes);
+        return;
+      }
+
+      // Level 1 is much faster than the default and compresses smooth fields almost as well.
+      uLongf compressedSize = compressBound(numberOfBytes);
+      encoded.resize(compressedSize);
+      if(compress2(&encoded[0], &compressedSize, reinterpret_cast<const Bytef*>(&pixels[0]), numberOfBytes, 1) != Z_OK)
+      {
+        compressionFailed = true;
+      }
+      encoded.resize(compressedSize);
+      });
+
+    if(compressionFailed)
+    {
+      throw std::runtime_error("TiledNNField: compressing a tile failed!");
+    }
+
+    for(size_t tileId = firstTile; tileId < lastTile; ++tileId)
+    {
+      const std::vector<unsigned char>& encoded = batch[tileId - firstTile];
+      tileOffsets[tileId] = offset;
+      WriteValues(file, encoded.empty() ? NULL : &encoded[0], encoded.size());
+      offset += encoded.size();
+    }
+  }
+
+  if(cancel)
+  {
+    file.close();
+    std::remove(fileName.c_str());
+    return false;
+  }
+
+  tileOffsets[numberOfTiles] = offset;
+  file.seekp(offsetsPosition);
+  WriteValues(file, &tileOffsets[0], tileOffsets.size());
+
+  file.close();
+  if(!file)
+  {
+    throw std::runtime_error("TiledNNField: could not write " + fileName + "!");
+  }
+
+  return true;
+}
+
+void TiledNNField::Open(const std::string& fileName)
+{
+  if(this->FileDescriptor >= 0)
+  {
+    throw std::runtime_error("TiledNNField: a file is already open!");
+  }
+
+  const int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+  if(fileDescriptor < 0)
+  {
+    throw std::runtime_error("TiledNNField: could not open " + fileName + "!");
+  }
+
+  try
+  {
+    char header[FixedHeaderSize];
+    ReadBytes(fileDescriptor, 0, header, FixedHeaderSize);
+    if(std::memcmp(header, Magic, sizeof(Magic)) != 0)
+    {
+      throw std::runtime_error("TiledNNField: " + fileName + " is not a .nnt file!");
+    }
+
+    struct stat fileStatus;
+    if(fstat(fileDescriptor, &fileStatus) != 0)
+    {
+      throw std::runtime_error("TiledNNField: could not get the size of " + fileName + "!");
+    }
+    const unsigned long long fileSize = static_cast<unsigned long long>(fileStatus.st_size);
+
+    unsigned int values[5];
+    std::memcpy(values, header + sizeof(Magic), sizeof(values));
+    this->Width = values[0];
+    this->Height = values[1];
+    this->NumberOfComponents = values[2];
+    this->TileSize = values[3];
+    // The sizes are added and multiplied as unsigned ints when the tiles are indexed, which must not overflow.
+    if(this->Width == 0 || this->Height == 0 || this->NumberOfComponents < 2 || this->TileSize == 0 || values[4] > ZLIB ||
+       this->Width > MaximumSize || this->Height > MaximumSize || this->TileSize > MaximumSize)
+    {
+      throw std::runtime_error("TiledNNField: the header of " + fileName + " is not valid!");
+    }
+    this->Compressed = (values[4] == ZLIB);
+
+    // The header values are checked against the size of the file before they size anything, so a damaged file
+    // cannot make the tables (or the tiles, zlib expands data at most 1032 times) larger than it could hold.
+    const unsigned long long numberOfTiles =
+      static_cast<unsigned long long>((this->Width + this->TileSize - 1) / this->TileSize) *
+      ((this->Height + this->TileSize - 1) / this->TileSize);
+    const unsigned long long tablesBytes = 2ull * this->NumberOfComponents * sizeof(float) +
+                                           (numberOfTiles + 1) * sizeof(unsigned long long);
+    const unsigned long long maximumExpansion = this->Compressed ? 1032 : 1;
+    const unsigned long long maximumNumberOfPixels = maximumExpansion * fileSize /
+                                                     (static_cast<unsigned long long>(this->NumberOfComponents) * sizeof(float));
+    if(FixedHeaderSize + tablesBytes > fileSize ||
+       static_cast<unsigned long long>(this->Width) * this->Height > maximumNumberOfPixels)
+    {
+      throw std::runtime_error("TiledNNField: the header of " + fileName + " does not match the size of the file!");
+    }
+
+    unsigned long long offset = FixedHeaderSize;
+    this->ChannelMin.resize(this->NumberOfComponents);
+    this->ChannelMax.resize(this->NumberOfComponents);
+    ReadBytes(fileDescriptor, offset, &this->ChannelMin[0], this->NumberOfComponents * sizeof(float));
+    offset += this->NumberOfComponents * sizeof(float);
+    ReadBytes(fileDescriptor, offset, &this->ChannelMax[0], this->NumberOfComponents * sizeof(float));
+    offset += this->NumberOfComponents * sizeof(float);
+
+    this->TileOffsets.resize(numberOfTiles + 1);
+    ReadBytes(fileDescriptor, offset, &this->TileOffsets[0], this->TileOffsets.size() * sizeof(unsigned long long));
+    offset += this->TileOffsets.size() * sizeof(unsigned long long);
+
+    if(this->TileOffsets[0] < offset || this->TileOffsets.back() > fileSize ||
+       !std::is_sorted(this->TileOffsets.begin(), this->TileOffsets.end()))
+    {
+      throw std::runtime_error("TiledNNField: the tile offsets of " + fileName + " are not valid!");
+    }
+  }
+  catch(std::exception&)
+  {
+    close(fileDescriptor);
+    throw;
+  }
+
+  this->FileDescriptor = fileDescriptor;
+}
+
+itk::ImageRegion<2> TiledNNField::GetRegion() const
+{
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{this->Width, this->Height}};
+  return itk::ImageRegion<2>(corner, size);
+}
+
+unsigned int TiledNNField::GetNumberOfComponents() const
+{
+  return this->NumberOfComponents;
+}
+
+float TiledNNField::GetChannelMin(const unsigned int channel) const
+{
+  return this->ChannelMin[channel];
+}
+
+float TiledNNField::GetChannelMax(const unsigned int channel) const
+{
+  return this->ChannelMax[channel];
+}
+
+void TiledNNField::GetPixel(const itk::Index<2>& index, float* const pixel)
+{
+  itk::Size<2> size = {{1, 1}};
+  ReadRegion(itk::ImageRegion<2>(index, size), pixel, this->NumberOfComponents);
+}
+
+void TiledNNField::ReadRegion(const itk::ImageRegion<2>& region, float* const out, const size_t outRowStride)
+{
+  if(!GetRegion().IsInside(region))
+  {
+    throw std::runtime_error("TiledNNField: the region must be inside the field!");
+  }
+
+  const unsigned int firstX = region.GetIndex()[0];
+  const unsigned int firstY = region.GetIndex()[1];
+  const unsigned int lastX = firstX + region.GetSize()[0];
+  const unsigned int lastY = firstY + region.GetSize()[1];
+
+  for(unsigned int tileY = firstY / this->TileSize; tileY * this->TileSize < lastY; ++tileY)
+  {
+    for(unsigned int tileX = firstX / this->TileSize; tileX * this->TileSize < lastX; ++tileX)
+    {
+      std::shared_ptr<const TileType> tile = GetTile(tileX, tileY);
+
+      // The part of the region in this tile.
+      const unsigned int tileFirstX = tileX * this->TileSize;
+      const unsigned int tileFirstY = tileY * this->TileSize;
+      const size_t tileRowStride = static_cast<size_t>(std::min(this->TileSize, this->Width - tileFirstX)) *
+                                   this->NumberOfComponents;
+      const unsigned int x0 = std::max(firstX, tileFirstX);
+      const unsigned int x1 = std::min(lastX, tileFirstX + this->TileSize);
+      const unsigned int y0 = std::max(firstY, tileFirstY);
+      const unsigned int y1 = std::min(lastY, tileFirstY + this->TileSize);
+
+      for(unsigned int y = y0; y < y1; ++y)
+      {
+        const float* in = &(*tile)[(y - tileFirstY) * tileRowStride + static_cast<size_t>(x0 - tileFirstX) * this->NumberOfComponents];
+        std::copy(in, in + static_cast<size_t>(x1 - x0) * this->NumberOfComponents,
+                  out + (y - firstY) * outRowStride + static_cast<size_t>(x0 - firstX) * this->NumberOfComponents);
+      }
+    }
+  }
+}
+
+size_t TiledNNField::GetCacheNumberOfBytes()
+{
+  std::lock_guard<std::mutex> lock(this->CacheMutex);
+  return this->Cache.GetNumberOfBytes();
+}
+
+std::shared_ptr<const TiledNNField::TileType> TiledNNField::GetTile(const unsigned int tileX, const unsigned int tileY)
+{
+  const unsigned int numberOfTilesX = (this->Width + this->TileSize - 1) / this->TileSize;
+  const unsigned int tileId = tileY * numberOfTilesX + tileX;
+
+  {
+  std::lock_guard<std::mutex> lock(this->CacheMutex);
+  std::shared_ptr<const TileType> tile = this->Cache.Find(tileId);
+  if(tile)
+  {
+    return tile;
+  }
+  }
+
+  // The file is read without holding the lock, so threads that need other tiles are not blocked.
+  // If two threads miss the same tile, both read it and the second one replaces the first in the cache.
+  std::shared_ptr<const TileType> tile = ReadTile(tileX, tileY);
+
+  std::lock_guard<std::mutex> lock(this->CacheMutex);
+  this->Cache.Insert(tileId, tile, tile->size() * sizeof(float));
+  return tile;
+}
+
+std::shared_ptr<const TiledNNField::TileType> TiledNNField::ReadTile(const unsigned int tileX, const unsigned int tileY) const
+{
+  const unsigned int numberOfTilesX = (this->Width + this->TileSize - 1) / this->TileSize;
+  const unsigned int tileId = tileY * numberOfTilesX + tileX;
+  const unsigned long long offset = this->TileOffsets[tileId];
+  const size_t numberOfStoredBytes = this->TileOffsets[tileId + 1] - offset;
+
+  const size_t numberOfPixels = static_cast<size_t>(std::min(this->TileSize, this->Width - tileX * this->TileSize)) *
+                                std::min(this->TileSize, this->Height - tileY * this->TileSize);
+  std::shared_ptr<TileType> tile(new TileType(numberOfPixels * this->NumberOfComponents));
+  const size_t numberOfBytes = tile->size() * sizeof(float);
+
+  if(!this->Compressed)
+  {
+    if(numberOfStoredBytes != numberOfBytes)
+    {
+      throw std::runtime_error("TiledNNField: a tile has the wrong size!");
+    }
+    ReadBytes(this->FileDescriptor, offset, &(*tile)[0], numberOfBytes);
+    return tile;
+  }
+
+  std::vector<unsigned char> compressed(numberOfStoredBytes);
+  ReadBytes(this->FileDescriptor, offset, compressed.empty() ? NULL : &compressed[0], compressed.size());
+
+  uLongf uncompressedSize = numberOfBytes;
+  if(uncompress(reinterpret_cast<Bytef*>(&(*tile)[0]), &uncompressedSize, compressed.empty() ? NULL : &compressed[0],
+                compressed.size()) != Z_OK || uncompressedSize != numberOfBytes)
+  {
+    throw std::runtime_error("TiledNNField: a tile could not be decompressed!");
+  }
+  return tile;
+}
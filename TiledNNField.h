@@ -0,0 +1,109 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TiledNNField_H
+#define TiledNNField_H
+
+// STL
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Custom
+#include "LRUCache.h"
+#include "NNFieldStore.h"
+#include "NNFieldTypes.h"
+
+/** A nearest neighbor field in the tiled .nnt format, read tile by tile through a bounded LRU cache, so fields
+  * larger than the memory can be inspected and only the tiles that are touched are read.
+  *
+  * A .nnt file (all values little endian) is:
+  * - the header: the 8 bytes "NNTILES1", then the uint32 width, height, number of channels, tile size and
+  *   compression (0 for none, 1 for zlib), then the float minimum and maximum of every channel;
+  * - the uint64 file offsets of the tiles in row major order, followed by the offset of the end of the last tile;
+  * - the tiles. Each one holds its pixels (fewer at the right and bottom border) with interleaved float channels,
+  *   row major, compressed as a whole if the file is compressed.
+  */
+class TiledNNField : public NNFieldStore
+{
+public:
+  typedef NNFieldTypes::NNFieldImageType NNFieldImageType;
+
+  explicit TiledNNField(const size_t maximumCacheBytes);
+  ~TiledNNField();
+
+  /** Write 'nnField' as a .nnt file with tiles of 'tileSize' x 'tileSize' pixels, compressed with zlib if
+    * 'compress'. The tiles are compressed on all cores. Returns false if 'cancel' became true first.*/
+  static bool Write(const NNFieldImageType* const nnField, const std::string& fileName, const unsigned int tileSize,
+                    const bool compress, const std::atomic<bool>& cancel);
+
+  /** Whether 'fileName' has the .nnt extension.*/
+  static bool IsTiledFileName(const std::string& fileName);
+
+  /** Open a .nnt file. Only the header and the tile offsets are read. Throws if the file is not valid.*/
+  void Open(const std::string& fileName);
+
+  itk::ImageRegion<2> GetRegion() const;
+  unsigned int GetNumberOfComponents() const;
+
+  /** The range of 'channel' over the whole field, as recorded when it was written.*/
+  float GetChannelMin(const unsigned int channel) const;
+  float GetChannelMax(const unsigned int channel) const;
+
+  /** The pixels are read through the tile cache.*/
+  void GetPixel(const itk::Index<2>& index, float* const pixel);
+  void ReadRegion(const itk::ImageRegion<2>& region, float* const out, const size_t outRowStride);
+
+  /** The number of bytes of the cached tiles.*/
+  size_t GetCacheNumberOfBytes();
+
+private:
+  /** The file is owned, so copying is not allowed.*/
+  TiledNNField(const TiledNNField&);
+  void operator=(const TiledNNField&);
+
+  typedef std::vector<float> TileType;
+
+  /** The pixels of a tile, from the cache or read (and added to the cache) if it is not cached.*/
+  std::shared_ptr<const TileType> GetTile(const unsigned int tileX, const unsigned int tileY);
+
+  /** Read a tile from the file.*/
+  std::shared_ptr<const TileType> ReadTile(const unsigned int tileX, const unsigned int tileY) const;
+
+  /** The file descriptor, or -1 if nothing is open. Tiles are read with pread, so several threads can read at once.*/
+  int FileDescriptor;
+
+  unsigned int Width;
+  unsigned int Height;
+  unsigned int NumberOfComponents;
+  unsigned int TileSize;
+  bool Compressed;
+  std::vector<float> ChannelMin;
+  std::vector<float> ChannelMax;
+
+  /** The offset of every tile in the file, and of the end of the last one.*/
+  std::vector<unsigned long long> TileOffsets;
+
+  /** The tiles that were read recently, by tile number.*/
+  LRUCache<unsigned int, TileType> Cache;
+  std::mutex CacheMutex;
+};
+
+#endif
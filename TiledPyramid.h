@@ -0,0 +1,368 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TiledPyramid_H
+#define TiledPyramid_H
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Custom
+#include "Parallel.h"
+
+/** The position of a tile in a TiledPyramid.*/
+struct PyramidTileIndex
+{
+  unsigned int Level;
+  unsigned int X;
+  unsigned int Y;
+
+  bool operator<(const PyramidTileIndex& other) const
+  {
+    if(this->Level != other.Level)
+    {
+      return this->Level < other.Level;
+    }
+    if(this->Y != other.Y)
+    {
+      return this->Y < other.Y;
+    }
+    return this->X < other.X;
+  }
+};
+
+/** A multi-resolution pyramid of an image with interleaved components, split into square tiles.
+  *
+  * Level 0 is the image itself. It is either referenced in memory (it must then outlive the pyramid) or read
+  * through a Level0Reader, e.g. from a file that does not fit into memory. Every further level halves the size of
+  * the previous one (rounding up) until a level fits into a single tile, and each of its pixels is the mean of the
+  * level 0 pixels it covers.
+  *
+  * Level 1 takes 3/4 of the memory of all the levels together, but each of its pixels only needs 4 pixels of
+  * level 0, so its tiles are computed when they are displayed (and cached by the display) instead of stored.
+  * The coarser levels would touch too many pixels per tile, so Build() computes and stores them.
+  */
+template <typename TComponent>
+class TiledPyramid
+{
+public:
+  /** The width and height of a tile in pixels. Tiles at the right and bottom of a level may be smaller.*/
+  static const unsigned int TileSize = 256;
+
+  /** Writes the level 0 pixels [firstX, firstX + width) x [firstY, firstY + height) row by row to 'out', with
+    * 'outRowStride' components from one row to the next. It is called from several threads at once.*/
+  typedef std::function<void(const unsigned int firstX, const unsigned int firstY, const unsigned int width,
+                             const unsigned int height, TComponent* const out, const size_t outRowStride)> Level0Reader;
+
+  /** A pyramid of the image in 'level0'.*/
+  TiledPyramid(const TComponent* const level0, const unsigned int width, const unsigned int height,
+               const unsigned int numberOfComponents) :
+    Level0(level0), NumberOfComponents(numberOfComponents)
+  {
+    Initialize(width, height);
+  }
+
+  /** A pyramid of an image that is read through 'reader'.*/
+  TiledPyramid(const Level0Reader& reader, const unsigned int width, const unsigned int height,
+               const unsigned int numberOfComponents) :
+    Level0(NULL), Reader(reader), NumberOfComponents(numberOfComponents)
+  {
+    Initialize(width, height);
+  }
+
+  /** Compute the stored levels on all cores. Returns false if 'cancel' became true before they were done.*/
+  bool Build(const std::atomic<bool>& cancel)
+  {
+    if(GetNumberOfLevels() <= FirstStoredLevel)
+    {
+      return true;
+    }
+
+    // The first stored level is computed from level 0 in blocks, so only one block of level 0 per thread
+    // is needed at a time when level 0 is read through the reader.
+    {
+      const unsigned int level = FirstStoredLevel;
+      const unsigned int factor = 1u << level;
+      const unsigned int blockSize = TileSize / factor;
+      const unsigned int numberOfBlocksX = (GetWidth(level) + blockSize - 1) / blockSize;
+      const unsigned int numberOfBlocksY = (GetHeight(level) + blockSize - 1) / blockSize;
+
+      std::vector<TComponent>& pixels = this->Levels[level];
+      const size_t rowStride = static_cast<size_t>(GetWidth(level)) * this->NumberOfComponents;
+      pixels.resize(rowStride * GetHeight(level));
+
+      Parallel::ForChunks(0, static_cast<size_t>(numberOfBlocksX) * numberOfBlocksY,
+                          [&](const size_t firstBlock, const size_t lastBlock, const unsigned int)
+        {
+        std::vector<TComponent> buffer;
+        for(size_t block = firstBlock; block < lastBlock && !cancel; ++block)
+        {
+          const unsigned int x = static_cast<unsigned int>(block % numberOfBlocksX) * blockSize;
+          const unsigned int y = static_cast<unsigned int>(block / numberOfBlocksX) * blockSize;
+          const unsigned int width = std::min(blockSize, GetWidth(level) - x);
+          const unsigned int height = std::min(blockSize, GetHeight(level) - y);
+          DownsampleLevel0(factor, x, y, width, height, buffer,
+                           &pixels[y * rowStride + static_cast<size_t>(x) * this->NumberOfComponents], rowStride);
+        }
+        });
+
+      if(cancel)
+      {
+        return false;
+      }
+    }
+
+    // The next ones are each computed from the previous level.
+    for(unsigned int level = FirstStoredLevel + 1; level < GetNumberOfLevels(); ++level)
+    {
+      const std::vector<TComponent>& source = this->Levels[level - 1];
+      const size_t sourceRowStride = static_cast<size_t>(GetWidth(level - 1)) * this->NumberOfComponents;
+
+      std::vector<TComponent>& pixels = this->Levels[level];
+      const size_t rowStride = static_cast<size_t>(GetWidth(level)) * this->NumberOfComponents;
+      pixels.resize(rowStride * GetHeight(level));
+
+      Parallel::ForChunks(0, GetHeight(level), [&](const size_t firstRow, const size_t lastRow, const unsigned int)
+        {
+        for(size_t row = firstRow; row < lastRow && !cancel; ++row)
+        {
+          const size_t sourceRow = 2 * row;
+          Downsample(&source[sourceRow * sourceRowStride], sourceRowStride, GetWidth(level - 1),
+                     std::min<size_t>(2, GetHeight(level - 1) - sourceRow), 2, GetWidth(level), 1,
+                     &pixels[row * rowStride], rowStride);
+        }
+        });
+
+      if(cancel)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  unsigned int GetNumberOfLevels() const
+  {
+    return this->Widths.size();
+  }
+
+  unsigned int GetNumberOfComponents() const
+  {
+    return this->NumberOfComponents;
+  }
+
+  unsigned int GetWidth(const unsigned int level) const
+  {
+    return this->Widths[level];
+  }
+
+  unsigned int GetHeight(const unsigned int level) const
+  {
+    return this->Heights[level];
+  }
+
+  unsigned int GetNumberOfTilesX(const unsigned int level) const
+  {
+    return (GetWidth(level) + TileSize - 1) / TileSize;
+  }
+
+  unsigned int GetNumberOfTilesY(const unsigned int level) const
+  {
+    return (GetHeight(level) + TileSize - 1) / TileSize;
+  }
+
+  unsigned int GetTileWidth(const PyramidTileIndex& tile) const
+  {
+    return std::min(TileSize, GetWidth(tile.Level) - tile.X * TileSize);
+  }
+
+  unsigned int GetTileHeight(const PyramidTileIndex& tile) const
+  {
+    return std::min(TileSize, GetHeight(tile.Level) - tile.Y * TileSize);
+  }
+
+  /** Whether the tiles of 'level' are copied rather than computed by CopyTile(). Level 0 is resident also when it
+    * is read through a reader, because the reader is expected to do its own caching.*/
+  bool IsResident(const unsigned int level) const
+  {
+    return level == 0 || level >= FirstStoredLevel;
+  }
+
+  /** Write the pixels of 'tile' row by row to 'out', with 'outRowStride' components from one row to the next.*/
+  void CopyTile(const PyramidTileIndex& tile, TComponent* const out, const size_t outRowStride) const
+  {
+    const unsigned int firstX = tile.X * TileSize;
+    const unsigned int firstY = tile.Y * TileSize;
+    const unsigned int tileWidth = GetTileWidth(tile);
+    const unsigned int tileHeight = GetTileHeight(tile);
+
+    if(tile.Level == 0 && !this->Level0)
+    {
+      this->Reader(firstX, firstY, tileWidth, tileHeight, out, outRowStride);
+      return;
+    }
+
+    if(!IsResident(tile.Level))
+    {
+      std::vector<TComponent> buffer;
+      DownsampleLevel0(1u << tile.Level, firstX, firstY, tileWidth, tileHeight, buffer, out, outRowStride);
+      return;
+    }
+
+    const size_t rowStride = static_cast<size_t>(GetWidth(tile.Level)) * this->NumberOfComponents;
+    const TComponent* in = ((tile.Level == 0) ? this->Level0 : &this->Levels[tile.Level][0]) +
+                           firstY * rowStride + static_cast<size_t>(firstX) * this->NumberOfComponents;
+    for(unsigned int row = 0; row < tileHeight; ++row)
+    {
+      std::copy(in + row * rowStride, in + row * rowStride + static_cast<size_t>(tileWidth) * this->NumberOfComponents,
+                out + row * outRowStride);
+    }
+  }
+
+  /** The coarsest level whose pixels are at most 'imagePixelsPerScreenPixel' level 0 pixels wide, i.e. the
+    * smallest level that still shows all the detail the screen can display at the current zoom.*/
+  unsigned int ChooseLevel(const double imagePixelsPerScreenPixel) const
+  {
+    if(!(imagePixelsPerScreenPixel >= 2.0))
+    {
+      return 0;
+    }
+    const unsigned int level = static_cast<unsigned int>(std::floor(std::log2(imagePixelsPerScreenPixel)));
+    return std::min(level, GetNumberOfLevels() - 1);
+  }
+
+private:
+  /** Level 1 is computed on demand, all coarser levels are stored.*/
+  static const unsigned int FirstStoredLevel = 2;
+
+  void Initialize(const unsigned int width, const unsigned int height)
+  {
+    if(width == 0 || height == 0 || this->NumberOfComponents == 0)
+    {
+      throw std::runtime_error("TiledPyramid: the image must not be empty!");
+    }
+
+    this->Widths.push_back(width);
+    this->Heights.push_back(height);
+    while(this->Widths.back() > TileSize || this->Heights.back() > TileSize)
+    {
+      this->Widths.push_back((this->Widths.back() + 1) / 2);
+      this->Heights.push_back((this->Heights.back() + 1) / 2);
+    }
+    this->Levels.resize(this->Widths.size());
+  }
+
+  /** Write the 'width' x 'height' pixels starting at (firstX, firstY) of the level that is 'factor' times
+    * smaller than level 0 to 'out'. 'buffer' holds the level 0 pixels if they are read through the reader.*/
+  void DownsampleLevel0(const unsigned int factor, const unsigned int firstX, const unsigned int firstY,
+                        const unsigned int width, const unsigned int height, std::vector<TComponent>& buffer,
+                        TComponent* const out, const size_t outRowStride) const
+  {
+    const unsigned int sourceX = firstX * factor;
+    const unsigned int sourceY = firstY * factor;
+    const unsigned int sourceWidth = std::min(width * factor, GetWidth(0) - sourceX);
+    const unsigned int sourceHeight = std::min(height * factor, GetHeight(0) - sourceY);
+
+    if(this->Level0)
+    {
+      const size_t rowStride = static_cast<size_t>(GetWidth(0)) * this->NumberOfComponents;
+      Downsample(this->Level0 + sourceY * rowStride + static_cast<size_t>(sourceX) * this->NumberOfComponents,
+                 rowStride, sourceWidth, sourceHeight, factor, width, height, out, outRowStride);
+      return;
+    }
+
+    const size_t rowStride = static_cast<size_t>(sourceWidth) * this->NumberOfComponents;
+    buffer.resize(rowStride * sourceHeight);
+    this->Reader(sourceX, sourceY, sourceWidth, sourceHeight, &buffer[0], rowStride);
+    Downsample(&buffer[0], rowStride, sourceWidth, sourceHeight, factor, width, height, out, outRowStride);
+  }
+
+  /** Write 'width' x 'height' pixels that are each the mean of (up to) factor x factor pixels of 'source' to 'out'.
+    * 'source' points to the first of the 'sourceWidth' x 'sourceHeight' source pixels, which may be fewer than
+    * width * factor x height * factor at the border of the image.*/
+  void Downsample(const TComponent* const source, const size_t sourceRowStride, const unsigned int sourceWidth,
+                  const size_t sourceHeight, const unsigned int factor, const unsigned int width,
+                  const unsigned int height, TComponent* const out, const size_t outRowStride) const
+  {
+    const unsigned int numberOfComponents = this->NumberOfComponents;
+    // Integer components are rounded to the nearest value instead of truncated.
+    const float rounding = std::is_integral<TComponent>::value ? 0.5f : 0.0f;
+
+    std::vector<float> sums(static_cast<size_t>(width) * numberOfComponents);
+    for(unsigned int row = 0; row < height; ++row)
+    {
+      const size_t firstSourceRow = static_cast<size_t>(row) * factor;
+      const size_t lastSourceRow = std::min<size_t>(firstSourceRow + factor, sourceHeight);
+
+      std::fill(sums.begin(), sums.end(), 0.0f);
+      for(size_t sourceRow = firstSourceRow; sourceRow < lastSourceRow; ++sourceRow)
+      {
+        const TComponent* in = source + sourceRow * sourceRowStride;
+        for(unsigned int x = 0; x < width; ++x)
+        {
+          const size_t firstSourceX = static_cast<size_t>(x) * factor;
+          const size_t lastSourceX = std::min<size_t>(firstSourceX + factor, sourceWidth);
+          float* sum = &sums[static_cast<size_t>(x) * numberOfComponents];
+          for(size_t sourceX = firstSourceX; sourceX < lastSourceX; ++sourceX)
+          {
+            const TComponent* pixel = in + sourceX * numberOfComponents;
+            for(unsigned int component = 0; component < numberOfComponents; ++component)
+            {
+              sum[component] += pixel[component];
+            }
+          }
+        }
+      }
+
+      TComponent* outRow = out + row * outRowStride;
+      for(unsigned int x = 0; x < width; ++x)
+      {
+        const size_t firstSourceX = static_cast<size_t>(x) * factor;
+        const size_t numberOfSourcePixels = (std::min<size_t>(firstSourceX + factor, sourceWidth) - firstSourceX) *
+                                            (lastSourceRow - firstSourceRow);
+        const float scale = 1.0f / numberOfSourcePixels;
+        for(unsigned int component = 0; component < numberOfComponents; ++component)
+        {
+          const size_t id = static_cast<size_t>(x) * numberOfComponents + component;
+          outRow[id] = static_cast<TComponent>(sums[id] * scale + rounding);
+        }
+      }
+    }
+  }
+
+  /** The level 0 pixels, which are not owned by the pyramid. NULL if they are read through Reader.*/
+  const TComponent* Level0;
+  Level0Reader Reader;
+  unsigned int NumberOfComponents;
+
+  /** The size of every level.*/
+  std::vector<unsigned int> Widths;
+  std::vector<unsigned int> Heights;
+
+  /** The pixels of the stored levels. The entries of the other levels are empty.*/
+  std::vector<std::vector<TComponent> > Levels;
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "Trace.h"
+
+// STL
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  /** A timed scope, in microseconds.*/
+  struct Event
+  {
+    const char* Name;
+    int Thread;
+    long long Start;
+    long long Duration;
+  };
+
+  /** The events kept for the trace (24 bytes each). Beyond this, the oldest are overwritten.*/
+  const size_t MaximumNumberOfEvents = 1 << 18;
+
+  std::mutex EventMutex;
+  std::vector<Event> Events;
+  size_t NextEvent = 0;
+  std::map<int, std::string> ThreadNames;
+
+  std::mutex OperationMutex;
+  Trace::OperationCallback OperationFinished;
+  std::string LastOperationSummary;
+
+  std::atomic<int> NumberOfThreads(0);
+
+  /** The state of the calling thread: its number in the trace, how deeply scopes are nested on it, and the
+    * stages of its outermost operation.*/
+  struct ThreadState
+  {
+    ThreadState() : Thread(NumberOfThreads++), Depth(0), OperationDepth(-1) {}
+
+    int Thread;
+    int Depth;
+
+    /** The depth of the outermost operation, or -1 if none is running.*/
+    int OperationDepth;
+
+    std::vector<std::pair<const char*, long long> > Stages;
+  };
+
+  ThreadState& GetThreadState()
+  {
+    thread_local ThreadState state;
+    return state;
+  }
+
+  void Record(const char* const name, const long long start, const long long end)
+  {
+    Event event;
+    event.Name = name;
+    event.Thread = GetThreadState().Thread;
+    event.Start = start;
+    event.Duration = end - start;
+
+    std::lock_guard<std::mutex> lock(EventMutex);
+    if(Events.size() < MaximumNumberOfEvents)
+    {
+      Events.push_back(event);
+    }
+    else
+    {
+      Events[NextEvent] = event;
+    }
+    NextEvent = (NextEvent + 1) % MaximumNumberOfEvents;
+  }
+
+  /** Add a Scope or Operation that just ended (and restored the depth of 'state') to the stages of the outermost
+    * operation, if it is directly inside it.*/
+  void AddStage(ThreadState& state, const char* const name, const long long duration)
+  {
+    if(state.OperationDepth >= 0 && state.Depth == state.OperationDepth + 1)
+    {
+      state.Stages.push_back(std::make_pair(name, duration));
+    }
+  }
+
+  std::string EscapeJSON(const std::string& value)
+  {
+    std::string escaped;
+    for(size_t i = 0; i < value.size(); ++i)
+    {
+      if(value[i] == '"' || value[i] == '\\')
+      {
+        escaped += '\\';
+      }
+      escaped += value[i];
+    }
+    return escaped;
+  }
+}
+
+namespace Trace
+{
+
+namespace Internal
+{
+  std::atomic<bool> Enabled(false);
+}
+
+void SetEnabled(const bool enabled)
+{
+  Internal::Enabled = enabled;
+}
+
+long long Now()
+{
+  static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void SetThreadName(const std::string& name)
+{
+  const int thread = GetThreadState().Thread;
+  std::lock_guard<std::mutex> lock(EventMutex);
+  ThreadNames[thread] = name;
+}
+
+Scope::Scope(const char* const name) : Name(name), Start(-1)
+{
+  if(!IsEnabled())
+  {
+    return;
+  }
+
+  this->Start = Now();
+  GetThreadState().Depth++;
+}
+
+Scope::~Scope()
+{
+  if(this->Start < 0)
+  {
+    return;
+  }
+
+  const long long end = Now();
+  ThreadState& state = GetThreadState();
+  state.Depth--;
+  Record(this->Name, this->Start, end);
+  AddStage(state, this->Name, end - this->Start);
+}
+
+Operation::Operation(const char* const name) : Name(name), Start(-1), ThreadStart(-1), Outermost(false)
+{
+  if(IsEnabled())
+  {
+    Begin(Now(), NULL);
+  }
+}
+
+Operation::Operation(const char* const name, const long long start, const char* const firstStageName) :
+  Name(name), Start(-1), ThreadStart(-1), Outermost(false)
+{
+  if(IsEnabled())
+  {
+    Begin(start, firstStageName);
+  }
+}
+
+void Operation::Begin(const long long start, const char* const firstStageName)
+{
+  this->ThreadStart = Now();
+  this->Start = (start >= 0 && start <= this->ThreadStart) ? start : this->ThreadStart;
+
+  ThreadState& state = GetThreadState();
+  if(state.OperationDepth < 0)
+  {
+    this->Outermost = true;
+    state.OperationDepth = state.Depth;
+    state.Stages.clear();
+    if(firstStageName)
+    {
+      state.Stages.push_back(std::make_pair(firstStageName, this->ThreadStart - this->Start));
+    }
+  }
+  state.Depth++;
+}
+
+Operation::~Operation()
+{
+  if(this->Start < 0)
+  {
+    return;
+  }
+
+  const long long end = Now();
+  ThreadState& state = GetThreadState();
+  state.Depth--;
+
+  // Only the part on this thread is recorded, the first stage ran elsewhere (or was waited for).
+  Record(this->Name, this->ThreadStart, end);
+
+  if(!this->Outermost)
+  {
+    AddStage(state, this->Name, end - this->Start);
+    return;
+  }
+
+  state.OperationDepth = -1;
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << this->Name << " " << (end - this->Start) / 1000.0 << " ms";
+  for(size_t stageId = 0; stageId < state.Stages.size(); ++stageId)
+  {
+    ss << (stageId == 0 ? ": " : ", ") << state.Stages[stageId].first << " " << state.Stages[stageId].second / 1000.0;
+  }
+  state.Stages.clear();
+
+  OperationCallback callback;
+  {
+    std::lock_guard<std::mutex> lock(OperationMutex);
+    LastOperationSummary = ss.str();
+    callback = OperationFinished;
+  }
+
+  // The callback is called without the lock, so it may start operations itself.
+  if(callback)
+  {
+    callback(ss.str());
+  }
+}
+
+void SetOperationCallback(const OperationCallback& callback)
+{
+  std::lock_guard<std::mutex> lock(OperationMutex);
+  OperationFinished = callback;
+}
+
+std::string GetLastOperationSummary()
+{
+  std::lock_guard<std::mutex> lock(OperationMutex);
+  return LastOperationSummary;
+}
+
+size_t GetNumberOfEvents()
+{
+  std::lock_guard<std::mutex> lock(EventMutex);
+  return Events.size();
+}
+
+void Clear()
+{
+  std::lock_guard<std::mutex> lock(EventMutex);
+  Events.clear();
+  NextEvent = 0;
+}
+
+void WriteChromeTrace(const std::string& fileName)
+{
+  // The events are copied so the file is not written with the lock held.
+  std::vector<Event> events;
+  std::map<int, std::string> threadNames;
+  {
+    std::lock_guard<std::mutex> lock(EventMutex);
+    if(Events.size() < MaximumNumberOfEvents)
+    {
+      events = Events;
+    }
+    else
+    {
+      // Oldest first.
+      events.insert(events.end(), Events.begin() + NextEvent, Events.end());
+      events.insert(events.end(), Events.begin(), Events.begin() + NextEvent);
+    }
+    threadNames = ThreadNames;
+  }
+
+  std::ofstream stream(fileName.c_str());
+  if(!stream)
+  {
+    throw std::runtime_error("Could not open " + fileName + " for writing!");
+  }
+
+  stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+  const char* separator = "\n";
+  for(std::map<int, std::string>::const_iterator iterator = threadNames.begin(); iterator != threadNames.end(); ++iterator)
+  {
+    stream << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << iterator->first
+           << ", \"args\": {\"name\": \"" << EscapeJSON(iterator->second) << "\"}}";
+    separator = ",\n";
+  }
+
+  for(size_t eventId = 0; eventId < events.size(); ++eventId)
+  {
+    const Event& event = events[eventId];
+    stream << separator << "{\"name\": \"" << EscapeJSON(event.Name) << "\", \"cat\": \"NNFieldInspector\", \"ph\": \"X\""
+           << ", \"pid\": 1, \"tid\": " << event.Thread << ", \"ts\": " << event.Start
+           << ", \"dur\": " << event.Duration << "}";
+    separator = ",\n";
+  }
+
+  stream << std::endl << "]}" << std::endl;
+
+  if(!stream)
+  {
+    throw std::runtime_error("Could not write " + fileName + "!");
+  }
+}
+
+} // end namespace
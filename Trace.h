@@ -0,0 +1,123 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef Trace_H
+#define Trace_H
+
+// STL
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/** Scoped timing of the stages of the operations the user waits for (a click, loading a file, a render).
+  *
+  * An Operation times the scope it lives in, and every Scope or Operation directly inside it on the same thread
+  * is one of its stages. When the outermost Operation of a thread ends, a summary of its stages like
+  * "PixelClicked 14.2 ms: Query 0.1, PatchDistance 0.3, Overlay 0.2, Refresh 13.5" is passed to the operation
+  * callback. Every timed scope, on any thread, is also recorded in a bounded buffer of events that can be
+  * written as a Chrome trace (which chrome://tracing and Perfetto open).
+  *
+  * Tracing is off by default. Then a Scope or an Operation costs one relaxed atomic load, nothing is recorded
+  * and no lock is taken. This does not depend on Qt.
+  */
+namespace Trace
+{
+  /** Whether scopes are timed and recorded. Scopes that began before a change finish as they began.*/
+  void SetEnabled(const bool enabled);
+
+  namespace Internal
+  {
+    extern std::atomic<bool> Enabled;
+  }
+
+  inline bool IsEnabled()
+  {
+    return Internal::Enabled.load(std::memory_order_relaxed);
+  }
+
+  /** Microseconds on a monotonic clock, for operations that started before the scope that finishes them.*/
+  long long Now();
+
+  /** Name the calling thread in the exported trace (e.g. "GUI"). Other threads are named by number.*/
+  void SetThreadName(const std::string& name);
+
+  /** Time the enclosing scope as a stage. 'name' is kept by pointer, so it must be a string literal.*/
+  class Scope
+  {
+  public:
+    explicit Scope(const char* const name);
+    ~Scope();
+
+  private:
+    Scope(const Scope&);
+    void operator=(const Scope&);
+
+    const char* Name;
+
+    /** When the scope began, or -1 if tracing was off then.*/
+    long long Start;
+  };
+
+  /** Time the enclosing scope as an operation with stages, or as a stage if it is inside another operation.
+    * 'name' is kept by pointer, so it must be a string literal.*/
+  class Operation
+  {
+  public:
+    explicit Operation(const char* const name);
+
+    /** An operation that began at 'start' (from Now()) on another thread, e.g. when its worker was started. The
+      * time from 'start' until now becomes its first stage 'firstStageName'.*/
+    Operation(const char* const name, const long long start, const char* const firstStageName);
+
+    ~Operation();
+
+  private:
+    Operation(const Operation&);
+    void operator=(const Operation&);
+
+    void Begin(const long long start, const char* const firstStageName);
+
+    const char* Name;
+
+    /** When the operation began and when this thread began it, or -1 if tracing was off then.*/
+    long long Start;
+    long long ThreadStart;
+
+    /** Whether this is the outermost operation of its thread.*/
+    bool Outermost;
+  };
+
+  /** Called with the summary of every outermost operation when it ends, on the thread it ran on.*/
+  typedef std::function<void(const std::string&)> OperationCallback;
+  void SetOperationCallback(const OperationCallback& callback);
+
+  /** The summary of the outermost operation that ended last, or an empty string.*/
+  std::string GetLastOperationSummary();
+
+  /** The number of recorded events. The oldest are dropped beyond a fixed number.*/
+  size_t GetNumberOfEvents();
+
+  /** Forget the recorded events.*/
+  void Clear();
+
+  /** Write the recorded events in the Chrome trace event format. Throws if the file cannot be written.*/
+  void WriteChromeTrace(const std::string& fileName);
+}
+
+#endif
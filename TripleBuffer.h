@@ -0,0 +1,95 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TripleBuffer_H
+#define TripleBuffer_H
+
+// STL
+#include <atomic>
+
+/** A lock-free triple buffer for handing the latest value from one producer thread to one consumer thread.
+  * The producer fills GetWriteBuffer() and calls Publish(). The consumer calls Consume() and, if it
+  * returns true, reads GetReadBuffer(). Neither side ever waits for the other: the producer always has
+  * a buffer to write into, and the consumer keeps its buffer until it asks for a newer one.
+  * Values that are published while the consumer is busy are replaced by newer ones, never queued.
+  */
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : Middle(1), WriteIndex(0), ReadIndex(2) {}
+
+  /** The buffer the producer may fill. Only call this from the producer thread.*/
+  T& GetWriteBuffer()
+  {
+    return this->Buffers[this->WriteIndex];
+  }
+
+  /** Make the write buffer the newest value, and take the previous middle buffer to write into next.*/
+  void Publish()
+  {
+    const unsigned int previous = this->Middle.exchange(this->WriteIndex | NewValueBit, std::memory_order_acq_rel);
+    this->WriteIndex = previous & IndexMask;
+  }
+
+  /** Take the newest value if there is one. Returns false (and keeps the current read buffer)
+    * if nothing was published since the last call. Only call this from the consumer thread.*/
+  bool Consume()
+  {
+    if(!(this->Middle.load(std::memory_order_acquire) & NewValueBit))
+    {
+      return false;
+    }
+
+    const unsigned int previous = this->Middle.exchange(this->ReadIndex, std::memory_order_acq_rel);
+    this->ReadIndex = previous & IndexMask;
+    return true;
+  }
+
+  /** The value the consumer took last. Only call this from the consumer thread.*/
+  const T& GetReadBuffer() const
+  {
+    return this->Buffers[this->ReadIndex];
+  }
+
+  T& GetReadBuffer()
+  {
+    return this->Buffers[this->ReadIndex];
+  }
+
+private:
+  /** The triple buffer is shared by reference between two threads, so it cannot be copied.*/
+  TripleBuffer(const TripleBuffer&);
+  void operator=(const TripleBuffer&);
+
+  static const unsigned int IndexMask = 3;
+  static const unsigned int NewValueBit = 4;
+
+  T Buffers[3];
+
+  /** The index of the buffer between the producer and the consumer, and whether it holds an unread value.*/
+  std::atomic<unsigned int> Middle;
+
+  /** Only used by the producer.*/
+  unsigned int WriteIndex;
+
+  /** Only used by the consumer.*/
+  unsigned int ReadIndex;
+};
+
+#endif